@@ -45,6 +45,15 @@ const DenominatorGraphTransition* DenominatorGraph::Transitions() const {
   return transitions_.Data();
 }
 
+const Int32Pair* DenominatorGraph::PdfTransitionRanges() const {
+  return (pdf_transition_ranges_.empty() ? NULL :
+          &(pdf_transition_ranges_[0]));
+}
+
+const DenominatorGraphPdfTransition* DenominatorGraph::PdfTransitions() const {
+  return (pdf_transitions_.empty() ? NULL : &(pdf_transitions_[0]));
+}
+
 const CuVector<BaseFloat>& DenominatorGraph::InitialProbs() const {
   return initial_probs_;
 }
@@ -89,6 +98,32 @@ void DenominatorGraph::SetTransitions(const fst::StdVectorFst &fst,
     backward_transitions[s].second = static_cast<int32>(transitions.size());
   }
 
+  // Group the transitions by pdf-id (a counting sort, which keeps them in
+  // the order of the forward transitions within each pdf-id).
+  pdf_transition_ranges_.clear();
+  pdf_transition_ranges_.resize(num_pdfs);
+  for (int32 s = 0; s < num_states; s++)
+    for (size_t i = 0; i < transitions_out[s].size(); i++)
+      pdf_transition_ranges_[transitions_out[s][i].pdf_id].second++;
+  int32 num_transitions = 0;
+  for (int32 p = 0; p < num_pdfs; p++) {
+    int32 count = pdf_transition_ranges_[p].second;
+    pdf_transition_ranges_[p].first = num_transitions;
+    pdf_transition_ranges_[p].second = num_transitions;
+    num_transitions += count;
+  }
+  pdf_transitions_.resize(num_transitions);
+  for (int32 s = 0; s < num_states; s++) {
+    for (size_t i = 0; i < transitions_out[s].size(); i++) {
+      const DenominatorGraphTransition &transition = transitions_out[s][i];
+      DenominatorGraphPdfTransition &pdf_transition =
+          pdf_transitions_[pdf_transition_ranges_[transition.pdf_id].second++];
+      pdf_transition.transition_prob = transition.transition_prob;
+      pdf_transition.prev_hmm_state = s;
+      pdf_transition.next_hmm_state = transition.hmm_state;
+    }
+  }
+
   forward_transitions_ = forward_transitions;
   backward_transitions_ = backward_transitions;
   transitions_ = transitions;
@@ -41,6 +41,16 @@ namespace kaldi {
 namespace chain {
 
 
+/// A transition of the DenominatorGraph in the layout returned by
+/// DenominatorGraph::PdfTransitions(), where the transitions are grouped by
+/// pdf-id so we need both of the HMM-states.
+struct DenominatorGraphPdfTransition {
+  BaseFloat transition_prob;
+  int32 prev_hmm_state;
+  int32 next_hmm_state;
+};
+
+
 /**  This class is responsible for storing the FST that we use as the
      'anti-model' or 'denominator-model', that models all possible phone
      sequences (or most possible phone sequences, depending how we built it)..
@@ -80,6 +90,18 @@ class DenominatorGraph {
   // memory will be GPU memory if we are using a GPU.
   const DenominatorGraphTransition *Transitions() const;
 
+  // returns an array, indexed by pdf-id, of start and end indexes into the
+  // PdfTransitions() array, which give us the set of transitions with that
+  // pdf-id.  Unlike the arrays above, this is always in CPU memory; it is used
+  // by the CPU version of the derivative computation, which works out the
+  // derivatives for each pdf-id separately so it can be done in parallel.
+  const Int32Pair *PdfTransitionRanges() const;
+
+  // returns the transitions in the order given by PdfTransitionRanges(); for
+  // each pdf-id they are in order of the source HMM-state, and then in the
+  // order of ForwardTransitions().  This is always in CPU memory.
+  const DenominatorGraphPdfTransition *PdfTransitions() const;
+
   // returns the initial-probs of the HMM-states... note, these initial-probs
   // don't mean initial at the start of the file, because we usually train on
   // pieces of a file.  They are approximate initial-probs obtained by running
@@ -129,6 +151,11 @@ class DenominatorGraph {
   // This stores the actual transitions.
   CuArray<DenominatorGraphTransition> transitions_;
 
+  // pdf_transition_ranges_ is indexed by pdf-id, and gives start and end
+  // indexes into pdf_transitions_; see PdfTransitionRanges().
+  std::vector<Int32Pair> pdf_transition_ranges_;
+  std::vector<DenominatorGraphPdfTransition> pdf_transitions_;
+
   // The initial-probability of all states, used on the first frame of a
   // sequence [although we also apply the constraint that on the first frame,
   // only pdf-ids that were active on the 1st frame of the numerator, are
@@ -0,0 +1,383 @@
+// chain/chain-denominator-cpu.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "chain/chain-denominator-cpu.h"
+#include <atomic>
+
+// As in matrix/compressed-matrix-simd.cc, we use function-level target
+// attributes so no special compiler flags are needed, and we don't enable FMA,
+// so the results are the same as those of the scalar code.  The vector code is
+// only for single precision.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)) && \
+    KALDI_DOUBLEPRECISION == 0
+#define KALDI_CHAIN_HMM_SIMD 1
+#include <immintrin.h>
+#define KALDI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace kaldi {
+namespace chain {
+
+namespace {
+
+// -1 means "not yet decided", otherwise 0 or 1.
+std::atomic<int> chain_hmm_simd(-1);
+
+bool ChainHmmSimdSupported() {
+#ifdef KALDI_CHAIN_HMM_SIMD
+  __builtin_cpu_init();
+  static const bool ans = __builtin_cpu_supports("avx2");
+  return ans;
+#else
+  return false;
+#endif
+}
+
+// The scalar versions of the functions below are for sequences
+// seq_begin <= s < num_sequences, so they can also be used for the sequences
+// left over at the end by the vector code.  They follow the loops that
+// DenominatorComputation used to have, except that the loop over sequences is
+// innermost.
+
+bool ForwardScalar(const DenominatorGraphTransition *trans_begin,
+                   const DenominatorGraphTransition *trans_end,
+                   int32 num_sequences, int32 seq_begin,
+                   const BaseFloat *probs, int32 prob_stride,
+                   const BaseFloat *prev_alpha_dash,
+                   const BaseFloat *arbitrary_scale_inv,
+                   BaseFloat *this_alpha) {
+  bool ok = true;
+  for (int32 s = seq_begin; s < num_sequences; s++) {
+    double this_tot_alpha = 0.0;
+    for (const DenominatorGraphTransition *trans_iter = trans_begin;
+         trans_iter != trans_end; ++trans_iter) {
+      BaseFloat transition_prob = trans_iter->transition_prob;
+      int32 pdf_id = trans_iter->pdf_id,
+          prev_hmm_state = trans_iter->hmm_state;
+      BaseFloat prob = probs[pdf_id * prob_stride + s],
+          this_prev_alpha = prev_alpha_dash[prev_hmm_state * num_sequences + s];
+      this_tot_alpha += this_prev_alpha * transition_prob * prob;
+    }
+    // See DenominatorComputation::AlphaGeneralFrame() for an explanation of
+    // the arbitrary scale.
+    BaseFloat arbitrary_scale = 1.0 / arbitrary_scale_inv[s];
+    if (this_tot_alpha - this_tot_alpha != 0)
+      ok = false;
+    this_alpha[s] = this_tot_alpha * arbitrary_scale;
+  }
+  return ok;
+}
+
+void BackwardScalar(const DenominatorGraphTransition *trans_begin,
+                    const DenominatorGraphTransition *trans_end,
+                    int32 num_sequences, int32 seq_begin,
+                    const BaseFloat *probs, int32 prob_stride,
+                    const BaseFloat *this_alpha_dash,
+                    const BaseFloat *inv_arbitrary_scale,
+                    const BaseFloat *next_beta,
+                    BaseFloat *this_beta_dash,
+                    BaseFloat *occupation_factor) {
+  for (int32 s = seq_begin; s < num_sequences; s++) {
+    double tot_variable_factor = 0.0;
+    for (const DenominatorGraphTransition *trans_iter = trans_begin;
+         trans_iter != trans_end; ++trans_iter) {
+      BaseFloat transition_prob = trans_iter->transition_prob;
+      int32 pdf_id = trans_iter->pdf_id,
+          next_hmm_state = trans_iter->hmm_state;
+      BaseFloat variable_factor = transition_prob *
+          next_beta[next_hmm_state * num_sequences + s] *
+          probs[pdf_id * prob_stride + s];
+      tot_variable_factor += variable_factor;
+    }
+    occupation_factor[s] = this_alpha_dash[s] / inv_arbitrary_scale[s];
+    this_beta_dash[s] = tot_variable_factor / inv_arbitrary_scale[s];
+  }
+}
+
+void DerivScalar(const DenominatorGraphPdfTransition *trans_begin,
+                 const DenominatorGraphPdfTransition *trans_end,
+                 int32 num_sequences, int32 seq_begin,
+                 const BaseFloat *this_probs,
+                 const BaseFloat *occupation_factor,
+                 const BaseFloat *next_beta,
+                 BaseFloat *this_log_prob_deriv) {
+  for (const DenominatorGraphPdfTransition *trans_iter = trans_begin;
+       trans_iter != trans_end; ++trans_iter) {
+    BaseFloat transition_prob = trans_iter->transition_prob;
+    const BaseFloat
+        *this_next_beta = next_beta + trans_iter->next_hmm_state * num_sequences,
+        *this_occupation_factor = occupation_factor +
+        trans_iter->prev_hmm_state * num_sequences;
+    for (int32 s = seq_begin; s < num_sequences; s++) {
+      BaseFloat variable_factor = transition_prob * this_next_beta[s] *
+          this_probs[s];
+      BaseFloat occupation_prob = variable_factor * this_occupation_factor[s];
+      this_log_prob_deriv[s] += occupation_prob;
+    }
+  }
+}
+
+
+#ifdef KALDI_CHAIN_HMM_SIMD
+
+// Adds the 8 floats in 'v', converted to double, to *lo and *hi.
+KALDI_TARGET_AVX2 inline void AddToDouble8(__m256 v, __m256d *lo, __m256d *hi) {
+  *lo = _mm256_add_pd(*lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+  *hi = _mm256_add_pd(*hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+KALDI_TARGET_AVX2 inline __m256 Double8ToFloat(__m256d lo, __m256d hi) {
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+                              _mm256_cvtpd_ps(hi), 1);
+}
+
+// Returns the number of sequences done (a multiple of 8).
+KALDI_TARGET_AVX2
+int32 ForwardAvx2(const DenominatorGraphTransition *trans_begin,
+                  const DenominatorGraphTransition *trans_end,
+                  int32 num_sequences,
+                  const BaseFloat *probs, int32 prob_stride,
+                  const BaseFloat *prev_alpha_dash,
+                  const BaseFloat *arbitrary_scale_inv,
+                  BaseFloat *this_alpha, bool *ok) {
+  const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+  __m256d bad = zero;
+  int32 s = 0;
+  for (; s + 8 <= num_sequences; s += 8) {
+    __m256d tot_lo = zero, tot_hi = zero;
+    for (const DenominatorGraphTransition *trans_iter = trans_begin;
+         trans_iter != trans_end; ++trans_iter) {
+      __m256 transition_prob = _mm256_set1_ps(trans_iter->transition_prob),
+          prob = _mm256_loadu_ps(probs + trans_iter->pdf_id * prob_stride + s),
+          prev_alpha = _mm256_loadu_ps(
+              prev_alpha_dash + trans_iter->hmm_state * num_sequences + s);
+      AddToDouble8(_mm256_mul_ps(_mm256_mul_ps(prev_alpha, transition_prob),
+                                 prob), &tot_lo, &tot_hi);
+    }
+    // arbitrary_scale = 1.0 / arbitrary_scale_inv, computed in double and
+    // rounded to float as in the scalar code.
+    __m256 scale_inv = _mm256_loadu_ps(arbitrary_scale_inv + s);
+    __m128 scale_lo = _mm256_cvtpd_ps(_mm256_div_pd(
+        one, _mm256_cvtps_pd(_mm256_castps256_ps128(scale_inv)))),
+        scale_hi = _mm256_cvtpd_ps(_mm256_div_pd(
+            one, _mm256_cvtps_pd(_mm256_extractf128_ps(scale_inv, 1))));
+    bad = _mm256_or_pd(bad, _mm256_cmp_pd(_mm256_sub_pd(tot_lo, tot_lo),
+                                          zero, _CMP_NEQ_UQ));
+    bad = _mm256_or_pd(bad, _mm256_cmp_pd(_mm256_sub_pd(tot_hi, tot_hi),
+                                          zero, _CMP_NEQ_UQ));
+    _mm256_storeu_ps(this_alpha + s, Double8ToFloat(
+        _mm256_mul_pd(tot_lo, _mm256_cvtps_pd(scale_lo)),
+        _mm256_mul_pd(tot_hi, _mm256_cvtps_pd(scale_hi))));
+  }
+  if (_mm256_movemask_pd(bad) != 0)
+    *ok = false;
+  return s;
+}
+
+KALDI_TARGET_AVX2
+int32 BackwardAvx2(const DenominatorGraphTransition *trans_begin,
+                   const DenominatorGraphTransition *trans_end,
+                   int32 num_sequences,
+                   const BaseFloat *probs, int32 prob_stride,
+                   const BaseFloat *this_alpha_dash,
+                   const BaseFloat *inv_arbitrary_scale,
+                   const BaseFloat *next_beta,
+                   BaseFloat *this_beta_dash,
+                   BaseFloat *occupation_factor) {
+  const __m256d zero = _mm256_setzero_pd();
+  int32 s = 0;
+  for (; s + 8 <= num_sequences; s += 8) {
+    __m256d tot_lo = zero, tot_hi = zero;
+    for (const DenominatorGraphTransition *trans_iter = trans_begin;
+         trans_iter != trans_end; ++trans_iter) {
+      __m256 transition_prob = _mm256_set1_ps(trans_iter->transition_prob),
+          prob = _mm256_loadu_ps(probs + trans_iter->pdf_id * prob_stride + s),
+          beta = _mm256_loadu_ps(
+              next_beta + trans_iter->hmm_state * num_sequences + s);
+      AddToDouble8(_mm256_mul_ps(_mm256_mul_ps(transition_prob, beta), prob),
+                   &tot_lo, &tot_hi);
+    }
+    __m256 scale = _mm256_loadu_ps(inv_arbitrary_scale + s);
+    _mm256_storeu_ps(occupation_factor + s,
+                     _mm256_div_ps(_mm256_loadu_ps(this_alpha_dash + s),
+                                   scale));
+    _mm256_storeu_ps(this_beta_dash + s, Double8ToFloat(
+        _mm256_div_pd(tot_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(scale))),
+        _mm256_div_pd(tot_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(scale,
+                                                                    1)))));
+  }
+  return s;
+}
+
+KALDI_TARGET_AVX2
+int32 DerivAvx2(const DenominatorGraphPdfTransition *trans_begin,
+                const DenominatorGraphPdfTransition *trans_end,
+                int32 num_sequences,
+                const BaseFloat *this_probs,
+                const BaseFloat *occupation_factor,
+                const BaseFloat *next_beta,
+                BaseFloat *this_log_prob_deriv) {
+  int32 s = 0;
+  for (; s + 8 <= num_sequences; s += 8) {
+    __m256 prob = _mm256_loadu_ps(this_probs + s),
+        deriv = _mm256_loadu_ps(this_log_prob_deriv + s);
+    for (const DenominatorGraphPdfTransition *trans_iter = trans_begin;
+         trans_iter != trans_end; ++trans_iter) {
+      __m256 transition_prob = _mm256_set1_ps(trans_iter->transition_prob),
+          beta = _mm256_loadu_ps(
+              next_beta + trans_iter->next_hmm_state * num_sequences + s),
+          factor = _mm256_loadu_ps(
+              occupation_factor + trans_iter->prev_hmm_state * num_sequences +
+              s),
+          variable_factor = _mm256_mul_ps(
+              _mm256_mul_ps(transition_prob, beta), prob);
+      deriv = _mm256_add_ps(deriv, _mm256_mul_ps(variable_factor, factor));
+    }
+    _mm256_storeu_ps(this_log_prob_deriv + s, deriv);
+  }
+  return s;
+}
+
+#endif  // KALDI_CHAIN_HMM_SIMD
+
+}  // namespace
+
+
+bool ChainHmmCpuUsesSimd() {
+  int ans = chain_hmm_simd.load(std::memory_order_relaxed);
+  if (ans < 0) {
+    ans = (ChainHmmSimdSupported() ? 1 : 0);
+    chain_hmm_simd.store(ans, std::memory_order_relaxed);
+  }
+  return (ans != 0);
+}
+
+bool SetChainHmmCpuSimd(bool enable) {
+  bool ans = ChainHmmCpuUsesSimd();
+  chain_hmm_simd.store((enable && ChainHmmSimdSupported()) ? 1 : 0,
+                       std::memory_order_relaxed);
+  return ans;
+}
+
+bool ChainHmmForwardCpu(const Int32Pair *backward_transitions,
+                        const DenominatorGraphTransition *transitions,
+                        int32 num_sequences, int32 num_hmm_states,
+                        int32 hmm_state_begin, int32 hmm_state_end,
+                        const BaseFloat *probs, int32 prob_stride,
+                        const BaseFloat *prev_alpha_dash,
+                        BaseFloat *this_alpha) {
+  KALDI_ASSERT(hmm_state_begin >= 0 && hmm_state_begin <= hmm_state_end &&
+               hmm_state_end <= num_hmm_states);
+  // The tot-alpha of the previous frame is stored where we would store the
+  // alpha of the state numbered num_hmm_states.
+  const BaseFloat *arbitrary_scale_inv =
+      prev_alpha_dash + num_hmm_states * num_sequences;
+  bool ok = true;
+#ifdef KALDI_CHAIN_HMM_SIMD
+  bool use_simd = ChainHmmCpuUsesSimd();
+#endif
+  for (int32 h = hmm_state_begin; h < hmm_state_end; h++) {
+    const DenominatorGraphTransition
+        *trans_begin = transitions + backward_transitions[h].first,
+        *trans_end = transitions + backward_transitions[h].second;
+    BaseFloat *alpha = this_alpha + h * num_sequences;
+    int32 s = 0;
+#ifdef KALDI_CHAIN_HMM_SIMD
+    if (use_simd)
+      s = ForwardAvx2(trans_begin, trans_end, num_sequences, probs,
+                      prob_stride, prev_alpha_dash, arbitrary_scale_inv,
+                      alpha, &ok);
+#endif
+    if (!ForwardScalar(trans_begin, trans_end, num_sequences, s, probs,
+                       prob_stride, prev_alpha_dash, arbitrary_scale_inv,
+                       alpha))
+      ok = false;
+  }
+  return ok;
+}
+
+void ChainHmmBackwardCpu(const Int32Pair *forward_transitions,
+                         const DenominatorGraphTransition *transitions,
+                         int32 num_sequences, int32 num_hmm_states,
+                         int32 hmm_state_begin, int32 hmm_state_end,
+                         const BaseFloat *probs, int32 prob_stride,
+                         const BaseFloat *this_alpha_dash,
+                         const BaseFloat *next_beta,
+                         BaseFloat *this_beta_dash,
+                         BaseFloat *occupation_factor) {
+  KALDI_ASSERT(hmm_state_begin >= 0 && hmm_state_begin <= hmm_state_end &&
+               hmm_state_end <= num_hmm_states);
+  const BaseFloat *inv_arbitrary_scale =
+      this_alpha_dash + num_hmm_states * num_sequences;
+#ifdef KALDI_CHAIN_HMM_SIMD
+  bool use_simd = ChainHmmCpuUsesSimd();
+#endif
+  for (int32 h = hmm_state_begin; h < hmm_state_end; h++) {
+    const DenominatorGraphTransition
+        *trans_begin = transitions + forward_transitions[h].first,
+        *trans_end = transitions + forward_transitions[h].second;
+    int32 offset = h * num_sequences, s = 0;
+#ifdef KALDI_CHAIN_HMM_SIMD
+    if (use_simd)
+      s = BackwardAvx2(trans_begin, trans_end, num_sequences, probs,
+                       prob_stride, this_alpha_dash + offset,
+                       inv_arbitrary_scale, next_beta,
+                       this_beta_dash + offset, occupation_factor + offset);
+#endif
+    BackwardScalar(trans_begin, trans_end, num_sequences, s, probs,
+                   prob_stride, this_alpha_dash + offset, inv_arbitrary_scale,
+                   next_beta, this_beta_dash + offset,
+                   occupation_factor + offset);
+  }
+}
+
+void ChainHmmDerivCpu(const Int32Pair *pdf_transition_ranges,
+                      const DenominatorGraphPdfTransition *pdf_transitions,
+                      int32 num_sequences,
+                      int32 pdf_begin, int32 pdf_end,
+                      const BaseFloat *probs, int32 prob_stride,
+                      const BaseFloat *occupation_factor,
+                      const BaseFloat *next_beta,
+                      BaseFloat *log_prob_deriv, int32 deriv_stride) {
+  KALDI_ASSERT(pdf_begin >= 0 && pdf_begin <= pdf_end);
+#ifdef KALDI_CHAIN_HMM_SIMD
+  bool use_simd = ChainHmmCpuUsesSimd();
+#endif
+  for (int32 n = pdf_begin; n < pdf_end; n++) {
+    const DenominatorGraphPdfTransition
+        *trans_begin = pdf_transitions + pdf_transition_ranges[n].first,
+        *trans_end = pdf_transitions + pdf_transition_ranges[n].second;
+    if (trans_begin == trans_end)
+      continue;
+    const BaseFloat *this_probs = probs + n * prob_stride;
+    BaseFloat *this_log_prob_deriv = log_prob_deriv + n * deriv_stride;
+    int32 s = 0;
+#ifdef KALDI_CHAIN_HMM_SIMD
+    if (use_simd)
+      s = DerivAvx2(trans_begin, trans_end, num_sequences, this_probs,
+                    occupation_factor, next_beta, this_log_prob_deriv);
+#endif
+    DerivScalar(trans_begin, trans_end, num_sequences, s, this_probs,
+                occupation_factor, next_beta, this_log_prob_deriv);
+  }
+}
+
+
+}  // namespace chain
+}  // namespace kaldi
@@ -0,0 +1,105 @@
+// chain/chain-denominator-cpu.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_CHAIN_CHAIN_DENOMINATOR_CPU_H_
+#define KALDI_CHAIN_CHAIN_DENOMINATOR_CPU_H_
+
+#include "base/kaldi-common.h"
+#include "chain/chain-den-graph.h"
+
+namespace kaldi {
+namespace chain {
+
+/*
+  This header declares the functions that DenominatorComputation uses for the
+  forward-backward when it is not using a GPU; they are the CPU counterparts of
+  cuda_chain_hmm_forward() and cuda_chain_hmm_backward().  See the comment in
+  chain-denominator.h for the notation; as there, the alphas and betas for a
+  frame are stored as a matrix of dimension (num_hmm_states + 1) by
+  num_sequences, whose last row contains the tot-alpha (or tot-beta) quantities,
+  and 'probs' is the matrix of exp'd nnet outputs for the frame, of dimension
+  num_pdfs by num_sequences, with row stride 'prob_stride'.
+
+  Each function does its computation for a range of HMM-states or pdf-ids, so
+  that the caller can divide the work between threads.  The loops are arranged
+  so that the inner loop is over sequences, which is contiguous in memory, and
+  it is vectorized with AVX2 if the CPU supports it.  The results are exactly
+  the same as those of the scalar code (each floating-point operation is done
+  in the same precision and the same order).
+ */
+
+
+/// Computes the alphas for frame t, for HMM-states hmm_state_begin <= h <
+/// hmm_state_end, from the alpha-dash quantities of frame t - 1 in
+/// 'prev_alpha_dash'.  'probs' are the probabilities of frame t - 1.  Returns
+/// false if any of the results was infinite or NaN.
+bool ChainHmmForwardCpu(const Int32Pair *backward_transitions,
+                        const DenominatorGraphTransition *transitions,
+                        int32 num_sequences, int32 num_hmm_states,
+                        int32 hmm_state_begin, int32 hmm_state_end,
+                        const BaseFloat *probs, int32 prob_stride,
+                        const BaseFloat *prev_alpha_dash,
+                        BaseFloat *this_alpha);
+
+/// Computes the beta-dash quantities for frame t, for HMM-states
+/// hmm_state_begin <= h < hmm_state_end, from the betas of frame t + 1 in
+/// 'next_beta'.  'probs' are the probabilities of frame t.  Also sets the
+/// 'occupation factor' alpha-dash(t, h) / tot-alpha(t) for each of those
+/// states, in 'occupation_factor', which has the same layout as 'this_alpha'
+/// (but without the last row); this is needed by ChainHmmDerivCpu().
+void ChainHmmBackwardCpu(const Int32Pair *forward_transitions,
+                         const DenominatorGraphTransition *transitions,
+                         int32 num_sequences, int32 num_hmm_states,
+                         int32 hmm_state_begin, int32 hmm_state_end,
+                         const BaseFloat *probs, int32 prob_stride,
+                         const BaseFloat *this_alpha_dash,
+                         const BaseFloat *next_beta,
+                         BaseFloat *this_beta_dash,
+                         BaseFloat *occupation_factor);
+
+/// Adds the occupation probabilities gamma(t, n) for frame t to
+/// log_prob_deriv[n * deriv_stride + s], for pdf-ids pdf_begin <= n < pdf_end.
+/// Must be called after ChainHmmBackwardCpu() has been called for all the
+/// HMM-states.  The arguments 'pdf_transition_ranges' and 'pdf_transitions'
+/// are from DenominatorGraph::PdfTransitionRanges() and PdfTransitions().
+/// Because those are grouped by pdf-id, ranges of pdf-ids can be done in
+/// parallel; and because within each pdf-id the transitions are in order of
+/// source state, the sums are done in the same order as in a loop over
+/// HMM-states.
+void ChainHmmDerivCpu(const Int32Pair *pdf_transition_ranges,
+                      const DenominatorGraphPdfTransition *pdf_transitions,
+                      int32 num_sequences,
+                      int32 pdf_begin, int32 pdf_end,
+                      const BaseFloat *probs, int32 prob_stride,
+                      const BaseFloat *occupation_factor,
+                      const BaseFloat *next_beta,
+                      BaseFloat *log_prob_deriv, int32 deriv_stride);
+
+/// Returns true if the functions above use AVX2 on this machine.
+bool ChainHmmCpuUsesSimd();
+
+/// Enables or disables the use of AVX2 in the functions above (it is enabled
+/// by default if the CPU supports it); this is for testing and for comparing
+/// speeds.  Returns the previous setting.
+bool SetChainHmmCpuSimd(bool enable);
+
+
+}  // namespace chain
+}  // namespace kaldi
+
+#endif  // KALDI_CHAIN_CHAIN_DENOMINATOR_CPU_H_
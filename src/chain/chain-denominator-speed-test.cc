@@ -0,0 +1,297 @@
+// chain/chain-denominator-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/kaldi-thread.h"
+#include "cudamatrix/cu-device.h"
+#include "chain/chain-den-graph.h"
+#include "chain/chain-denominator.h"
+#include "chain/chain-denominator-cpu.h"
+
+namespace kaldi {
+namespace chain {
+
+// Makes a random acceptor like a denominator FST, with pdf-ids plus one as the
+// labels.
+void MakeRandomDenominatorFst(int32 num_states, int32 num_pdfs,
+                              int32 num_arcs_per_state,
+                              fst::StdVectorFst *fst) {
+  fst->DeleteStates();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    int32 num_arcs = RandInt(1, 2 * num_arcs_per_state - 1);
+    for (int32 a = 0; a < num_arcs; a++) {
+      int32 label = RandInt(1, num_pdfs),
+          nextstate = (a == 0 ? (s + 1) % num_states :
+                       RandInt(0, num_states - 1));
+      BaseFloat prob = 0.9 * RandUniform() / num_arcs + 0.001;
+      fst->AddArc(s, fst::StdArc(label, label, -Log(prob), nextstate));
+    }
+  }
+}
+
+// The scalar loops that DenominatorComputation used before
+// chain-denominator-cpu.h existed, for comparison.
+void AlphaGeneralFrameReference(const DenominatorGraph &den_graph,
+                                int32 num_sequences,
+                                const BaseFloat *prob_data, int32 prob_stride,
+                                const BaseFloat *prev_alpha_dash,
+                                BaseFloat *this_alpha) {
+  const Int32Pair *backward_transitions = den_graph.BackwardTransitions();
+  const DenominatorGraphTransition *transitions = den_graph.Transitions();
+  int32 num_hmm_states = den_graph.NumStates();
+  for (int32 h = 0; h < num_hmm_states; h++) {
+    for (int32 s = 0; s < num_sequences; s++) {
+      double this_tot_alpha = 0.0;
+      const DenominatorGraphTransition
+          *trans_iter = transitions + backward_transitions[h].first,
+          *trans_end = transitions + backward_transitions[h].second;
+      for (; trans_iter != trans_end; ++trans_iter) {
+        BaseFloat transition_prob = trans_iter->transition_prob;
+        int32 pdf_id = trans_iter->pdf_id,
+            prev_hmm_state = trans_iter->hmm_state;
+        BaseFloat prob = prob_data[pdf_id * prob_stride + s],
+            this_prev_alpha = prev_alpha_dash[prev_hmm_state * num_sequences + s];
+        this_tot_alpha += this_prev_alpha * transition_prob * prob;
+      }
+      BaseFloat arbitrary_scale =
+          1.0 / prev_alpha_dash[num_hmm_states * num_sequences + s];
+      KALDI_ASSERT(this_tot_alpha - this_tot_alpha == 0);
+      this_alpha[h * num_sequences + s] = this_tot_alpha * arbitrary_scale;
+    }
+  }
+}
+
+void BetaDashGeneralFrameReference(const DenominatorGraph &den_graph,
+                                   int32 num_sequences,
+                                   const BaseFloat *prob_data,
+                                   int32 prob_stride,
+                                   const BaseFloat *this_alpha_dash,
+                                   const BaseFloat *next_beta,
+                                   BaseFloat *this_beta_dash,
+                                   BaseFloat *log_prob_deriv_data,
+                                   int32 deriv_stride) {
+  const Int32Pair *forward_transitions = den_graph.ForwardTransitions();
+  const DenominatorGraphTransition *transitions = den_graph.Transitions();
+  int32 num_hmm_states = den_graph.NumStates();
+  for (int32 h = 0; h < num_hmm_states; h++) {
+    for (int32 s = 0; s < num_sequences; s++) {
+      BaseFloat this_alpha_dash_prob = this_alpha_dash[h * num_sequences + s],
+          inv_arbitrary_scale =
+          this_alpha_dash[num_hmm_states * num_sequences + s];
+      double tot_variable_factor = 0.0;
+      BaseFloat occupation_factor = this_alpha_dash_prob /
+          inv_arbitrary_scale;
+      const DenominatorGraphTransition
+          *trans_iter = transitions + forward_transitions[h].first,
+          *trans_end = transitions + forward_transitions[h].second;
+      for (; trans_iter != trans_end; ++trans_iter) {
+        BaseFloat transition_prob = trans_iter->transition_prob;
+        int32 pdf_id = trans_iter->pdf_id,
+            next_hmm_state = trans_iter->hmm_state;
+        BaseFloat variable_factor = transition_prob *
+            next_beta[next_hmm_state * num_sequences + s] *
+            prob_data[pdf_id * prob_stride + s];
+        tot_variable_factor += variable_factor;
+        BaseFloat occupation_prob = variable_factor * occupation_factor;
+        log_prob_deriv_data[pdf_id * deriv_stride + s] += occupation_prob;
+      }
+      this_beta_dash[h * num_sequences + s] =
+          tot_variable_factor / inv_arbitrary_scale;
+    }
+  }
+}
+
+// Runs one frame of the alpha and beta-dash computations with the functions
+// in chain-denominator-cpu.h, dividing them between the threads in 'threads'.
+void ForwardBackwardFrameCpu(const DenominatorGraph &den_graph,
+                             int32 num_sequences,
+                             const Matrix<BaseFloat> &probs,
+                             const Vector<BaseFloat> &prev_alpha_dash,
+                             const Vector<BaseFloat> &next_beta,
+                             ThreadTeam *threads,
+                             Vector<BaseFloat> *this_alpha,
+                             Vector<BaseFloat> *this_beta_dash,
+                             Vector<BaseFloat> *occupation_factor,
+                             Matrix<BaseFloat> *log_prob_deriv) {
+  int32 num_hmm_states = den_graph.NumStates(),
+      num_pdfs = den_graph.NumPdfs();
+  threads->Run([&](int32 thread_id) {
+      int32 begin, end;
+      threads->GetRange(thread_id, num_hmm_states, 1, &begin, &end);
+      KALDI_ASSERT(ChainHmmForwardCpu(
+          den_graph.BackwardTransitions(), den_graph.Transitions(),
+          num_sequences, num_hmm_states, begin, end, probs.Data(),
+          probs.Stride(), prev_alpha_dash.Data(), this_alpha->Data()));
+    });
+  // As for the alpha computation, we use prev_alpha_dash as the alpha-dash of
+  // the current frame.
+  threads->Run([&](int32 thread_id) {
+      int32 begin, end;
+      threads->GetRange(thread_id, num_hmm_states, 1, &begin, &end);
+      ChainHmmBackwardCpu(den_graph.ForwardTransitions(),
+                          den_graph.Transitions(), num_sequences,
+                          num_hmm_states, begin, end, probs.Data(),
+                          probs.Stride(), prev_alpha_dash.Data(),
+                          next_beta.Data(), this_beta_dash->Data(),
+                          occupation_factor->Data());
+    });
+  threads->Run([&](int32 thread_id) {
+      int32 begin, end;
+      threads->GetRange(thread_id, num_pdfs, 1, &begin, &end);
+      ChainHmmDerivCpu(den_graph.PdfTransitionRanges(),
+                       den_graph.PdfTransitions(), num_sequences, begin, end,
+                       probs.Data(), probs.Stride(),
+                       occupation_factor->Data(), next_beta.Data(),
+                       log_prob_deriv->Data(), log_prob_deriv->Stride());
+    });
+}
+
+// Checks that the functions in chain-denominator-cpu.h give exactly the same
+// results as the old loops, and compares their speeds.
+void TestChainHmmCpu(int32 num_states, int32 num_pdfs, int32 num_sequences) {
+  fst::StdVectorFst fst;
+  MakeRandomDenominatorFst(num_states, num_pdfs, 4, &fst);
+  DenominatorGraph den_graph(fst, num_pdfs);
+
+  int32 dim = (num_states + 1) * num_sequences;
+  Matrix<BaseFloat> probs(num_pdfs, num_sequences);
+  probs.SetRandn();
+  probs.ApplyExp();
+  Vector<BaseFloat> prev_alpha_dash(dim), next_beta(dim);
+  prev_alpha_dash.SetRandn();
+  prev_alpha_dash.ApplyExp();
+  next_beta.SetRandn();
+  next_beta.ApplyExp();
+
+  Vector<BaseFloat> ref_alpha(dim), ref_beta_dash(dim);
+  Matrix<BaseFloat> ref_deriv(num_pdfs, num_sequences);
+  int32 num_iters = 0;
+  Timer timer;
+  do {
+    AlphaGeneralFrameReference(den_graph, num_sequences, probs.Data(),
+                               probs.Stride(), prev_alpha_dash.Data(),
+                               ref_alpha.Data());
+    ref_deriv.SetZero();
+    BetaDashGeneralFrameReference(den_graph, num_sequences, probs.Data(),
+                                  probs.Stride(), prev_alpha_dash.Data(),
+                                  next_beta.Data(), ref_beta_dash.Data(),
+                                  ref_deriv.Data(), ref_deriv.Stride());
+    num_iters++;
+  } while (timer.Elapsed() < 0.2);
+  double ref_time = timer.Elapsed() / num_iters;
+  KALDI_LOG << "For " << num_states << " HMM-states, " << num_sequences
+            << " sequences, the reference loops took " << (ref_time * 1000.0)
+            << " ms per frame.";
+
+  bool simd_supported = ChainHmmCpuUsesSimd();
+  for (int32 simd = 0; simd <= (simd_supported ? 1 : 0); simd++) {
+    SetChainHmmCpuSimd(simd == 1);
+    for (int32 num_threads = 1; num_threads <= 4; num_threads *= 2) {
+      ThreadTeam threads(num_threads);
+      Vector<BaseFloat> alpha(dim), beta_dash(dim),
+          occupation_factor(num_states * num_sequences);
+      Matrix<BaseFloat> deriv(num_pdfs, num_sequences);
+      num_iters = 0;
+      timer.Reset();
+      do {
+        deriv.SetZero();
+        ForwardBackwardFrameCpu(den_graph, num_sequences, probs,
+                                prev_alpha_dash, next_beta, &threads,
+                                &alpha, &beta_dash, &occupation_factor,
+                                &deriv);
+        num_iters++;
+      } while (timer.Elapsed() < 0.2);
+      double time = timer.Elapsed() / num_iters;
+      KALDI_LOG << "With " << (simd ? "AVX2" : "no SIMD") << " and "
+                << num_threads << " thread(s), the time was "
+                << (time * 1000.0) << " ms per frame, speedup "
+                << (ref_time / time);
+
+      // The results should be exactly the same; we don't check the last
+      // num_sequences elements, which are for the tot-alphas and tot-betas.
+      for (int32 i = 0; i < num_states * num_sequences; i++) {
+        KALDI_ASSERT(alpha(i) == ref_alpha(i));
+        KALDI_ASSERT(beta_dash(i) == ref_beta_dash(i));
+      }
+      for (int32 n = 0; n < num_pdfs; n++)
+        for (int32 s = 0; s < num_sequences; s++)
+          KALDI_ASSERT(deriv(n, s) == ref_deriv(n, s));
+    }
+  }
+  SetChainHmmCpuSimd(true);
+}
+
+// Checks that the number of threads makes no difference to the results of
+// DenominatorComputation, and compares the speeds.
+void TestDenominatorComputationThreads(int32 num_states, int32 num_pdfs,
+                                       int32 num_sequences) {
+  fst::StdVectorFst fst;
+  MakeRandomDenominatorFst(num_states, num_pdfs, 4, &fst);
+  DenominatorGraph den_graph(fst, num_pdfs);
+  int32 frames_per_sequence = 50;
+  CuMatrix<BaseFloat> nnet_output(num_sequences * frames_per_sequence,
+                                  num_pdfs);
+  nnet_output.SetRandn();
+
+  BaseFloat ref_objf = 0.0;
+  CuMatrix<BaseFloat> ref_deriv;
+  for (int32 num_threads = 1; num_threads <= 4; num_threads *= 2) {
+    ChainTrainingOptions opts;
+    opts.denominator_num_threads = num_threads;
+    CuMatrix<BaseFloat> deriv(nnet_output.NumRows(), nnet_output.NumCols());
+    Timer timer;
+    DenominatorComputation computation(opts, den_graph, num_sequences,
+                                       nnet_output);
+    BaseFloat objf = computation.Forward();
+    KALDI_ASSERT(computation.Backward(1.0, &deriv));
+    KALDI_LOG << "For " << num_states << " HMM-states, " << num_sequences
+              << " sequences, DenominatorComputation with " << num_threads
+              << " thread(s) took " << timer.Elapsed() << " seconds.";
+    if (num_threads == 1) {
+      ref_objf = objf;
+      ref_deriv = deriv;
+    } else {
+      KALDI_ASSERT(objf == ref_objf);
+      AssertEqual(deriv, ref_deriv, 0.0);
+    }
+  }
+}
+
+
+}  // namespace chain
+}  // namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::chain;
+#if HAVE_CUDA == 1
+  // This tests the CPU version of the computation.
+  CuDevice::Instantiate().SelectGpuId("no");
+#endif
+  TestChainHmmCpu(2000, 1000, 64);
+  TestChainHmmCpu(5000, 3000, 37);
+  TestDenominatorComputationThreads(2000, 1000, 64);
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -19,6 +19,7 @@
 
 
 #include "chain/chain-denominator.h"
+#include "chain/chain-denominator-cpu.h"
 #include "chain/chain-kernels-ansi.h"
 
 namespace kaldi {
@@ -46,7 +47,7 @@ DenominatorComputation::DenominatorComputation(
     tot_prob_(num_sequences_, kUndefined),
     tot_log_prob_(num_sequences_, kUndefined),
     log_correction_term_(num_sequences_, kUndefined),
-    ok_(true) {
+    ok_(true), threads_(NULL) {
   // We don't let leaky_hmm_coefficient be exactly zero (although that would
   // make sense mathematically, corresponding to "turning off" the leaky HMM),
   // because that would lead to underflow and eventually NaN's or inf's
@@ -73,6 +74,19 @@ DenominatorComputation::DenominatorComputation(
   // this avoids NaNs appearing in the forward-backward computation, which
   // is not done in log space.
   exp_nnet_output_transposed_.ApplyExpLimited(-30.0, 30.0);
+
+#if HAVE_CUDA == 1
+  if (!CuDevice::Instantiate().Enabled())
+#endif
+  {
+    threads_ = new ThreadTeam(opts_.denominator_num_threads);
+    occupation_factor_.Resize(den_graph_.NumStates() * num_sequences_,
+                              kUndefined);
+  }
+}
+
+DenominatorComputation::~DenominatorComputation() {
+  delete threads_;
 }
 
 
@@ -140,34 +154,26 @@ void DenominatorComputation::AlphaGeneralFrame(int32 t) {
 #endif
   {
     int32 prob_stride = probs.Stride();
-    for (int32 h = 0; h < num_hmm_states; h++) {
-      for (int32 s = 0; s < num_sequences; s++) {
-        double this_tot_alpha = 0.0;
-        const DenominatorGraphTransition
-            *trans_iter = transitions + backward_transitions[h].first,
-            *trans_end = transitions + backward_transitions[h].second;
-        for (; trans_iter != trans_end; ++trans_iter) {
-          BaseFloat transition_prob = trans_iter->transition_prob;
-          int32 pdf_id = trans_iter->pdf_id,
-              prev_hmm_state = trans_iter->hmm_state;
-          BaseFloat prob = prob_data[pdf_id * prob_stride + s],
-              this_prev_alpha = prev_alpha_dash[prev_hmm_state * num_sequences + s];
-          this_tot_alpha += this_prev_alpha * transition_prob * prob;
-        }
-        // Let arbitrary_scale be the inverse of the alpha-sum value that we
-        // store in the same place we'd store the alpha for the state numbered
-        // 'num_hmm_states'. We multiply this into all the
-        // transition-probabilities from the previous frame to this frame, in
-        // both the forward and backward passes, in order to keep the alphas in
-        // a good numeric range.  This won't affect the posteriors, but when
-        // computing the total likelihood we'll need to compensate for it later
-        // on.
-        BaseFloat arbitrary_scale =
-            1.0 / prev_alpha_dash[num_hmm_states * num_sequences + s];
-        KALDI_ASSERT(this_tot_alpha - this_tot_alpha == 0);
-        this_alpha[h * num_sequences + s] = this_tot_alpha * arbitrary_scale;
-      }
-    }
+    // Let arbitrary_scale be the inverse of the alpha-sum value that we store
+    // in the same place we'd store the alpha for the state numbered
+    // 'num_hmm_states'. We multiply this into all the transition-probabilities
+    // from the previous frame to this frame, in both the forward and backward
+    // passes, in order to keep the alphas in a good numeric range.  This won't
+    // affect the posteriors, but when computing the total likelihood we'll
+    // need to compensate for it later on.
+    // Each thread does a range of HMM-states; see chain-denominator-cpu.h.
+    std::vector<char> thread_ok(threads_->NumThreads(), 1);
+    threads_->Run([&](int32 thread_id) {
+        int32 hmm_state_begin, hmm_state_end;
+        threads_->GetRange(thread_id, num_hmm_states, 1,
+                           &hmm_state_begin, &hmm_state_end);
+        thread_ok[thread_id] = ChainHmmForwardCpu(
+            backward_transitions, transitions, num_sequences, num_hmm_states,
+            hmm_state_begin, hmm_state_end, prob_data, prob_stride,
+            prev_alpha_dash, this_alpha);
+      });
+    for (size_t i = 0; i < thread_ok.size(); i++)
+      KALDI_ASSERT(thread_ok[i]);
   }
 }
 
@@ -373,33 +379,30 @@ void DenominatorComputation::BetaDashGeneralFrame(int32 t) {
     int32 prob_stride = probs.Stride(),
          deriv_stride = log_prob_deriv.Stride();
     const BaseFloat *prob_data = probs.Data();
-    BaseFloat *log_prob_deriv_data = log_prob_deriv.Data();
-    for (int32 h = 0; h < num_hmm_states; h++) {
-      for (int32 s = 0; s < num_sequences; s++) {
-        BaseFloat this_alpha_dash_prob = this_alpha_dash[h * num_sequences + s],
-            inv_arbitrary_scale =
-            this_alpha_dash[num_hmm_states * num_sequences + s];
-        double tot_variable_factor = 0.0;
-        BaseFloat occupation_factor = this_alpha_dash_prob /
-            inv_arbitrary_scale;
-        const DenominatorGraphTransition
-            *trans_iter = transitions + forward_transitions[h].first,
-            *trans_end = transitions + forward_transitions[h].second;
-        for (; trans_iter != trans_end; ++trans_iter) {
-          BaseFloat transition_prob = trans_iter->transition_prob;
-          int32 pdf_id = trans_iter->pdf_id,
-              next_hmm_state = trans_iter->hmm_state;
-          BaseFloat variable_factor = transition_prob *
-              next_beta[next_hmm_state * num_sequences + s] *
-              prob_data[pdf_id * prob_stride + s];
-          tot_variable_factor += variable_factor;
-          BaseFloat occupation_prob = variable_factor * occupation_factor;
-          log_prob_deriv_data[pdf_id * deriv_stride + s] += occupation_prob;
-        }
-        this_beta_dash[h * num_sequences + s] =
-            tot_variable_factor / inv_arbitrary_scale;
-      }
-    }
+    BaseFloat *log_prob_deriv_data = log_prob_deriv.Data(),
+        *occupation_factor = occupation_factor_.Data();
+    // First the beta-dash for ranges of HMM-states; then, because
+    // the derivatives for a pdf-id get contributions from many HMM-states,
+    // they are computed separately for ranges of pdf-ids, using the
+    // transitions grouped by pdf-id.
+    threads_->Run([&](int32 thread_id) {
+        int32 hmm_state_begin, hmm_state_end;
+        threads_->GetRange(thread_id, num_hmm_states, 1,
+                           &hmm_state_begin, &hmm_state_end);
+        ChainHmmBackwardCpu(forward_transitions, transitions, num_sequences,
+                            num_hmm_states, hmm_state_begin, hmm_state_end,
+                            prob_data, prob_stride, this_alpha_dash,
+                            next_beta, this_beta_dash, occupation_factor);
+      });
+    threads_->Run([&](int32 thread_id) {
+        int32 pdf_begin, pdf_end;
+        threads_->GetRange(thread_id, num_pdfs, 1, &pdf_begin, &pdf_end);
+        ChainHmmDerivCpu(den_graph_.PdfTransitionRanges(),
+                         den_graph_.PdfTransitions(), num_sequences,
+                         pdf_begin, pdf_end, prob_data, prob_stride,
+                         occupation_factor, next_beta,
+                         log_prob_deriv_data, deriv_stride);
+      });
   }
 }
 
@@ -27,6 +27,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 #include "fstext/fstext-lib.h"
 #include "tree/context-dep.h"
 #include "lat/kaldi-lattice.h"
@@ -223,6 +224,8 @@ class DenominatorComputation {
   bool Backward(BaseFloat deriv_weight,
                 CuMatrixBase<BaseFloat> *nnet_output_deriv);
 
+  ~DenominatorComputation();
+
  private:
   // Defining this constant as an enum is easier.  it controls a memory/speed
   // tradeoff, determining how many frames' worth of the transposed derivative
@@ -307,6 +310,17 @@ class DenominatorComputation {
   CuVector<BaseFloat> log_correction_term_;
 
   bool ok_;
+
+  // The threads used for the forward-backward if we are not using a GPU
+  // (see opts_.denominator_num_threads); NULL if we are using a GPU.
+  ThreadTeam *threads_;
+
+  // Only used if we are not using a GPU: the alpha-dash for each HMM-state
+  // and sequence divided by the tot-alpha of that sequence, for the frame
+  // whose beta-dash we are computing; see ChainHmmBackwardCpu().
+  Vector<BaseFloat> occupation_factor_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DenominatorComputation);
 };
 
 
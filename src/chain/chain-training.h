@@ -62,8 +62,12 @@ struct ChainTrainingOptions {
   // should have a softmax as its final nonlinearity.
   BaseFloat xent_regularize;
 
+  // Number of threads used for the denominator forward-backward when we are
+  // not using a GPU.
+  int32 denominator_num_threads;
+
   ChainTrainingOptions(): l2_regularize(0.0), leaky_hmm_coefficient(1.0e-05),
-                          xent_regularize(0.0) { }
+                          xent_regularize(0.0), denominator_num_threads(1) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("l2-regularize", &l2_regularize, "l2 regularization "
@@ -79,6 +83,10 @@ struct ChainTrainingOptions {
                    "nonzero, the network is expected to have an output "
                    "named 'output-xent', which should have a softmax as "
                    "its final nonlinearity.");
+    opts->Register("denominator-num-threads", &denominator_num_threads,
+                   "Number of threads to use for the denominator "
+                   "forward-backward computation; only relevant when not "
+                   "using a GPU.");
   }
 };
 
@@ -0,0 +1,108 @@
+// decoder/decoder-speed-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+// This measures the speed of the decoders on a fixed random graph and
+// likelihood matrix.  To compare the hashes used for the tokens, run it once as
+// it is, and once after changing DecoderTokenHash in decoder-token-hash.h and
+// doing "make clean; make decoder-speed-test".
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "decoder/decodable-matrix.h"
+#include "decoder/faster-decoder.h"
+#include "decoder/lattice-faster-decoder.h"
+#include "decoder/lattice-faster-online-decoder.h"
+
+namespace kaldi {
+
+// Creates a random graph in which each state has "num_arcs" arcs with random
+// input labels (pdf-ids plus one) to random states, and some states also have
+// an epsilon arc.
+void CreateRandomGraph(int32 num_states, int32 num_arcs, int32 num_pdfs,
+                       fst::VectorFst<fst::StdArc> *fst) {
+  typedef fst::StdArc Arc;
+  typedef Arc::Weight Weight;
+  fst->DeleteStates();
+  for (int32 s = 0; s < num_states; s++)
+    fst->AddState();
+  fst->SetStart(0);
+  for (int32 s = 0; s < num_states; s++) {
+    for (int32 a = 0; a < num_arcs; a++) {
+      int32 ilabel = RandInt(1, num_pdfs),
+          olabel = (Rand() % 10 == 0 ? RandInt(1, 1000) : 0);
+      fst->AddArc(s, Arc(ilabel, olabel, Weight(5.0 * RandUniform()),
+                         Rand() % num_states));
+    }
+    if (Rand() % 10 == 0)
+      fst->AddArc(s, Arc(0, RandInt(1, 1000), Weight(5.0 * RandUniform()),
+                         Rand() % num_states));
+    if (Rand() % 100 == 0)
+      fst->SetFinal(s, Weight::One());
+  }
+}
+
+template<class Decoder> void DecodeAndTime(const std::string &name,
+                                           Decoder *decoder,
+                                           const Matrix<BaseFloat> &loglikes) {
+  int32 num_repeats = 3;
+  Timer timer;
+  for (int32 i = 0; i < num_repeats; i++) {
+    DecodableMatrixScaled decodable(loglikes, 1.0);
+    decoder->Decode(&decodable);
+    Lattice best_path;
+    decoder->GetBestPath(&best_path);
+    KALDI_ASSERT(best_path.NumStates() != 0);
+  }
+  double elapsed = timer.Elapsed();
+  KALDI_LOG << name << " decoded " << (num_repeats * loglikes.NumRows())
+            << " frames in " << elapsed << "s, "
+            << (num_repeats * loglikes.NumRows() / elapsed)
+            << " frames/sec.";
+}
+
+void DecoderSpeedTest() {
+  int32 num_states = 200000, num_arcs = 4, num_pdfs = 2000,
+      num_frames = 200;
+  fst::VectorFst<fst::StdArc> fst;
+  CreateRandomGraph(num_states, num_arcs, num_pdfs, &fst);
+  Matrix<BaseFloat> loglikes(num_frames, num_pdfs);
+  loglikes.SetRandn();
+  loglikes.Scale(2.0);
+
+  FasterDecoderOptions faster_opts;
+  faster_opts.beam = 12.0;
+  faster_opts.max_active = 20000;
+  FasterDecoder faster_decoder(fst, faster_opts);
+  DecodeAndTime("FasterDecoder", &faster_decoder, loglikes);
+
+  LatticeFasterDecoderConfig lattice_config;
+  lattice_config.beam = 12.0;
+  lattice_config.max_active = 20000;
+  LatticeFasterDecoder lattice_decoder(fst, lattice_config);
+  DecodeAndTime("LatticeFasterDecoder", &lattice_decoder, loglikes);
+
+  LatticeFasterOnlineDecoder online_decoder(fst, lattice_config);
+  DecodeAndTime("LatticeFasterOnlineDecoder", &online_decoder, loglikes);
+}
+
+}  // namespace kaldi
+
+int main() {
+  kaldi::DecoderSpeedTest();
+  std::cout << "Test OK.\n";
+  return 0;
+}
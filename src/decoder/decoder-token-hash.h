@@ -0,0 +1,42 @@
+// decoder/decoder-token-hash.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_DECODER_DECODER_TOKEN_HASH_H_
+#define KALDI_DECODER_DECODER_TOKEN_HASH_H_
+
+#include "util/hash-list.h"
+#include "util/flat-hash-list.h"
+
+namespace kaldi {
+
+/// DecoderTokenHash<I, T>::Type is the hash from graph states to tokens used
+/// by FasterDecoder, LatticeFasterDecoder and LatticeFasterOnlineDecoder.  It
+/// is HashList, or FlatHashList (see util/flat-hash-list.h) if Kaldi was
+/// configured with --flat-token-hash, which defines KALDI_DECODER_FLAT_HASH
+/// for all of the code (like KALDI_DOUBLEPRECISION), so that everything that
+/// is linked together agrees on the layout of the decoders.
+template<class I, class T> struct DecoderTokenHash {
+#ifdef KALDI_DECODER_FLAT_HASH
+  typedef FlatHashList<I, T> Type;
+#else
+  typedef HashList<I, T> Type;
+#endif
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_DECODER_DECODER_TOKEN_HASH_H_
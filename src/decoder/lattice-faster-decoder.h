@@ -29,7 +29,8 @@
 
 
 #include "util/stl-utils.h"
-#include "util/hash-list.h"
+#include "decoder/decoder-token-hash.h"
+#include "util/memory-pool.h"
 #include "fst/fstlib.h"
 #include "itf/decodable-itf.h"
 #include "fstext/fstext-lib.h"
@@ -244,15 +245,6 @@ class LatticeFasterDecoder {
     inline Token(BaseFloat tot_cost, BaseFloat extra_cost, ForwardLink *links,
                  Token *next):
         tot_cost(tot_cost), extra_cost(extra_cost), links(links), next(next) { }
-    inline void DeleteForwardLinks() {
-      ForwardLink *l = links, *m;
-      while (l != NULL) {
-        m = l->next;
-        delete l;
-        l = m;
-      }
-      links = NULL;
-    }
   };
 
   // head of per-frame list of Tokens (list is in topological order),
@@ -265,7 +257,21 @@ class LatticeFasterDecoder {
                  must_prune_tokens(true) { }
   };
 
-  typedef HashList<StateId, Token*>::Elem Elem;
+  // The hash from states to tokens; see decoder/decoder-token-hash.h.
+  typedef DecoderTokenHash<StateId, Token*>::Type TokenHash;
+  typedef TokenHash::Elem Elem;
+
+  // Deletes all forward links out of this token, returning their memory to
+  // link_pool_.
+  inline void DeleteForwardLinks(Token *tok) {
+    ForwardLink *l = tok->links, *m;
+    while (l != NULL) {
+      m = l->next;
+      link_pool_.Delete(l);
+      l = m;
+    }
+    tok->links = NULL;
+  }
 
   void PossiblyResizeHash(size_t num_toks);
 
@@ -353,14 +359,22 @@ class LatticeFasterDecoder {
 
   void ProcessNonemittingWrapper(BaseFloat cost_cutoff);
 
-  // HashList defined in ../util/hash-list.h.  It actually allows us to maintain
+  // See TokenHash above.  It actually allows us to maintain
   // more than one list (e.g. for current and previous frames), but only one of
   // them at a time can be indexed by StateId.  It is indexed by frame-index
   // plus one, where the frame-index is zero-based, as used in decodable object.
   // That is, the emitting probs of frame t are accounted for in tokens at
   // toks_[t+1].  The zeroth frame is for nonemitting transition at the start of
   // the graph.
-  HashList<StateId, Token*> toks_;
+  TokenHash toks_;
+
+  // All Tokens and ForwardLinks are allocated from these pools rather than
+  // with new/delete; this avoids allocator calls (and contention between
+  // decoders running in different threads) in the inner loop, and the memory
+  // is reused across utterances.  At the end of an utterance,
+  // ClearActiveTokens() releases all of it in one go.
+  MemoryPool<Token> token_pool_;
+  MemoryPool<ForwardLink> link_pool_;
 
   std::vector<TokenList> active_toks_; // Lists of tokens, indexed by
   // frame (members of TokenList are toks, must_prune_forward_links,
@@ -30,11 +30,12 @@ void OfflineFeatureTpl<F>::ComputeFeatures(
     const VectorBase<BaseFloat> &wave,
     BaseFloat sample_freq,
     BaseFloat vtln_warp,
-    Matrix<BaseFloat> *output) {
+    Matrix<BaseFloat> *output,
+    std::vector<RandomState> *dither_states) {
   KALDI_ASSERT(output != NULL);
   BaseFloat new_sample_freq = computer_.GetFrameOptions().samp_freq;
   if (sample_freq == new_sample_freq)
-    Compute(wave, vtln_warp, output);
+    Compute(wave, vtln_warp, output, dither_states);
   else {
     if (new_sample_freq < sample_freq) {
       if (! computer_.GetFrameOptions().allow_downsample)
@@ -47,7 +48,7 @@ void OfflineFeatureTpl<F>::ComputeFeatures(
       Vector<BaseFloat> downsampled_wave(wave);
       DownsampleWaveForm(sample_freq, wave,
                          new_sample_freq, &downsampled_wave);
-      Compute(downsampled_wave, vtln_warp, output);
+      Compute(downsampled_wave, vtln_warp, output, dither_states);
     } else
       KALDI_ERR << "The waveform is allowed to get downsampled."
                 << "New sample Frequency " << new_sample_freq
@@ -62,20 +63,22 @@ void OfflineFeatureTpl<F>::ComputeFeatures(
     const VectorBase<BaseFloat> &wave,
     BaseFloat sample_freq,
     BaseFloat vtln_warp,
-    Matrix<BaseFloat> *output) const {
+    Matrix<BaseFloat> *output,
+    std::vector<RandomState> *dither_states) const {
   OfflineFeatureTpl<F> temp(*this);
   // This const version of ComputeFeatures() is a wrapper that
   // calls the non-const ComputeFeatures() on a temporary object
   // that is a copy of *this.  It is not as efficient because of the
   // overhead of copying *this.
-  temp.ComputeFeatures(wave, vtln_warp, output);
+  temp.ComputeFeatures(wave, sample_freq, vtln_warp, output, dither_states);
 }
 
 template <class F>
 void OfflineFeatureTpl<F>::Compute(
     const VectorBase<BaseFloat> &wave,
     BaseFloat vtln_warp,
-    Matrix<BaseFloat> *output) {
+    Matrix<BaseFloat> *output,
+    std::vector<RandomState> *dither_states) {
   KALDI_ASSERT(output != NULL);
   int32 rows_out = NumFrames(wave.Dim(), computer_.GetFrameOptions()),
       cols_out = computer_.Dim();
@@ -83,17 +86,36 @@ void OfflineFeatureTpl<F>::Compute(
     output->Resize(0, 0);
     return;
   }
-  output->Resize(rows_out, cols_out);
+  if (dither_states != NULL && computer_.GetFrameOptions().dither != 0.0)
+    KALDI_ASSERT(dither_states->size() == static_cast<size_t>(rows_out));
+  output->Resize(rows_out, cols_out, kUndefined);
+  // We process the frames in batches, which lets the computer do some of the
+  // computation as matrix operations.  The batches are kept fairly
+  // small so that the windowed frames stay in cache.
+  const int32 max_batch_size = 64;
+  int32 batch_size = std::min(rows_out, max_batch_size),
+      padded_window_size = computer_.GetFrameOptions().PaddedWindowSize();
+  Matrix<BaseFloat> windows(batch_size, padded_window_size, kUndefined);
+  Vector<BaseFloat> raw_log_energies(batch_size);
   Vector<BaseFloat> window;  // windowed waveform.
   bool use_raw_log_energy = computer_.NeedRawLogEnergy();
-  for (int32 r = 0; r < rows_out; r++) {  // r is frame index.
-    BaseFloat raw_log_energy = 0.0;
-    ExtractWindow(0, wave, r, computer_.GetFrameOptions(),
-                  feature_window_function_, &window,
-                  (use_raw_log_energy ? &raw_log_energy : NULL));
-
-    SubVector<BaseFloat> output_row(*output, r);
-    computer_.Compute(raw_log_energy, vtln_warp, &window, &output_row);
+  for (int32 start = 0; start < rows_out; start += batch_size) {
+    int32 this_batch_size = std::min(batch_size, rows_out - start);
+    for (int32 i = 0; i < this_batch_size; i++) {
+      BaseFloat raw_log_energy = 0.0;
+      ExtractWindow(0, wave, start + i, computer_.GetFrameOptions(),
+                    feature_window_function_, &window,
+                    (use_raw_log_energy ? &raw_log_energy : NULL),
+                    (dither_states != NULL && !dither_states->empty() ?
+                     &((*dither_states)[start + i]) : NULL));
+      windows.Row(i).CopyFromVec(window);
+      raw_log_energies(i) = raw_log_energy;
+    }
+    SubMatrix<BaseFloat> windows_part(windows, 0, this_batch_size,
+                                      0, padded_window_size),
+        output_part(*output, start, this_batch_size, 0, cols_out);
+    computer_.Compute(raw_log_energies.Range(0, this_batch_size), vtln_warp,
+                      &windows_part, &output_part);
   }
 }
 
@@ -101,12 +123,37 @@ template <class F>
 void OfflineFeatureTpl<F>::Compute(
     const VectorBase<BaseFloat> &wave,
     BaseFloat vtln_warp,
-    Matrix<BaseFloat> *output) const {
+    Matrix<BaseFloat> *output,
+    std::vector<RandomState> *dither_states) const {
   OfflineFeatureTpl<F> temp(*this);
   // call the non-const version of Compute() on a temporary copy of this object.
   // This is a workaround for const-ness that may sometimes be useful in
   // multi-threaded code, although it's not optimally efficient.
-  temp.Compute(wave, vtln_warp, output);
+  temp.Compute(wave, vtln_warp, output, dither_states);
+}
+
+template <class F>
+void OfflineFeatureTpl<F>::InitDitherStates(
+    int64 num_samples,
+    BaseFloat sample_freq,
+    std::vector<RandomState> *dither_states) const {
+  const FrameExtractionOptions &frame_opts = computer_.GetFrameOptions();
+  dither_states->clear();
+  if (frame_opts.dither == 0.0)
+    return;
+  int32 num_frames;
+  if (sample_freq == frame_opts.samp_freq)
+    num_frames = NumFrames(num_samples, frame_opts);
+  else if (sample_freq > frame_opts.samp_freq && frame_opts.allow_downsample)
+    num_frames = NumFrames(DownsampleWaveFormNumSamples(
+        sample_freq, num_samples, frame_opts.samp_freq), frame_opts);
+  else
+    return;  // ComputeFeatures() will fail anyway.
+  // Each RandomState takes its seed from the global random number generator
+  // when it is constructed, so they have to be created in frame order.
+  dither_states->reserve(num_frames);
+  for (int32 r = 0; r < num_frames; r++)
+    dither_states->push_back(RandomState());
 }
 
 } // end namespace kaldi
@@ -94,6 +94,28 @@ class ExampleFeatureComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /**
+     This version of Compute() computes the features for a batch of frames,
+     one per row, which is used by OfflineFeatureTpl.  It must give the same
+     results as calling the one-frame version of Compute() for each row (up to
+     rounding error), but it can be faster because parts of the computation can
+     be done as matrix-matrix operations.
+
+     @param [in] signal_raw_log_energies  The raw log-energies of the frames,
+         as for 'signal_raw_log_energy' above; its dimension equals
+         signal_frames->NumRows().
+     @param [in] vtln_warp  The VTLN warping factor, as above.
+     @param [in] signal_frames  The frames of the signal, one per row, as
+         extracted by ExtractWindow(); used as a workspace.
+     @param [out] features  Matrix with the same number of rows as
+         'signal_frames' and this->Dim() columns, to which the features will
+         be written.
+  */
+  void Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+               BaseFloat vtln_warp,
+               MatrixBase<BaseFloat> *signal_frames,
+               MatrixBase<BaseFloat> *features);
+
  private:
   // disallow assignment.
   ExampleFeatureComputer &operator = (const ExampleFeatureComputer &in);
@@ -121,17 +143,19 @@ class OfflineFeatureTpl {
   // Internal (and back-compatibility) interface for computing features, which
   // requires that the user has already checked that the sampling frequency
   // of the waveform is equal to the sampling frequency specified in
-  // the frame-extraction options.
+  // the frame-extraction options.  See ComputeFeatures() for 'dither_states'.
   void Compute(const VectorBase<BaseFloat> &wave,
                BaseFloat vtln_warp,
-               Matrix<BaseFloat> *output);
+               Matrix<BaseFloat> *output,
+               std::vector<RandomState> *dither_states = NULL);
 
   // This const version of Compute() is a wrapper that
   // calls the non-const version on a temporary object.
   // It's less efficient than the non-const version.
   void Compute(const VectorBase<BaseFloat> &wave,
                BaseFloat vtln_warp,
-               Matrix<BaseFloat> *output) const;
+               Matrix<BaseFloat> *output,
+               std::vector<RandomState> *dither_states = NULL) const;
 
   /**
      Computes the features for one file (one sequence of features).
@@ -147,11 +171,21 @@ class OfflineFeatureTpl {
                             be 1.0)
      @param [out]  output  The matrix of features, where the row-index
                            is the frame index.
+     @param [in,out] dither_states  If non-NULL, frame r is dithered using
+                           (*dither_states)[r] instead of a RandomState
+                           initialized from the global random number generator
+                           at that point.  It should be set up by
+                           InitDitherStates(), which gives the same output as
+                           NULL would have given if called at the same point.
+                           Multi-threaded programs use this so that their
+                           output doesn't depend on the order in which the
+                           threads run.
   */
   void ComputeFeatures(const VectorBase<BaseFloat> &wave,
                        BaseFloat sample_freq,
                        BaseFloat vtln_warp,
-                       Matrix<BaseFloat> *output);
+                       Matrix<BaseFloat> *output,
+                       std::vector<RandomState> *dither_states = NULL);
   /**
      This const version of ComputeFeatures() is a wrapper that
      calls the non-const ComputeFeatures() on a temporary object
@@ -161,7 +195,19 @@ class OfflineFeatureTpl {
   void ComputeFeatures(const VectorBase<BaseFloat> &wave,
                        BaseFloat sample_freq,
                        BaseFloat vtln_warp,
-                       Matrix<BaseFloat> *output) const;
+                       Matrix<BaseFloat> *output,
+                       std::vector<RandomState> *dither_states = NULL) const;
+
+  /**
+     Sets up the random states for the 'dither_states' argument of
+     ComputeFeatures(), for a waveform with 'num_samples' samples sampled at
+     'sample_freq'.  It creates one RandomState per output frame (none if the
+     dither is zero), in order, so it consumes the global random number
+     generator exactly as ComputeFeatures() would with dither_states == NULL.
+  */
+  void InitDitherStates(int64 num_samples,
+                        BaseFloat sample_freq,
+                        std::vector<RandomState> *dither_states) const;
 
   int32 Dim() const { return computer_.Dim(); }
 
@@ -22,6 +22,7 @@
 
 #include "feat/feature-fbank.h"
 #include "base/kaldi-math.h"
+#include "base/timer.h"
 #include "matrix/kaldi-matrix-inl.h"
 #include "feat/wave-reader.h"
 
@@ -443,9 +444,86 @@ static void UnitTestHTKCompare4() {
 
 
 
+// Checks that the batched computation in Fbank::Compute() gives the same
+// result as computing the features one frame at a time.
+static void UnitTestBatchCompute() {
+  std::cout << "=== UnitTestBatchCompute() ===\n";
+  FbankOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.round_to_power_of_two = (RandInt(0, 3) != 0);
+  op.use_energy = (RandInt(0, 1) == 0);
+  op.raw_energy = (RandInt(0, 1) == 0);
+  op.htk_compat = (RandInt(0, 1) == 0);
+  op.energy_floor = (RandInt(0, 1) == 0 ? 0.0 : 1.0);
+  op.use_log_fbank = (RandInt(0, 3) != 0);
+  op.use_power = (RandInt(0, 1) == 0);
+
+  Vector<BaseFloat> v(RandInt(400, 30000));
+  v.SetRandn();
+  v.Scale(1000.0);
+  BaseFloat vtln_warp = (RandInt(0, 1) == 0 ? 1.0 : 0.9);
+
+  Fbank fbank(op);
+  Matrix<BaseFloat> m1;
+  fbank.Compute(v, vtln_warp, &m1);
+
+  FbankComputer computer(op);
+  FeatureWindowFunction window_function(op.frame_opts);
+  Matrix<BaseFloat> m2(NumFrames(v.Dim(), op.frame_opts), computer.Dim());
+  Vector<BaseFloat> window;
+  for (int32 r = 0; r < m2.NumRows(); r++) {
+    BaseFloat raw_log_energy = 0.0;
+    ExtractWindow(0, v, r, op.frame_opts, window_function, &window,
+                  &raw_log_energy);
+    SubVector<BaseFloat> feature(m2, r);
+    computer.Compute(raw_log_energy, vtln_warp, &window, &feature);
+  }
+  AssertEqual(m1, m2, 1.0e-04);
+  std::cout << "Test passed :)\n\n";
+}
+
+// Compares the speed of the batch version of MelBanks::Compute() with that of
+// the one-frame version, and checks that they agree.
+static void UnitTestMelBanksSpeed() {
+  std::cout << "=== UnitTestMelBanksSpeed() ===\n";
+  FrameExtractionOptions frame_opts;
+  MelBanksOptions mel_opts(RandInt(0, 1) == 0 ? 23 : 80);
+  MelBanks mel_banks(mel_opts, frame_opts, 1.0);
+  int32 num_frames = 1000,
+      num_fft_bins = frame_opts.PaddedWindowSize() / 2 + 1;
+  Matrix<BaseFloat> power_spectra(num_frames, num_fft_bins);
+  power_spectra.SetRandn();
+  power_spectra.ApplyPowAbs(2.0);
+
+  int32 num_iters = 10;
+  Matrix<BaseFloat> m1(num_frames, mel_opts.num_bins),
+      m2(num_frames, mel_opts.num_bins);
+  Timer timer;
+  for (int32 i = 0; i < num_iters; i++)
+    mel_banks.Compute(power_spectra, &m1);
+  double batch_time = timer.Elapsed();
+  timer.Reset();
+  for (int32 i = 0; i < num_iters; i++) {
+    for (int32 r = 0; r < num_frames; r++) {
+      SubVector<BaseFloat> mel_energies(m2, r);
+      mel_banks.Compute(power_spectra.Row(r), &mel_energies);
+    }
+  }
+  double frame_time = timer.Elapsed();
+  AssertEqual(m1, m2, 1.0e-04);
+  std::cout << "With " << mel_opts.num_bins << " mel bins, time per frame is "
+            << (1.0e+06 * batch_time / (num_iters * num_frames))
+            << " us in batch and "
+            << (1.0e+06 * frame_time / (num_iters * num_frames))
+            << " us one frame at a time.\n";
+  std::cout << "Test passed :)\n\n";
+}
+
 static void UnitTestFeat() {
   UnitTestReadWave();
   UnitTestSimple();
+  UnitTestBatchCompute();
+  UnitTestMelBanksSpeed();
   UnitTestHTKCompare1();
   UnitTestHTKCompare2();
   UnitTestHTKCompare3();
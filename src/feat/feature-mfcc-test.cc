@@ -653,10 +653,84 @@ void UnitTestVtln() {
   }
 }
 
+// Checks that the batched computation in Mfcc::Compute() gives the same
+// result as computing the features one frame at a time.
+static void UnitTestBatchCompute() {
+  std::cout << "=== UnitTestBatchCompute() ===\n";
+  MfccOptions op;
+  op.frame_opts.dither = 0.0;
+  op.frame_opts.round_to_power_of_two = (RandInt(0, 3) != 0);
+  op.use_energy = (RandInt(0, 1) == 0);
+  op.raw_energy = (RandInt(0, 1) == 0);
+  op.htk_compat = (RandInt(0, 1) == 0);
+  op.energy_floor = (RandInt(0, 1) == 0 ? 0.0 : 1.0);
+  op.cepstral_lifter = (RandInt(0, 1) == 0 ? 0.0 : 22.0);
+
+  Vector<BaseFloat> v(RandInt(400, 30000));
+  v.SetRandn();
+  v.Scale(1000.0);
+  BaseFloat vtln_warp = (RandInt(0, 1) == 0 ? 1.0 : 0.9);
+
+  Mfcc mfcc(op);
+  Matrix<BaseFloat> m1;
+  mfcc.Compute(v, vtln_warp, &m1);
+
+  MfccComputer computer(op);
+  FeatureWindowFunction window_function(op.frame_opts);
+  Matrix<BaseFloat> m2(NumFrames(v.Dim(), op.frame_opts), computer.Dim());
+  Vector<BaseFloat> window;
+  for (int32 r = 0; r < m2.NumRows(); r++) {
+    BaseFloat raw_log_energy = 0.0;
+    ExtractWindow(0, v, r, op.frame_opts, window_function, &window,
+                  &raw_log_energy);
+    SubVector<BaseFloat> feature(m2, r);
+    computer.Compute(raw_log_energy, vtln_warp, &window, &feature);
+  }
+  AssertEqual(m1, m2, 1.0e-04);
+  std::cout << "Test passed :)\n\n";
+}
+
+// Checks that the dither states set up by InitDitherStates() give exactly the
+// same output as dithering from the global random number generator, even if
+// the utterances are then processed in a different order.
+static void UnitTestDitherStates() {
+  std::cout << "=== UnitTestDitherStates() ===\n";
+  MfccOptions op;
+  op.frame_opts.dither = 1.0;
+  op.frame_opts.samp_freq = 8000.0;
+  op.frame_opts.allow_downsample = true;
+  Mfcc mfcc(op);
+  // The second utterance has to be downsampled.
+  BaseFloat samp_freq1 = 8000.0, samp_freq2 = 16000.0;
+  Vector<BaseFloat> v1(RandInt(400, 10000)), v2(RandInt(400, 10000));
+  v1.SetRandn();
+  v2.SetRandn();
+
+  int32 seed = RandInt(0, 10000);
+  srand(seed);
+  Matrix<BaseFloat> m1, m2;
+  mfcc.ComputeFeatures(v1, samp_freq1, 1.0, &m1);
+  mfcc.ComputeFeatures(v2, samp_freq2, 1.0, &m2);
+  int32 next_rand = Rand();
+
+  srand(seed);
+  std::vector<RandomState> states1, states2;
+  mfcc.InitDitherStates(v1.Dim(), samp_freq1, &states1);
+  mfcc.InitDitherStates(v2.Dim(), samp_freq2, &states2);
+  KALDI_ASSERT(Rand() == next_rand);
+  Matrix<BaseFloat> m1b, m2b;
+  mfcc.ComputeFeatures(v2, samp_freq2, 1.0, &m2b, &states2);
+  mfcc.ComputeFeatures(v1, samp_freq1, 1.0, &m1b, &states1);
+  KALDI_ASSERT(m1.ApproxEqual(m1b, 0.0) && m2.ApproxEqual(m2b, 0.0));
+  std::cout << "Test passed :)\n\n";
+}
+
 static void UnitTestFeat() {
   UnitTestVtln();
   UnitTestReadWave();
   UnitTestSimple();
+  UnitTestBatchCompute();
+  UnitTestDitherStates();
   UnitTestHTKCompare1();
   UnitTestHTKCompare2();
   // commenting out this one as it doesn't compare right now I normalized
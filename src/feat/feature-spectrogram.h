@@ -92,6 +92,14 @@ class SpectrogramComputer {
                VectorBase<BaseFloat> *signal_frame,
                VectorBase<BaseFloat> *feature);
 
+  /// Computes the features for a batch of frames, one per row of
+  /// 'signal_frames'; see ExampleFeatureComputer::Compute() in
+  /// feature-common.h.
+  void Compute(const VectorBase<BaseFloat> &signal_raw_log_energies,
+               BaseFloat vtln_warp,
+               MatrixBase<BaseFloat> *signal_frames,
+               MatrixBase<BaseFloat> *features);
+
   ~SpectrogramComputer();
 
  private:
@@ -87,14 +87,19 @@ int32 NumFrames(int64 num_samples,
 }
 
 
-void Dither(VectorBase<BaseFloat> *waveform, BaseFloat dither_value) {
+void Dither(VectorBase<BaseFloat> *waveform, BaseFloat dither_value,
+            RandomState *rand_state) {
   if (dither_value == 0.0)
     return;
+  if (rand_state == NULL) {
+    RandomState rstate;
+    Dither(waveform, dither_value, &rstate);
+    return;
+  }
   int32 dim = waveform->Dim();
   BaseFloat *data = waveform->Data();
-  RandomState rstate;
   for (int32 i = 0; i < dim; i++)
-    data[i] += RandGauss(&rstate) * dither_value;
+    data[i] += RandGauss(rand_state) * dither_value;
 }
 
 
@@ -133,12 +138,13 @@ FeatureWindowFunction::FeatureWindowFunction(const FrameExtractionOptions &opts)
 void ProcessWindow(const FrameExtractionOptions &opts,
                    const FeatureWindowFunction &window_function,
                    VectorBase<BaseFloat> *window,
-                   BaseFloat *log_energy_pre_window) {
+                   BaseFloat *log_energy_pre_window,
+                   RandomState *dither_state) {
   int32 frame_length = opts.WindowSize();
   KALDI_ASSERT(window->Dim() == frame_length);
 
   if (opts.dither != 0.0)
-    Dither(window, opts.dither);
+    Dither(window, opts.dither, dither_state);
 
   if (opts.remove_dc_offset)
     window->Add(-window->Sum() / frame_length);
@@ -165,7 +171,8 @@ void ExtractWindow(int64 sample_offset,
                    const FrameExtractionOptions &opts,
                    const FeatureWindowFunction &window_function,
                    Vector<BaseFloat> *window,
-                   BaseFloat *log_energy_pre_window) {
+                   BaseFloat *log_energy_pre_window,
+                   RandomState *dither_state) {
   KALDI_ASSERT(sample_offset >= 0 && wave.Dim() != 0);
   int32 frame_length = opts.WindowSize(),
       frame_length_padded = opts.PaddedWindowSize();
@@ -216,7 +223,8 @@ void ExtractWindow(int64 sample_offset,
 
   SubVector<BaseFloat> frame(*window, 0, frame_length);
 
-  ProcessWindow(opts, window_function, &frame, log_energy_pre_window);
+  ProcessWindow(opts, window_function, &frame, log_energy_pre_window,
+                dither_state);
 }
 
 void ExtractWaveformRemainder(const VectorBase<BaseFloat> &wave,
@@ -142,7 +142,11 @@ int64 FirstSampleOfFrame(int32 frame,
 
 
 
-void Dither(VectorBase<BaseFloat> *waveform, BaseFloat dither_value);
+/// Adds Gaussian noise with standard deviation 'dither_value' to the waveform.
+/// The noise is drawn from 'rand_state' if it is non-NULL, and otherwise from
+/// a RandomState initialized from the global random number generator.
+void Dither(VectorBase<BaseFloat> *waveform, BaseFloat dither_value,
+            RandomState *rand_state = NULL);
 
 void Preemphasize(VectorBase<BaseFloat> *waveform, BaseFloat preemph_coeff);
 
@@ -162,11 +166,14 @@ void Preemphasize(VectorBase<BaseFloat> *waveform, BaseFloat preemph_coeff);
    @param [out]   log_energy_pre_window If non-NULL, then after dithering and
       DC offset removal, this function will write to this pointer the log of
       the total energy (i.e. sum-squared) of the frame.
+   @param [in,out] dither_state  If non-NULL, the random numbers for the
+      dithering are drawn from here; see Dither().
  */
 void ProcessWindow(const FrameExtractionOptions &opts,
                    const FeatureWindowFunction &window_function,
                    VectorBase<BaseFloat> *window,
-                   BaseFloat *log_energy_pre_window = NULL);
+                   BaseFloat *log_energy_pre_window = NULL,
+                   RandomState *dither_state = NULL);
 
 
 /*
@@ -199,7 +206,8 @@ void ExtractWindow(int64 sample_offset,
                    const FrameExtractionOptions &opts,
                    const FeatureWindowFunction &window_function,
                    Vector<BaseFloat> *window,
-                   BaseFloat *log_energy_pre_window = NULL);
+                   BaseFloat *log_energy_pre_window = NULL,
+                   RandomState *dither_state = NULL);
 
 
 // ExtractWaveformRemainder is useful if the waveform is coming in segments.
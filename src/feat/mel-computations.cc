@@ -133,6 +133,24 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
       bins_[bin].second(0) = 0.0;
 
   }
+
+  for (int32 block_start = 0; block_start < num_bins;
+       block_start += kBinsPerBlock) {
+    int32 block_end = std::min(num_bins, block_start + kBinsPerBlock),
+        offset = bins_[block_start].first, end = 0;
+    for (int32 bin = block_start; bin < block_end; bin++) {
+      offset = std::min(offset, bins_[bin].first);
+      end = std::max(end, bins_[bin].first + bins_[bin].second.Dim());
+    }
+    band_blocks_.push_back(std::make_pair(offset, Matrix<BaseFloat>()));
+    Matrix<BaseFloat> &weights = band_blocks_.back().second;
+    weights.Resize(block_end - block_start, end - offset);
+    for (int32 bin = block_start; bin < block_end; bin++)
+      weights.Row(bin - block_start).Range(
+          bins_[bin].first - offset,
+          bins_[bin].second.Dim()).CopyFromVec(bins_[bin].second);
+  }
+
   if (debug_) {
     for (size_t i = 0; i < bins_.size(); i++) {
       KALDI_LOG << "bin " << i << ", offset = " << bins_[i].first
@@ -144,6 +162,7 @@ MelBanks::MelBanks(const MelBanksOptions &opts,
 MelBanks::MelBanks(const MelBanks &other):
     center_freqs_(other.center_freqs_),
     bins_(other.bins_),
+    band_blocks_(other.band_blocks_),
     debug_(other.debug_),
     htk_mode_(other.htk_mode_) { }
 
@@ -250,6 +269,40 @@ void MelBanks::Compute(const VectorBase<BaseFloat> &power_spectrum,
   }
 }
 
+void MelBanks::Compute(const MatrixBase<BaseFloat> &power_spectra,
+                       MatrixBase<BaseFloat> *mel_energies_out) const {
+  int32 num_frames = power_spectra.NumRows(),
+      num_bins = bins_.size();
+  KALDI_ASSERT(mel_energies_out->NumRows() == num_frames &&
+               mel_energies_out->NumCols() == num_bins);
+
+  mel_energies_out->SetZero();  // in case there were NaNs.
+  for (size_t b = 0; b < band_blocks_.size(); b++) {
+    int32 offset = band_blocks_[b].first;
+    const Matrix<BaseFloat> &weights = band_blocks_[b].second;
+    SubMatrix<BaseFloat> power_part(power_spectra, 0, num_frames,
+                                    offset, weights.NumCols()),
+        mel_part(*mel_energies_out, 0, num_frames, b * kBinsPerBlock,
+                 weights.NumRows());
+    mel_part.AddMatMat(1.0, power_part, kNoTrans, weights, kTrans, 0.0);
+  }
+  // HTK-like flooring- for testing purposes (we prefer dither)
+  if (htk_mode_)
+    mel_energies_out->ApplyFloor(1.0);
+
+  // See the comment in the vector version of Compute().
+  KALDI_ASSERT(!KALDI_ISNAN(mel_energies_out->Sum()));
+
+  if (debug_) {
+    fprintf(stderr, "MEL BANKS:\n");
+    for (int32 r = 0; r < num_frames; r++) {
+      for (int32 i = 0; i < num_bins; i++)
+        fprintf(stderr, " %f", (*mel_energies_out)(r, i));
+      fprintf(stderr, "\n");
+    }
+  }
+}
+
 void ComputeLifterCoeffs(BaseFloat Q, VectorBase<BaseFloat> *coeffs) {
   // Compute liftering coefficients (scaling on cepstral coeffs)
   // coeffs are numbered slightly differently from HTK: the zeroth
@@ -111,6 +111,13 @@ class MelBanks {
   void Compute(const VectorBase<BaseFloat> &fft_energies,
                VectorBase<BaseFloat> *mel_energies_out) const;
 
+  /// This version of Compute() does the computation for a batch of frames at
+  /// once (one per row), as a few matrix multiplications (see band_blocks_);
+  /// the results are the same as those of the vector version up to rounding
+  /// error.
+  void Compute(const MatrixBase<BaseFloat> &fft_energies,
+               MatrixBase<BaseFloat> *mel_energies_out) const;
+
   int32 NumBins() const { return bins_.size(); }
 
   // returns vector of central freq of each bin; needed by plp code.
@@ -130,6 +137,17 @@ class MelBanks {
   // (the first nonzero fft-bin), (the vector of weights).
   std::vector<std::pair<int32, Vector<BaseFloat> > > bins_;
 
+  // The same weights as bins_, for the batch version of Compute(), as dense
+  // matrices for blocks of kBinsPerBlock consecutive mel bins (the last block
+  // may be smaller): band_blocks_[b] is (the first nonzero fft-bin of any of
+  // mel bins b * kBinsPerBlock ...), (the matrix whose rows are the weights of
+  // those mel bins, over all the fft-bins that any of them uses).  Each block
+  // is a matrix multiplication; with blocks, rather than one matrix for all the
+  // bins, we don't spend much time multiplying by zeros, as each bin only uses
+  // a narrow range of fft-bins.
+  static const int32 kBinsPerBlock = 16;
+  std::vector<std::pair<int32, Matrix<BaseFloat> > > band_blocks_;
+
   bool debug_;
   bool htk_mode_;
 };
@@ -324,6 +324,47 @@ static void UnitTestSearch() {
   KALDI_LOG << "Test passed :)\n";
 }
 
+// Checks that --nccf-use-fft gives the same output as the direct computation
+// of the NCCF, and compares their speed.  The larger range of lags (small
+// min-f0, higher resample-frequency) is where the FFT is expected to help.
+static void UnitTestNccfUseFft() {
+  KALDI_LOG << "=== UnitTestNccfUseFft() ===\n";
+  Vector<BaseFloat> v(16000);
+  double cur_freq = 200.0, normalized_time = 0.0;
+  for (int32 i = 0; i < v.Dim(); i++) {
+    v(i) = 1000.0 * (0.1 * RandGauss() + cos(normalized_time * M_2PI));
+    cur_freq += RandGauss();
+    if (cur_freq < 100.0) cur_freq = 100.0;
+    if (cur_freq > 300.0) cur_freq = 300.0;
+    normalized_time += cur_freq / 16000.0;
+  }
+  for (int32 config = 0; config < 2; config++) {
+    PitchExtractionOptions op;
+    if (config == 1) {
+      op.min_f0 = 25;
+      op.resample_freq = 8000;
+      op.lowpass_cutoff = 2000;
+    }
+    Matrix<BaseFloat> m1, m2;
+    int32 num_iters = 5;
+    Timer timer;
+    for (int32 i = 0; i < num_iters; i++)
+      ComputeKaldiPitch(op, v, &m1);
+    double direct_time = timer.Elapsed();
+    op.nccf_use_fft = true;
+    timer.Reset();
+    for (int32 i = 0; i < num_iters; i++)
+      ComputeKaldiPitch(op, v, &m2);
+    double fft_time = timer.Elapsed();
+    KALDI_LOG << "min-f0 = " << op.min_f0 << ", resample-frequency = "
+              << op.resample_freq << ": time per second of speech is "
+              << (direct_time / num_iters) << " seconds (direct), "
+              << (fft_time / num_iters) << " seconds (FFT)";
+    AssertEqual(m1, m2, 1.0e-03);
+  }
+  KALDI_LOG << "Test passed :)\n";
+}
+
 static void UnitTestComputeGPE() {
   KALDI_LOG << "=== UnitTestComputeGPE ===\n";
   int32 wrong_pitch = 0, tot_voiced = 0, tot_unvoiced = 0, num_frames = 0;
@@ -599,6 +640,7 @@ static void UnitTestFeatNoKeele() {
   UnitTestSnipEdges();
   UnitTestDelay();
   UnitTestSearch();
+  UnitTestNccfUseFft();
 }
 
 static void UnitTestFeatWithKeele() {
@@ -121,6 +121,67 @@ void ComputeCorrelation(const VectorBase<BaseFloat> &wave,
   }
 }
 
+/**
+   This function outputs the same quantities as ComputeCorrelation(), but it
+   computes the inner products for all lags at once, as a cross-correlation
+   of the mean-subtracted window with the mean-subtracted signal via the FFT;
+   the energies e2 are obtained from a running sum of squares.  "srfft" must
+   have been initialized with dimension
+   RoundUpToNearestPowerOfTwo(wave.Dim()).  Used if --nccf-use-fft=true.
+ */
+void ComputeCorrelationFft(const VectorBase<BaseFloat> &wave,
+                           int32 first_lag, int32 last_lag,
+                           int32 nccf_window_size,
+                           SplitRadixRealFft<BaseFloat> *srfft,
+                           VectorBase<BaseFloat> *inner_prod,
+                           VectorBase<BaseFloat> *norm_prod) {
+  int32 dim = wave.Dim(), fft_size = RoundUpToNearestPowerOfTwo(dim);
+  KALDI_ASSERT(last_lag + nccf_window_size <= dim && fft_size >= 4);
+  SubVector<BaseFloat> wave_part(wave, 0, nccf_window_size);
+  BaseFloat mean = wave_part.Sum() / nccf_window_size;
+  // "window" is the mean-subtracted first nccf_window_size samples and
+  // "signal" the whole mean-subtracted wave, both zero-padded to fft_size.
+  // Because fft_size >= dim, the circular correlation computed below does not
+  // wrap around for the lags we need.
+  Vector<BaseFloat> window(fft_size), signal(fft_size);
+  SubVector<BaseFloat> signal_part(signal, 0, dim);
+  signal_part.CopyFromVec(wave);
+  signal_part.Add(-mean);
+  window.Range(0, nccf_window_size).CopyFromVec(
+      signal.Range(0, nccf_window_size));
+
+  srfft->Compute(window.Data(), true);
+  srfft->Compute(signal.Data(), true);
+  // Multiply the conjugate of the window's transform into the signal's, in
+  // the packed format of SplitRadixRealFft: the real parts of the DC and
+  // Nyquist bins first, then (real, imag) pairs.
+  BaseFloat *w = window.Data(), *x = signal.Data();
+  x[0] *= w[0];
+  x[1] *= w[1];
+  for (int32 i = 2; i < fft_size; i += 2) {
+    BaseFloat re = w[i] * x[i] + w[i + 1] * x[i + 1],
+        im = w[i] * x[i + 1] - w[i + 1] * x[i];
+    x[i] = re;
+    x[i + 1] = im;
+  }
+  srfft->Compute(x, false);
+
+  // sumsq(i) is the sum of squares of the first i mean-subtracted samples;
+  // accumulate in double as we take differences of it.
+  const BaseFloat *y = wave.Data();
+  std::vector<double> sumsq(dim + 1);
+  sumsq[0] = 0.0;
+  for (int32 i = 0; i < dim; i++)
+    sumsq[i + 1] = sumsq[i] + (y[i] - mean) * (y[i] - mean);
+
+  BaseFloat e1 = sumsq[nccf_window_size], scale = 1.0 / fft_size;
+  for (int32 lag = first_lag; lag <= last_lag; lag++) {
+    BaseFloat e2 = sumsq[lag + nccf_window_size] - sumsq[lag];
+    (*inner_prod)(lag - first_lag) = x[lag] * scale;
+    (*norm_prod)(lag - first_lag) = e1 * e2;
+  }
+}
+
 /**
    Computes the NCCF as a fraction of the numerator term (a dot product between
    two vectors) and a denominator term which equals sqrt(e1*e2 + nccf_ballast)
@@ -658,6 +719,11 @@ class OnlinePitchFeatureImpl {
   // have to use the initializer from the constructor.
   ArbitraryResample *nccf_resampler_;
 
+  // The FFT object used by ComputeCorrelationFft() if opts_.nccf_use_fft ==
+  // true, else NULL.  Its dimension is the full frame length rounded up to a
+  // power of two.
+  SplitRadixRealFft<BaseFloat> *nccf_srfft_;
+
   // The following objects may change during the lifetime of this object.
 
   // This object is used to resample the signal.
@@ -758,6 +824,11 @@ OnlinePitchFeatureImpl::OnlinePitchFeatureImpl(
                                           upsample_cutoff, lags_offset,
                                           opts.upsample_filter_width);
 
+  nccf_srfft_ = NULL;
+  if (opts.nccf_use_fft)
+    nccf_srfft_ = new SplitRadixRealFft<BaseFloat>(
+        RoundUpToNearestPowerOfTwo(opts.NccfWindowSize() + nccf_last_lag_));
+
   // add a PitchInfo object for frame -1 (not a real frame).
   frame_info_.push_back(new PitchFrameInfo(lags_.Dim()));
   // zeroes forward_cost_; this is what we want for the fake frame -1.
@@ -1036,6 +1107,7 @@ void OnlinePitchFeatureImpl::RecomputeBacktraces() {
 
 OnlinePitchFeatureImpl::~OnlinePitchFeatureImpl() {
   delete nccf_resampler_;
+  delete nccf_srfft_;
   delete signal_resampler_;
   for (size_t i = 0; i < frame_info_.size(); i++)
     delete frame_info_[i];
@@ -1136,8 +1208,13 @@ void OnlinePitchFeatureImpl::AcceptWaveform(
     double mean_square = cur_sumsq / cur_num_samp -
         pow(cur_sum / cur_num_samp, 2.0);
 
-    ComputeCorrelation(window, nccf_first_lag_, nccf_last_lag_,
-                       basic_frame_length, &inner_prod, &norm_prod);
+    if (nccf_srfft_ != NULL)
+      ComputeCorrelationFft(window, nccf_first_lag_, nccf_last_lag_,
+                            basic_frame_length, nccf_srfft_,
+                            &inner_prod, &norm_prod);
+    else
+      ComputeCorrelation(window, nccf_first_lag_, nccf_last_lag_,
+                         basic_frame_length, &inner_prod, &norm_prod);
     double nccf_ballast_pov = 0.0,
         nccf_ballast_pitch = pow(mean_square * basic_frame_length, 2) *
              opts_.nccf_ballast,
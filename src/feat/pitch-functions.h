@@ -110,6 +110,14 @@ struct PitchExtractionOptions {
   // chunking, which is useful for testing purposes.
   bool nccf_ballast_online;
   bool snip_edges;
+
+  // If true, the dot-products needed for the NCCF are computed for all lags
+  // at once as a cross-correlation via the FFT, instead of one lag at a time.
+  // The result is the same up to floating-point roundoff.  This is slower for
+  // the default configuration (where there are only about 80 lags), but it
+  // scales better with the number of lags, e.g. for small --min-f0 or large
+  // --resample-frequency.
+  bool nccf_use_fft;
   PitchExtractionOptions():
       samp_freq(16000),
       frame_shift_ms(10.0),
@@ -130,7 +138,8 @@ struct PitchExtractionOptions {
       simulate_first_pass_online(false),
       recompute_frame(500),
       nccf_ballast_online(false),
-      snip_edges(true) { }
+      snip_edges(true),
+      nccf_use_fft(false) { }
 
   void Register(OptionsItf *opts) {
     opts->Register("sample-frequency", &samp_freq,
@@ -195,6 +204,10 @@ struct PitchExtractionOptions {
                    "so that the number of frames is the file size divided by "
                    "the frame-shift. This makes different types of features "
                    "give the same number of frames.");
+    opts->Register("nccf-use-fft", &nccf_use_fft, "If true, compute the "
+                   "correlations needed for the NCCF via the FFT rather than "
+                   "directly; this is faster only if the number of lags is "
+                   "large (e.g. small --min-f0 or large --resample-frequency)");
   }
   /// Returns the window-size in samples, after resampling.  This is the
   /// "basic window size", not the full window size after extending by max-lag.
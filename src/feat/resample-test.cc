@@ -141,6 +141,19 @@ void UnitTestArbitraryResample() {
       KALDI_VLOG(1) << "[not checking since out of bounds]";
     }
   }
+
+  // the matrix version should give the same as the vector version on each
+  // row.
+  int32 num_rows = 1 + rand() % 5;
+  Matrix<BaseFloat> rand_values(num_rows, num_samp),
+      rand_resampled(num_rows, num_resamp);
+  rand_values.SetRandn();
+  resampler.Resample(rand_values, &rand_resampled);
+  for (int32 r = 0; r < num_rows; r++) {
+    Vector<BaseFloat> row_resampled(num_resamp);
+    resampler.Resample(rand_values.Row(r), &row_resampled);
+    KALDI_ASSERT(row_resampled.ApproxEqual(rand_resampled.Row(r)));
+  }
 }
 
 
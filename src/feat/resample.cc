@@ -286,15 +286,23 @@ void ArbitraryResample::Resample(const MatrixBase<BaseFloat> &input,
                input.NumCols() == num_samples_in_ &&
                output->NumCols() == weights_.size());
 
-  Vector<BaseFloat> output_col(output->NumRows());
-  for (int32 i = 0; i < NumSamplesOut(); i++) {
-    SubMatrix<BaseFloat> input_part(input, 0, input.NumRows(),
-                                    first_index_[i],
-                                    weights_[i].Dim());
-    const Vector<BaseFloat> &weight_vec(weights_[i]);
-    output_col.AddMatVec(1.0, input_part,
-                         kNoTrans, weight_vec, 0.0);
-    output->CopyColFromVec(output_col, i);
+  // We go row by row, so that the input and output are accessed
+  // contiguously.  The filters are short (a few samples), so the dot products
+  // are done inline; calling BLAS for each of them would cost more than the
+  // arithmetic.
+  int32 num_rows = input.NumRows(), num_samples_out = NumSamplesOut();
+  for (int32 r = 0; r < num_rows; r++) {
+    const BaseFloat *input_row = input.RowData(r);
+    BaseFloat *output_row = output->RowData(r);
+    for (int32 i = 0; i < num_samples_out; i++) {
+      const BaseFloat *input_part = input_row + first_index_[i],
+          *weights = weights_[i].Data();
+      int32 filter_dim = weights_[i].Dim();
+      BaseFloat sum = 0.0;
+      for (int32 j = 0; j < filter_dim; j++)
+        sum += input_part[j] * weights[j];
+      output_row[i] = sum;
+    }
   }
 }
 
@@ -374,4 +382,14 @@ void DownsampleWaveForm(BaseFloat orig_freq, const VectorBase<BaseFloat> &wave,
                                     lowpass_cutoff, lowpass_filter_width);
   signal_downsampler.Resample(wave, true, new_wave);
 }
+
+int64 DownsampleWaveFormNumSamples(BaseFloat orig_freq, int64 num_samples,
+                                   BaseFloat new_freq) {
+  KALDI_ASSERT(new_freq < orig_freq);
+  BaseFloat lowpass_cutoff = 0.99 * 0.5 * new_freq;
+  int32 lowpass_filter_width = 6;
+  LinearResample signal_downsampler(orig_freq, new_freq,
+                                    lowpass_cutoff, lowpass_filter_width);
+  return signal_downsampler.GetNumOutputSamples(num_samples, true);
+}
 }  // namespace kaldi
@@ -185,7 +185,7 @@ class LinearResample {
   /// Resample(x, y, true) for the last piece.  Call it unnecessarily between
   /// signals will not do any harm.
   void Reset();
- private:
+
   /// This function outputs the number of output samples we will output
   /// for a signal with "input_num_samp" input samples.  If flush == true,
   /// we return the largest n such that
@@ -195,7 +195,7 @@ class LinearResample {
   /// we return the largest n such that (n/samp_rate_out_) is in the interval
   /// [ 0, input_num_samp/samp_rate_in_ - window_width ).
   int64 GetNumOutputSamples(int64 input_num_samp, bool flush) const;
-
+ private:
 
   /// Given an output-sample index, this function outputs to *first_samp_in the
   /// first input-sample index that we have a weight on (may be negative),
@@ -263,6 +263,11 @@ class LinearResample {
 void DownsampleWaveForm(BaseFloat orig_freq, const VectorBase<BaseFloat> &wave,
                         BaseFloat new_freq, Vector<BaseFloat> *new_wave);
 
+/// Returns the dimension of the waveform that DownsampleWaveForm() would output
+/// for an input waveform with 'num_samples' samples.
+int64 DownsampleWaveFormNumSamples(BaseFloat orig_freq, int64 num_samples,
+                                   BaseFloat new_freq);
+
 /// @} End of "addtogroup feat"
 }  // namespace kaldi
 #endif  // KALDI_FEAT_RESAMPLE_H_
@@ -22,7 +22,38 @@
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
 #include "transform/cmvn.h"
+#include "util/table-task-sequencer.h"
+
+namespace kaldi {
+
+// This class applies CMVN to the features of one utterance; it is run by
+// TableTaskSequencer, possibly in a different thread.
+class ApplyCmvnTask {
+ public:
+  ApplyCmvnTask(const Matrix<BaseFloat> &feat,
+                const Matrix<double> &cmvn_stats,
+                bool norm_vars, bool reverse):
+      feat_(feat), cmvn_stats_(cmvn_stats), norm_vars_(norm_vars),
+      reverse_(reverse) { }
+
+  bool operator () (Matrix<BaseFloat> *output) {
+    output->Swap(&feat_);
+    if (reverse_) {
+      ApplyCmvnReverse(cmvn_stats_, norm_vars_, output);
+    } else {
+      ApplyCmvn(cmvn_stats_, norm_vars_, output);
+    }
+    return true;
+  }
 
+ private:
+  Matrix<BaseFloat> feat_;
+  Matrix<double> cmvn_stats_;
+  bool norm_vars_;
+  bool reverse_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -41,6 +72,7 @@ int main(int argc, char *argv[]) {
     bool norm_means = true;
     bool reverse = false;
     std::string skip_dims_str;
+    TaskSequencerConfig sequencer_config;
 
     po.Register("utt2spk", &utt2spk_rspecifier,
                 "rspecifier for utterance to speaker map");
@@ -53,6 +85,7 @@ int main(int argc, char *argv[]) {
     po.Register("reverse", &reverse, "If true, apply CMVN in a reverse sense, "
                 "so as to transform zero-mean, unit-variance input into data "
                 "with the given mean and variance.");
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -96,6 +129,8 @@ int main(int argc, char *argv[]) {
 
     SequentialBaseFloatMatrixReader feat_reader(feat_rspecifier);
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+    TableTaskSequencer<KaldiObjectHolder<Matrix<BaseFloat> >, ApplyCmvnTask>
+        sequencer(sequencer_config, &feat_writer);
 
     if (ClassifyRspecifier(cmvn_rspecifier_or_rxfilename, NULL, NULL)
         != kNoRspecifier) { // reading from a Table: per-speaker or per-utt CMN/CVN.
@@ -106,28 +141,18 @@ int main(int argc, char *argv[]) {
 
       for (; !feat_reader.Done(); feat_reader.Next()) {
         std::string utt = feat_reader.Key();
-        Matrix<BaseFloat> feat(feat_reader.Value());
-        if (norm_means) {
-          if (!cmvn_reader.HasKey(utt)) {
-            KALDI_WARN << "No normalization statistics available for key "
-                       << utt << ", producing no output for this utterance";
-            num_err++;
-            continue;
-          }
-          Matrix<double> cmvn_stats = cmvn_reader.Value(utt);
-          if (!skip_dims.empty())
-            FakeStatsForSomeDims(skip_dims, &cmvn_stats);
-
-          if (reverse) {
-            ApplyCmvnReverse(cmvn_stats, norm_vars, &feat);
-          } else {
-            ApplyCmvn(cmvn_stats, norm_vars, &feat);
-          }
-          feat_writer.Write(utt, feat);
-        } else {
-          feat_writer.Write(utt, feat);
+        if (!cmvn_reader.HasKey(utt)) {
+          KALDI_WARN << "No normalization statistics available for key "
+                     << utt << ", producing no output for this utterance";
+          num_err++;
+          continue;
         }
-        num_done++;
+        Matrix<double> cmvn_stats = cmvn_reader.Value(utt);
+        if (!skip_dims.empty())
+          FakeStatsForSomeDims(skip_dims, &cmvn_stats);
+
+        sequencer.Run(utt, new ApplyCmvnTask(feat_reader.Value(), cmvn_stats,
+                                             norm_vars, reverse));
       }
     } else {
       if (utt2spk_rspecifier != "")
@@ -141,20 +166,13 @@ int main(int argc, char *argv[]) {
       if (!skip_dims.empty())
         FakeStatsForSomeDims(skip_dims, &cmvn_stats);
 
-      for (;!feat_reader.Done(); feat_reader.Next()) {
-        std::string utt = feat_reader.Key();
-        Matrix<BaseFloat> feat(feat_reader.Value());
-        if (norm_means) {
-          if (reverse) {
-            ApplyCmvnReverse(cmvn_stats, norm_vars, &feat);
-          } else {
-            ApplyCmvn(cmvn_stats, norm_vars, &feat);
-          }
-        }
-        feat_writer.Write(utt, feat);
-        num_done++;
-      }
+      for (;!feat_reader.Done(); feat_reader.Next())
+        sequencer.Run(feat_reader.Key(),
+                      new ApplyCmvnTask(feat_reader.Value(), cmvn_stats,
+                                        norm_vars, reverse));
     }
+    sequencer.Wait();
+    num_done = sequencer.NumDone();
     if (norm_vars)
       KALDI_LOG << "Applied cepstral mean and variance normalization to "
                 << num_done << " utterances, errors on " << num_err;
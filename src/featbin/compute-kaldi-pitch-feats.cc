@@ -22,7 +22,36 @@
 #include "util/common-utils.h"
 #include "feat/pitch-functions.h"
 #include "feat/wave-reader.h"
+#include "util/table-task-sequencer.h"
+
+namespace kaldi {
+
+// This class computes the pitch for one utterance; it is run by
+// TableTaskSequencer, possibly in a different thread.
+class PitchTask {
+ public:
+  PitchTask(const PitchExtractionOptions &opts, const std::string &utt,
+            const VectorBase<BaseFloat> &waveform):
+      opts_(opts), utt_(utt), waveform_(waveform) { }
+
+  bool operator () (Matrix<BaseFloat> *features) {
+    try {
+      ComputeKaldiPitch(opts_, waveform_, features);
+    } catch (...) {
+      KALDI_WARN << "Failed to compute pitch for utterance "
+                 << utt_;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  const PitchExtractionOptions &opts_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+};
 
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -40,12 +69,14 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     PitchExtractionOptions pitch_opts;
+    TaskSequencerConfig sequencer_config;
     int32 channel = -1; // Note: this isn't configurable because it's not a very
                         // good idea to control it this way: better to extract the
                         // on the command line (in the .scp file) using sox or
                         // similar.
 
     pitch_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -59,8 +90,10 @@ int main(int argc, char *argv[]) {
 
     SequentialTableReader<WaveHolder> wav_reader(wav_rspecifier);
     BaseFloatMatrixWriter feat_writer(feat_wspecifier);
+    TableTaskSequencer<KaldiObjectHolder<Matrix<BaseFloat> >, PitchTask>
+        sequencer(sequencer_config, &feat_writer);
 
-    int32 num_done = 0, num_err = 0;
+    int32 num_utts = 0;
     for (; !wav_reader.Done(); wav_reader.Next()) {
       std::string utt = wav_reader.Key();
       const WaveData &wave_data = wav_reader.Value();
@@ -92,21 +125,13 @@ int main(int argc, char *argv[]) {
 
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        ComputeKaldiPitch(pitch_opts, waveform, &features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute pitch for utterance "
-                   << utt;
-        num_err++;
-        continue;
-      }
-
-      feat_writer.Write(utt, features);
-      if (num_done % 50 == 0 && num_done != 0)
-        KALDI_VLOG(2) << "Processed " << num_done << " utterances";
-      num_done++;
+      sequencer.Run(utt, new PitchTask(pitch_opts, utt, waveform));
+      if (num_utts % 50 == 0 && num_utts != 0)
+        KALDI_VLOG(2) << "Processed " << num_utts << " utterances";
+      num_utts++;
     }
+    sequencer.Wait();
+    int32 num_done = sequencer.NumDone(), num_err = sequencer.NumFail();
     KALDI_LOG << "Done " << num_done << " utterances, " << num_err
               << " with errors.";
     return (num_done != 0 ? 0 : 1);
@@ -22,6 +22,73 @@
 #include "util/common-utils.h"
 #include "feat/feature-mfcc.h"
 #include "feat/wave-reader.h"
+#include "util/table-task-sequencer.h"
+
+namespace kaldi {
+
+// This class computes the features for one utterance; it is run by
+// TableTaskSequencer, possibly in a different thread.
+class MfccTask {
+ public:
+  MfccTask(const Mfcc &mfcc, const MfccOptions &opts, const std::string &utt,
+           const VectorBase<BaseFloat> &waveform, BaseFloat samp_freq,
+           BaseFloat vtln_warp, bool subtract_mean):
+      mfcc_(mfcc), opts_(opts), utt_(utt), waveform_(waveform),
+      samp_freq_(samp_freq), vtln_warp_(vtln_warp),
+      subtract_mean_(subtract_mean) {
+    // This runs in the main thread, so the random states for the dither are
+    // seeded from the global random number generator in the same order as
+    // without threads, and the output doesn't depend on --num-threads.
+    mfcc.InitDitherStates(waveform.Dim(), samp_freq, &dither_states_);
+  }
+
+  bool operator () (Matrix<BaseFloat> *features) {
+    try {
+      mfcc_.ComputeFeatures(waveform_, samp_freq_, vtln_warp_, features,
+                            &dither_states_);
+    } catch (...) {
+      KALDI_WARN << "Failed to compute features for utterance "
+                 << utt_;
+      return false;
+    }
+    if (subtract_mean_) {
+      Vector<BaseFloat> mean(features->NumCols());
+      mean.AddRowSumMat(1.0, *features);
+      mean.Scale(1.0 / features->NumRows());
+      for (int32 i = 0; i < features->NumRows(); i++)
+        features->Row(i).AddVec(-1.0, mean);
+    }
+    KALDI_VLOG(2) << "Processed features for key " << utt_;
+    return true;
+  }
+
+  bool operator () (std::pair<Matrix<BaseFloat>, HtkHeader> *output) {
+    if (!(*this)(&(output->first)))
+      return false;
+    const Matrix<BaseFloat> &features = output->first;
+    HtkHeader header = {
+      features.NumRows(),
+      100000,  // 10ms shift
+      static_cast<int16>(sizeof(float)*(features.NumCols())),
+      static_cast<uint16>( 006 | // MFCC
+      (opts_.use_energy ? 0100 : 020000)) // energy; otherwise c0
+    };
+    output->second = header;
+    return true;
+  }
+
+ private:
+  const Mfcc &mfcc_;
+  const MfccOptions &opts_;
+  std::string utt_;
+  Vector<BaseFloat> waveform_;
+  BaseFloat samp_freq_;
+  BaseFloat vtln_warp_;
+  bool subtract_mean_;
+  std::vector<RandomState> dither_states_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -33,6 +100,7 @@ int main(int argc, char *argv[]) {
     // construct all the global objects
     ParseOptions po(usage);
     MfccOptions mfcc_opts;
+    TaskSequencerConfig sequencer_config;
     bool subtract_mean = false;
     BaseFloat vtln_warp = 1.0;
     std::string vtln_map_rspecifier;
@@ -44,6 +112,7 @@ int main(int argc, char *argv[]) {
 
     // Register the MFCC option struct
     mfcc_opts.Register(&po);
+    sequencer_config.Register(&po);
 
     // Register the options
     po.Register("output-format", &output_format, "Format of the output "
@@ -95,8 +164,13 @@ int main(int argc, char *argv[]) {
     } else {
       KALDI_ERR << "Invalid output_format string " << output_format;
     }
+    // Only the sequencer for the chosen output format is used.
+    TableTaskSequencer<KaldiObjectHolder<Matrix<BaseFloat> >, MfccTask>
+        kaldi_sequencer(sequencer_config, &kaldi_writer);
+    TableTaskSequencer<HtkMatrixHolder, MfccTask>
+        htk_sequencer(sequencer_config, &htk_writer);
 
-    int32 num_utts = 0, num_success = 0;
+    int32 num_utts = 0;
     for (; !reader.Done(); reader.Next()) {
       num_utts++;
       std::string utt = reader.Key();
@@ -137,42 +211,19 @@ int main(int argc, char *argv[]) {
       }
 
       SubVector<BaseFloat> waveform(wave_data.Data(), this_chan);
-      Matrix<BaseFloat> features;
-      try {
-        mfcc.ComputeFeatures(waveform, wave_data.SampFreq(), vtln_warp_local, &features);
-      } catch (...) {
-        KALDI_WARN << "Failed to compute features for utterance "
-                   << utt;
-        continue;
-      }
-      if (subtract_mean) {
-        Vector<BaseFloat> mean(features.NumCols());
-        mean.AddRowSumMat(1.0, features);
-        mean.Scale(1.0 / features.NumRows());
-        for (int32 i = 0; i < features.NumRows(); i++)
-          features.Row(i).AddVec(-1.0, mean);
-      }
-      if (output_format == "kaldi") {
-        kaldi_writer.Write(utt, features);
-      } else {
-        std::pair<Matrix<BaseFloat>, HtkHeader> p;
-        p.first.Resize(features.NumRows(), features.NumCols());
-        p.first.CopyFromMat(features);
-        HtkHeader header = {
-          features.NumRows(),
-          100000,  // 10ms shift
-          static_cast<int16>(sizeof(float)*(features.NumCols())),
-          static_cast<uint16>( 006 | // MFCC
-          (mfcc_opts.use_energy ? 0100 : 020000)) // energy; otherwise c0
-        };
-        p.second = header;
-        htk_writer.Write(utt, p);
-      }
+      MfccTask *task = new MfccTask(mfcc, mfcc_opts, utt, waveform,
+                                    wave_data.SampFreq(), vtln_warp_local,
+                                    subtract_mean);
+      if (output_format == "kaldi")
+        kaldi_sequencer.Run(utt, task);
+      else
+        htk_sequencer.Run(utt, task);
       if (num_utts % 10 == 0)
         KALDI_LOG << "Processed " << num_utts << " utterances";
-      KALDI_VLOG(2) << "Processed features for key " << utt;
-      num_success++;
     }
+    kaldi_sequencer.Wait();
+    htk_sequencer.Wait();
+    int32 num_success = kaldi_sequencer.NumDone() + htk_sequencer.NumDone();
     KALDI_LOG << " Done " << num_success << " out of " << num_utts
               << " utterances.";
     return (num_success != 0 ? 0 : 1);
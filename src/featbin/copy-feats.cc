@@ -21,7 +21,29 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "matrix/kaldi-matrix.h"
+#include "util/table-task-sequencer.h"
 
+namespace kaldi {
+
+// This class compresses the features of one utterance; it is run by
+// TableTaskSequencer, possibly in a different thread.
+class CompressTask {
+ public:
+  CompressTask(const Matrix<BaseFloat> &feats,
+               CompressionMethod compression_method):
+      feats_(feats), compression_method_(compression_method) { }
+
+  bool operator () (CompressedMatrix *output) {
+    output->CopyFromMat(feats_, compression_method_);
+    return true;
+  }
+
+ private:
+  Matrix<BaseFloat> feats_;
+  CompressionMethod compression_method_;
+};
+
+}  // namespace kaldi
 
 int main(int argc, char *argv[]) {
   try {
@@ -44,6 +66,7 @@ int main(int argc, char *argv[]) {
     bool compress = false;
     int32 compression_method_in = 1;
     std::string num_frames_wspecifier;
+    TaskSequencerConfig sequencer_config;
     po.Register("htk-in", &htk_in, "Read input as HTK features");
     po.Register("sphinx-in", &sphinx_in, "Read input as Sphinx features");
     po.Register("binary", &binary, "Binary-mode output (not relevant if writing "
@@ -60,6 +83,7 @@ int main(int argc, char *argv[]) {
                 "e.g. 'ark,t:utt2num_frames'.  Only applicable if writing tables, "
                 "not when this program is writing individual files.  See also "
                 "feat-to-len.");
+    sequencer_config.Register(&po);  // only affects --compress=true.
 
     po.Read(argc, argv);
 
@@ -108,12 +132,15 @@ int main(int argc, char *argv[]) {
         }
       } else {
         CompressedMatrixWriter kaldi_writer(wspecifier);
+        // The compression is done in parallel if --num-threads > 1.
+        TableTaskSequencer<KaldiObjectHolder<CompressedMatrix>, CompressTask>
+            sequencer(sequencer_config, &kaldi_writer);
         if (htk_in) {
           SequentialTableReader<HtkMatrixHolder> htk_reader(rspecifier);
           for (; !htk_reader.Done(); htk_reader.Next(), num_done++) {
-            kaldi_writer.Write(htk_reader.Key(),
-                               CompressedMatrix(htk_reader.Value().first,
-                                                compression_method));
+            sequencer.Run(htk_reader.Key(),
+                          new CompressTask(htk_reader.Value().first,
+                                           compression_method));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(htk_reader.Key(),
                                       htk_reader.Value().first.NumRows());
@@ -121,9 +148,9 @@ int main(int argc, char *argv[]) {
         } else if (sphinx_in) {
           SequentialTableReader<SphinxMatrixHolder<> > sphinx_reader(rspecifier);
           for (; !sphinx_reader.Done(); sphinx_reader.Next(), num_done++) {
-            kaldi_writer.Write(sphinx_reader.Key(),
-                               CompressedMatrix(sphinx_reader.Value(),
-                                                compression_method));
+            sequencer.Run(sphinx_reader.Key(),
+                          new CompressTask(sphinx_reader.Value(),
+                                           compression_method));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(sphinx_reader.Key(),
                                       sphinx_reader.Value().NumRows());
@@ -131,9 +158,9 @@ int main(int argc, char *argv[]) {
         } else {
           SequentialBaseFloatMatrixReader kaldi_reader(rspecifier);
           for (; !kaldi_reader.Done(); kaldi_reader.Next(), num_done++) {
-            kaldi_writer.Write(kaldi_reader.Key(),
-                               CompressedMatrix(kaldi_reader.Value(),
-                                                compression_method));
+            sequencer.Run(kaldi_reader.Key(),
+                          new CompressTask(kaldi_reader.Value(),
+                                           compression_method));
             if (!num_frames_wspecifier.empty())
               num_frames_writer.Write(kaldi_reader.Key(),
                                       kaldi_reader.Value().NumRows());
@@ -0,0 +1,106 @@
+// gmm/am-diag-gmm-gselect-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+
+#include "gmm/model-test-common.h"
+#include "gmm/am-diag-gmm-gselect.h"
+#include "gmm/decodable-am-diag-gmm.h"
+
+namespace kaldi {
+
+void UnitTestAmDiagGmmGselect() {
+  int32 dim = 1 + RandInt(0, 9),
+      num_pdfs = 5 + RandInt(0, 9),
+      num_ubm = 1 + RandInt(0, 19),
+      num_frames = 1 + RandInt(0, 19);
+
+  AmDiagGmm am_gmm;
+  for (int32 i = 0; i < num_pdfs; i++) {
+    DiagGmm gmm;
+    unittest::InitRandDiagGmm(dim, 1 + RandInt(0, 9), &gmm);
+    am_gmm.AddPdf(gmm);
+  }
+  DiagGmm ubm;
+  unittest::InitRandDiagGmm(dim, num_ubm, &ubm);
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+
+  AmDiagGmmGselectConfig config;
+  config.num_gselect = 1 + RandInt(0, 3);
+  config.num_ubm_per_gauss = RandInt(0, 3);
+  AmDiagGmmGselect gselect(config, am_gmm, ubm);
+
+  // If all UBM Gaussians are selected, all the Gaussians are used and the
+  // likelihoods are exact.
+  AmDiagGmmGselectConfig full_config;
+  full_config.num_gselect = num_ubm;
+  full_config.num_ubm_per_gauss = 1;
+  AmDiagGmmGselect full_gselect(full_config, am_gmm, ubm);
+
+  DecodableAmDiagGmmUnmapped decodable(am_gmm, feats),
+      gselect_decodable(am_gmm, feats, -1.0, &gselect),
+      full_gselect_decodable(am_gmm, feats, -1.0, &full_gselect);
+
+  for (int32 t = 0; t < num_frames; t++) {
+    Vector<BaseFloat> data_ext, ubm_loglikes;
+    AmDiagGmmGselect::ExtendData(feats.Row(t), &data_ext);
+    std::vector<int32> ubm_gselect, gauss;
+    gselect.SelectUbmGaussians(data_ext, &ubm_loglikes, &ubm_gselect);
+    for (int32 u = 0; u < num_ubm; u++)
+      AssertEqual(ubm_loglikes(u), ubm.ComponentLogLikelihood(feats.Row(t), u));
+    KALDI_ASSERT(static_cast<int32>(ubm_gselect.size()) ==
+                 std::min(num_ubm, config.num_gselect));
+    for (size_t i = 0; i < ubm_gselect.size(); i++)
+      for (int32 u = 0; u < num_ubm; u++)
+        if (std::find(ubm_gselect.begin(), ubm_gselect.end(), u) ==
+            ubm_gselect.end())
+          KALDI_ASSERT(ubm_loglikes(u) <= ubm_loglikes(ubm_gselect[i]));
+
+    for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+      BaseFloat loglike = am_gmm.LogLikelihood(pdf, feats.Row(t));
+      gselect.GetPdfGaussians(ubm_gselect, pdf, &gauss);
+      KALDI_ASSERT(!gauss.empty() && IsSortedAndUniq(gauss) &&
+                   gauss.back() < am_gmm.NumGaussInPdf(pdf));
+      // Query in a random order, as a decoder would.
+      int32 state = RandInt(1, num_pdfs);
+      AssertEqual(decodable.LogLikelihood(t, state),
+                  am_gmm.LogLikelihood(state - 1, feats.Row(t)));
+      AssertEqual(full_gselect_decodable.LogLikelihood(t, pdf + 1), loglike);
+      KALDI_ASSERT(gselect_decodable.LogLikelihood(t, pdf + 1) <=
+                   loglike + 1.0e-03);
+      // The AVX and the scalar code give the same answer.
+      Vector<BaseFloat> gauss_loglikes;
+      BaseFloat gselect_loglike = gselect.LogLikelihood(
+          data_ext, ubm_gselect, pdf, -1.0, &gauss, &gauss_loglikes);
+      bool simd = SetAmDiagGmmGselectSimd(!AmDiagGmmGselectUsesSimd());
+      AssertEqual(gselect.LogLikelihood(data_ext, ubm_gselect, pdf, -1.0,
+                                        &gauss, &gauss_loglikes),
+                  gselect_loglike);
+      SetAmDiagGmmGselectSimd(simd);
+    }
+  }
+}
+
+}  // namespace kaldi
+
+int main() {
+  for (int32 i = 0; i < 10; i++)
+    kaldi::UnitTestAmDiagGmmGselect();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,342 @@
+// gmm/am-diag-gmm-gselect.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "gmm/am-diag-gmm-gselect.h"
+
+// As in chain/chain-denominator-cpu.cc, we use a function-level target
+// attribute so no special compiler flags are needed, and choose the code at
+// run time.  The vector code is only for single precision.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)) && \
+    KALDI_DOUBLEPRECISION == 0
+#define KALDI_GSELECT_SIMD 1
+#include <immintrin.h>
+#define KALDI_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// -1 means "not yet decided", otherwise 0 or 1.
+std::atomic<int> gselect_simd(-1);
+
+bool GselectSimdSupported() {
+#ifdef KALDI_GSELECT_SIMD
+  __builtin_cpu_init();
+  static const bool ans = __builtin_cpu_supports("avx");
+  return ans;
+#else
+  return false;
+#endif
+}
+
+#ifdef KALDI_GSELECT_SIMD
+
+KALDI_TARGET_AVX inline float HorizontalSum(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                        _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+// Sets loglikes[i] to the dot product of row rows[i] of "params" (which has
+// "dim" columns and the given stride) with "data", for 0 <= i < num_rows.
+// The rows are done four at a time, so that each load of "data" is used four
+// times.
+KALDI_TARGET_AVX
+void DotProductsAvx(const float *params, int32 stride, int32 dim,
+                    const int32 *rows, int32 num_rows, const float *data,
+                    float *loglikes) {
+  int32 dim8 = dim - dim % 8, i = 0;
+  for (; i + 4 <= num_rows; i += 4) {
+    const float *p0 = params + static_cast<size_t>(rows[i]) * stride,
+        *p1 = params + static_cast<size_t>(rows[i + 1]) * stride,
+        *p2 = params + static_cast<size_t>(rows[i + 2]) * stride,
+        *p3 = params + static_cast<size_t>(rows[i + 3]) * stride;
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps(),
+        sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+    for (int32 d = 0; d < dim8; d += 8) {
+      __m256 x = _mm256_loadu_ps(data + d);
+      sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(p0 + d), x));
+      sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(p1 + d), x));
+      sum2 = _mm256_add_ps(sum2, _mm256_mul_ps(_mm256_loadu_ps(p2 + d), x));
+      sum3 = _mm256_add_ps(sum3, _mm256_mul_ps(_mm256_loadu_ps(p3 + d), x));
+    }
+    float s0 = HorizontalSum(sum0), s1 = HorizontalSum(sum1),
+        s2 = HorizontalSum(sum2), s3 = HorizontalSum(sum3);
+    for (int32 d = dim8; d < dim; d++) {
+      s0 += p0[d] * data[d];
+      s1 += p1[d] * data[d];
+      s2 += p2[d] * data[d];
+      s3 += p3[d] * data[d];
+    }
+    loglikes[i] = s0;
+    loglikes[i + 1] = s1;
+    loglikes[i + 2] = s2;
+    loglikes[i + 3] = s3;
+  }
+  for (; i < num_rows; i++) {
+    const float *p = params + static_cast<size_t>(rows[i]) * stride;
+    __m256 sum = _mm256_setzero_ps();
+    for (int32 d = 0; d < dim8; d += 8)
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(p + d),
+                                             _mm256_loadu_ps(data + d)));
+    float s = HorizontalSum(sum);
+    for (int32 d = dim8; d < dim; d++)
+      s += p[d] * data[d];
+    loglikes[i] = s;
+  }
+  // The compiler only inserts this itself when optimizing (-O2); without it,
+  // the SSE code that follows runs much slower on some CPUs.
+  _mm256_zeroupper();
+}
+
+#endif  // KALDI_GSELECT_SIMD
+
+}  // namespace
+
+bool AmDiagGmmGselectUsesSimd() {
+  int ans = gselect_simd.load(std::memory_order_relaxed);
+  if (ans < 0) {
+    ans = (GselectSimdSupported() ? 1 : 0);
+    gselect_simd.store(ans, std::memory_order_relaxed);
+  }
+  return (ans != 0);
+}
+
+bool SetAmDiagGmmGselectSimd(bool enable) {
+  bool ans = AmDiagGmmGselectUsesSimd();
+  gselect_simd.store((enable && GselectSimdSupported()) ? 1 : 0,
+                     std::memory_order_relaxed);
+  return ans;
+}
+
+void AmDiagGmmGselect::GetParams(const DiagGmm &gmm,
+                                 MatrixBase<BaseFloat> *params) {
+  int32 dim = gmm.Dim();
+  KALDI_ASSERT(params->NumRows() == gmm.NumGauss() &&
+               params->NumCols() == 2 * dim + 1);
+  params->ColRange(0, dim).CopyFromMat(gmm.means_invvars());
+  params->ColRange(dim, dim).CopyFromMat(gmm.inv_vars());
+  params->ColRange(dim, dim).Scale(-0.5);
+  params->CopyColFromVec(gmm.gconsts(), 2 * dim);
+}
+
+void AmDiagGmmGselect::ExtendData(const VectorBase<BaseFloat> &data,
+                                  Vector<BaseFloat> *data_ext) {
+  int32 dim = data.Dim();
+  data_ext->Resize(2 * dim + 1, kUndefined);
+  SubVector<BaseFloat> data_sq(*data_ext, dim, dim);
+  data_ext->Range(0, dim).CopyFromVec(data);
+  data_sq.CopyFromVec(data);
+  data_sq.ApplyPow(2.0);
+  (*data_ext)(2 * dim) = 1.0;
+}
+
+AmDiagGmmGselect::AmDiagGmmGselect(const AmDiagGmmGselectConfig &config,
+                                   const AmDiagGmm &am,
+                                   const DiagGmm &ubm_in):
+    config_(config), am_(am) {
+  int32 num_pdfs = am.NumPdfs(), num_ubm = ubm_in.NumGauss(), dim = am.Dim();
+  if (ubm_in.Dim() != dim)
+    KALDI_ERR << "Dimension mismatch: UBM dim = " << ubm_in.Dim()
+              << " vs. model dim = " << dim;
+  if (num_ubm == 0 || config_.num_gselect <= 0 ||
+      config_.num_ubm_per_gauss < 0)
+    KALDI_ERR << "Invalid options or empty UBM for Gaussian selection.";
+  if (config_.num_gselect > num_ubm)
+    config_.num_gselect = num_ubm;
+  DiagGmm ubm(ubm_in);
+  ubm.ComputeGconsts();
+  ubm_params_.Resize(num_ubm, 2 * dim + 1, kUndefined);
+  GetParams(ubm, &ubm_params_);
+
+  pdf_offsets_.resize(num_pdfs + 1);
+  pdf_offsets_[0] = 0;
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++)
+    pdf_offsets_[pdf + 1] = pdf_offsets_[pdf] + am.NumGaussInPdf(pdf);
+  params_.Resize(pdf_offsets_[num_pdfs], 2 * dim + 1, kUndefined);
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+    SubMatrix<BaseFloat> params(params_.RowRange(pdf_offsets_[pdf],
+                                                 am.NumGaussInPdf(pdf)));
+    GetParams(am.GetPdf(pdf), &params);
+  }
+
+  Matrix<BaseFloat> ubm_means;
+  ubm.GetMeans(&ubm_means);
+
+  // Pairs (u * num_pdfs + pdf, gauss) for the Gaussians on the shortlists.
+  std::vector<std::pair<int64, int32> > pairs;
+  Matrix<BaseFloat> means, loglikes;
+  std::vector<std::pair<BaseFloat, int32> > scores(num_ubm);
+  int32 num_ubm_per_gauss = std::min(config_.num_ubm_per_gauss, num_ubm);
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+    const DiagGmm &gmm = am.GetPdf(pdf);
+    // Put each Gaussian on the shortlists of the UBM Gaussians under which
+    // its mean is most likely.
+    if (num_ubm_per_gauss > 0) {
+      gmm.GetMeans(&means);
+      ubm.LogLikelihoods(means, &loglikes);
+      for (int32 g = 0; g < gmm.NumGauss(); g++) {
+        for (int32 u = 0; u < num_ubm; u++)
+          scores[u] = std::make_pair(loglikes(g, u), u);
+        std::nth_element(scores.begin(),
+                         scores.begin() + num_ubm_per_gauss - 1,
+                         scores.end(),
+                         std::greater<std::pair<BaseFloat, int32> >());
+        for (int32 i = 0; i < num_ubm_per_gauss; i++)
+          pairs.push_back(std::make_pair(
+              static_cast<int64>(scores[i].second) * num_pdfs + pdf, g));
+      }
+    }
+    // Make sure that each shortlist has at least one Gaussian of each PDF.
+    gmm.LogLikelihoods(ubm_means, &loglikes);
+    for (int32 u = 0; u < num_ubm; u++) {
+      MatrixIndexT best_g;
+      loglikes.Row(u).Max(&best_g);
+      pairs.push_back(std::make_pair(
+          static_cast<int64>(u) * num_pdfs + pdf, static_cast<int32>(best_g)));
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+  offsets_.resize(static_cast<size_t>(num_ubm) * (num_pdfs + 1));
+  gauss_.resize(pairs.size());
+  size_t k = 0;
+  for (int32 u = 0; u < num_ubm; u++) {
+    for (int32 pdf = 0; pdf <= num_pdfs; pdf++) {
+      offsets_[static_cast<size_t>(u) * (num_pdfs + 1) + pdf] = k;
+      int64 key = static_cast<int64>(u) * num_pdfs + pdf;
+      for (; pdf < num_pdfs && k < pairs.size() && pairs[k].first == key; k++)
+        gauss_[k] = pairs[k].second;
+    }
+  }
+  KALDI_ASSERT(k == pairs.size());
+  KALDI_VLOG(1) << "Gaussian selection: average shortlist size is "
+                << (static_cast<BaseFloat>(gauss_.size()) / num_ubm / num_pdfs)
+                << " Gaussians per PDF, vs. " << am.NumGauss() /
+      static_cast<BaseFloat>(num_pdfs) << " in the model.";
+}
+
+void AmDiagGmmGselect::SelectUbmGaussians(
+    const VectorBase<BaseFloat> &data_ext,
+    Vector<BaseFloat> *ubm_loglikes,
+    std::vector<int32> *ubm_gselect) const {
+  int32 num_ubm = ubm_params_.NumRows(), num_gselect = config_.num_gselect;
+  ubm_loglikes->Resize(num_ubm, kUndefined);
+  ubm_loglikes->AddMatVec(1.0, ubm_params_, kNoTrans, data_ext, 0.0);
+  // num_gselect is small, so we just keep the best ones found so far in a
+  // sorted list.
+  std::vector<std::pair<BaseFloat, int32> > best;
+  best.reserve(num_gselect + 1);
+  const BaseFloat *loglikes = ubm_loglikes->Data();
+  for (int32 u = 0; u < num_ubm; u++) {
+    if (static_cast<int32>(best.size()) == num_gselect &&
+        loglikes[u] <= best.back().first)
+      continue;
+    int32 k = best.size();
+    best.resize(k + 1);
+    for (; k > 0 && best[k - 1].first < loglikes[u]; k--)
+      best[k] = best[k - 1];
+    best[k] = std::make_pair(loglikes[u], u);
+    if (static_cast<int32>(best.size()) > num_gselect)
+      best.pop_back();
+  }
+  ubm_gselect->resize(num_gselect);
+  for (int32 i = 0; i < num_gselect; i++)
+    (*ubm_gselect)[i] = best[i].second;
+  std::sort(ubm_gselect->begin(), ubm_gselect->end());
+}
+
+void AmDiagGmmGselect::GetPdfGaussians(const std::vector<int32> &ubm_gselect,
+                                       int32 pdf,
+                                       std::vector<int32> *gauss) const {
+  size_t stride = am_.NumPdfs() + 1;
+  int32 num_gselect = ubm_gselect.size(), max_num_gauss = 0;
+  for (int32 i = 0; i < num_gselect; i++) {
+    const int32 *offsets = &(offsets_[ubm_gselect[i] * stride + pdf]);
+    max_num_gauss += offsets[1] - offsets[0];
+  }
+  gauss->resize(max_num_gauss);
+  // The shortlists are short, so we merge them by insertion.
+  int32 *g = &((*gauss)[0]), n = 0;
+  for (int32 i = 0; i < num_gselect; i++) {
+    const int32 *offsets = &(offsets_[ubm_gselect[i] * stride + pdf]);
+    for (int32 j = offsets[0]; j < offsets[1]; j++) {
+      int32 this_gauss = gauss_[j], k = n;
+      while (k > 0 && g[k - 1] > this_gauss)
+        k--;
+      if (k > 0 && g[k - 1] == this_gauss)
+        continue;
+      for (int32 m = n; m > k; m--)
+        g[m] = g[m - 1];
+      g[k] = this_gauss;
+      n++;
+    }
+  }
+  gauss->resize(n);
+}
+
+BaseFloat AmDiagGmmGselect::LogLikelihood(
+    const VectorBase<BaseFloat> &data_ext,
+    const std::vector<int32> &ubm_gselect,
+    int32 pdf,
+    BaseFloat log_sum_exp_prune,
+    std::vector<int32> *gauss,
+    Vector<BaseFloat> *loglikes) const {
+  GetPdfGaussians(ubm_gselect, pdf, gauss);
+  int32 num_gauss = gauss->size(), offset = pdf_offsets_[pdf];
+  KALDI_ASSERT(num_gauss > 0);
+  if (loglikes->Dim() < num_gauss)
+    loglikes->Resize(am_.NumGaussInPdf(pdf), kUndefined);
+  SubVector<BaseFloat> this_loglikes(*loglikes, 0, num_gauss);
+#ifdef KALDI_GSELECT_SIMD
+  if (AmDiagGmmGselectUsesSimd()) {
+    DotProductsAvx(params_.RowData(offset), params_.Stride(), params_.NumCols(),
+                   &((*gauss)[0]), num_gauss, data_ext.Data(),
+                   this_loglikes.Data());
+    return this_loglikes.LogSumExp(log_sum_exp_prune);
+  }
+#endif
+  // Without SIMD, each run of consecutive Gaussians needs one matrix-vector
+  // product (or one dot product, for a single Gaussian).
+  for (int32 i = 0; i < num_gauss; ) {
+    int32 j = i + 1;
+    while (j < num_gauss && (*gauss)[j] == (*gauss)[j - 1] + 1)
+      j++;
+    if (j == i + 1) {
+      this_loglikes(i) = VecVec(params_.Row(offset + (*gauss)[i]), data_ext);
+    } else {
+      SubVector<BaseFloat> run_loglikes(this_loglikes, i, j - i);
+      run_loglikes.AddMatVec(1.0, params_.RowRange(offset + (*gauss)[i], j - i),
+                             kNoTrans, data_ext, 0.0);
+    }
+    i = j;
+  }
+  return this_loglikes.LogSumExp(log_sum_exp_prune);
+}
+
+}  // namespace kaldi
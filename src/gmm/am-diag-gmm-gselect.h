@@ -0,0 +1,145 @@
+// gmm/am-diag-gmm-gselect.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_GMM_AM_DIAG_GMM_GSELECT_H_
+#define KALDI_GMM_AM_DIAG_GMM_GSELECT_H_
+
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "gmm/am-diag-gmm.h"
+#include "itf/options-itf.h"
+
+namespace kaldi {
+
+struct AmDiagGmmGselectConfig {
+  /// Number of UBM Gaussians selected for each frame.
+  int32 num_gselect;
+  /// Number of UBM Gaussians each Gaussian of the model is assigned to.
+  int32 num_ubm_per_gauss;
+
+  AmDiagGmmGselectConfig(): num_gselect(2), num_ubm_per_gauss(3) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("gselect-num-gselect", &num_gselect, "Number of UBM "
+                   "Gaussians selected per frame for Gaussian selection "
+                   "(larger is more exact, but slower).");
+    opts->Register("gselect-num-ubm-per-gauss", &num_ubm_per_gauss, "Number "
+                   "of UBM Gaussians to which each Gaussian of the acoustic "
+                   "model is assigned for Gaussian selection (larger is more "
+                   "exact, but slower).");
+  }
+};
+
+/**
+   AmDiagGmmGselect does Gaussian selection for an AmDiagGmm, using a UBM
+   (e.g. obtained from the model with "init-ubm --fullcov-ubm=false").  For
+   each frame we select the num_gselect best-scoring UBM Gaussians, and the
+   likelihood of each PDF is computed only from its Gaussians that are on the
+   shortlists of those UBM Gaussians; the other Gaussians are treated as
+   having zero likelihood.  The shortlists are precomputed from the model:
+   each Gaussian of the model is put on the shortlists of the
+   num_ubm_per_gauss UBM Gaussians under which its mean has the highest
+   likelihood, and in addition, the shortlist of each UBM Gaussian contains,
+   for each PDF, the Gaussian of the PDF under which the UBM Gaussian's mean
+   has the highest likelihood; so the set of Gaussians selected for each PDF
+   is never empty.
+
+   This object is not modified during decoding, so it can be shared between
+   decoders, including those in different threads.  It holds a reference to
+   the model, which must not be changed while it is in use.
+*/
+class AmDiagGmmGselect {
+ public:
+  AmDiagGmmGselect(const AmDiagGmmGselectConfig &config,
+                   const AmDiagGmm &am,
+                   const DiagGmm &ubm);
+
+  const AmDiagGmm &Am() const { return am_; }
+
+  int32 NumGselect() const { return config_.num_gselect; }
+
+  /// Computes the vector [ data, data^2, 1 ] for a frame "data", which is the
+  /// form in which the other functions take the frame.
+  static void ExtendData(const VectorBase<BaseFloat> &data,
+                         Vector<BaseFloat> *data_ext);
+
+  /// Selects the NumGselect() best UBM Gaussians for a frame, given the
+  /// output of ExtendData(); "ubm_loglikes" is a temporary.  The output is
+  /// sorted.
+  void SelectUbmGaussians(const VectorBase<BaseFloat> &data_ext,
+                          Vector<BaseFloat> *ubm_loglikes,
+                          std::vector<int32> *ubm_gselect) const;
+
+  /// Outputs the Gaussians of PDF "pdf" that are on the shortlists of the
+  /// UBM Gaussians in "ubm_gselect" (as output by SelectUbmGaussians()),
+  /// sorted and without duplicates.
+  void GetPdfGaussians(const std::vector<int32> &ubm_gselect,
+                       int32 pdf,
+                       std::vector<int32> *gauss) const;
+
+  /// Returns the log-likelihood of PDF "pdf" for a frame, given the output of
+  /// ExtendData() and the selected UBM Gaussians (as output by
+  /// SelectUbmGaussians()), computed over the selected Gaussians of that PDF;
+  /// "gauss" and "loglikes" are temporaries.  log_sum_exp_prune is as for
+  /// DecodableAmDiagGmmUnmapped.
+  BaseFloat LogLikelihood(const VectorBase<BaseFloat> &data_ext,
+                          const std::vector<int32> &ubm_gselect,
+                          int32 pdf,
+                          BaseFloat log_sum_exp_prune,
+                          std::vector<int32> *gauss,
+                          Vector<BaseFloat> *loglikes) const;
+
+ private:
+  AmDiagGmmGselectConfig config_;
+  const AmDiagGmm &am_;
+
+  // Sets the rows of "params" to [ means_invvars, -0.5 * inv_vars, gconst ]
+  // for the Gaussians of "gmm", so that the log-likelihoods are the product
+  // of "params" with the output of ExtendData().
+  static void GetParams(const DiagGmm &gmm, MatrixBase<BaseFloat> *params);
+
+  // The parameters of the UBM, as output by GetParams().
+  Matrix<BaseFloat> ubm_params_;
+
+  // The parameters of Gaussian g of PDF p, as output by GetParams(), are in
+  // row pdf_offsets_[p] + g of params_; having them all in one place avoids
+  // indirection, and makes it possible to compute the log-likelihoods for
+  // consecutive Gaussians with a single matrix-vector product.
+  std::vector<int32> pdf_offsets_;
+  Matrix<BaseFloat> params_;
+
+  // The shortlist of PDF p for UBM Gaussian u is the Gaussians
+  // gauss_[offsets_[u * (num_pdfs + 1) + p]] ...
+  // gauss_[offsets_[u * (num_pdfs + 1) + p + 1] - 1], in increasing order.
+  std::vector<int32> offsets_;
+  std::vector<int32> gauss_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AmDiagGmmGselect);
+};
+
+/// Returns true if AmDiagGmmGselect::LogLikelihood() uses AVX on this machine.
+bool AmDiagGmmGselectUsesSimd();
+
+/// Enables or disables the use of AVX in AmDiagGmmGselect::LogLikelihood() (it
+/// is enabled by default if the CPU supports it); this is for testing and for
+/// comparing speeds.  Returns the previous setting.
+bool SetAmDiagGmmGselectSimd(bool enable);
+
+}  // namespace kaldi
+
+#endif  // KALDI_GMM_AM_DIAG_GMM_GSELECT_H_
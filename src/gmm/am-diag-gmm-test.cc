@@ -92,6 +92,19 @@ void TestSplitStates(const AmDiagGmm &am_gmm) {
   delete am_gmm1;
 }
 
+void TestLogLikelihoods(const AmDiagGmm &am_gmm) {
+  int32 num_frames = kaldi::RandInt(1, 20);
+  kaldi::Matrix<BaseFloat> feats(num_frames, am_gmm.Dim()), loglikes;
+  feats.SetRandn();
+  am_gmm.LogLikelihoods(feats, &loglikes);
+  KALDI_ASSERT(loglikes.NumRows() == num_frames &&
+               loglikes.NumCols() == am_gmm.NumPdfs());
+  for (int32 t = 0; t < num_frames; t++)
+    for (int32 i = 0; i < am_gmm.NumPdfs(); i++)
+      kaldi::AssertEqual(loglikes(t, i), am_gmm.LogLikelihood(i, feats.Row(t)),
+                         1e-4);
+}
+
 void TestClustering(const AmDiagGmm &am_gmm) {
   int32 target_comp = am_gmm.NumGauss() / 5,
       interm_comp = am_gmm.NumGauss() / 2;
@@ -117,6 +130,7 @@ void UnitTestAmDiagGmm() {
   }
 
   TestAmDiagGmmIO(am_gmm);
+  TestLogLikelihoods(am_gmm);
   TestSplitStates(am_gmm);
   TestClustering(am_gmm);
 }
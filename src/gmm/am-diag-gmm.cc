@@ -98,6 +98,36 @@ int32 AmDiagGmm::ComputeGconsts() {
   return num_bad;
 }
 
+void AmDiagGmm::LogLikelihoods(const MatrixBase<BaseFloat> &data,
+                               Matrix<BaseFloat> *loglikes) const {
+  int32 num_frames = data.NumRows(), num_pdfs = NumPdfs();
+  if (data.NumCols() != Dim())
+    KALDI_ERR << "Dimension mismatch: data dim = " << data.NumCols()
+              << " vs. model dim = " << Dim();
+  loglikes->Resize(num_frames, num_pdfs, kUndefined);
+  if (num_frames == 0)
+    return;
+  Matrix<BaseFloat> data_sq(data);
+  data_sq.ApplyPow(2.0);
+  Matrix<BaseFloat> gauss_loglikes;
+  for (int32 pdf = 0; pdf < num_pdfs; pdf++) {
+    const DiagGmm &gmm = *(densities_[pdf]);
+    gauss_loglikes.Resize(num_frames, gmm.NumGauss(), kUndefined);
+    gauss_loglikes.CopyRowsFromVec(gmm.gconsts());
+    // gauss_loglikes +=  data * inv(vars) * means.
+    gauss_loglikes.AddMatMat(1.0, data, kNoTrans, gmm.means_invvars(), kTrans,
+                             1.0);
+    // gauss_loglikes += -0.5 * data_sq * inv(vars).
+    gauss_loglikes.AddMatMat(-0.5, data_sq, kNoTrans, gmm.inv_vars(), kTrans,
+                             1.0);
+    for (int32 t = 0; t < num_frames; t++) {
+      BaseFloat log_sum = gauss_loglikes.Row(t).LogSumExp();
+      if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
+        KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
+      (*loglikes)(t, pdf) = log_sum;
+    }
+  }
+}
 
 void AmDiagGmm::SplitByCount(const Vector<BaseFloat> &state_occs,
                              int32 target_components,
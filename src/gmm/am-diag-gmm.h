@@ -72,6 +72,13 @@ class AmDiagGmm {
 
   BaseFloat LogLikelihood(const int32 pdf_index,
                           const VectorBase<BaseFloat> &data) const;
+
+  /// Computes the log-likelihoods of all the rows of "data" (e.g. the
+  /// frames of an utterance) for all the PDFs, as a matrix indexed
+  /// (frame, pdf).  This is much faster than calling LogLikelihood() for
+  /// each frame and PDF, as it uses matrix-matrix products.
+  void LogLikelihoods(const MatrixBase<BaseFloat> &data,
+                      Matrix<BaseFloat> *loglikes) const;
   
   void Read(std::istream &in_stream, bool binary);
   void Write(std::ostream &out_stream, bool binary) const;
@@ -37,8 +37,14 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
   }
 
   if (frame != previous_frame_) {  // cache the squared stats.
-    data_squared_.CopyFromVec(feature_matrix_.Row(frame));
-    data_squared_.ApplyPow(2.0);
+    if (gselect_ != NULL) {
+      // ... and select the UBM Gaussians.
+      AmDiagGmmGselect::ExtendData(feature_matrix_.Row(frame), &data_ext_);
+      gselect_->SelectUbmGaussians(data_ext_, &ubm_loglikes_, &ubm_gselect_);
+    } else {
+      data_squared_.CopyFromVec(feature_matrix_.Row(frame));
+      data_squared_.ApplyPow(2.0);
+    }
     previous_frame_ = frame;
   }
 
@@ -55,13 +61,22 @@ BaseFloat DecodableAmDiagGmmUnmapped::LogLikelihoodZeroBased(
         "before computing likelihood.";
   }
 
-  Vector<BaseFloat> loglikes(pdf.gconsts());  // need to recreate for each pdf
-  // loglikes +=  means * inv(vars) * data.
-  loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
-  // loglikes += -0.5 * inv(vars) * data_sq.
-  loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
-
-  BaseFloat log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
+  BaseFloat log_sum;
+  if (gselect_ != NULL) {
+    log_sum = gselect_->LogLikelihood(data_ext_, ubm_gselect_, state,
+                                      log_sum_exp_prune_, &gauss_, &loglikes_);
+  } else {
+    int32 num_gauss = pdf.NumGauss();
+    if (loglikes_.Dim() < num_gauss)
+      loglikes_.Resize(num_gauss, kUndefined);
+    SubVector<BaseFloat> loglikes(loglikes_, 0, num_gauss);
+    loglikes.CopyFromVec(pdf.gconsts());
+    // loglikes +=  means * inv(vars) * data.
+    loglikes.AddMatVec(1.0, pdf.means_invvars(), kNoTrans, data, 1.0);
+    // loglikes += -0.5 * inv(vars) * data_sq.
+    loglikes.AddMatVec(-0.5, pdf.inv_vars(), kNoTrans, data_squared_, 1.0);
+    log_sum = loglikes.LogSumExp(log_sum_exp_prune_);
+  }
   if (KALDI_ISNAN(log_sum) || KALDI_ISINF(log_sum))
     KALDI_ERR << "Invalid answer (overflow or invalid variances/features?)";
 
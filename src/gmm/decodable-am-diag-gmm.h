@@ -26,6 +26,7 @@
 
 #include "base/kaldi-common.h"
 #include "gmm/am-diag-gmm.h"
+#include "gmm/am-diag-gmm-gselect.h"
 #include "hmm/transition-model.h"
 #include "itf/decodable-itf.h"
 #include "transform/regression-tree.h"
@@ -48,12 +49,17 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
   /// in the LogSumExp operation (larger = more exact); I suggest 5.
   /// This is advisable if it's spending a long time doing exp 
   /// operations. 
+  /// If "gselect" is non-NULL, it is used to do Gaussian selection, which
+  /// makes the likelihood computation faster but approximate; it must have
+  /// been constructed with the same model "am", and must outlive this object.
   DecodableAmDiagGmmUnmapped(const AmDiagGmm &am,
                              const Matrix<BaseFloat> &feats,
-                             BaseFloat log_sum_exp_prune = -1.0):
+                             BaseFloat log_sum_exp_prune = -1.0,
+                             const AmDiagGmmGselect *gselect = NULL):
     acoustic_model_(am), feature_matrix_(feats),
     previous_frame_(-1), log_sum_exp_prune_(log_sum_exp_prune), 
-    data_squared_(feats.NumCols()) {
+    gselect_(gselect), data_squared_(feats.NumCols()) {
+    KALDI_ASSERT(gselect == NULL || &(gselect->Am()) == &am);
     ResetLogLikeCache();
   }
 
@@ -88,7 +94,14 @@ class DecodableAmDiagGmmUnmapped : public DecodableInterface {
   };
   std::vector<LikelihoodCacheRecord> log_like_cache_;
  private:
+  const AmDiagGmmGselect *gselect_;
   Vector<BaseFloat> data_squared_;  ///< Cache for fast likelihood calculation
+  Vector<BaseFloat> data_ext_;  ///< [data, data^2, 1], for Gaussian selection
+  std::vector<int32> ubm_gselect_;  ///< UBM Gaussians selected for the frame
+  // Temporaries, kept here to avoid memory allocation for each PDF.
+  Vector<BaseFloat> loglikes_;
+  Vector<BaseFloat> ubm_loglikes_;
+  std::vector<int32> gauss_;
 
 
   KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmDiagGmmUnmapped);
@@ -100,8 +113,9 @@ class DecodableAmDiagGmm: public DecodableAmDiagGmmUnmapped {
   DecodableAmDiagGmm(const AmDiagGmm &am,
                      const TransitionModel &tm,
                      const Matrix<BaseFloat> &feats,
-                     BaseFloat log_sum_exp_prune = -1.0)
-    : DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune),
+                     BaseFloat log_sum_exp_prune = -1.0,
+                     const AmDiagGmmGselect *gselect = NULL)
+    : DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune, gselect),
       trans_model_(tm) {}
 
   // Note, frames are numbered from zero.
@@ -124,9 +138,10 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
                            const TransitionModel &tm,
                            const Matrix<BaseFloat> &feats,
                            BaseFloat scale,
-                           BaseFloat log_sum_exp_prune = -1.0):
-      DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune), trans_model_(tm),
-      scale_(scale), delete_feats_(NULL) {}
+                           BaseFloat log_sum_exp_prune = -1.0,
+                           const AmDiagGmmGselect *gselect = NULL):
+      DecodableAmDiagGmmUnmapped(am, feats, log_sum_exp_prune, gselect),
+      trans_model_(tm), scale_(scale), delete_feats_(NULL) {}
 
   // This version of the initializer takes ownership of the pointer
   // "feats" and will delete it when this class is destroyed.
@@ -134,8 +149,9 @@ class DecodableAmDiagGmmScaled: public DecodableAmDiagGmmUnmapped {
                            const TransitionModel &tm,
                            BaseFloat scale,
                            BaseFloat log_sum_exp_prune,
-                           Matrix<BaseFloat> *feats):
-      DecodableAmDiagGmmUnmapped(am, *feats, log_sum_exp_prune),
+                           Matrix<BaseFloat> *feats,
+                           const AmDiagGmmGselect *gselect = NULL):
+      DecodableAmDiagGmmUnmapped(am, *feats, log_sum_exp_prune, gselect),
       trans_model_(tm),  scale_(scale), delete_feats_(feats) {}
 
   // Note, frames are numbered from zero but transition-ids from one.
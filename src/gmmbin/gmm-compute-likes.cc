@@ -68,13 +68,8 @@ int main(int argc, char *argv[]) {
     for (; !feature_reader.Done(); feature_reader.Next()) {
       std::string key = feature_reader.Key();
       const Matrix<BaseFloat> &features (feature_reader.Value());
-      Matrix<BaseFloat> loglikes(features.NumRows(), am_gmm.NumPdfs());
-      for (int32 i = 0; i < features.NumRows(); i++) {
-        for (int32 j = 0; j < am_gmm.NumPdfs(); j++) {
-          SubVector<BaseFloat> feat_row(features, i);
-          loglikes(i, j) = am_gmm.LogLikelihood(j, feat_row);
-        }
-      }
+      Matrix<BaseFloat> loglikes;
+      am_gmm.LogLikelihoods(features, &loglikes);
       loglikes_writer.Write(key, loglikes);
       num_done++;
     }
@@ -55,7 +55,8 @@ int main(int argc, char *argv[]) {
     LatticeFasterDecoderConfig latgen_config;
     TaskSequencerConfig sequencer_config; // has --num-threads option
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, gselect_ubm_rxfilename;
+    AmDiagGmmGselectConfig gselect_config;
     latgen_config.Register(&po);
     sequencer_config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale,
@@ -67,6 +68,13 @@ int main(int argc, char *argv[]) {
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("gselect-ubm", &gselect_ubm_rxfilename, "If supplied, a "
+                "diagonal-covariance UBM (e.g. from \"init-ubm "
+                "--fullcov-ubm=false\") used for Gaussian selection, which "
+                "speeds up the likelihood computation at some cost in "
+                "accuracy; see also --gselect-num-gselect and "
+                "--gselect-num-ubm-per-gauss.");
+    gselect_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -91,6 +99,13 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
+    AmDiagGmmGselect *gselect = NULL;
+    if (gselect_ubm_rxfilename != "") {
+      DiagGmm ubm;
+      ReadKaldiObject(gselect_ubm_rxfilename, &ubm);
+      gselect = new AmDiagGmmGselect(gselect_config, am_gmm, ubm);
+    }
+
     bool determinize = latgen_config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
     LatticeWriter lattice_writer;
@@ -144,7 +159,7 @@ int main(int argc, char *argv[]) {
               new DecodableAmDiagGmmScaled(am_gmm, trans_model,
                                            acoustic_scale,
                                            log_sum_exp_prune,
-                                           features);
+                                           features, gselect);
 
           DecodeUtteranceLatticeFasterClass *task =
               new DecodeUtteranceLatticeFasterClass(
@@ -186,7 +201,8 @@ int main(int argc, char *argv[]) {
         // The "decodable" object takes ownership of the features.
         DecodableAmDiagGmmScaled *gmm_decodable =
             new DecodableAmDiagGmmScaled(am_gmm, trans_model, acoustic_scale,
-                                         log_sum_exp_prune, features);
+                                         log_sum_exp_prune, features,
+                                         gselect);
 
         DecodeUtteranceLatticeFasterClass *task =
             new DecodeUtteranceLatticeFasterClass(
@@ -215,6 +231,7 @@ int main(int argc, char *argv[]) {
               << frame_count << " frames.";
 
     delete word_syms;
+    delete gselect;
     if (num_done != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
@@ -49,7 +49,8 @@ int main(int argc, char *argv[]) {
     BaseFloat acoustic_scale = 0.1;
     LatticeFasterDecoderConfig config;
 
-    std::string word_syms_filename;
+    std::string word_syms_filename, gselect_ubm_rxfilename;
+    AmDiagGmmGselectConfig gselect_config;
     config.Register(&po);
     po.Register("acoustic-scale", &acoustic_scale,
                 "Scaling factor for acoustic likelihoods");
@@ -57,6 +58,13 @@ int main(int argc, char *argv[]) {
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
                 "If true, produce output even if end state was not reached.");
+    po.Register("gselect-ubm", &gselect_ubm_rxfilename, "If supplied, a "
+                "diagonal-covariance UBM (e.g. from \"init-ubm "
+                "--fullcov-ubm=false\") used for Gaussian selection, which "
+                "speeds up the likelihood computation at some cost in "
+                "accuracy; see also --gselect-num-gselect and "
+                "--gselect-num-ubm-per-gauss.");
+    gselect_config.Register(&po);
 
     po.Read(argc, argv);
 
@@ -81,6 +89,13 @@ int main(int argc, char *argv[]) {
       am_gmm.Read(ki.Stream(), binary);
     }
 
+    AmDiagGmmGselect *gselect = NULL;
+    if (gselect_ubm_rxfilename != "") {
+      DiagGmm ubm;
+      ReadKaldiObject(gselect_ubm_rxfilename, &ubm);
+      gselect = new AmDiagGmmGselect(gselect_config, am_gmm, ubm);
+    }
+
     bool determinize = config.determinize_lattice;
     CompactLatticeWriter compact_lattice_writer;
     LatticeWriter lattice_writer;
@@ -123,7 +138,7 @@ int main(int argc, char *argv[]) {
           }
 
           DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                                 acoustic_scale);
+                                                 acoustic_scale, -1.0, gselect);
 
           double like;
           if (DecodeUtteranceLatticeFaster(
@@ -158,7 +173,7 @@ int main(int argc, char *argv[]) {
 
         LatticeFasterDecoder decoder(fst_reader.Value(), config);
         DecodableAmDiagGmmScaled gmm_decodable(am_gmm, trans_model, features,
-                                               acoustic_scale);
+                                               acoustic_scale, -1.0, gselect);
         double like;
         if (DecodeUtteranceLatticeFaster(
                 decoder, gmm_decodable, trans_model, word_syms, utt,
@@ -182,6 +197,7 @@ int main(int argc, char *argv[]) {
               << frame_count << " frames.";
 
     delete word_syms;
+    delete gselect;
     if (num_done != 0) return 0;
     else return 1;
   } catch(const std::exception &e) {
@@ -0,0 +1,130 @@
+// ivector/agglomerative-clustering-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ivector/agglomerative-clustering.h"
+
+namespace kaldi {
+
+// A slow but simple version of AgglomerativeCluster() (single pass), which
+// recomputes the costs between all pairs of clusters for every merge.
+void AgglomerativeClusterSimple(const Matrix<BaseFloat> &costs,
+                                BaseFloat thresh,
+                                int32 min_clust,
+                                std::vector<int32> *assignments) {
+  int32 num_points = costs.NumRows();
+  // The clusters in the order in which they were created.
+  std::vector<std::vector<int32> > clusters;
+  std::vector<bool> active;
+  for (int32 i = 0; i < num_points; i++) {
+    clusters.push_back(std::vector<int32>(1, i));
+    active.push_back(true);
+  }
+  int32 num_clusters = num_points;
+  while (num_clusters > min_clust) {
+    int32 best_i = -1, best_j = -1;
+    double best_cost = 0.0;
+    for (size_t i = 0; i < clusters.size(); i++) {
+      for (size_t j = i + 1; j < clusters.size(); j++) {
+        if (!active[i] || !active[j])
+          continue;
+        double sum = 0.0;
+        for (size_t m = 0; m < clusters[i].size(); m++)
+          for (size_t n = 0; n < clusters[j].size(); n++)
+            sum += costs(clusters[i][m], clusters[j][n]);
+        double cost = sum / (clusters[i].size() * clusters[j].size());
+        if (best_i == -1 || cost < best_cost) {
+          best_i = i;
+          best_j = j;
+          best_cost = cost;
+        }
+      }
+    }
+    if (best_i == -1 || best_cost > thresh)
+      break;
+    std::vector<int32> merged(clusters[best_i]);
+    merged.insert(merged.end(), clusters[best_j].begin(),
+                  clusters[best_j].end());
+    active[best_i] = active[best_j] = false;
+    clusters.push_back(merged);
+    active.push_back(true);
+    num_clusters--;
+  }
+  assignments->resize(num_points);
+  int32 label = 0;
+  for (size_t i = 0; i < clusters.size(); i++) {
+    if (!active[i])
+      continue;
+    label++;
+    for (size_t m = 0; m < clusters[i].size(); m++)
+      (*assignments)[clusters[i][m]] = label;
+  }
+}
+
+void UnitTestAgglomerativeCluster() {
+  int32 num_points = 1 + Rand() % 60, num_groups = 1 + Rand() % 5;
+  // The points are in groups, with lower costs within the groups.
+  std::vector<int32> groups(num_points);
+  for (int32 i = 0; i < num_points; i++)
+    groups[i] = Rand() % num_groups;
+  Matrix<BaseFloat> costs(num_points, num_points);
+  for (int32 i = 0; i < num_points; i++) {
+    for (int32 j = 0; j < i; j++) {
+      costs(i, j) = costs(j, i) = RandUniform() +
+          (groups[i] == groups[j] ? 0.0 : 1.0);
+    }
+  }
+  BaseFloat thresh = (Rand() % 2 == 0 ? 1.0 + 0.5 * RandUniform() :
+                      std::numeric_limits<BaseFloat>::max());
+  int32 min_clust = Rand() % 4;
+
+  std::vector<int32> assignments, ref_assignments;
+  AgglomerativeCluster(costs, thresh, min_clust, 0, &assignments);
+  AgglomerativeClusterSimple(costs, thresh, min_clust, &ref_assignments);
+  KALDI_ASSERT(assignments == ref_assignments);
+
+  // The first pass does nothing if there are few enough points.
+  std::vector<int32> assignments2;
+  AgglomerativeCluster(costs, thresh, min_clust, num_points, &assignments2);
+  KALDI_ASSERT(assignments2 == assignments);
+
+  // With two passes, the result is not exactly the same, but the labels
+  // should still be 1, 2, ... and respect min_clust.
+  int32 first_pass_max_points = 1 + Rand() % 20;
+  AgglomerativeCluster(costs, thresh, min_clust, first_pass_max_points,
+                       &assignments2);
+  KALDI_ASSERT(static_cast<int32>(assignments2.size()) == num_points);
+  int32 num_clusters = *std::max_element(assignments2.begin(),
+                                         assignments2.end());
+  KALDI_ASSERT(num_clusters >= std::min(min_clust, num_points));
+  std::vector<bool> seen(num_clusters + 1, false);
+  for (int32 i = 0; i < num_points; i++) {
+    KALDI_ASSERT(assignments2[i] >= 1);
+    seen[assignments2[i]] = true;
+  }
+  for (int32 c = 1; c <= num_clusters; c++)
+    KALDI_ASSERT(seen[c]);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 100; i++)
+    UnitTestAgglomerativeCluster();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -20,112 +20,273 @@
 
 #include <algorithm>
 #include "ivector/agglomerative-clustering.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
 void AgglomerativeClusterer::Cluster() {
   KALDI_VLOG(2) << "Initializing cluster assignments.";
-  Initialize();
+  KALDI_ASSERT(num_points_ != 0);
+  std::vector<AhcCluster*> clusters;
+  if (first_pass_max_points_ > 0 && num_points_ > first_pass_max_points_) {
+    // Cluster subsets of consecutive points of (nearly) equal size separately
+    // first.  We don't go below 10 * min_clust_ clusters for each subset, so
+    // that clusters that would be kept separate by single-pass clustering are
+    // not merged too early.
+    int32 num_subsets = (num_points_ + first_pass_max_points_ - 1) /
+        first_pass_max_points_,
+        subset_size = (num_points_ + num_subsets - 1) / num_subsets;
+    for (int32 begin = 0; begin < num_points_; begin += subset_size) {
+      int32 end = std::min(begin + subset_size, num_points_);
+      std::vector<AhcCluster*> subset;
+      for (int32 i = begin; i < end; i++)
+        subset.push_back(new AhcCluster(++count_, -1, -1,
+                                        std::vector<int32>(1, i)));
+      Initialize(subset);
+      ComputeClusters(10 * min_clust_);
+      for (size_t i = 0; i < clusters_.size(); i++) {
+        if (clusters_[i] != NULL)
+          clusters.push_back(clusters_[i]);
+        clusters_[i] = NULL;
+      }
+    }
+    KALDI_VLOG(2) << "First pass reduced " << num_points_ << " points to "
+                  << clusters.size() << " clusters.";
+  } else {
+    for (int32 i = 0; i < num_points_; i++)
+      clusters.push_back(new AhcCluster(++count_, -1, -1,
+                                        std::vector<int32>(1, i)));
+  }
 
   KALDI_VLOG(2) << "Clustering...";
-  // This is the main algorithm loop. It moves through the queue merging
-  // clusters until a stopping criterion has been reached.
-  while (num_clusters_ > min_clust_ && !queue_.empty()) {
-    std::pair<BaseFloat, std::pair<uint16, uint16> > pr = queue_.top();
-    int32 i = (int32) pr.second.first, j = (int32) pr.second.second;
-    queue_.pop();
-    // check to make sure clusters have not already been merged
-    if ((active_clusters_.find(i) != active_clusters_.end()) &&
-        (active_clusters_.find(j) != active_clusters_.end()))
-      MergeClusters(i, j);
-  }
+  Initialize(clusters);
+  ComputeClusters(min_clust_);
 
+  // Iterate through the clusters in the order in which they were created and
+  // assign all utterances within the cluster an ID label unique to the
+  // cluster. This is the final output.
+  std::vector<std::pair<int32, AhcCluster*> > active_clusters;
+  for (size_t i = 0; i < clusters_.size(); i++)
+    if (clusters_[i] != NULL)
+      active_clusters.push_back(std::make_pair(clusters_[i]->id,
+                                               clusters_[i]));
+  std::sort(active_clusters.begin(), active_clusters.end());
   std::vector<int32> new_assignments(num_points_);
-  int32 label_id = 0;
-  std::set<int32>::iterator it;
-  // Iterate through the clusters and assign all utterances within the cluster
-  // an ID label unique to the cluster. This is the final output and frees up
-  // the cluster memory accordingly.
-  for (it = active_clusters_.begin(); it != active_clusters_.end(); ++it) {
-    ++label_id;
-    AhcCluster *cluster = clusters_map_[*it];
-    std::vector<int32>::iterator utt_it;
-    for (utt_it = cluster->utt_ids.begin();
-         utt_it != cluster->utt_ids.end(); ++utt_it)
-      new_assignments[*utt_it] = label_id;
-    delete cluster;
+  for (size_t c = 0; c < active_clusters.size(); c++) {
+    const std::vector<int32> &utt_ids = active_clusters[c].second->utt_ids;
+    for (size_t i = 0; i < utt_ids.size(); i++)
+      new_assignments[utt_ids[i]] = c + 1;
   }
   assignments_->swap(new_assignments);
 }
 
-BaseFloat AgglomerativeClusterer::GetCost(int32 i, int32 j) {
-  if (i < j)
-    return cluster_cost_map_[std::make_pair(i, j)];
-  else
-    return cluster_cost_map_[std::make_pair(j, i)];
+AgglomerativeClusterer::~AgglomerativeClusterer() {
+  for (size_t i = 0; i < clusters_.size(); i++)
+    delete clusters_[i];
+}
+
+// Computes the rows of the triangular matrix of total costs and the nearest
+// neighbors; thread t does rows t, t + num_threads_, ...
+class AgglomerativeClusterer::InitializeClass: public MultiThreadable {
+ public:
+  InitializeClass(AgglomerativeClusterer *clusterer): clusterer_(clusterer) { }
+  void operator () () {
+    const Matrix<BaseFloat> &costs = clusterer_->costs_;
+    const std::vector<AhcCluster*> &clusters = clusterer_->clusters_;
+    int32 num_clusters = clusters.size();
+    for (int32 i = thread_id_; i < num_clusters; i += num_threads_) {
+      const std::vector<int32> &utts_i = clusters[i]->utt_ids;
+      BaseFloat *sums = (i + 1 < num_clusters ?
+                         &(clusterer_->sums_[clusterer_->SumIndex(i, i + 1)]) :
+                         NULL);
+      for (int32 j = i + 1; j < num_clusters; j++) {
+        const std::vector<int32> &utts_j = clusters[j]->utt_ids;
+        BaseFloat sum = 0.0;
+        for (size_t m = 0; m < utts_i.size(); m++) {
+          for (size_t n = 0; n < utts_j.size(); n++) {
+            int32 u = utts_i[m], v = utts_j[n];
+            sum += (u < v ? costs(u, v) : costs(v, u));
+          }
+        }
+        sums[j - i - 1] = sum;
+      }
+      clusterer_->ComputeNearestNeighbor(i);
+    }
+  }
+ private:
+  AgglomerativeClusterer *clusterer_;
+};
+
+void AgglomerativeClusterer::Initialize(
+    const std::vector<AhcCluster*> &clusters) {
+  KALDI_ASSERT(!clusters.empty());
+  for (size_t i = 0; i < clusters_.size(); i++)
+    delete clusters_[i];
+  clusters_ = clusters;
+  int32 num_clusters = clusters.size();
+  num_clusters_ = num_clusters;
+  sums_.resize(static_cast<int64>(num_clusters) * (num_clusters - 1) / 2);
+  nn_.resize(num_clusters);
+  min_cost_.resize(num_clusters);
+
+  // It is only worth using threads if there are many pairs of points.
+  int32 num_threads = (static_cast<int64>(num_points_) * num_points_ >
+                       1000000 ? g_num_threads : 0);
+  InitializeClass c(this);
+  {
+    MultiThreader<InitializeClass> m(num_threads, c);
+  }
+
+  heap_.clear();
+  heap_pos_.assign(num_clusters, -1);
+  for (int32 i = 0; i < num_clusters; i++)
+    HeapUpdate(i);
+}
+
+void AgglomerativeClusterer::ComputeNearestNeighbor(int32 i) {
+  int32 num_clusters = clusters_.size(), best_j = -1;
+  BaseFloat best_cost = std::numeric_limits<BaseFloat>::infinity();
+  for (int32 j = i + 1; j < num_clusters; j++) {
+    if (clusters_[j] == NULL)
+      continue;
+    BaseFloat cost = GetCost(i, j);
+    if (best_j == -1 || cost < best_cost) {
+      best_j = j;
+      best_cost = cost;
+    }
+  }
+  nn_[i] = best_j;
+  min_cost_[i] = best_cost;
 }
 
-void AgglomerativeClusterer::Initialize() {
-  KALDI_ASSERT(num_clusters_ != 0);
-  for (int32 i = 0; i < num_points_; i++) {
-    // create an initial cluster of size 1 for each point
-    std::vector<int32> ids;
-    ids.push_back(i);
-    AhcCluster *c = new AhcCluster(++count_, -1, -1, ids);
-    clusters_map_[count_] = c;
-    active_clusters_.insert(count_);
-
-    // propagate the queue with all pairs from the cost matrix
-    for (int32 j = i+1; j < num_clusters_; j++) {
-      BaseFloat cost = costs_(i,j);
-      cluster_cost_map_[std::make_pair(i+1, j+1)] = cost;
-      if (cost <= thresh_)
-        queue_.push(std::make_pair(cost,
-            std::make_pair(static_cast<uint16>(i+1),
-                           static_cast<uint16>(j+1))));
+void AgglomerativeClusterer::ComputeClusters(int32 min_clust) {
+  // This is the main algorithm loop.  The cluster at the top of the heap has
+  // the lowest lower bound on the cost to its nearest neighbor; if that is
+  // exact, it is the pair with the lowest cost, otherwise we recompute the
+  // nearest neighbor and try again.
+  while (num_clusters_ > min_clust && !heap_.empty()) {
+    int32 i = heap_[0], j = nn_[i];
+    if (min_cost_[i] > thresh_)
+      break;
+    if (clusters_[j] == NULL || GetCost(i, j) != min_cost_[i]) {
+      ComputeNearestNeighbor(i);
+      HeapUpdate(i);
+      continue;
     }
+    MergeClusters(i, j);
   }
 }
 
 void AgglomerativeClusterer::MergeClusters(int32 i, int32 j) {
-  AhcCluster *clust1 = clusters_map_[i];
-  AhcCluster *clust2 = clusters_map_[j];
-  // For memory efficiency, the first cluster is updated to contain the new
-  // merged cluster information, and the second cluster is later deleted.
-  clust1->id = ++count_;
-  clust1->parent1 = i;
-  clust1->parent2 = j;
-  clust1->size += clust2->size;
-  clust1->utt_ids.insert(clust1->utt_ids.end(), clust2->utt_ids.begin(),
-                         clust2->utt_ids.end());
-  // Remove the merged clusters from the list of active clusters.
-  active_clusters_.erase(i);
-  active_clusters_.erase(j);
-  // Update the queue with all the new costs involving the new cluster
-  std::set<int32>::iterator it;
-  for (it = active_clusters_.begin(); it != active_clusters_.end(); ++it) {
-    // The new cost is the sum of the costs of the new cluster's parents
-    BaseFloat new_cost = GetCost(*it, i) + GetCost(*it, j);
-    cluster_cost_map_[std::make_pair(*it, count_)] = new_cost;
-    BaseFloat norm = clust1->size * (clusters_map_[*it])->size;
-    if (new_cost / norm <= thresh_)
-      queue_.push(std::make_pair(new_cost / norm,
-          std::make_pair(static_cast<uint16>(*it),
-                         static_cast<uint16>(count_))));
+  AhcCluster *clust1 = clusters_[i];
+  AhcCluster *clust2 = clusters_[j];
+  int32 num_clusters = clusters_.size();
+  // The new cost with another cluster is the sum of the costs of the new
+  // cluster's parents.
+  for (int32 k = 0; k < num_clusters; k++) {
+    if (k == i || k == j || clusters_[k] == NULL)
+      continue;
+    sums_[k < j ? SumIndex(k, j) : SumIndex(j, k)] +=
+        sums_[k < i ? SumIndex(k, i) : SumIndex(i, k)];
   }
-  active_clusters_.insert(count_);
-  clusters_map_[count_] = clust1;
-  delete clust2;
+  // The second cluster is updated to contain the new merged cluster
+  // information, and the first cluster is deleted.
+  clust2->parent1 = clust1->id;
+  clust2->parent2 = clust2->id;
+  clust2->id = ++count_;
+  clust2->size += clust1->size;
+  clust2->utt_ids.insert(clust2->utt_ids.end(), clust1->utt_ids.begin(),
+                         clust1->utt_ids.end());
+  delete clust1;
+  clusters_[i] = NULL;
+  nn_[i] = -1;
+  HeapUpdate(i);
   num_clusters_--;
+
+  // Update the nearest neighbors of the clusters before j.  Their min_cost_
+  // stays a lower bound, since the new cost is between the costs of the
+  // parents.
+  for (int32 k = 0; k < j; k++) {
+    if (clusters_[k] == NULL)
+      continue;
+    if (nn_[k] == i)
+      nn_[k] = j;
+    BaseFloat cost = GetCost(k, j);
+    if (cost < min_cost_[k]) {
+      nn_[k] = j;
+      min_cost_[k] = cost;
+      HeapUpdate(k);
+    }
+  }
+  ComputeNearestNeighbor(j);
+  HeapUpdate(j);
+}
+
+void AgglomerativeClusterer::HeapSiftUp(int32 pos) {
+  int32 i = heap_[pos];
+  while (pos > 0) {
+    int32 parent = (pos - 1) / 2;
+    if (!HeapLess(i, heap_[parent]))
+      break;
+    heap_[pos] = heap_[parent];
+    heap_pos_[heap_[pos]] = pos;
+    pos = parent;
+  }
+  heap_[pos] = i;
+  heap_pos_[i] = pos;
+}
+
+void AgglomerativeClusterer::HeapSiftDown(int32 pos) {
+  int32 i = heap_[pos], size = heap_.size();
+  while (true) {
+    int32 child = 2 * pos + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size && HeapLess(heap_[child + 1], heap_[child]))
+      child++;
+    if (!HeapLess(heap_[child], i))
+      break;
+    heap_[pos] = heap_[child];
+    heap_pos_[heap_[pos]] = pos;
+    pos = child;
+  }
+  heap_[pos] = i;
+  heap_pos_[i] = pos;
+}
+
+void AgglomerativeClusterer::HeapUpdate(int32 i) {
+  int32 pos = heap_pos_[i];
+  if (nn_[i] == -1) {
+    if (pos == -1)
+      return;
+    // Remove i from the heap.
+    heap_pos_[i] = -1;
+    int32 last = heap_.back();
+    heap_.pop_back();
+    if (last != i) {
+      heap_[pos] = last;
+      heap_pos_[last] = pos;
+      HeapSiftUp(pos);
+      HeapSiftDown(heap_pos_[last]);
+    }
+  } else if (pos == -1) {
+    heap_.push_back(i);
+    HeapSiftUp(heap_.size() - 1);
+  } else {
+    HeapSiftUp(pos);
+    HeapSiftDown(heap_pos_[i]);
+  }
 }
 
 void AgglomerativeCluster(
     const Matrix<BaseFloat> &costs,
     BaseFloat thresh,
     int32 min_clust,
+    int32 first_pass_max_points,
     std::vector<int32> *assignments_out) {
-  KALDI_ASSERT(min_clust >= 0);
-  AgglomerativeClusterer ac(costs, thresh, min_clust, assignments_out);
+  KALDI_ASSERT(min_clust >= 0 && first_pass_max_points >= 0);
+  AgglomerativeClusterer ac(costs, thresh, min_clust, first_pass_max_points,
+                            assignments_out);
   ac.Cluster();
 }
 
@@ -22,10 +22,6 @@
 #define KALDI_IVECTOR_AGGLOMERATIVE_CLUSTERING_H_
 
 #include <vector>
-#include <queue>
-#include <set>
-#include <unordered_map>
-#include <functional>
 #include "base/kaldi-common.h"
 #include "matrix/matrix-lib.h"
 #include "util/stl-utils.h"
@@ -57,47 +53,85 @@ class AgglomerativeClusterer {
       const Matrix<BaseFloat> &costs,
       BaseFloat thresh,
       int32 min_clust,
+      int32 first_pass_max_points,
       std::vector<int32> *assignments_out)
       : count_(0), costs_(costs), thresh_(thresh), min_clust_(min_clust),
-        assignments_(assignments_out) {
-    num_clusters_ = costs.NumRows();
+        first_pass_max_points_(first_pass_max_points),
+        assignments_(assignments_out), num_clusters_(0) {
     num_points_ = costs.NumRows();
   }
 
   // Performs the clustering
   void Cluster();
+
+  ~AgglomerativeClusterer();
  private:
-  // Returns the cost between clusters with IDs i and j
-  BaseFloat GetCost(int32 i, int32 j);
-  // Initializes the clustering queue with singleton clusters
-  void Initialize();
-  // Merges clusters with IDs i and j and updates cost map and queue
+  class InitializeClass;
+
+  // Sets up the clustering of the clusters in "clusters" (this object takes
+  // ownership of them): computes the total costs between all pairs of them,
+  // from costs_, and the nearest neighbors.
+  void Initialize(const std::vector<AhcCluster*> &clusters);
+  // Merges the closest pair of clusters until there are only min_clust
+  // clusters left or the lowest cost is greater than thresh_.
+  void ComputeClusters(int32 min_clust);
+  // Merges the clusters with indexes i < j; the result goes in index j.
   void MergeClusters(int32 i, int32 j);
 
+  // Returns the index into sums_ for the pair of clusters with indexes i < j.
+  inline int64 SumIndex(int32 i, int32 j) const {
+    return static_cast<int64>(i) * (2 * clusters_.size() - i - 1) / 2 +
+        (j - i - 1);
+  }
+  // Returns the cost (average pairwise cost between points) between the
+  // clusters with indexes i < j
+  inline BaseFloat GetCost(int32 i, int32 j) const {
+    return sums_[SumIndex(i, j)] /
+        (static_cast<BaseFloat>(clusters_[i]->size) * clusters_[j]->size);
+  }
+  // Sets nn_[i] and min_cost_[i] to the active cluster with index > i with
+  // the lowest cost, and its cost (nn_[i] = -1 if there is none).
+  void ComputeNearestNeighbor(int32 i);
+
+  // The heap of cluster indexes i with nn_[i] != -1, ordered by min_cost_.
+  inline bool HeapLess(int32 i, int32 j) const {
+    return min_cost_[i] < min_cost_[j] ||
+        (min_cost_[i] == min_cost_[j] && i < j);
+  }
+  void HeapSiftUp(int32 pos);
+  void HeapSiftDown(int32 pos);
+  // Restores the heap property after nn_[i] or min_cost_[i] changed, adding
+  // or removing i as needed.
+  void HeapUpdate(int32 i);
 
   int32 count_;  // Count of clusters that have been created. Also used to give
                  // clusters unique IDs.
   const Matrix<BaseFloat> &costs_;  // cost matrix
   BaseFloat thresh_;  // stopping criterion threshold
   int32 min_clust_;  // minimum number of clusters
+  int32 first_pass_max_points_;  // if > 0, maximum number of points per
+                                 // subset clustered in the first pass.
   std::vector<int32> *assignments_;  // assignments out
+  int32 num_points_;  // total number of points to cluster
 
-  // Priority queue using greater (lowest costs are highest priority).
-  // Elements contain pairs of cluster IDs and their cost.
-  typedef std::pair<BaseFloat, std::pair<uint16,
-    uint16> > QueueElement;
-  typedef std::priority_queue<QueueElement, std::vector<QueueElement>,
-    std::greater<QueueElement>  > QueueType;
-  QueueType queue_;
-
-  // Map from cluster IDs to cost between them
-  std::unordered_map<std::pair<int32, int32>, BaseFloat,
-                     PairHasher<int32, int32>> cluster_cost_map_;
-  // Map from cluster ID to cluster object address
-  std::unordered_map<int32, AhcCluster*> clusters_map_;
-  std::set<int32> active_clusters_;  // IDs of unmerged clusters
+  // The clusters, indexed by position; NULL for clusters that have been
+  // merged into other ones.
+  std::vector<AhcCluster*> clusters_;
   int32 num_clusters_;  // number of active clusters
-  int32 num_points_;  // total number of points to cluster
+  // The total cost between the clusters with indexes i < j is
+  // sums_[SumIndex(i, j)] (a packed upper-triangular matrix).
+  std::vector<BaseFloat> sums_;
+  // For each cluster index i, nn_[i] is a candidate for the closest cluster
+  // with a higher index, and min_cost_[i] is a lower bound on the cost to any
+  // cluster with a higher index; when the lowest one is not exact any more,
+  // it is recomputed (see ComputeClusters()).
+  std::vector<int32> nn_;
+  std::vector<BaseFloat> min_cost_;
+  // The heap of cluster indexes, and the position of each index in it (or -1).
+  std::vector<int32> heap_;
+  std::vector<int32> heap_pos_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(AgglomerativeClusterer);
 };
 
 /** This is the function that is called to perform the agglomerative
@@ -107,6 +141,8 @@ class AgglomerativeClusterer {
         cost for pairing the utterances for its row and column
  *   - A threshold which is used as the stopping criterion for the clusters
  *   - A minimum number of clusters that will not be merged past
+ *   - The maximum number of points clustered together in the first pass
+ *      (see below); if 0 or if there are fewer points, there is only one pass.
  *   - A vector which will be filled with integer IDs corresponding to each
  *      of the rows/columns of the score matrix.
  *
@@ -126,11 +162,24 @@ class AgglomerativeClusterer {
  *  costs between clusters I and M and clusters I and N, where
  *  cluster J was formed by merging clusters M and N.
  *
+ *  The sums are stored in a triangular matrix, and the closest pair is found
+ *  with a heap of nearest-neighbor candidates that are only recomputed when
+ *  needed (this is the "generic" algorithm of D. Mullner, "Modern
+ *  hierarchical, agglomerative clustering algorithms", 2011), so the time is
+ *  usually quadratic in the number of points.  The initial costs are computed
+ *  using g_num_threads threads if there are many points.
+ *
+ *  If there are more than first_pass_max_points points (and it is > 0), we
+ *  first divide them into subsets of consecutive points of at most that
+ *  size, and cluster each subset separately until there are at most
+ *  10 * min_clust clusters or the threshold is reached; the resulting
+ *  clusters are then clustered together.  This is faster but not exact.
  */
 void AgglomerativeCluster(
     const Matrix<BaseFloat> &costs,
     BaseFloat thresh,
     int32 min_clust,
+    int32 first_pass_max_points,
     std::vector<int32> *assignments_out);
 
 }  // end namespace kaldi.
@@ -142,6 +142,52 @@ void TestIvectorExtraction(const IvectorExtractor &extractor,
 }
 
 
+void UnitTestComputeUbmPosteriors() {
+  FullGmm fgmm;
+  int32 dim = 1 + Rand() % 5, num_comp = 1 + Rand() % 10,
+      num_frames = 1 + Rand() % 50;
+  unittest::InitRandFullGmm(dim, num_comp, &fgmm);
+  DiagGmm diag_gmm;
+  diag_gmm.CopyFromFullGmm(fgmm);
+  Matrix<BaseFloat> feats(num_frames, dim);
+  feats.SetRandn();
+
+  // With all the Gaussians selected and no pruning, the posteriors are exact.
+  UbmPosteriorOptions opts;
+  opts.num_gselect = num_comp;
+  opts.min_post = 0.0;
+  Posterior post;
+  double tot_loglike;
+  KALDI_ASSERT(ComputeUbmPosteriors(opts, diag_gmm, fgmm, feats, &post,
+                                    &tot_loglike));
+  KALDI_ASSERT(static_cast<int32>(post.size()) == num_frames);
+  double tot_loglike2 = 0.0;
+  for (int32 t = 0; t < num_frames; t++) {
+    Vector<BaseFloat> posteriors(num_comp);
+    tot_loglike2 += fgmm.ComponentPosteriors(feats.Row(t), &posteriors);
+    Vector<BaseFloat> posteriors2(num_comp);
+    for (size_t i = 0; i < post[t].size(); i++)
+      posteriors2(post[t][i].first) += post[t][i].second;
+    KALDI_ASSERT(posteriors.ApproxEqual(posteriors2, 0.001));
+  }
+  AssertEqual(tot_loglike, tot_loglike2, 0.001);
+
+  opts.num_gselect = 1 + Rand() % num_comp;
+  opts.min_post = 0.1 * (Rand() % 5);
+  opts.posterior_scale = 0.1 * (1 + Rand() % 10);
+  KALDI_ASSERT(ComputeUbmPosteriors(opts, diag_gmm, fgmm, feats, &post));
+  for (int32 t = 0; t < num_frames; t++) {
+    KALDI_ASSERT(!post[t].empty() &&
+                 static_cast<int32>(post[t].size()) <= opts.num_gselect);
+    BaseFloat sum = 0.0;
+    for (size_t i = 0; i < post[t].size(); i++) {
+      KALDI_ASSERT(post[t][i].second >= opts.min_post * opts.posterior_scale);
+      sum += post[t][i].second;
+    }
+    AssertEqual(sum, opts.posterior_scale, 0.001);
+  }
+}
+
 void UnitTestIvectorExtractor() {
   FullGmm fgmm;
   int32 dim = 5 + Rand() % 5, num_comp = 1 + Rand() % 5;
@@ -216,6 +262,8 @@ void UnitTestIvectorExtractor() {
 int main() {
   using namespace kaldi;
   SetVerboseLevel(5);
+  for (int i = 0; i < 10; i++)
+    UnitTestComputeUbmPosteriors();
   for (int i = 0; i < 10; i++)
     UnitTestIvectorExtractor();
   std::cout << "Test OK.\n";
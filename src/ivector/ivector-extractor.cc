@@ -795,6 +795,63 @@ void IvectorExtractorUtteranceStats::AccStats(
   }
 }
 
+bool ComputeUbmPosteriors(const UbmPosteriorOptions &opts,
+                          const DiagGmm &diag_ubm,
+                          const FullGmm &full_ubm,
+                          const MatrixBase<BaseFloat> &feats,
+                          Posterior *post,
+                          double *tot_loglike) {
+  int32 num_frames = feats.NumRows(),
+      num_gselect = std::min(opts.num_gselect, diag_ubm.NumGauss());
+  KALDI_ASSERT(num_frames > 0 && num_gselect > 0 && opts.min_post < 1.0 &&
+               diag_ubm.NumGauss() == full_ubm.NumGauss());
+  if (feats.NumCols() != full_ubm.Dim())
+    KALDI_ERR << "Dimension mismatch: features have dim " << feats.NumCols()
+              << ", UBM has dim " << full_ubm.Dim();
+
+  // This does the diagonal-covariance log-likelihoods for blocks of frames
+  // with matrix multiplications.
+  std::vector<std::vector<int32> > gselect;
+  diag_ubm.GaussianSelection(feats, num_gselect, &gselect);
+
+  double this_tot_loglike = 0.0;
+  post->clear();
+  post->resize(num_frames);
+  Vector<BaseFloat> loglikes;
+  for (int32 t = 0; t < num_frames; t++) {
+    const std::vector<int32> &this_gselect = gselect[t];
+    full_ubm.LogLikelihoodsPreselect(feats.Row(t), this_gselect, &loglikes);
+    this_tot_loglike += loglikes.ApplySoftMax();
+    // now "loglikes" contains posteriors.
+    if (fabs(loglikes.Sum() - 1.0) > 0.01) {
+      KALDI_WARN << "Bad posterior-sum encountered (NaN?) on frame " << t;
+      post->clear();
+      return false;
+    }
+    if (opts.min_post != 0.0) {
+      int32 max_index = 0;  // in case all pruned away...
+      loglikes.Max(&max_index);
+      for (int32 i = 0; i < loglikes.Dim(); i++)
+        if (loglikes(i) < opts.min_post)
+          loglikes(i) = 0.0;
+      BaseFloat sum = loglikes.Sum();
+      if (sum == 0.0) {
+        loglikes(max_index) = 1.0;
+      } else {
+        loglikes.Scale(1.0 / sum);
+      }
+    }
+    for (int32 i = 0; i < loglikes.Dim(); i++)
+      if (loglikes(i) != 0.0)
+        (*post)[t].push_back(std::make_pair(this_gselect[i], loglikes(i)));
+  }
+  if (opts.posterior_scale != 1.0)
+    ScalePosterior(opts.posterior_scale, post);
+  if (tot_loglike != NULL)
+    *tot_loglike = this_tot_loglike;
+  return true;
+}
+
 void IvectorExtractorUtteranceStats::Scale(double scale) {
   gamma_.Scale(scale);
   X_.Scale(scale);
@@ -68,6 +68,46 @@ struct IvectorEstimationOptions {
   }
 };
 
+// Options for computing the Gaussian-level posteriors for iVector extraction
+// directly from the features; see ComputeUbmPosteriors().  The defaults are
+// those of the speaker-id scripts.
+struct UbmPosteriorOptions {
+  int32 num_gselect;
+  BaseFloat min_post;
+  BaseFloat posterior_scale;
+  UbmPosteriorOptions(): num_gselect(20), min_post(0.025),
+                         posterior_scale(1.0) { }
+  void Register(OptionsItf *opts) {
+    opts->Register("num-gselect", &num_gselect, "Number of Gaussians of the "
+                   "diagonal version of the UBM to select per frame, which are "
+                   "then rescored with the full-covariance UBM.");
+    opts->Register("min-post", &min_post, "Posteriors of the full-covariance "
+                   "UBM below this are pruned away (and the rest "
+                   "renormalized).");
+    opts->Register("posterior-scale", &posterior_scale, "Scale on the "
+                   "posteriors (e.g. 0.1), applied after pruning.");
+  }
+};
+
+/// Computes the Gaussian-level posteriors of the full-covariance UBM
+/// "full_ubm" for the frames "feats", for iVector extraction.  The result is
+/// the same as that of the pipeline "gmm-gselect --n=<num-gselect>" (with the
+/// diagonal UBM "diag_ubm", which would normally be obtained from full_ubm with
+/// fgmm-global-to-gmm) | "fgmm-global-gselect-to-post --min-post=<min-post>"
+/// | "scale-post <posterior-scale>", but it is computed without any
+/// intermediate archives; the diagonal-UBM log-likelihoods are computed for
+/// blocks of frames with matrix multiplications.  If "tot_loglike" is
+/// non-NULL, it is set to the total log-likelihood of the frames under the
+/// full-covariance UBM (restricted to the selected Gaussians).  Returns false
+/// (with a warning) if a bad posterior was encountered, e.g. a NaN in the
+/// features.  This function is thread-safe.
+bool ComputeUbmPosteriors(const UbmPosteriorOptions &opts,
+                          const DiagGmm &diag_ubm,
+                          const FullGmm &full_ubm,
+                          const MatrixBase<BaseFloat> &feats,
+                          Posterior *post,
+                          double *tot_loglike = NULL);
+
 
 class IvectorExtractor;
 class IvectorExtractorComputeDerivedVarsClass;
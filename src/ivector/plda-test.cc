@@ -89,6 +89,80 @@ void UnitTestPldaEstimation(int32 dim) {
 
 }
 
+void UnitTestPldaBatchScorer() {
+  int32 dim = 1 + Rand() % 10, num_classes = 20 + Rand() % 20;
+  PldaStats stats;
+  for (int32 n = 0; n < num_classes; n++) {
+    Vector<double> class_mean(dim);
+    class_mean.SetRandn();
+    class_mean.Scale(3.0);
+    Matrix<double> egs(2 + Rand() % 4, dim);
+    egs.SetRandn();
+    egs.AddVecToRows(1.0, class_mean);
+    stats.AddSamples(1.0, egs);
+  }
+  stats.Sort();
+  PldaEstimator estimator(stats);
+  Plda plda;
+  PldaEstimationConfig estimation_config;
+  estimator.Estimate(estimation_config, &plda);
+
+  PldaConfig config;
+  int32 num_train = 1 + Rand() % 300, num_test = 1 + Rand() % 300;
+  std::vector<int32> num_train_utts;
+  if (Rand() % 2 == 0)
+    for (int32 i = 0; i < num_train; i++)
+      num_train_utts.push_back(1 + Rand() % 4);
+  Matrix<double> train(num_train, dim), test(num_test, dim);
+  for (int32 i = 0; i < num_train; i++) {
+    Vector<double> ivector(dim);
+    ivector.SetRandn();
+    SubVector<double> transformed(train, i);
+    plda.TransformIvector(config, ivector,
+                          num_train_utts.empty() ? 1 : num_train_utts[i],
+                          &transformed);
+  }
+  for (int32 j = 0; j < num_test; j++) {
+    Vector<double> ivector(dim);
+    ivector.SetRandn();
+    SubVector<double> transformed(test, j);
+    plda.TransformIvector(config, ivector, 1, &transformed);
+  }
+  PldaBatchScorer scorer(plda, train, num_train_utts, test);
+
+  Matrix<double> ref_scores(num_train, num_test);
+  for (int32 i = 0; i < num_train; i++)
+    for (int32 j = 0; j < num_test; j++)
+      ref_scores(i, j) = plda.LogLikelihoodRatio(
+          train.Row(i), num_train_utts.empty() ? 1 : num_train_utts[i],
+          test.Row(j));
+
+  for (int32 n = 0; n < 10; n++) {
+    int32 i = Rand() % num_train, j = Rand() % num_test;
+    AssertEqual(scorer.Score(i, j), ref_scores(i, j), 1.0e-06);
+  }
+  Matrix<double> scores(num_train, num_test);
+  scorer.ScoreBlock(0, 0, &scores);
+  KALDI_ASSERT(scores.ApproxEqual(ref_scores, 1.0e-06));
+
+  // A mixture of sparse and dense trials.
+  std::vector<std::pair<int32, int32> > trials;
+  int32 num_trials = Rand() % 20000;
+  for (int32 t = 0; t < num_trials; t++) {
+    if (Rand() % 2 == 0)
+      trials.push_back(std::make_pair(Rand() % num_train, Rand() % num_test));
+    else
+      trials.push_back(std::make_pair(Rand() % std::min(num_train, 10),
+                                      Rand() % std::min(num_test, 20)));
+  }
+  std::vector<double> trial_scores;
+  scorer.ScoreTrials(trials, &trial_scores);
+  KALDI_ASSERT(trial_scores.size() == trials.size());
+  for (int32 t = 0; t < num_trials; t++)
+    AssertEqual(trial_scores[t], ref_scores(trials[t].first, trials[t].second),
+                1.0e-06);
+}
+
 }
 
 
@@ -110,6 +184,8 @@ int main() {
 
   // UnitTestPldaEstimation(400);
   UnitTestPldaEstimation(40);
+  for (int i = 0; i < 5; i++)
+    UnitTestPldaBatchScorer();
   std::cout << "Test OK.\n";
   return 0;
 }
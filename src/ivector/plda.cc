@@ -18,8 +18,10 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <vector>
 #include "ivector/plda.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -192,6 +194,174 @@ double Plda::LogLikelihoodRatio(
 }
 
 
+PldaBatchScorer::PldaBatchScorer(
+    const Plda &plda,
+    const MatrixBase<double> &transformed_train_ivectors,
+    const std::vector<int32> &num_train_utts,
+    const MatrixBase<double> &transformed_test_ivectors):
+    train_(transformed_train_ivectors),
+    train_terms_(transformed_train_ivectors.NumRows(), kUndefined),
+    train_n_index_(transformed_train_ivectors.NumRows(), 0),
+    test_(transformed_test_ivectors) {
+  int32 dim = plda.Dim(), num_train = train_.NumRows(),
+      num_test = test_.NumRows();
+  KALDI_ASSERT(train_.NumCols() == dim && test_.NumCols() == dim);
+  KALDI_ASSERT(num_train_utts.empty() ||
+               static_cast<int32>(num_train_utts.size()) == num_train);
+  // The distinct values of n.
+  std::vector<int32> ns(num_train_utts);
+  if (ns.empty())
+    ns.push_back(1);
+  SortAndUniq(&ns);
+  int32 num_n = ns.size();
+  KALDI_ASSERT(ns[0] >= 0);
+  for (int32 i = 0; i < num_train && !num_train_utts.empty(); i++)
+    train_n_index_[i] = std::lower_bound(ns.begin(), ns.end(),
+                                         num_train_utts[i]) - ns.begin();
+
+  // See LogLikelihoodRatio() for the notation.  With a = n \Psi / (n \Psi + I)
+  // and v = I + \Psi / (n \Psi + I), expanding the log-likelihood ratio for
+  // training iVector x and test iVector y gives
+  //  -0.5 logdet(v) + 0.5 logdet(I + \Psi) - 0.5 x^T (a^2 / v) x
+  //  + x^T (a / v) y - 0.5 y^T (v^{-1} - (I + \Psi)^{-1}) y.
+  const Vector<double> &psi = plda.psi_;
+  Matrix<double> scales(num_n, dim, kUndefined),
+      train_quad(num_n, dim, kUndefined),
+      test_quad(num_n, dim, kUndefined);
+  Vector<double> consts(num_n, kUndefined);
+  for (int32 k = 0; k < num_n; k++) {
+    int32 n = ns[k];
+    double logdet = 0.0;
+    for (int32 d = 0; d < dim; d++) {
+      double a = n * psi(d) / (n * psi(d) + 1.0),
+          v = 1.0 + psi(d) / (n * psi(d) + 1.0);
+      logdet += -0.5 * Log(v) + 0.5 * Log(1.0 + psi(d));
+      scales(k, d) = a / v;
+      train_quad(k, d) = -0.5 * a * a / v;
+      test_quad(k, d) = -0.5 * (1.0 / v - 1.0 / (1.0 + psi(d)));
+    }
+    consts(k) = logdet;
+  }
+
+  Vector<double> train_sq(dim, kUndefined);
+  for (int32 i = 0; i < num_train; i++) {
+    int32 k = train_n_index_[i];
+    SubVector<double> train(train_, i);
+    train_sq.CopyFromVec(train);
+    train_sq.ApplyPow(2.0);
+    train_terms_(i) = consts(k) + VecVec(train_quad.Row(k), train_sq);
+    train.MulElements(scales.Row(k));
+  }
+
+  Matrix<double> test_sq(test_);
+  test_sq.ApplyPow(2.0);
+  test_terms_.Resize(num_n, num_test, kUndefined);
+  test_terms_.AddMatMat(1.0, test_quad, kNoTrans, test_sq, kTrans, 0.0);
+}
+
+double PldaBatchScorer::Score(int32 train_index, int32 test_index) const {
+  return train_terms_(train_index) +
+      test_terms_(train_n_index_[train_index], test_index) +
+      VecVec(train_.Row(train_index), test_.Row(test_index));
+}
+
+void PldaBatchScorer::ScoreBlock(int32 train_begin, int32 test_begin,
+                                 MatrixBase<double> *scores) const {
+  int32 num_rows = scores->NumRows(), num_cols = scores->NumCols();
+  scores->AddMatMat(1.0, train_.RowRange(train_begin, num_rows), kNoTrans,
+                    test_.RowRange(test_begin, num_cols), kTrans, 0.0);
+  scores->AddVecToCols(1.0, train_terms_.Range(train_begin, num_rows));
+  for (int32 r = 0; r < num_rows; r++)
+    scores->Row(r).AddVec(1.0, test_terms_.Row(
+        train_n_index_[train_begin + r]).Range(test_begin, num_cols));
+}
+
+// Scores groups of trials that are in the same block of training and test
+// iVectors; thread i does the groups i, i + num_threads_, ...
+class PldaBatchScorer::ScoreTrialsClass: public MultiThreadable {
+ public:
+  ScoreTrialsClass(const PldaBatchScorer &scorer,
+                   const std::vector<std::pair<int32, int32> > &trials,
+                   const std::vector<std::pair<int64, int32> > &sorted_trials,
+                   const std::vector<size_t> &group_begin,
+                   std::vector<double> *scores):
+      scorer_(scorer), trials_(trials), sorted_trials_(sorted_trials),
+      group_begin_(group_begin), scores_(scores) { }
+
+  void operator () () {
+    int32 num_groups = group_begin_.size() - 1;
+    Matrix<double> block_scores;
+    for (int32 g = thread_id_; g < num_groups; g += num_threads_) {
+      size_t begin = group_begin_[g], end = group_begin_[g + 1];
+      int32 train_min = trials_[sorted_trials_[begin].second].first,
+          train_max = train_min,
+          test_min = trials_[sorted_trials_[begin].second].second,
+          test_max = test_min;
+      for (size_t i = begin + 1; i < end; i++) {
+        const std::pair<int32, int32> &trial = trials_[sorted_trials_[i].second];
+        train_min = std::min(train_min, trial.first);
+        train_max = std::max(train_max, trial.first);
+        test_min = std::min(test_min, trial.second);
+        test_max = std::max(test_max, trial.second);
+      }
+      int32 num_rows = train_max - train_min + 1,
+          num_cols = test_max - test_min + 1;
+      // A matrix multiplication is many times faster per score than separate
+      // dot products, so it is worth computing scores we don't need.
+      if ((end - begin) * 8 >= static_cast<size_t>(num_rows) * num_cols) {
+        block_scores.Resize(num_rows, num_cols, kUndefined);
+        scorer_.ScoreBlock(train_min, test_min, &block_scores);
+        for (size_t i = begin; i < end; i++) {
+          int32 t = sorted_trials_[i].second;
+          (*scores_)[t] = block_scores(trials_[t].first - train_min,
+                                       trials_[t].second - test_min);
+        }
+      } else {
+        for (size_t i = begin; i < end; i++) {
+          int32 t = sorted_trials_[i].second;
+          (*scores_)[t] = scorer_.Score(trials_[t].first, trials_[t].second);
+        }
+      }
+    }
+  }
+ private:
+  const PldaBatchScorer &scorer_;
+  const std::vector<std::pair<int32, int32> > &trials_;
+  const std::vector<std::pair<int64, int32> > &sorted_trials_;
+  const std::vector<size_t> &group_begin_;
+  std::vector<double> *scores_;
+};
+
+void PldaBatchScorer::ScoreTrials(
+    const std::vector<std::pair<int32, int32> > &trials,
+    std::vector<double> *scores) const {
+  const int32 block_size = 256;
+  int32 num_trials = trials.size(),
+      num_test_blocks = (NumTest() + block_size - 1) / block_size;
+  // Pairs (block-index, trial-index), sorted so that the trials in the same
+  // block are together.
+  std::vector<std::pair<int64, int32> > sorted_trials(num_trials);
+  for (int32 t = 0; t < num_trials; t++) {
+    int32 train_index = trials[t].first, test_index = trials[t].second;
+    KALDI_ASSERT(train_index >= 0 && train_index < NumTrain() &&
+                 test_index >= 0 && test_index < NumTest());
+    int64 block = static_cast<int64>(train_index / block_size) *
+        num_test_blocks + test_index / block_size;
+    sorted_trials[t] = std::make_pair(block, t);
+  }
+  std::sort(sorted_trials.begin(), sorted_trials.end());
+  std::vector<size_t> group_begin;
+  for (int32 i = 0; i < num_trials; i++)
+    if (i == 0 || sorted_trials[i].first != sorted_trials[i - 1].first)
+      group_begin.push_back(i);
+  group_begin.push_back(num_trials);
+
+  scores->resize(num_trials);
+  ScoreTrialsClass c(*this, trials, sorted_trials, group_begin, scores);
+  RunMultiThreaded(c);
+}
+
+
 void Plda::SmoothWithinClassCovariance(double smoothing_factor) {
   KALDI_ASSERT(smoothing_factor >= 0.0 && smoothing_factor <= 1.0);
   // smoothing_factor > 1.0 is possible but wouldn't really make sense.
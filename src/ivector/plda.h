@@ -24,6 +24,7 @@
 
 #include <vector>
 #include <algorithm>
+#include <utility>
 #include "base/kaldi-common.h"
 #include "matrix/matrix-lib.h"
 #include "gmm/model-common.h"
@@ -144,6 +145,7 @@ class Plda {
   void ComputeDerivedVars(); // computes offset_.
   friend class PldaEstimator;
   friend class PldaUnsupervisedAdaptor;
+  friend class PldaBatchScorer;
 
   Vector<double> mean_;  // mean of samples in original space.
   Matrix<double> transform_; // of dimension Dim() by Dim();
@@ -169,6 +171,68 @@ class Plda {
 };
 
 
+/**
+   PldaBatchScorer computes Plda::LogLikelihoodRatio() for many pairs of
+   training and test iVectors.  For a given number of training utterances n,
+   the log-likelihood ratio is a quadratic function of the two iVectors,
+   which we write as
+      f(train, n) + g(test, n) + (a(n) * train) . test,
+   where a(n) is a diagonal matrix.  The constructor computes f(), g() and
+   a(n) * train for all the iVectors once, so that after that each score is a
+   dot product, and a block of scores is a matrix multiplication.
+*/
+class PldaBatchScorer {
+ public:
+  /// The rows of "transformed_train_ivectors" and "transformed_test_ivectors"
+  /// are iVectors that have been transformed by Plda::TransformIvector().
+  /// num_train_utts[i] is the number of utterances that training iVector i is
+  /// an average over; if it is empty, 1 is assumed for all of them.
+  PldaBatchScorer(const Plda &plda,
+                  const MatrixBase<double> &transformed_train_ivectors,
+                  const std::vector<int32> &num_train_utts,
+                  const MatrixBase<double> &transformed_test_ivectors);
+
+  int32 NumTrain() const { return train_.NumRows(); }
+  int32 NumTest() const { return test_.NumRows(); }
+
+  /// Returns the same as plda.LogLikelihoodRatio() would for training iVector
+  /// "train_index" and test iVector "test_index".
+  double Score(int32 train_index, int32 test_index) const;
+
+  /// Computes the scores for the training iVectors train_begin ...
+  /// train_begin + scores->NumRows() - 1 (indexing the rows of "scores")
+  /// and the test iVectors test_begin ... test_begin + scores->NumCols() - 1
+  /// (indexing the columns).
+  void ScoreBlock(int32 train_begin, int32 test_begin,
+                  MatrixBase<double> *scores) const;
+
+  /// Computes the scores for a list of trials, given as pairs (train-index,
+  /// test-index), and outputs them to "scores" in the same order.  The
+  /// trials are grouped into blocks of training and test iVectors, and the
+  /// blocks that have enough trials in them are scored with ScoreBlock().
+  /// This uses g_num_threads threads (see util/kaldi-thread.h).
+  void ScoreTrials(const std::vector<std::pair<int32, int32> > &trials,
+                   std::vector<double> *scores) const;
+
+ private:
+  class ScoreTrialsClass;
+
+  // Row i is the training iVector i times a(n), where n is its number of
+  // utterances.
+  Matrix<double> train_;
+  // The f(train, n) terms, including the constant terms.
+  Vector<double> train_terms_;
+  // The index into the distinct values of n, for each training iVector.
+  std::vector<int32> train_n_index_;
+  Matrix<double> test_;
+  // Element (k, j) is the g(test, n) term for test iVector j and the k'th
+  // distinct value of n.
+  Matrix<double> test_terms_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(PldaBatchScorer);
+};
+
+
 class PldaStats {
  public:
   PldaStats(): dim_(0) { } /// The dimension is set up the first time you add samples.
@@ -22,6 +22,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "util/stl-utils.h"
+#include "util/kaldi-thread.h"
 #include "ivector/agglomerative-clustering.h"
 
 int main(int argc, char *argv[]) {
@@ -49,6 +50,7 @@ int main(int argc, char *argv[]) {
     std::string reco2num_spk_rspecifier;
     BaseFloat threshold = 0.0;
     bool read_costs = false;
+    int32 first_pass_max_utterances = 0;
 
     po.Register("reco2num-spk-rspecifier", &reco2num_spk_rspecifier,
       "If supplied, clustering creates exactly this many clusters for each"
@@ -58,6 +60,13 @@ int main(int argc, char *argv[]) {
     po.Register("read-costs", &read_costs, "If true, the first"
       " argument is interpreted as a matrix of costs rather than a"
       " similarity matrix.");
+    po.Register("first-pass-max-utterances", &first_pass_max_utterances,
+      "If > 0 and a recording has more utterances than this, they are first"
+      " clustered in subsets of consecutive utterances of at most this size,"
+      " and the resulting clusters are then clustered together.  This is"
+      " faster for long recordings, but not exact.");
+    po.Register("num-threads", &g_num_threads, "Number of threads used to"
+      " compute the initial costs between clusters, for long recordings.");
 
     po.Read(argc, argv);
 
@@ -91,9 +100,11 @@ int main(int argc, char *argv[]) {
       if (reco2num_spk_rspecifier.size()) {
         int32 num_speakers = reco2num_spk_reader.Value(reco);
         AgglomerativeCluster(costs,
-          std::numeric_limits<BaseFloat>::max(), num_speakers, &spk_ids);
+          std::numeric_limits<BaseFloat>::max(), num_speakers,
+          first_pass_max_utterances, &spk_ids);
       } else {
-        AgglomerativeCluster(costs, threshold, 1, &spk_ids);
+        AgglomerativeCluster(costs, threshold, 1, first_pass_max_utterances,
+          &spk_ids);
       }
       for (int32 i = 0; i < spk_ids.size(); i++)
         label_writer.Write(uttlist[i], spk_ids[i]);
@@ -0,0 +1,258 @@
+// ivectorbin/ivector-extract-with-ubm.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "util/common-utils.h"
+#include "gmm/diag-gmm.h"
+#include "gmm/full-gmm.h"
+#include "ivector/ivector-extractor.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+// As IvectorExtractTask in ivector-extract.cc, but it also computes the
+// posteriors from the UBM.  The work happens in the operator (), the output
+// happens in the destructor.
+class IvectorExtractWithUbmTask {
+ public:
+  IvectorExtractWithUbmTask(const IvectorExtractor &extractor,
+                            const DiagGmm &diag_ubm,
+                            const FullGmm &full_ubm,
+                            const IvectorEstimationOptions &opts,
+                            const UbmPosteriorOptions &post_opts,
+                            std::string utt,
+                            const Matrix<BaseFloat> &feats,
+                            BaseFloatVectorWriter *writer,
+                            double *tot_auxf_change,
+                            double *tot_t,
+                            double *tot_ubm_loglike,
+                            int32 *num_done,
+                            int32 *num_err):
+      extractor_(extractor), diag_ubm_(diag_ubm), full_ubm_(full_ubm),
+      opts_(opts), post_opts_(post_opts), utt_(utt), feats_(feats),
+      writer_(writer), tot_auxf_change_(tot_auxf_change), tot_t_(tot_t),
+      tot_ubm_loglike_(tot_ubm_loglike), num_done_(num_done),
+      num_err_(num_err), success_(false), t_(0.0), ubm_loglike_(0.0),
+      auxf_change_(0.0) { }
+
+  void operator () () {
+    Posterior posterior;
+    if (!ComputeUbmPosteriors(post_opts_, diag_ubm_, full_ubm_, feats_,
+                              &posterior, &ubm_loglike_))
+      return;
+    t_ = opts_.acoustic_weight * TotalPosterior(posterior);
+    double max_count_scale = 1.0;
+    if (opts_.max_count > 0 && t_ > opts_.max_count) {
+      max_count_scale = opts_.max_count / t_;
+      KALDI_LOG << "Scaling stats for utterance " << utt_ << " by scale "
+                << max_count_scale << " due to --max-count="
+                << opts_.max_count;
+      t_ = opts_.max_count;
+    }
+    ScalePosterior(opts_.acoustic_weight * max_count_scale, &posterior);
+
+    bool need_2nd_order_stats = false;
+    IvectorExtractorUtteranceStats utt_stats(extractor_.NumGauss(),
+                                             extractor_.FeatDim(),
+                                             need_2nd_order_stats);
+    utt_stats.AccStats(feats_, posterior);
+
+    ivector_.Resize(extractor_.IvectorDim());
+    ivector_(0) = extractor_.PriorOffset();
+
+    if (tot_auxf_change_ != NULL) {
+      double old_auxf = extractor_.GetAuxf(utt_stats, ivector_);
+      extractor_.GetIvectorDistribution(utt_stats, &ivector_, NULL);
+      double new_auxf = extractor_.GetAuxf(utt_stats, ivector_);
+      auxf_change_ = new_auxf - old_auxf;
+    } else {
+      extractor_.GetIvectorDistribution(utt_stats, &ivector_, NULL);
+    }
+    success_ = true;
+  }
+  ~IvectorExtractWithUbmTask() {
+    if (!success_) {
+      KALDI_WARN << "Failed to compute posteriors for utterance " << utt_;
+      (*num_err_)++;
+      return;
+    }
+    if (tot_auxf_change_ != NULL) {
+      *tot_auxf_change_ += auxf_change_;
+      KALDI_VLOG(2) << "Auxf change for utterance " << utt_ << " was "
+                    << (auxf_change_ / t_) << " per frame over " << t_
+                    << " frames (weighted)";
+    }
+    KALDI_VLOG(2) << "UBM log-likelihood for utterance " << utt_ << " was "
+                  << (ubm_loglike_ / feats_.NumRows()) << " per frame over "
+                  << feats_.NumRows() << " frames.";
+    *tot_t_ += t_;
+    *tot_ubm_loglike_ += ubm_loglike_;
+    (*num_done_)++;
+    // We write out the offset of the iVectors from the mean of the prior
+    // distribution, as ivector-extract does.
+    ivector_(0) -= extractor_.PriorOffset();
+    KALDI_VLOG(2) << "Ivector norm for utterance " << utt_
+                  << " was " << ivector_.Norm(2.0);
+    writer_->Write(utt_, Vector<BaseFloat>(ivector_));
+  }
+ private:
+  const IvectorExtractor &extractor_;
+  const DiagGmm &diag_ubm_;
+  const FullGmm &full_ubm_;
+  const IvectorEstimationOptions &opts_;
+  const UbmPosteriorOptions &post_opts_;
+  std::string utt_;
+  Matrix<BaseFloat> feats_;
+  BaseFloatVectorWriter *writer_;
+  double *tot_auxf_change_; // if non-NULL we need the auxf change.
+  double *tot_t_;
+  double *tot_ubm_loglike_;
+  int32 *num_done_;
+  int32 *num_err_;
+  bool success_;
+  double t_;  // weighted number of frames.
+  double ubm_loglike_;
+  Vector<double> ivector_;
+  double auxf_change_;
+};
+
+}
+
+
+int main(int argc, char *argv[]) {
+  using namespace kaldi;
+  typedef kaldi::int32 int32;
+  typedef kaldi::int64 int64;
+  try {
+    const char *usage =
+        "Extract iVectors for utterances, using a trained iVector extractor\n"
+        "and the full-covariance UBM.  This is equivalent to the pipeline\n"
+        " gmm-gselect --n=<num-gselect> <diag-ubm> '$feats' ark:- | \\\n"
+        "  fgmm-global-gselect-to-post --min-post=<min-post> <full-ubm> \\\n"
+        "   '$feats' ark:- ark:- | scale-post ark:- <posterior-scale> ark:- | \\\n"
+        "  ivector-extract <extractor> '$feats' ark:- <ivector-wspecifier>\n"
+        "(where <diag-ubm> is obtained from <full-ubm> with fgmm-global-to-gmm),\n"
+        "but the posteriors are computed in-process, without reading the\n"
+        "features several times or writing any intermediate archives.\n"
+        "Usage:  ivector-extract-with-ubm [options] <full-ubm-in> "
+        "<extractor-in> <feature-rspecifier> <ivector-wspecifier>\n"
+        "e.g.: \n"
+        " ivector-extract-with-ubm --min-post=0.025 --posterior-scale=1.0 \\\n"
+        "   final.ubm final.ie '$feats' ark,t:ivectors.1.ark\n";
+
+    ParseOptions po(usage);
+    bool compute_objf_change = true;
+    IvectorEstimationOptions opts;
+    UbmPosteriorOptions post_opts;
+    TaskSequencerConfig sequencer_config;
+    po.Register("compute-objf-change", &compute_objf_change,
+                "If true, compute the change in objective function from using "
+                "nonzero iVector (a potentially useful diagnostic).  Combine "
+                "with --verbose=2 for per-utterance information");
+
+    opts.Register(&po);
+    post_opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string fgmm_rxfilename = po.GetArg(1),
+        ivector_extractor_rxfilename = po.GetArg(2),
+        feature_rspecifier = po.GetArg(3),
+        ivectors_wspecifier = po.GetArg(4);
+
+    // g_num_threads affects how ComputeDerivedVars is called when we read the
+    // extractor.
+    g_num_threads = sequencer_config.num_threads;
+    IvectorExtractor extractor;
+    ReadKaldiObject(ivector_extractor_rxfilename, &extractor);
+
+    FullGmm full_ubm;
+    ReadKaldiObject(fgmm_rxfilename, &full_ubm);
+    if (full_ubm.NumGauss() != extractor.NumGauss() ||
+        full_ubm.Dim() != extractor.FeatDim())
+      KALDI_ERR << "UBM and iVector extractor do not match: UBM has "
+                << full_ubm.NumGauss() << " Gaussians of dim "
+                << full_ubm.Dim() << ", extractor has " << extractor.NumGauss()
+                << " Gaussians of dim " << extractor.FeatDim();
+    DiagGmm diag_ubm;
+    diag_ubm.CopyFromFullGmm(full_ubm);
+
+    Timer timer;
+    double tot_auxf_change = 0.0, tot_t = 0.0, tot_ubm_loglike = 0.0;
+    int64 frame_count = 0;
+    int32 num_done = 0, num_err = 0;
+
+    SequentialBaseFloatMatrixReader feature_reader(feature_rspecifier);
+    BaseFloatVectorWriter ivector_writer(ivectors_wspecifier);
+
+    {
+      TaskSequencer<IvectorExtractWithUbmTask> sequencer(sequencer_config);
+      for (; !feature_reader.Done(); feature_reader.Next()) {
+        std::string utt = feature_reader.Key();
+        const Matrix<BaseFloat> &mat = feature_reader.Value();
+        if (mat.NumRows() == 0) {
+          KALDI_WARN << "Empty features for utterance " << utt;
+          num_err++;
+          continue;
+        }
+        if (mat.NumCols() != full_ubm.Dim()) {
+          KALDI_WARN << "Dimension mismatch for utterance " << utt
+                     << ": got " << mat.NumCols() << ", expected "
+                     << full_ubm.Dim();
+          num_err++;
+          continue;
+        }
+        double *auxf_ptr = (compute_objf_change ? &tot_auxf_change : NULL );
+        frame_count += mat.NumRows();
+        sequencer.Run(new IvectorExtractWithUbmTask(
+            extractor, diag_ubm, full_ubm, opts, post_opts, utt, mat,
+            &ivector_writer, auxf_ptr, &tot_t, &tot_ubm_loglike,
+            &num_done, &num_err));
+      }
+      // Destructor of "sequencer" will wait for any remaining tasks.
+    }
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken " << elapsed
+              << "s: real-time factor assuming 100 frames/sec is "
+              << (elapsed * 100.0 / frame_count) << " ("
+              << (frame_count / elapsed) << " frames/sec with "
+              << sequencer_config.num_threads << " threads)";
+    KALDI_LOG << "Done " << num_done << " files, " << num_err
+              << " with errors.  Total (weighted) frames " << tot_t;
+    KALDI_LOG << "Average UBM log-likelihood per frame was "
+              << (tot_ubm_loglike / frame_count) << " over "
+              << frame_count << " frames.";
+    if (compute_objf_change)
+      KALDI_LOG << "Overall average objective-function change from estimating "
+                << "ivector was " << (tot_auxf_change / tot_t) << " per frame "
+                << " over " << tot_t << " (weighted) frames.";
+
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
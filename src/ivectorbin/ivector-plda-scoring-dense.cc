@@ -22,6 +22,7 @@
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
 #include "util/stl-utils.h"
+#include "util/table-task-sequencer.h"
 #include "ivector/plda.h"
 
 namespace kaldi {
@@ -100,6 +101,57 @@ void ApplyPca(const Matrix<BaseFloat> &ivectors_in,
     pca_mat, kTrans, 0.0);
 }
 
+// Computes the score matrix for one recording; this is run by a
+// TableTaskSequencer, possibly in a different thread.
+class PldaScoringDenseTask {
+ public:
+  PldaScoringDenseTask(const Plda &plda, const PldaConfig &plda_config,
+                       BaseFloat target_energy, const std::string &reco,
+                       Matrix<BaseFloat> *ivector_mat):
+      plda_(plda), plda_config_(plda_config), target_energy_(target_energy),
+      reco_(reco) {
+    ivector_mat_.Swap(ivector_mat);
+  }
+
+  bool operator () (Matrix<BaseFloat> *scores) {
+    Plda this_plda(plda_);
+    Matrix<BaseFloat> ivector_mat_pca,
+                      ivector_mat_plda,
+                      pca_transform;
+    scores->Resize(ivector_mat_.NumRows(), ivector_mat_.NumRows());
+    if (EstPca(ivector_mat_, target_energy_, &pca_transform)) {
+      // Apply the PCA transform to the raw i-vectors.
+      ApplyPca(ivector_mat_, pca_transform, &ivector_mat_pca);
+
+      // Apply the PCA transform to the parameters of the PLDA model.
+      this_plda.ApplyTransform(Matrix<double>(pca_transform));
+
+      // Now transform the i-vectors using the reduced PLDA model.
+      TransformIvectors(ivector_mat_pca, plda_config_, this_plda,
+        &ivector_mat_plda);
+    } else {
+      KALDI_WARN << "Unable to compute conversation dependent PCA for"
+        << " recording " << reco_ << ".";
+    }
+    if (ivector_mat_plda.NumRows() != 0) {
+      // All the pairs of i-vectors are scored with one matrix multiplication.
+      Matrix<double> ivector_mat_plda_dbl(ivector_mat_plda),
+          scores_dbl(ivector_mat_plda.NumRows(), ivector_mat_plda.NumRows());
+      PldaBatchScorer scorer(this_plda, ivector_mat_plda_dbl,
+                             std::vector<int32>(), ivector_mat_plda_dbl);
+      scorer.ScoreBlock(0, 0, &scores_dbl);
+      scores->CopyFromMat(scores_dbl);
+    }
+    return true;
+  }
+ private:
+  const Plda &plda_;
+  const PldaConfig &plda_config_;
+  BaseFloat target_energy_;
+  std::string reco_;
+  Matrix<BaseFloat> ivector_mat_;
+};
+
 } // namespace kaldi
 
 int main(int argc, char *argv[]) {
@@ -114,6 +166,9 @@ int main(int argc, char *argv[]) {
       "an archive of score matrices, one for each recording-id.  The rows\n"
       "and columns of the the matrix correspond the sorted order of the\n"
       "segments.\n"
+      "The scores for each recording are computed with a matrix\n"
+      "multiplication, and different recordings are scored in parallel if\n"
+      "--num-threads > 1.\n"
       "Usage: ivector-plda-scoring-dense [options] <plda> <reco2utt>"
       " <ivectors-rspecifier> <scores-wspecifier>\n"
       "e.g.: \n"
@@ -123,7 +178,9 @@ int main(int argc, char *argv[]) {
     ParseOptions po(usage);
     BaseFloat target_energy = 0.5;
     PldaConfig plda_config;
+    TaskSequencerConfig sequencer_config;
     plda_config.Register(&po);
+    sequencer_config.Register(&po);
 
     po.Register("target-energy", &target_energy,
       "Reduce dimensionality of i-vectors using a recording-dependent"
@@ -150,63 +207,41 @@ int main(int argc, char *argv[]) {
     BaseFloatMatrixWriter scores_writer(scores_wspecifier);
     int32 num_reco_err = 0,
           num_reco_done = 0;
-    for (; !reco2utt_reader.Done(); reco2utt_reader.Next()) {
-      Plda this_plda(plda);
-      std::string reco = reco2utt_reader.Key();
+    {
+      TableTaskSequencer<KaldiObjectHolder<Matrix<BaseFloat> >,
+                         PldaScoringDenseTask> sequencer(sequencer_config,
+                                                         &scores_writer);
+      for (; !reco2utt_reader.Done(); reco2utt_reader.Next()) {
+        std::string reco = reco2utt_reader.Key();
 
-      std::vector<std::string> uttlist = reco2utt_reader.Value();
-      std::vector<Vector<BaseFloat> > ivectors;
+        std::vector<std::string> uttlist = reco2utt_reader.Value();
+        std::vector<Vector<BaseFloat> > ivectors;
 
-      for (size_t i = 0; i < uttlist.size(); i++) {
-        std::string utt = uttlist[i];
+        for (size_t i = 0; i < uttlist.size(); i++) {
+          std::string utt = uttlist[i];
 
-        if (!ivector_reader.HasKey(utt)) {
-          KALDI_ERR << "No iVector present in input for utterance " << utt;
-        }
+          if (!ivector_reader.HasKey(utt)) {
+            KALDI_ERR << "No iVector present in input for utterance " << utt;
+          }
 
-        Vector<BaseFloat> ivector = ivector_reader.Value(utt);
-        ivectors.push_back(ivector);
-      }
-      if (ivectors.size() == 0) {
-        KALDI_WARN << "Not producing output for recording " << reco
-                   << " since no segments had iVectors";
-        num_reco_err++;
-      } else {
-        Matrix<BaseFloat> ivector_mat(ivectors.size(), ivectors[0].Dim()),
-                          ivector_mat_pca,
-                          ivector_mat_plda,
-                          pca_transform,
-                          scores(ivectors.size(), ivectors.size());
-
-        for (size_t i = 0; i < ivectors.size(); i++) {
-          ivector_mat.Row(i).CopyFromVec(ivectors[i]);
+          Vector<BaseFloat> ivector = ivector_reader.Value(utt);
+          ivectors.push_back(ivector);
         }
-        if (EstPca(ivector_mat, target_energy, &pca_transform)) {
-          // Apply the PCA transform to the raw i-vectors.
-          ApplyPca(ivector_mat, pca_transform, &ivector_mat_pca);
-
-          // Apply the PCA transform to the parameters of the PLDA model.
-          this_plda.ApplyTransform(Matrix<double>(pca_transform));
-
-          // Now transform the i-vectors using the reduced PLDA model.
-          TransformIvectors(ivector_mat_pca, plda_config, this_plda,
-            &ivector_mat_plda);
+        if (ivectors.size() == 0) {
+          KALDI_WARN << "Not producing output for recording " << reco
+                     << " since no segments had iVectors";
+          num_reco_err++;
         } else {
-          KALDI_WARN << "Unable to compute conversation dependent PCA for"
-            << " recording " << reco << ".";
-          ivector_mat_pca.Resize(ivector_mat.NumRows(), ivector_mat.NumCols());
-          ivector_mat_pca.CopyFromMat(ivector_mat);
-        }
-        for (int32 i = 0; i < ivector_mat_plda.NumRows(); i++) {
-          for (int32 j = 0; j < ivector_mat_plda.NumRows(); j++) {
-            scores(i, j) = this_plda.LogLikelihoodRatio(Vector<double>(
-              ivector_mat_plda.Row(i)), 1.0,
-              Vector<double>(ivector_mat_plda.Row(j)));
+          Matrix<BaseFloat> ivector_mat(ivectors.size(), ivectors[0].Dim());
+          for (size_t i = 0; i < ivectors.size(); i++) {
+            ivector_mat.Row(i).CopyFromVec(ivectors[i]);
           }
+          sequencer.Run(reco, new PldaScoringDenseTask(
+              plda, plda_config, target_energy, reco, &ivector_mat));
         }
-        scores_writer.Write(reco, scores);
-        num_reco_done++;
       }
+      sequencer.Wait();
+      num_reco_done = sequencer.NumDone();
     }
     KALDI_LOG << "Processed " << num_reco_done << " recordings, "
               << num_reco_err << " had errors.";
@@ -20,6 +20,7 @@
 
 #include "base/kaldi-common.h"
 #include "util/common-utils.h"
+#include "util/kaldi-thread.h"
 #include "ivector/plda.h"
 
 
@@ -46,6 +47,8 @@ int main(int argc, char *argv[]) {
         "\n"
         "e.g.: ivector-plda-scoring --num-utts=ark:exp/train/num_utts.ark plda "
         "ark:exp/train/spk_ivectors.ark ark:exp/test/ivectors.ark trials scores\n"
+        "The scores are computed in blocks of training x test iVectors using\n"
+        "matrix multiplications, in --num-threads threads.\n"
         "See also: ivector-compute-dot-products, ivector-compute-plda\n";
 
     ParseOptions po(usage);
@@ -56,6 +59,8 @@ int main(int argc, char *argv[]) {
     plda_config.Register(&po);
     po.Register("num-utts", &num_utts_rspecifier, "Table to read the number of "
                 "utterances per speaker, e.g. ark:num_utts.ark\n");
+    po.Register("num-threads", &g_num_threads, "Number of threads to use for "
+                "computing the scores.");
 
     po.Read(argc, argv);
 
@@ -85,18 +90,21 @@ int main(int argc, char *argv[]) {
     SequentialBaseFloatVectorReader test_ivector_reader(test_ivector_rspecifier);
     RandomAccessInt32Reader num_utts_reader(num_utts_rspecifier);
 
-    typedef unordered_map<string, Vector<BaseFloat>*, StringHasher> HashType;
+    typedef unordered_map<string, int32, StringHasher> HashType;
 
-    // These hashes will contain the iVectors in the PLDA subspace
-    // (that makes the within-class variance unit and diagonalizes the
-    // between-class covariance).  They will also possibly be length-normalized,
-    // depending on the config.
-    HashType train_ivectors, test_ivectors;
+    // These hashes map from the keys to the indexes of the iVectors in
+    // train_ivectors and test_ivectors, which will contain the iVectors in
+    // the PLDA subspace (that makes the within-class variance unit and
+    // diagonalizes the between-class covariance).  They will also possibly be
+    // length-normalized, depending on the config.
+    HashType train_indexes, test_indexes;
+    std::vector<Vector<BaseFloat>*> train_ivectors, test_ivectors;
+    std::vector<int32> num_train_utts;
 
     KALDI_LOG << "Reading train iVectors";
     for (; !train_ivector_reader.Done(); train_ivector_reader.Next()) {
       std::string spk = train_ivector_reader.Key();
-      if (train_ivectors.count(spk) != 0) {
+      if (train_indexes.count(spk) != 0) {
         KALDI_ERR << "Duplicate training iVector found for speaker " << spk;
       }
       const Vector<BaseFloat> &ivector = train_ivector_reader.Value();
@@ -116,7 +124,10 @@ int main(int argc, char *argv[]) {
       tot_train_renorm_scale += plda.TransformIvector(plda_config, ivector,
                                                       num_examples,
                                                       transformed_ivector);
-      train_ivectors[spk] = transformed_ivector;
+      train_indexes[spk] = train_ivectors.size();
+      train_ivectors.push_back(transformed_ivector);
+      if (!num_utts_rspecifier.empty())
+        num_train_utts.push_back(num_examples);
       num_train_ivectors++;
     }
     KALDI_LOG << "Read " << num_train_ivectors << " training iVectors, "
@@ -129,7 +140,7 @@ int main(int argc, char *argv[]) {
     KALDI_LOG << "Reading test iVectors";
     for (; !test_ivector_reader.Done(); test_ivector_reader.Next()) {
       std::string utt = test_ivector_reader.Key();
-      if (test_ivectors.count(utt) != 0) {
+      if (test_indexes.count(utt) != 0) {
         KALDI_ERR << "Duplicate test iVector found for utterance " << utt;
       }
       const Vector<BaseFloat> &ivector = test_ivector_reader.Value();
@@ -141,7 +152,8 @@ int main(int argc, char *argv[]) {
       tot_test_renorm_scale += plda.TransformIvector(plda_config, ivector,
                                                      num_examples,
                                                      transformed_ivector);
-      test_ivectors[utt] = transformed_ivector;
+      test_indexes[utt] = test_ivectors.size();
+      test_ivectors.push_back(transformed_ivector);
       num_test_ivectors++;
     }
     KALDI_LOG << "Read " << num_test_ivectors << " test iVectors.";
@@ -151,6 +163,18 @@ int main(int argc, char *argv[]) {
               << (tot_test_renorm_scale / num_test_ivectors);
 
 
+    Matrix<double> train_mat(num_train_ivectors, dim, kUndefined),
+        test_mat(num_test_ivectors, dim, kUndefined);
+    for (size_t i = 0; i < train_ivectors.size(); i++) {
+      train_mat.Row(i).CopyFromVec(*(train_ivectors[i]));
+      delete train_ivectors[i];
+    }
+    for (size_t i = 0; i < test_ivectors.size(); i++) {
+      test_mat.Row(i).CopyFromVec(*(test_ivectors[i]));
+      delete test_ivectors[i];
+    }
+    PldaBatchScorer scorer(plda, train_mat, num_train_utts, test_mat);
+
     Input ki(trials_rxfilename);
     bool binary = false;
     Output ko(scores_wxfilename, binary);
@@ -158,55 +182,56 @@ int main(int argc, char *argv[]) {
     double sum = 0.0, sumsq = 0.0;
     std::string line;
 
-    while (std::getline(ki.Stream(), line)) {
-      std::vector<std::string> fields;
-      SplitStringToVector(line, " \t\n\r", true, &fields);
-      if (fields.size() != 2) {
-        KALDI_ERR << "Bad line " << (num_trials_done + num_trials_err)
-                  << "in input (expected two fields: key1 key2): " << line;
-      }
-      std::string key1 = fields[0], key2 = fields[1];
-      if (train_ivectors.count(key1) == 0) {
-        KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
-        num_trials_err++;
-        continue;
-      }
-      if (test_ivectors.count(key2) == 0) {
-        KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
-        num_trials_err++;
-        continue;
-      }
-      const Vector<BaseFloat> *train_ivector = train_ivectors[key1],
-          *test_ivector = test_ivectors[key2];
-
-      Vector<double> train_ivector_dbl(*train_ivector),
-          test_ivector_dbl(*test_ivector);
-
-      int32 num_train_examples;
-      if (!num_utts_rspecifier.empty()) {
-        // we already checked that it has this key.
-        num_train_examples = num_utts_reader.Value(key1);
+    // We read the trials in chunks of this many, and score each chunk at
+    // once.
+    const size_t trials_per_chunk = 1000000;
+    std::vector<std::pair<std::string, std::string> > chunk_keys;
+    std::vector<std::pair<int32, int32> > chunk_trials;
+    std::vector<double> chunk_scores;
+    bool done = false;
+    while (!done) {
+      if (!std::getline(ki.Stream(), line)) {
+        done = true;
       } else {
-        num_train_examples = 1;
+        std::vector<std::string> fields;
+        SplitStringToVector(line, " \t\n\r", true, &fields);
+        if (fields.size() != 2) {
+          KALDI_ERR << "Bad line " << (num_trials_done + chunk_trials.size() +
+                                       num_trials_err)
+                    << "in input (expected two fields: key1 key2): " << line;
+        }
+        std::string key1 = fields[0], key2 = fields[1];
+        HashType::const_iterator train_iter = train_indexes.find(key1),
+            test_iter = test_indexes.find(key2);
+        if (train_iter == train_indexes.end()) {
+          KALDI_WARN << "Key " << key1 << " not present in training iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        if (test_iter == test_indexes.end()) {
+          KALDI_WARN << "Key " << key2 << " not present in test iVectors.";
+          num_trials_err++;
+          continue;
+        }
+        chunk_keys.push_back(std::make_pair(key1, key2));
+        chunk_trials.push_back(std::make_pair(train_iter->second,
+                                              test_iter->second));
+        if (chunk_trials.size() < trials_per_chunk)
+          continue;
       }
-
-
-      BaseFloat score = plda.LogLikelihoodRatio(train_ivector_dbl,
-                                                num_train_examples,
-                                                test_ivector_dbl);
-      sum += score;
-      sumsq += score * score;
-      num_trials_done++;
-      ko.Stream() << key1 << ' ' << key2 << ' ' << score << std::endl;
+      scorer.ScoreTrials(chunk_trials, &chunk_scores);
+      for (size_t t = 0; t < chunk_trials.size(); t++) {
+        BaseFloat score = chunk_scores[t];
+        sum += score;
+        sumsq += score * score;
+        num_trials_done++;
+        ko.Stream() << chunk_keys[t].first << ' ' << chunk_keys[t].second
+                    << ' ' << score << '\n';
+      }
+      chunk_keys.clear();
+      chunk_trials.clear();
     }
 
-    for (HashType::iterator iter = train_ivectors.begin();
-         iter != train_ivectors.end(); ++iter)
-      delete iter->second;
-    for (HashType::iterator iter = test_ivectors.begin();
-         iter != test_ivectors.end(); ++iter)
-      delete iter->second;
-
 
     if (num_trials_done != 0) {
       BaseFloat mean = sum / num_trials_done, scatter = sumsq / num_trials_done,
@@ -23,6 +23,7 @@
 #include "fstext/fst-test-utils.h"
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
+#include "hmm/hmm-test-utils.h"
 
 namespace fst {
 // Caution: these tests are not as generic as you might think from all the
@@ -136,6 +137,122 @@ template<class Arc> void TestDeterminizeLatticePruned2() {
   }
 }
 
+// test that splitting the lattice and determinizing the pieces in parallel
+// gives the same result as determinizing it all at once.
+template<class Arc> void TestDeterminizeLatticePrunedSegmented() {
+  typedef kaldi::int32 Int;
+  typedef typename Arc::Weight Weight;
+  typedef ArcTpl<CompactLatticeWeightTpl<Weight, Int> > CompactArc;
+
+  for(int i = 0; i < 100; i++) {
+    RandFstOptions opts;
+    opts.n_states = 4;
+    opts.n_arcs = 10;
+    opts.n_final = 2;
+    opts.allow_empty = false;
+    opts.weight_multiplier = 0.5;
+    opts.acyclic = true;
+
+    // Concatenate some random FSTs, so there are states that all paths pass
+    // through.
+    VectorFst<Arc> fst;
+    int num_pieces = kaldi::RandInt(1, 4);
+    for (int j = 0; j < num_pieces; j++) {
+      VectorFst<Arc> *piece = RandPairFst<Arc>(opts);
+      if (j == 0)
+        fst = *piece;
+      else
+        Concat(&fst, *piece);
+      delete piece;
+    }
+    bool sorted = TopSort(&fst);
+    KALDI_ASSERT(sorted);
+
+    DeterminizeLatticePrunedOptions lat_opts;
+    VectorFst<CompactArc> det_fst, segmented_det_fst;
+    bool ans = DeterminizeLatticePruned<Weight, Int>(fst, 10.0, &det_fst,
+                                                     lat_opts);
+    lat_opts.num_threads = kaldi::RandInt(2, 4);
+    lat_opts.segment_length = kaldi::RandInt(0, 2);
+    bool segmented_ans = DeterminizeLatticePruned<Weight, Int>(
+        fst, 10.0, &segmented_det_fst, lat_opts);
+    KALDI_ASSERT(segmented_det_fst.Properties(kIDeterministic, true) &
+                 kIDeterministic);
+    // The alignments may differ where there are ties, so we just compare the
+    // word sequences and costs.
+    RemoveAlignmentsFromCompactLattice(&det_fst);
+    RemoveAlignmentsFromCompactLattice(&segmented_det_fst);
+    if (ans && segmented_ans)
+      KALDI_ASSERT(RandEquivalent(det_fst, segmented_det_fst, 5/*paths*/,
+                                  0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                  100/*path length, max*/));
+  }
+}
+
+// As TestDeterminizeLatticePrunedSegmented(), but for the phone-pruned
+// version with a real TransitionModel, whose first pass inserts phones and
+// splits the lattice by counting transition-ids.
+void TestDeterminizeLatticePhonePrunedSegmented() {
+  using kaldi::LatticeArc;
+  using kaldi::CompactLatticeArc;
+  kaldi::TransitionModel *trans_model = kaldi::GenRandTransitionModel(NULL);
+
+  for(int i = 0; i < 100; i++) {
+    RandFstOptions opts;
+    opts.n_states = 4;
+    opts.n_arcs = 10;
+    opts.n_final = 2;
+    opts.allow_empty = false;
+    opts.weight_multiplier = 0.5;
+    opts.acyclic = true;
+
+    // The input labels of the random FSTs are mapped to random
+    // transition-ids; 0 stays epsilon.
+    std::vector<kaldi::int32> tids(opts.n_syms);
+    for (size_t l = 1; l < tids.size(); l++)
+      tids[l] = kaldi::RandInt(1, trans_model->NumTransitionIds());
+
+    VectorFst<LatticeArc> fst;
+    int num_pieces = kaldi::RandInt(1, 4);
+    for (int j = 0; j < num_pieces; j++) {
+      VectorFst<LatticeArc> *piece = RandPairFst<LatticeArc>(opts);
+      if (j == 0)
+        fst = *piece;
+      else
+        Concat(&fst, *piece);
+      delete piece;
+    }
+    for (StateIterator<VectorFst<LatticeArc> > siter(fst); !siter.Done();
+         siter.Next()) {
+      for (MutableArcIterator<VectorFst<LatticeArc> > aiter(&fst,
+                                                              siter.Value());
+           !aiter.Done(); aiter.Next()) {
+        LatticeArc arc = aiter.Value();
+        arc.ilabel = tids[arc.ilabel];
+        aiter.SetValue(arc);
+      }
+    }
+
+    DeterminizeLatticePhonePrunedOptions lat_opts;
+    VectorFst<LatticeArc> fst_copy(fst);
+    VectorFst<CompactLatticeArc> det_fst, segmented_det_fst;
+    bool ans = DeterminizeLatticePhonePrunedWrapper(*trans_model, &fst_copy,
+                                                    10.0, &det_fst, lat_opts);
+    lat_opts.num_threads = kaldi::RandInt(2, 4);
+    lat_opts.segment_length = kaldi::RandInt(0, 2);
+    bool segmented_ans = DeterminizeLatticePhonePrunedWrapper(
+        *trans_model, &fst, 10.0, &segmented_det_fst, lat_opts);
+    KALDI_ASSERT(segmented_det_fst.Properties(kIDeterministic, true) &
+                 kIDeterministic);
+    RemoveAlignmentsFromCompactLattice(&det_fst);
+    RemoveAlignmentsFromCompactLattice(&segmented_det_fst);
+    if (ans && segmented_ans)
+      KALDI_ASSERT(RandEquivalent(det_fst, segmented_det_fst, 5/*paths*/,
+                                  0.01/*delta*/, kaldi::Rand()/*seed*/,
+                                  100/*path length, max*/));
+  }
+  delete trans_model;
+}
 
 } // end namespace fst
 
@@ -143,5 +260,7 @@ int main() {
   using namespace fst;
   TestDeterminizeLatticePruned<kaldi::LatticeArc>();
   TestDeterminizeLatticePruned2<kaldi::LatticeArc>();
+  TestDeterminizeLatticePrunedSegmented<kaldi::LatticeArc>();
+  TestDeterminizeLatticePhonePrunedSegmented();
   std::cout << "Tests succeeded\n";
 }
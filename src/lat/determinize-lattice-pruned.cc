@@ -21,12 +21,14 @@
 
 #include <vector>
 #include <climits>
+#include <memory>
 #include "fstext/determinize-lattice.h" // for LatticeStringRepository
 #include "fstext/fstext-utils.h"
 #include "lat/lattice-functions.h"  // for PruneLattice
 #include "lat/minimize-lattice.h"   // for minimization
 #include "lat/push-lattice.h"       // for minimization
 #include "lat/determinize-lattice-pruned.h"
+#include "util/kaldi-thread.h"
 
 namespace fst {
 
@@ -1185,6 +1187,18 @@ template<class Weight, class IntType> class LatticeDeterminizerPruned {
 };
 
 
+// Declared here because DeterminizeLatticePruned() uses it; see its definition
+// below.
+template<class Weight, class IntType>
+bool DeterminizeLatticeSegments(const kaldi::TransitionModel *trans_model,
+                                double beam,
+                                int32 num_threads,
+                                int32 segment_length,
+                                const DeterminizeLatticePrunedOptions &opts,
+                                MutableFst<ArcTpl<Weight> > *fst,
+                                bool *ans);
+
+
 // normally Weight would be LatticeWeight<float> (which has two floats),
 // or possibly TropicalWeightTpl<float>, and IntType would be int32.
 // Caution: there are two versions of the function DeterminizeLatticePruned,
@@ -1201,6 +1215,20 @@ bool DeterminizeLatticePruned(
     ofst->DeleteStates();
     return true;
   }
+  if (opts.num_threads > 1) {
+    // Determinize pieces of the lattice in parallel, then the result as a
+    // whole, which gives the same output (see DeterminizeLatticeSegments()).
+    int32 num_threads = opts.num_threads;
+    opts.num_threads = 1;
+    VectorFst<ArcTpl<Weight> > segmented_fst(ifst);
+    bool ans = true;
+    if (DeterminizeLatticeSegments<Weight, IntType>(
+            NULL, beam, num_threads, opts.segment_length, opts,
+            &segmented_fst, &ans))
+      return DeterminizeLatticePruned<Weight, IntType>(
+          segmented_fst, beam, ofst, opts) && ans;
+    // Otherwise the lattice could not be split, so just carry on.
+  }
   KALDI_ASSERT(opts.retry_cutoff >= 0.0 && opts.retry_cutoff < 1.0);
   int32 max_num_iters = 10;  // avoid the potential for infinite loops if
                              // retrying.
@@ -1407,6 +1435,213 @@ bool DeterminizeLatticePhonePrunedFirstPass(
   return ans;
 }
 
+
+// This is the task that DeterminizeLatticeSegments() gives to a TaskSequencer
+// for each segment.
+template<class Weight, class IntType>
+class DeterminizeLatticeSegmentTask {
+ public:
+  DeterminizeLatticeSegmentTask(const kaldi::TransitionModel *trans_model,
+                                double beam,
+                                const DeterminizeLatticePrunedOptions &opts,
+                                VectorFst<ArcTpl<Weight> > *fst,
+                                bool *ans):
+      trans_model_(trans_model), beam_(beam), opts_(opts), fst_(fst),
+      ans_(ans) { }
+
+  void operator () () {
+    if (trans_model_ != NULL)
+      *ans_ = DeterminizeLatticePhonePrunedFirstPass<Weight, IntType>(
+          *trans_model_, beam_, fst_, opts_);
+    else
+      *ans_ = DeterminizeLatticePruned<Weight>(*fst_, beam_, fst_, opts_);
+  }
+
+ private:
+  const kaldi::TransitionModel *trans_model_;
+  double beam_;
+  const DeterminizeLatticePrunedOptions &opts_;
+  VectorFst<ArcTpl<Weight> > *fst_;
+  bool *ans_;
+};
+
+/*
+   DeterminizeLatticeSegments() is used when the options ask for more than one
+   thread.  The lattice *fst, which must be topologically sorted with the words
+   on the input side and the transition-ids on the output side, is split at
+   "cut states", i.e. states that every successful path passes through; in the
+   lattices that the decoders produce these are typically frames where only one
+   token survived pruning.  The segments between the cut states we choose, which
+   are at least segment_length frames long, are determinized independently using
+   up to num_threads threads, with DeterminizeLatticePhonePrunedFirstPass() if
+   trans_model != NULL and with DeterminizeLatticePruned() otherwise; then *fst
+   is replaced with the concatenation of the results.
+
+   The result is not deterministic, because a word sequence may be split among
+   the segments in more than one way, so (like the output of
+   DeterminizeLatticePhonePrunedFirstPass()) it needs a pass of word-level
+   determinization.  That gives the same result as determinizing the original
+   lattice: the costs of the segments add up, so the best path for any word
+   sequence consists of the best paths, within each segment, for its part of the
+   word sequence, and each of those is within the beam of the best path in its
+   segment, so it is not pruned away.
+
+   Returns false, leaving *fst unchanged, if the lattice cannot be split into at
+   least two segments.  Otherwise sets *ans to false if the determinization of
+   any of the segments stopped early (see DeterminizeLatticePruned()).
+*/
+template<class Weight, class IntType>
+bool DeterminizeLatticeSegments(const kaldi::TransitionModel *trans_model,
+                                double beam,
+                                int32 num_threads,
+                                int32 segment_length,
+                                const DeterminizeLatticePrunedOptions &opts,
+                                MutableFst<ArcTpl<Weight> > *fst,
+                                bool *ans) {
+  typedef ArcTpl<Weight> Arc;
+  typedef typename Arc::StateId StateId;
+
+  StateId num_states = fst->NumStates(), start = fst->Start();
+  if (start == kNoStateId || fst->Properties(kTopSorted, true) == 0)
+    return false;
+
+  // frames[s] is the number of frames (i.e. transition-ids) before state s, or
+  // -1 if s is not reachable; it only matters for the cut states, for which
+  // all paths agree.
+  std::vector<int32> frames(num_states, -1);
+  frames[start] = 0;
+  // The cut states: a reachable state s > start is a cut state if no
+  // reachable state before it is final or has an arc to a state after it.
+  std::vector<StateId> cut_states;
+  StateId max_nextstate = start;
+  bool seen_final = false;
+  int32 num_frames = 0;
+  for (StateId s = start; s < num_states; s++) {
+    if (frames[s] < 0)
+      continue;
+    if (s > start && max_nextstate <= s && !seen_final)
+      cut_states.push_back(s);
+    if (fst->Final(s) != Weight::Zero())
+      seen_final = true;
+    num_frames = std::max(num_frames, frames[s]);
+    for (ArcIterator<MutableFst<Arc> > aiter(*fst, s);
+         !aiter.Done(); aiter.Next()) {
+      const Arc &arc = aiter.Value();
+      if (arc.nextstate <= s)
+        return false;  // Not acyclic, which is not expected.
+      max_nextstate = std::max(max_nextstate, arc.nextstate);
+      frames[arc.nextstate] = std::max(frames[arc.nextstate],
+                                       frames[s] + (arc.olabel != 0 ? 1 : 0));
+    }
+  }
+
+  // Choose the cut states at which we split the lattice; the segments are
+  // [boundaries[i], boundaries[i+1]] except for the last one, which goes on to
+  // the end of the lattice.
+  std::vector<StateId> boundaries(1, start);
+  for (size_t i = 0; i < cut_states.size(); i++) {
+    int32 t = frames[cut_states[i]];
+    if (t - frames[boundaries.back()] >= segment_length &&
+        num_frames - t >= segment_length)
+      boundaries.push_back(cut_states[i]);
+  }
+  int32 num_segments = boundaries.size();
+  if (num_segments < 2)
+    return false;
+  KALDI_VLOG(3) << "Splitting lattice with " << num_frames << " frames into "
+                << num_segments << " segments for determinization.";
+
+  std::vector<VectorFst<Arc> > segments(num_segments);
+  for (int32 i = 0; i < num_segments; i++) {
+    bool last = (i + 1 == num_segments);
+    StateId begin = boundaries[i],
+        end = (last ? num_states - 1 : boundaries[i + 1]);
+    VectorFst<Arc> &segment = segments[i];
+    for (StateId s = begin; s <= end; s++)
+      segment.AddState();
+    segment.SetStart(0);
+    for (StateId s = begin; s <= end; s++) {
+      // Unreachable states are left without arcs, as they may have arcs to
+      // states outside the segment.
+      if (frames[s] < 0)
+        continue;
+      if (last) {
+        segment.SetFinal(s - begin, fst->Final(s));
+      } else if (s == end) {
+        // The arcs of the cut state belong to the next segment.
+        segment.SetFinal(s - begin, Weight::One());
+        continue;
+      }
+      for (ArcIterator<MutableFst<Arc> > aiter(*fst, s);
+           !aiter.Done(); aiter.Next()) {
+        Arc arc = aiter.Value();
+        arc.nextstate -= begin;
+        segment.AddArc(s - begin, arc);
+      }
+    }
+  }
+  fst->DeleteStates();
+
+  std::unique_ptr<bool[]> segment_ans(new bool[num_segments]);
+  {
+    kaldi::TaskSequencerConfig sequencer_config;
+    sequencer_config.num_threads = num_threads;
+    sequencer_config.num_threads_total = num_threads;
+    kaldi::TaskSequencer<DeterminizeLatticeSegmentTask<Weight, IntType> >
+        sequencer(sequencer_config);
+    for (int32 i = 0; i < num_segments; i++)
+      sequencer.Run(new DeterminizeLatticeSegmentTask<Weight, IntType>(
+          trans_model, beam, opts, &(segments[i]), &(segment_ans[i])));
+    sequencer.Wait();
+  }
+
+  // Concatenate the segments, joining the final states of each one to the
+  // start state of the next with epsilon arcs that carry the final-probs.
+  std::vector<std::pair<StateId, Weight> > prev_finals;
+  for (int32 i = 0; i < num_segments; i++) {
+    VectorFst<Arc> &segment = segments[i];
+    if (!segment_ans[i])
+      *ans = false;
+    if (segment.Start() == kNoStateId) {
+      // There is no successful path.
+      fst->DeleteStates();
+      return true;
+    }
+    StateId offset = fst->NumStates();
+    for (StateIterator<VectorFst<Arc> > siter(segment);
+         !siter.Done(); siter.Next())
+      fst->AddState();
+    if (i == 0) {
+      fst->SetStart(segment.Start() + offset);
+    } else {
+      for (size_t j = 0; j < prev_finals.size(); j++)
+        fst->AddArc(prev_finals[j].first,
+                    Arc(0, 0, prev_finals[j].second, segment.Start() + offset));
+    }
+    prev_finals.clear();
+    for (StateIterator<VectorFst<Arc> > siter(segment);
+         !siter.Done(); siter.Next()) {
+      StateId s = siter.Value();
+      for (ArcIterator<VectorFst<Arc> > aiter(segment, s);
+           !aiter.Done(); aiter.Next()) {
+        Arc arc = aiter.Value();
+        arc.nextstate += offset;
+        fst->AddArc(s + offset, arc);
+      }
+      Weight final_weight = segment.Final(s);
+      if (final_weight != Weight::Zero()) {
+        if (i + 1 == num_segments)
+          fst->SetFinal(s + offset, final_weight);
+        else
+          prev_finals.push_back(std::make_pair(s + offset, final_weight));
+      }
+    }
+    segment.DeleteStates();  // Free the memory.
+  }
+  TopSort(fst);
+  return true;
+}
+
 // "Destructive" version of DeterminizeLatticePhonePruned() where the input
 // lattice might be modified.
 template<class Weight, class IntType>
@@ -1439,8 +1674,15 @@ bool DeterminizeLatticePhonePruned(
   if (opts.phone_determinize) {
     KALDI_VLOG(3) << "Doing first pass of determinization on phone + word "
                   << "lattices.";
-    ans = DeterminizeLatticePhonePrunedFirstPass<Weight, IntType>(
-        trans_model, beam, ifst, det_opts) && ans;
+    // If --determinize-threads > 1, try to do this pass on pieces of the
+    // lattice in parallel.
+    bool segmented = (opts.num_threads > 1 &&
+                      DeterminizeLatticeSegments<Weight, IntType>(
+                          &trans_model, beam, opts.num_threads,
+                          opts.segment_length, det_opts, ifst, &ans));
+    if (!segmented)
+      ans = DeterminizeLatticePhonePrunedFirstPass<Weight, IntType>(
+          trans_model, beam, ifst, det_opts) && ans;
 
     // If --word-determinize is false, we've finished the job and return here.
     if (!opts.word_determinize) {
@@ -118,12 +118,17 @@ struct DeterminizeLatticePrunedOptions {
   int max_states;
   int max_arcs;
   float retry_cutoff;
+  int num_threads; // If >1, split the lattice at states that all paths pass
+  // through and determinize the pieces in parallel (see below).
+  int segment_length; // Minimum length in frames of those pieces.
   DeterminizeLatticePrunedOptions(): delta(kDelta),
                                      max_mem(-1),
                                      max_loop(-1),
                                      max_states(-1),
                                      max_arcs(-1),
-                                     retry_cutoff(0.5) { }
+                                     retry_cutoff(0.5),
+                                     num_threads(1),
+                                     segment_length(250) { }
   void Register (kaldi::OptionsItf *opts) {
     opts->Register("delta", &delta, "Tolerance used in determinization");
     opts->Register("max-mem", &max_mem, "Maximum approximate memory usage in "
@@ -139,6 +144,13 @@ struct DeterminizeLatticePrunedOptions {
                    "lattice and retrying determinization: if effective-beam < "
                    "retry-cutoff * beam, we prune the raw lattice and retry.  Avoids "
                    "ever getting empty output for long segments.");
+    opts->Register("determinize-threads", &num_threads, "If >1, split lattices "
+                   "at points that all paths pass through (e.g. frames where "
+                   "only one token survived) and determinize the pieces in "
+                   "parallel, using this many threads.  The result is the same.");
+    opts->Register("determinize-segment-length", &segment_length, "Minimum "
+                   "length in frames of the pieces that lattices are split into "
+                   "if --determinize-threads > 1.");
   }
 };
 
@@ -155,11 +167,19 @@ struct DeterminizeLatticePhonePrunedOptions {
   bool word_determinize;
   // minimize: if true, push and minimize after determinization.
   bool minimize;
+  // num_threads: if > 1, the lattice is split at states that all paths pass
+  // through, and the first pass of determinization (see phone_determinize) is
+  // done on the pieces in parallel using this many threads.
+  int num_threads;
+  // segment_length: the minimum length in frames of those pieces.
+  int segment_length;
   DeterminizeLatticePhonePrunedOptions(): delta(kDelta),
                                           max_mem(50000000),
                                           phone_determinize(true),
                                           word_determinize(true),
-                                          minimize(false) {}
+                                          minimize(false),
+                                          num_threads(1),
+                                          segment_length(250) {}
   void Register (kaldi::OptionsItf *opts) {
     opts->Register("delta", &delta, "Tolerance used in determinization");
     opts->Register("max-mem", &max_mem, "Maximum approximate memory usage in "
@@ -172,6 +192,14 @@ struct DeterminizeLatticePhonePrunedOptions {
                    "--phone-determinize)");
     opts->Register("minimize", &minimize, "If true, push and minimize after "
                    "determinization.");
+    opts->Register("determinize-threads", &num_threads, "If >1, split lattices "
+                   "at points that all paths pass through (e.g. frames where "
+                   "only one token survived) and do the first pass of "
+                   "determinization on the pieces in parallel, using this many "
+                   "threads.  The result is the same.");
+    opts->Register("determinize-segment-length", &segment_length, "Minimum "
+                   "length in frames of the pieces that lattices are split into "
+                   "if --determinize-threads > 1.");
   }
 };
 
@@ -204,6 +232,10 @@ bool DeterminizeLatticePruned(
     of the max_mem, max_loop or max_arcs constraints in the options.
     CAUTION: if Lattice is the input, you need to Invert() before calling this,
     so words are on the input side.
+    If opts.num_threads > 1, the lattice is split into pieces that are
+    determinized in parallel, before a final pass over the (much smaller)
+    combined result; this needs the transition-ids to be on the output side, as
+    they are used to count frames.  (The version above ignores opts.num_threads.)
 */
 template<class Weight, class IntType>
 bool DeterminizeLatticePruned(
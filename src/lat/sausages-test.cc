@@ -0,0 +1,226 @@
+// lat/sausages-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "lat/kaldi-lattice.h"
+#include "lat/sausages.h"
+#include "base/timer.h"
+
+
+namespace kaldi {
+
+// Creates a random word lattice with a start state 0 and one final state,
+// whose paths all have "num_frames" frames.
+void RandChunkLattice(int32 num_frames, CompactLattice *clat) {
+  typedef CompactLattice::StateId StateId;
+  clat->DeleteStates();
+  StateId start = clat->AddState(), end = clat->AddState();
+  clat->SetStart(start);
+  clat->SetFinal(end, CompactLatticeWeight::One());
+  int32 num_paths = RandInt(1, 4);
+  for (int32 p = 0; p < num_paths; p++) {
+    int32 num_words = RandInt(1, std::min(3, num_frames));
+    std::vector<int32> durations(num_words, 1);
+    for (int32 t = num_words; t < num_frames; t++)
+      durations[RandInt(0, num_words - 1)]++;
+    StateId cur = start;
+    for (int32 w = 0; w < num_words; w++) {
+      StateId next = (w + 1 == num_words ? end : clat->AddState());
+      int32 word = RandInt(1, 5);
+      std::vector<int32> alignment(durations[w], 1);
+      CompactLatticeWeight weight(
+          LatticeWeight(2.0 * RandUniform(), 5.0 * RandUniform()), alignment);
+      clat->AddArc(cur, CompactLatticeArc(word, word, weight, next));
+      cur = next;
+    }
+  }
+}
+
+// Appends "chunk", which has one final state, to "clat" (identifying the
+// start state of "chunk" with the final state of "clat").
+void AppendChunkLattice(const CompactLattice &chunk, CompactLattice *clat) {
+  typedef CompactLattice::StateId StateId;
+  if (clat->NumStates() == 0) {
+    *clat = chunk;
+    return;
+  }
+  StateId final_state = fst::kNoStateId;
+  for (StateId s = 0; s < clat->NumStates(); s++)
+    if (clat->Final(s) != CompactLatticeWeight::Zero())
+      final_state = s;
+  KALDI_ASSERT(final_state != fst::kNoStateId);
+  clat->SetFinal(final_state, CompactLatticeWeight::Zero());
+  std::vector<StateId> state_map(chunk.NumStates());
+  for (StateId s = 0; s < chunk.NumStates(); s++)
+    state_map[s] = (s == chunk.Start() ? final_state : clat->AddState());
+  for (StateId s = 0; s < chunk.NumStates(); s++) {
+    for (fst::ArcIterator<CompactLattice> aiter(chunk, s); !aiter.Done();
+         aiter.Next()) {
+      CompactLatticeArc arc = aiter.Value();
+      arc.nextstate = state_map[arc.nextstate];
+      clat->AddArc(state_map[s], arc);
+    }
+    clat->SetFinal(state_map[s], chunk.Final(s));
+  }
+}
+
+bool MbrOutputsEqual(const MinimumBayesRisk &mbr1,
+                     const MinimumBayesRisk &mbr2) {
+  return mbr1.GetOneBest() == mbr2.GetOneBest() &&
+      mbr1.GetBayesRisk() == mbr2.GetBayesRisk() &&
+      mbr1.GetSausageStats() == mbr2.GetSausageStats() &&
+      mbr1.GetSausageTimes() == mbr2.GetSausageTimes() &&
+      mbr1.GetOneBestConfidences() == mbr2.GetOneBestConfidences();
+}
+
+void TestMinimumBayesRiskSegmented() {
+  // The lattice is a sequence of chunks, and every path goes through the
+  // states between them, so we can split it there.
+  int32 num_chunks = RandInt(1, 5), chunk_frames = RandInt(3, 10);
+  std::vector<CompactLattice> chunks(num_chunks);
+  CompactLattice clat;
+  for (int32 c = 0; c < num_chunks; c++) {
+    RandChunkLattice(chunk_frames, &(chunks[c]));
+    AppendChunkLattice(chunks[c], &clat);
+  }
+
+  MinimumBayesRiskOptions opts;
+  opts.decode_mbr = (RandInt(0, 1) == 0);
+  MinimumBayesRisk mbr(clat, opts);
+
+  // With segments longer than the lattice, nothing changes.
+  MinimumBayesRiskOptions unsplit_opts(opts);
+  unsplit_opts.segment_frames = num_chunks * chunk_frames + 1;
+  MinimumBayesRisk unsplit_mbr(clat, unsplit_opts);
+  KALDI_ASSERT(MbrOutputsEqual(mbr, unsplit_mbr));
+
+  std::vector<CompactLattice> segments;
+  std::vector<int32> segment_offsets;
+  bool split = SplitCompactLatticeForMbr(clat, chunk_frames, 0.99,
+                                         &segments, &segment_offsets);
+  KALDI_ASSERT(split == (num_chunks > 1));
+  if (split) {
+    KALDI_ASSERT(segments.size() == num_chunks);
+    for (int32 c = 0; c < num_chunks; c++)
+      KALDI_ASSERT(segment_offsets[c] == c * chunk_frames);
+  }
+
+  MinimumBayesRiskOptions split_opts(opts);
+  split_opts.segment_frames = chunk_frames;
+  split_opts.num_segment_threads = RandInt(1, 3);
+  MinimumBayesRisk split_mbr(clat, split_opts);
+  split_opts.num_segment_threads = 1;
+  MinimumBayesRisk split_mbr2(clat, split_opts);
+  KALDI_ASSERT(MbrOutputsEqual(split_mbr, split_mbr2));
+
+  // Every path goes through the split states, so the best path is the
+  // concatenation of the best paths of the segments, and with MAP decoding the
+  // one-best is the same as without splitting.  (With MBR decoding it may
+  // differ, as the edit-distance alignments are no longer allowed to cross the
+  // split points.)
+  if (!opts.decode_mbr)
+    KALDI_ASSERT(split_mbr.GetOneBest() == mbr.GetOneBest());
+
+  // The Bayes risk is the sum of that of the chunks.
+  double tot_risk = 0.0;
+  for (int32 c = 0; c < num_chunks; c++)
+    tot_risk += MinimumBayesRisk(chunks[c], opts).GetBayesRisk();
+  KALDI_ASSERT(fabs(split_mbr.GetBayesRisk() - tot_risk) <
+               1.0e-03 * (1.0 + tot_risk));
+
+  const std::vector<std::vector<std::pair<int32, BaseFloat> > > &stats =
+      split_mbr.GetSausageStats();
+  const std::vector<std::pair<BaseFloat, BaseFloat> > &times =
+      split_mbr.GetSausageTimes();
+  KALDI_ASSERT(stats.size() == times.size());
+  for (size_t q = 0; q < stats.size(); q++) {
+    double sum = 0.0;
+    for (size_t j = 0; j < stats[q].size(); j++)
+      sum += stats[q][j].second;
+    KALDI_ASSERT(fabs(sum - 1.0) < 0.1);
+    KALDI_ASSERT(times[q].first <= times[q].second + 0.01);
+    if (q > 0)
+      KALDI_ASSERT(times[q - 1].second <= times[q].first + 0.01);
+  }
+  KALDI_ASSERT(split_mbr.GetOneBestTimes().size() ==
+               split_mbr.GetOneBest().size() &&
+               split_mbr.GetOneBestConfidences().size() ==
+               split_mbr.GetOneBest().size());
+}
+
+void TestMinimumBayesRiskOptionsCheck() {
+  MinimumBayesRiskOptions opts;
+  opts.segment_min_posterior = 0.5;
+  opts.Check();  // Not used, as segment_frames == 0.
+  opts.segment_frames = 100;
+  bool threw = false;
+  try {
+    opts.Check();
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  KALDI_ASSERT(threw);
+}
+
+// Compares the speed of MBR decoding on a long lattice with and without
+// splitting it.
+void TestMinimumBayesRiskSpeed() {
+  int32 num_chunks = 500, chunk_frames = 20;
+  CompactLattice clat, chunk;
+  for (int32 c = 0; c < num_chunks; c++) {
+    RandChunkLattice(chunk_frames, &chunk);
+    AppendChunkLattice(chunk, &clat);
+  }
+  MinimumBayesRiskOptions opts;
+  Timer timer;
+  MinimumBayesRisk mbr(clat, opts);
+  double elapsed = timer.Elapsed();
+
+  opts.segment_frames = 10 * chunk_frames;
+  timer.Reset();
+  MinimumBayesRisk split_mbr(clat, opts);
+  double split_elapsed = timer.Elapsed();
+
+  opts.num_segment_threads = 4;
+  timer.Reset();
+  MinimumBayesRisk threaded_mbr(clat, opts);
+  double threaded_elapsed = timer.Elapsed();
+
+  KALDI_ASSERT(MbrOutputsEqual(split_mbr, threaded_mbr));
+  KALDI_ASSERT(!mbr.GetOneBest().empty() && !split_mbr.GetOneBest().empty());
+
+  KALDI_LOG << "For a lattice with " << clat.NumStates() << " states and "
+            << (num_chunks * chunk_frames) << " frames, MBR decoding took "
+            << elapsed << " seconds; with --segment-frames="
+            << opts.segment_frames << ", " << split_elapsed
+            << " seconds, and " << threaded_elapsed << " seconds with "
+            << opts.num_segment_threads << " threads.  The Bayes risk was "
+            << mbr.GetBayesRisk() << " vs. " << split_mbr.GetBayesRisk();
+}
+
+
+} // end namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using kaldi::int32;
+  for (int32 i = 0; i < 100; i++)
+    TestMinimumBayesRiskSegmented();
+  TestMinimumBayesRiskOptionsCheck();
+  TestMinimumBayesRiskSpeed();
+  KALDI_LOG << "Success.";
+}
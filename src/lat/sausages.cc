@@ -20,6 +20,7 @@
 
 #include "lat/sausages.h"
 #include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
 
 namespace kaldi {
 
@@ -31,9 +32,6 @@ void MinimumBayesRisk::MbrDecode() {
     AccStats(); // writes to gamma_
     double delta_Q = 0.0; // change in objective function.
 
-    one_best_times_.clear();
-    one_best_confidences_.clear();
-
     // Caution: q in the line below is (q-1) in the algorithm
     // in the paper; both R_ and gamma_ are indexed by q-1.
     for (size_t q = 0; q < R_.size(); q++) {
@@ -50,15 +48,9 @@ void MinimumBayesRisk::MbrDecode() {
           KALDI_VLOG(2) << "Changing word " << rq << " to " << rhat;
         R_[q] = rhat;
       }
-      // build the outputs (time, confidences),
-      if (R_[q] != 0 || opts_.print_silence) {
-        one_best_times_.push_back(times_[q]);
-        BaseFloat confidence = 0.0;
-        for (int32 j = 0; j < gamma_[q].size(); j++)
-          if (gamma_[q][j].first == R_[q]) confidence = gamma_[q][j].second;
-        one_best_confidences_.push_back(confidence);
-      }
     }
+    // build the outputs (time, confidences),
+    ComputeOneBestTimesAndConfidences();
     KALDI_VLOG(2) << "Iter = " << counter << ", delta-Q = " << delta_Q;
     if (delta_Q == 0) break;
     if (counter > 100) {
@@ -69,6 +61,20 @@ void MinimumBayesRisk::MbrDecode() {
   if (!opts_.print_silence) RemoveEps(&R_);
 }
 
+void MinimumBayesRisk::ComputeOneBestTimesAndConfidences() {
+  one_best_times_.clear();
+  one_best_confidences_.clear();
+  for (size_t q = 0; q < R_.size(); q++) {
+    if (R_[q] != 0 || opts_.print_silence) {
+      one_best_times_.push_back(times_[q]);
+      BaseFloat confidence = 0.0;
+      for (int32 j = 0; j < gamma_[q].size(); j++)
+        if (gamma_[q][j].first == R_[q]) confidence = gamma_[q][j].second;
+      one_best_confidences_.push_back(confidence);
+    }
+  }
+}
+
 struct Int32IsZero {
   bool operator() (int32 i) { return (i == 0); }
 };
@@ -317,6 +323,17 @@ void MinimumBayesRisk::PrepareLatticeAndInitStats(CompactLattice *clat) {
 
 MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
                                    MinimumBayesRiskOptions opts) : opts_(opts) {
+  opts_.Check();
+  if (opts_.segment_frames > 0) {
+    std::vector<CompactLattice> segments;
+    std::vector<int32> segment_offsets;
+    if (SplitCompactLatticeForMbr(clat_in, opts_.segment_frames,
+                                  opts_.segment_min_posterior,
+                                  &segments, &segment_offsets)) {
+      MbrDecodeSegments(segments, segment_offsets);
+      return;
+    }
+  }
   CompactLattice clat(clat_in); // copy.
 
   PrepareLatticeAndInitStats(&clat);
@@ -377,5 +394,196 @@ MinimumBayesRisk::MinimumBayesRisk(const CompactLattice &clat_in,
   MbrDecode();
 }
 
+void MinimumBayesRisk::MbrDecodeSegments(
+    const std::vector<CompactLattice> &segments,
+    const std::vector<int32> &segment_offsets) {
+  int32 num_segments = segments.size();
+  KALDI_ASSERT(num_segments > 0 && segment_offsets.size() == num_segments);
+  // We keep the epsilon bins in the 1-best of the segments, so that it lines
+  // up with the sausage bins.
+  MinimumBayesRiskOptions segment_opts(opts_);
+  segment_opts.print_silence = true;
+  segment_opts.segment_frames = 0;
+
+  std::vector<MinimumBayesRisk*> segment_mbr(num_segments, NULL);
+  {
+    ThreadTeam team(std::min(opts_.num_segment_threads, num_segments));
+    team.Run([&](int32 thread_id) {
+        for (int32 k = thread_id; k < num_segments; k += team.NumThreads())
+          segment_mbr[k] = new MinimumBayesRisk(segments[k], segment_opts);
+      });
+  }
+
+  R_.clear();
+  gamma_.clear();
+  times_.clear();
+  L_ = 0.0;
+  for (int32 k = 0; k < num_segments; k++) {
+    const MinimumBayesRisk &mbr = *(segment_mbr[k]);
+    KALDI_ASSERT(mbr.R_.size() == mbr.gamma_.size() &&
+                 mbr.times_.size() == mbr.gamma_.size());
+    BaseFloat offset = segment_offsets[k];
+    L_ += mbr.L_;
+    for (size_t q = 0; q < mbr.gamma_.size(); q++) {
+      std::pair<BaseFloat, BaseFloat> times(mbr.times_[q].first + offset,
+                                            mbr.times_[q].second + offset);
+      if (q == 0 && !R_.empty() && R_.back() == 0 && mbr.R_[0] == 0) {
+        // The bins on either side of the split are normally both epsilon
+        // bins for insertions; we merge them so that the bins still alternate
+        // between epsilon bins and word bins.
+        MergeEpsBins(mbr.gamma_[0], &(gamma_.back()));
+        times_.back().second = times.second;
+        if (opts_.decode_mbr)
+          R_.back() = gamma_.back()[0].first;
+      } else {
+        R_.push_back(mbr.R_[q]);
+        gamma_.push_back(mbr.gamma_[q]);
+        times_.push_back(times);
+      }
+    }
+    delete segment_mbr[k];
+  }
+  ComputeOneBestTimesAndConfidences();
+  if (!opts_.print_silence) RemoveEps(&R_);
+}
+
+// static
+void MinimumBayesRisk::MergeEpsBins(
+    const std::vector<std::pair<int32, BaseFloat> > &other,
+    std::vector<std::pair<int32, BaseFloat> > *bin) {
+  std::map<int32, double> gamma;
+  double eps_prob = -1.0, tot_prob = 0.0;
+  for (int32 i = 0; i < 2; i++) {
+    const std::vector<std::pair<int32, BaseFloat> > &this_bin =
+        (i == 0 ? *bin : other);
+    for (size_t j = 0; j < this_bin.size(); j++) {
+      if (this_bin[j].first == 0) {
+        eps_prob += this_bin[j].second;
+      } else {
+        AddToMap(this_bin[j].first, this_bin[j].second, &gamma);
+        tot_prob += this_bin[j].second;
+      }
+    }
+  }
+  if (eps_prob > 0.0) {
+    AddToMap(0, eps_prob, &gamma);
+    tot_prob += eps_prob;
+  }
+  // If eps_prob was negative, the probabilities now sum to more than one, so
+  // we renormalize.
+  double scale = (tot_prob > 1.0 ? 1.0 / tot_prob : 1.0);
+  bin->clear();
+  for (std::map<int32, double>::iterator iter = gamma.begin();
+       iter != gamma.end(); ++iter)
+    bin->push_back(std::make_pair(iter->first,
+                                  static_cast<BaseFloat>(iter->second * scale)));
+  GammaCompare comp;
+  std::sort(bin->begin(), bin->end(), comp);
+}
+
+bool SplitCompactLatticeForMbr(const CompactLattice &clat_in,
+                               int32 segment_frames,
+                               BaseFloat min_posterior,
+                               std::vector<CompactLattice> *segments,
+                               std::vector<int32> *segment_offsets) {
+  typedef CompactLattice::StateId StateId;
+  // With min_posterior > 0.5, consecutive split states are on a common path,
+  // so no segment is empty.
+  KALDI_ASSERT(segment_frames > 0 && min_posterior > 0.5 &&
+               min_posterior <= 1.0);
+  segments->clear();
+  segment_offsets->clear();
+
+  CompactLattice clat_sorted;
+  const CompactLattice *clat = &clat_in;
+  if (clat_in.Properties(fst::kTopSorted, true) == 0 ||
+      clat_in.Start() != 0) {
+    clat_sorted = clat_in;
+    if (fst::TopSort(&clat_sorted) == false)
+      KALDI_ERR << "Cycles detected in lattice.";
+    clat = &clat_sorted;
+  }
+  StateId num_states = clat->NumStates();
+  if (num_states == 0)
+    return false;
+  std::vector<int32> state_times;
+  int32 num_frames = CompactLatticeStateTimes(*clat, &state_times);
+  if (num_frames <= segment_frames)
+    return false;
+
+  std::vector<double> alpha, beta;
+  if (!ComputeCompactLatticeAlphas(*clat, &alpha) ||
+      !ComputeCompactLatticeBetas(*clat, &beta))
+    return false;
+  double tot_like = beta[clat->Start()];
+  if (!(tot_like - tot_like == 0.0)) {  // NaN or infinity.
+    KALDI_WARN << "Total likelihood of lattice is " << tot_like
+               << ", not splitting it.";
+    return false;
+  }
+
+  // Choose the split states.  Any path that does not go through state s has
+  // an arc from a state before s to a state after it, as the states are
+  // topologically sorted.
+  std::vector<StateId> split_states;
+  int32 last_split_time = 0;
+  double log_min_posterior = Log(min_posterior);
+  for (StateId s = 1; s < num_states; s++) {
+    if (state_times[s] - last_split_time >= segment_frames &&
+        clat->NumArcs(s) > 0 &&
+        alpha[s] + beta[s] - tot_like >= log_min_posterior) {
+      split_states.push_back(s);
+      last_split_time = state_times[s];
+    }
+  }
+  if (split_states.empty()) {
+    KALDI_VLOG(1) << "Found no state with posterior >= " << min_posterior
+                  << " to split the lattice of " << num_frames
+                  << " frames at; decoding it as a whole.";
+    return false;
+  }
+
+  int32 num_segments = split_states.size() + 1;
+  segments->resize(num_segments);
+  segment_offsets->resize(num_segments);
+  StateId begin = 0;
+  for (int32 k = 0; k < num_segments; k++) {
+    bool is_last = (k + 1 == num_segments);
+    // "end" is the last state of the segment; states begin...end become
+    // states 0...end-begin of the segment.
+    StateId end = (is_last ? num_states - 1 : split_states[k]);
+    CompactLattice &segment = (*segments)[k];
+    for (StateId s = begin; s <= end; s++)
+      segment.AddState();
+    segment.SetStart(0);
+    for (StateId s = begin; s <= end; s++) {
+      if (!is_last && s == end) {
+        segment.SetFinal(s - begin, CompactLatticeWeight::One());
+        break;
+      }
+      if (is_last)
+        segment.SetFinal(s - begin, clat->Final(s));
+      for (fst::ArcIterator<CompactLattice> aiter(*clat, s); !aiter.Done();
+           aiter.Next()) {
+        CompactLatticeArc arc = aiter.Value();
+        if (arc.nextstate > end)
+          continue;  // This arc bypasses the split state "end".
+        arc.nextstate -= begin;
+        segment.AddArc(s - begin, arc);
+      }
+    }
+    fst::Connect(&segment);
+    if (segment.NumStates() == 0) {
+      KALDI_WARN << "Empty segment when splitting lattice (numerical "
+                 << "problem?); not splitting it.";
+      segments->clear();
+      segment_offsets->clear();
+      return false;
+    }
+    (*segment_offsets)[k] = state_times[begin];
+    begin = end;
+  }
+  return true;
+}
 
 }  // namespace kaldi
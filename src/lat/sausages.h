@@ -59,17 +59,68 @@ struct MinimumBayesRiskOptions {
   bool decode_mbr;
   /// Boolean configuration parameter: if true, the 1-best path will 'keep' the <eps> bins,
   bool print_silence;
-
-  MinimumBayesRiskOptions() : decode_mbr(true), print_silence(false)
+  /// If > 0, lattices are split into segments of at least this many frames at
+  /// states with posterior >= segment_min_posterior, and the segments are
+  /// decoded separately and their sausages concatenated (see
+  /// SplitCompactLatticeForMbr()).  The computation grows faster than
+  /// linearly with the length of the lattice, so this is meant for long
+  /// recordings.
+  int32 segment_frames;
+  /// The minimum posterior of the states where we split the lattice; must be
+  /// > 0.5.
+  BaseFloat segment_min_posterior;
+  /// The number of threads used to decode the segments.
+  int32 num_segment_threads;
+
+  MinimumBayesRiskOptions() : decode_mbr(true), print_silence(false),
+                              segment_frames(0), segment_min_posterior(0.99),
+                              num_segment_threads(1)
   { }
   void Register(OptionsItf *opts) {
     opts->Register("decode-mbr", &decode_mbr, "If true, do Minimum Bayes Risk "
                    "decoding (else, Maximum a Posteriori)");
     opts->Register("print-silence", &print_silence, "Keep the inter-word '<eps>' "
                    "bins in the 1-best output (ctm, <eps> can be a 'silence' or a 'deleted' word)");
+    opts->Register("segment-frames", &segment_frames, "If >0, split lattices "
+                   "into segments of at least this many frames at confident "
+                   "states (see --segment-min-posterior) and decode them "
+                   "separately; meant for long lattices.  E.g. 3000.");
+    opts->Register("segment-min-posterior", &segment_min_posterior, "Only "
+                   "relevant if --segment-frames > 0: the minimum posterior "
+                   "of the lattice states where we split it.  The paths that "
+                   "bypass those states are discarded.  Must be > 0.5.");
+    opts->Register("num-segment-threads", &num_segment_threads, "Only "
+                   "relevant if --segment-frames > 0: number of threads used "
+                   "to decode the segments in parallel.");
+  }
+  void Check() const {
+    if (segment_frames > 0 &&
+        !(segment_min_posterior > 0.5 && segment_min_posterior <= 1.0))
+      KALDI_ERR << "--segment-min-posterior must be > 0.5 and <= 1.0, got "
+                << segment_min_posterior;
+    if (num_segment_threads < 1)
+      KALDI_ERR << "--num-segment-threads must be at least 1, got "
+                << num_segment_threads;
   }
 };
 
+/// Splits the lattice "clat" for segmented MBR decoding.  We go through the
+/// states in topological order, and split the lattice at the first state with
+/// posterior >= "min_posterior" (which must be > 0.5) that is at least
+/// "segment_frames" frames after the previous split (or the start).  The arcs
+/// that bypass such a state are discarded (their total posterior is at most
+/// 1 - min_posterior), so that every path goes through it, and the lattice is
+/// cut into a sequence of segments: each segment starts at a split state (or
+/// the start state), and ends at the next split state, which is its only final
+/// state (or at the original final states, for the last segment).  Outputs the
+/// segments and the frame at which each of them starts.  Returns false, and
+/// outputs nothing, if the lattice was not split.
+bool SplitCompactLatticeForMbr(const CompactLattice &clat,
+                               int32 segment_frames,
+                               BaseFloat min_posterior,
+                               std::vector<CompactLattice> *segments,
+                               std::vector<int32> *segment_offsets);
+
 /// This class does the word-level Minimum Bayes Risk computation, and gives you
 /// either the 1-best MBR output together with the expected Bayes Risk,
 /// or a sausage-like structure.
@@ -79,6 +130,10 @@ class MinimumBayesRisk {
   /// to have been done already.
   /// This does the whole computation.  You get the output with
   /// GetOneBest(), GetBayesRisk(), and GetSausageStats().
+  /// If opts.segment_frames > 0, long lattices are split with
+  /// SplitCompactLatticeForMbr() and the segments are decoded separately;
+  /// this is an approximation, and the Bayes risk is the sum over the segments.
+  /// (The other constructors ignore opts.segment_frames.)
   MinimumBayesRisk(const CompactLattice &clat,
                    MinimumBayesRiskOptions opts = MinimumBayesRiskOptions());
 
@@ -136,6 +191,23 @@ class MinimumBayesRisk {
   /// Minimum-Bayes-Risk Decode. Top-level algorithm.  Figure 6 of the paper.
   void MbrDecode();
 
+  /// Sets one_best_times_ and one_best_confidences_ from R_ (before the
+  /// epsilons are removed from it), gamma_ and times_.
+  void ComputeOneBestTimesAndConfidences();
+
+  /// Decodes the segments of a lattice, as output by
+  /// SplitCompactLatticeForMbr(), and concatenates the results.
+  void MbrDecodeSegments(const std::vector<CompactLattice> &segments,
+                         const std::vector<int32> &segment_offsets);
+
+  /// Merges the sausage bin "other" into "bin", which are the last and first
+  /// bins of consecutive segments of a lattice, where the 1-best has epsilon
+  /// in both.  The probability of each word is the sum of its
+  /// probabilities in the two bins, and that of epsilon is the lower bound
+  /// p1(eps) + p2(eps) - 1 of the probability of no word in either bin.
+  static void MergeEpsBins(const std::vector<std::pair<int32, BaseFloat> > &other,
+                           std::vector<std::pair<int32, BaseFloat> > *bin);
+
   /// Without the 'penalize' argument this gives us the basic edit-distance
   /// function l(a,b), as in the paper.
   /// With the 'penalize' argument it can be interpreted as the edit distance
@@ -0,0 +1,173 @@
+// latbin/lattice-lmrescore-const-arpa-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "fstext/fstext-lib.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lm/const-arpa-lm.h"
+#include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+class ConstArpaRescoreTask {
+ public:
+  // Initializer takes ownership of "clat".
+  ConstArpaRescoreTask(const ConstArpaLm &const_arpa,
+                       int32 max_cached_histories,
+                       const std::string &key,
+                       BaseFloat lm_scale,
+                       CompactLattice *clat,
+                       CompactLatticeWriter *clat_writer,
+                       int32 *num_done,
+                       int32 *num_fail):
+      const_arpa_(const_arpa), max_cached_histories_(max_cached_histories),
+      key_(key), lm_scale_(lm_scale), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_fail_(num_fail) { }
+
+  void operator () () {
+    if (lm_scale_ == 0.0) {
+      // Zero scale so nothing to do.
+      det_clat_ = *clat_;
+    } else {
+      // As in lattice-lmrescore-const-arpa.  The LM itself is shared between
+      // the threads, but each task has its own FST wrapper, which caches the
+      // LM states it visits.
+      fst::ScaleLattice(fst::GraphLatticeScale(1.0 / lm_scale_), clat_);
+      ArcSort(clat_, fst::OLabelCompare<CompactLatticeArc>());
+      ConstArpaLmDeterministicFst const_arpa_fst(const_arpa_,
+                                                 max_cached_histories_);
+      CompactLattice composed_clat;
+      ComposeCompactLatticeDeterministic(*clat_, &const_arpa_fst,
+                                         &composed_clat);
+      if (GetVerboseLevel() >= 2)
+        const_arpa_fst.PrintStats();
+      Lattice composed_lat;
+      ConvertLattice(composed_clat, &composed_lat);
+      Invert(&composed_lat);
+      DeterminizeLattice(composed_lat, &det_clat_);
+      fst::ScaleLattice(fst::GraphLatticeScale(lm_scale_), &det_clat_);
+    }
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+  }
+
+  ~ConstArpaRescoreTask() {
+    // The destructors are called in the original order of the lattices, from
+    // one thread, so it is safe to write and update the counts here.
+    if (det_clat_.Start() == fst::kNoStateId) {
+      KALDI_WARN << "Empty lattice for utterance " << key_
+                 << " (incompatible LM?)";
+      (*num_fail_)++;
+    } else {
+      clat_writer_->Write(key_, det_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ConstArpaLm &const_arpa_;
+  int32 max_cached_histories_;
+  std::string key_;
+  BaseFloat lm_scale_;
+  CompactLattice *clat_;  // The lattice we're working on.  Owned locally.
+  CompactLattice det_clat_;  // The output of our process.  Will be written
+                             // to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_fail_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Rescores lattice with the ConstArpaLm format language model.  This is\n"
+        "a version of lattice-lmrescore-const-arpa that accepts the\n"
+        "--num-threads option: the lattices are rescored in parallel, sharing\n"
+        "one copy of the language model, and are written in the input order.\n"
+        "\n"
+        "Usage: lattice-lmrescore-const-arpa-parallel [options] \\\n"
+        "                lattice-rspecifier const-arpa-in lattice-wspecifier\n"
+        " e.g.: lattice-lmrescore-const-arpa-parallel --num-threads=8 \\\n"
+        "                --lm-scale=-1.0 ark:in.lats const_arpa ark:out.lats\n";
+
+    ParseOptions po(usage);
+    BaseFloat lm_scale = 1.0;
+    bool mmap = false;
+    int32 max_cached_histories = 0;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
+                "costs; frequently 1.0 or -1.0");
+    po.Register("mmap", &mmap, "If true, memory-map the language model "
+                "read-only instead of reading it into memory; this is faster "
+                "to load, and the memory is shared by all jobs that use the "
+                "same file.");
+    po.Register("max-cached-histories", &max_cached_histories, "If positive, "
+                "the maximum number of LM histories to remember for each "
+                "lattice; the least recently used ones are forgotten.  This "
+                "bounds the memory used on long lattices.");
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 3) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string lats_rspecifier = po.GetArg(1),
+        lm_rxfilename = po.GetArg(2),
+        lats_wspecifier = po.GetArg(3);
+
+    // Reads the language model in ConstArpaLm format.
+    ConstArpaLm const_arpa;
+    ReadConstArpaLm(lm_rxfilename, mmap, &const_arpa);
+
+    // Reads and writes as compact lattice.
+    SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    TaskSequencer<ConstArpaRescoreTask> sequencer(sequencer_config);
+
+    int32 n_done = 0, n_fail = 0;
+    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+      std::string key = compact_lattice_reader.Key();
+      // will give ownership to "task" below.
+      CompactLattice *clat = new CompactLattice(compact_lattice_reader.Value());
+      compact_lattice_reader.FreeCurrent();
+      ConstArpaRescoreTask *task = new ConstArpaRescoreTask(
+          const_arpa, max_cached_histories, key, lm_scale, clat,
+          &compact_lattice_writer, &n_done, &n_fail);
+      sequencer.Run(task);
+    }
+    sequencer.Wait();
+
+    KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
+    return (n_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -45,9 +45,14 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     BaseFloat lm_scale = 1.0;
+    bool mmap = false;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for language model "
                 "costs; frequently 1.0 or -1.0");
+    po.Register("mmap", &mmap, "If true, memory-map the language model "
+                "read-only instead of reading it into memory; this is faster "
+                "to load, and the memory is shared by all jobs that use the "
+                "same file.");
 
     po.Read(argc, argv);
 
@@ -62,7 +67,7 @@ int main(int argc, char *argv[]) {
 
     // Reads the language model in ConstArpaLm format.
     ConstArpaLm const_arpa;
-    ReadKaldiObject(lm_rxfilename, &const_arpa);
+    ReadConstArpaLm(lm_rxfilename, mmap, &const_arpa);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
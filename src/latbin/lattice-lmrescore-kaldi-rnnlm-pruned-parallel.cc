@@ -0,0 +1,254 @@
+// latbin/lattice-lmrescore-kaldi-rnnlm-pruned-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "fstext/fstext-lib.h"
+#include "rnnlm/rnnlm-lattice-rescoring.h"
+#include "rnnlm/rnnlm-utils.h"
+#include "lm/const-arpa-lm.h"
+#include "util/common-utils.h"
+#include "util/kaldi-thread.h"
+#include "nnet3/nnet-utils.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/compose-lattice-pruned.h"
+
+namespace kaldi {
+
+class RnnlmRescoreTask {
+ public:
+  // Initializer takes ownership of "clat".  Exactly one of
+  // "lm_to_subtract_fst" and "const_arpa" must be non-NULL.
+  RnnlmRescoreTask(const ComposeLatticePrunedOptions &compose_opts,
+                   const rnnlm::RnnlmComputeStateInfo &info,
+                   const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst,
+                   const ConstArpaLm *const_arpa,
+                   int32 max_ngram_order,
+                   BaseFloat lm_scale,
+                   BaseFloat acoustic_scale,
+                   const std::string &key,
+                   CompactLattice *clat,
+                   CompactLatticeWriter *clat_writer,
+                   int32 *num_done,
+                   int32 *num_err):
+      compose_opts_(compose_opts), info_(info),
+      lm_to_subtract_fst_(lm_to_subtract_fst), const_arpa_(const_arpa),
+      max_ngram_order_(max_ngram_order), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    using fst::StdArc;
+    // The old LM and the RNNLM (including its compiled computation) are
+    // shared between the threads; the on-demand FSTs, which hold the LM and
+    // RNNLM states they visit, are created for each lattice.
+    fst::DeterministicOnDemandFst<StdArc> *lm_to_subtract_orig;
+    if (const_arpa_ != NULL)
+      lm_to_subtract_orig = new ConstArpaLmDeterministicFst(*const_arpa_);
+    else
+      lm_to_subtract_orig = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract(-lm_scale_,
+                                                      lm_to_subtract_orig);
+    rnnlm::KaldiRnnlmDeterministicFst lm_to_add_orig(max_ngram_order_, info_);
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, &lm_to_add_orig);
+
+    if (acoustic_scale_ != 1.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
+        &lm_to_subtract, &lm_to_add);
+    ComposeCompactLatticePruned(compose_opts_, *clat_, &combined_lms,
+                                &composed_clat_);
+    delete lm_to_subtract_orig;
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+  }
+
+  ~RnnlmRescoreTask() {
+    // The destructors are called in the original order of the lattices, from
+    // one thread, so it is safe to write and update the counts here.
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  const rnnlm::RnnlmComputeStateInfo &info_;
+  const fst::VectorFst<fst::StdArc> *lm_to_subtract_fst_;
+  const ConstArpaLm *const_arpa_;
+  int32 max_ngram_order_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The lattice we're working on.  Owned locally.
+  CompactLattice composed_clat_;  // The output of our process.  Will be
+                                  // written to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "Rescores lattice with kaldi-rnnlm.  This is a version of\n"
+        "lattice-lmrescore-kaldi-rnnlm-pruned that accepts the --num-threads\n"
+        "option: the lattices are rescored in parallel, sharing one copy of\n"
+        "the old LM and of the RNNLM, and are written in the input order.\n"
+        "\n"
+        "Usage: lattice-lmrescore-kaldi-rnnlm-pruned-parallel [options] \\\n"
+        "             <old-lm-rxfilename> <embedding-file> \\\n"
+        "             <raw-rnnlm-rxfilename> \\\n"
+        "             <lattice-rspecifier> <lattice-wspecifier>\n"
+        " e.g.: lattice-lmrescore-kaldi-rnnlm-pruned-parallel --num-threads=8 \\\n"
+        "              --lm-scale=0.5 --bos-symbol=1 --eos-symbol=2 \\\n"
+        "              data/lang_test/G.fst word_embedding.mat \\\n"
+        "              final.raw ark:in.lats ark:out.lats\n";
+
+    ParseOptions po(usage);
+    rnnlm::RnnlmComputeStateComputationOptions opts;
+    std::string unigram_probs_rxfilename;
+    ComposeLatticePrunedOptions compose_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    int32 max_ngram_order = 3;
+    BaseFloat lm_scale = 0.5;
+    BaseFloat acoustic_scale = 0.1;
+    bool use_carpa = false;
+    bool mmap = false;
+
+    po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
+                "will be applied to <lm-to-subtract>.");
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic "
+                "probabilities (e.g. 0.1 for non-chain systems); important because "
+                "of its effect on pruning.");
+    po.Register("max-ngram-order", &max_ngram_order,
+        "If positive, allow RNNLM histories longer than this to be identified "
+        "with each other for rescoring purposes (an approximation that "
+        "saves time and reduces output lattice size).");
+    po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
+                "as a const-arpa file as opposed to an FST file");
+    po.Register("mmap", &mmap, "If true (and --use-const-arpa=true), "
+                "memory-map the const-arpa file read-only instead of reading "
+                "it into memory.");
+    po.Register("unigram-probs", &unigram_probs_rxfilename, "File with the "
+                "unigram probability of each word, with lines '<word-id> "
+                "<prob>' (e.g. exp/rnnlm/config/unigram_probs.txt); needed "
+                "with --normalization-method=sampled.");
+    opts.Register(&po);
+    compose_opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 5) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    if (opts.bos_index == -1 || opts.eos_index == -1) {
+      KALDI_ERR << "must set --bos-symbol and --eos-symbol options";
+    }
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
+    std::string lm_to_subtract_rxfilename = po.GetArg(1),
+        word_embedding_rxfilename = po.GetArg(2),
+        rnnlm_rxfilename = po.GetArg(3),
+        lats_rspecifier = po.GetArg(4),
+        lats_wspecifier = po.GetArg(5);
+
+    KALDI_LOG << "Reading old LMs...";
+    VectorFst<StdArc> *lm_to_subtract_fst = NULL;
+    ConstArpaLm const_arpa;
+    if (use_carpa) {
+      ReadConstArpaLm(lm_to_subtract_rxfilename, mmap, &const_arpa);
+    } else {
+      lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
+          lm_to_subtract_rxfilename);
+    }
+
+    kaldi::nnet3::Nnet rnnlm;
+    ReadKaldiObject(rnnlm_rxfilename, &rnnlm);
+
+    KALDI_ASSERT(IsSimpleNnet(rnnlm));
+
+    CuMatrix<BaseFloat> word_embedding_mat;
+    ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
+
+    std::vector<BaseFloat> unigram_probs;
+    if (!unigram_probs_rxfilename.empty()) {
+      Input ki(unigram_probs_rxfilename);
+      rnnlm::ReadUnigramProbs(ki.Stream(), word_embedding_mat.NumRows(),
+                              &unigram_probs);
+    }
+    const rnnlm::RnnlmComputeStateInfo info(
+        opts, rnnlm, word_embedding_mat,
+        unigram_probs_rxfilename.empty() ? NULL : &unigram_probs);
+
+    // Reads and writes as compact lattice.
+    SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    TaskSequencer<RnnlmRescoreTask> sequencer(sequencer_config);
+
+    int32 num_done = 0, num_err = 0;
+    for (; !compact_lattice_reader.Done(); compact_lattice_reader.Next()) {
+      std::string key = compact_lattice_reader.Key();
+      // will give ownership to "task" below.
+      CompactLattice *clat = new CompactLattice(compact_lattice_reader.Value());
+      compact_lattice_reader.FreeCurrent();
+      RnnlmRescoreTask *task = new RnnlmRescoreTask(
+          compose_opts, info, lm_to_subtract_fst,
+          (use_carpa ? &const_arpa : NULL), max_ngram_order, lm_scale,
+          acoustic_scale, key, clat, &compact_lattice_writer,
+          &num_done, &num_err);
+      sequencer.Run(task);
+    }
+    sequencer.Wait();
+
+    delete lm_to_subtract_fst;
+
+    if (info.normalizer != NULL)
+      info.normalizer->PrintStats();
+    KALDI_LOG << "Overall, succeeded for " << num_done
+              << " lattices, failed for " << num_err;
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
@@ -22,6 +22,7 @@
 #include "base/kaldi-common.h"
 #include "fstext/fstext-lib.h"
 #include "rnnlm/rnnlm-lattice-rescoring.h"
+#include "rnnlm/rnnlm-utils.h"
 #include "lm/const-arpa-lm.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-utils.h"
@@ -59,12 +60,15 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
+    std::string unigram_probs_rxfilename;
     ComposeLatticePrunedOptions compose_opts;
 
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 0.5;
     BaseFloat acoustic_scale = 0.1;
     bool use_carpa = false;
+    bool mmap = false;
+    int32 max_cached_histories = 0;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -77,7 +81,18 @@ int main(int argc, char *argv[]) {
         "saves time and reduces output lattice size).");
     po.Register("use-const-arpa", &use_carpa, "If true, read the old-LM file "
                 "as a const-arpa file as opposed to an FST file");
-
+    po.Register("mmap", &mmap, "If true (and --use-const-arpa=true), "
+                "memory-map the const-arpa file read-only instead of reading "
+                "it into memory.");
+    po.Register("max-cached-histories", &max_cached_histories, "If positive "
+                "(and --use-const-arpa=true), the maximum number of old-LM "
+                "histories to remember; the least recently used ones are "
+                "forgotten.  This bounds the memory used, which otherwise "
+                "grows with the number of lattices.");
+    po.Register("unigram-probs", &unigram_probs_rxfilename, "File with the "
+                "unigram probability of each word, with lines '<word-id> "
+                "<prob>' (e.g. exp/rnnlm/config/unigram_probs.txt); needed "
+                "with --normalization-method=sampled.");
     opts.Register(&po);
     compose_opts.Register(&po);
 
@@ -108,13 +123,14 @@ int main(int argc, char *argv[]) {
 
     // for G.carpa
     ConstArpaLm* const_arpa = NULL;
-    fst::DeterministicOnDemandFst<StdArc> *carpa_lm_to_subtract_fst = NULL;
+    ConstArpaLmDeterministicFst *carpa_lm_to_subtract_fst = NULL;
 
     KALDI_LOG << "Reading old LMs...";
     if (use_carpa) {
       const_arpa = new ConstArpaLm();
-      ReadKaldiObject(lm_to_subtract_rxfilename, const_arpa);
-      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(*const_arpa);
+      ReadConstArpaLm(lm_to_subtract_rxfilename, mmap, const_arpa);
+      carpa_lm_to_subtract_fst = new ConstArpaLmDeterministicFst(
+          *const_arpa, max_cached_histories);
       lm_to_subtract_det_scale
         = new fst::ScaleDeterministicOnDemandFst(-lm_scale,
                                                  carpa_lm_to_subtract_fst);
@@ -136,7 +152,15 @@ int main(int argc, char *argv[]) {
     CuMatrix<BaseFloat> word_embedding_mat;
     ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
 
-    const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    std::vector<BaseFloat> unigram_probs;
+    if (!unigram_probs_rxfilename.empty()) {
+      Input ki(unigram_probs_rxfilename);
+      rnnlm::ReadUnigramProbs(ki.Stream(), word_embedding_mat.NumRows(),
+                              &unigram_probs);
+    }
+    const rnnlm::RnnlmComputeStateInfo info(
+        opts, rnnlm, word_embedding_mat,
+        unigram_probs_rxfilename.empty() ? NULL : &unigram_probs);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
@@ -191,6 +215,9 @@ int main(int argc, char *argv[]) {
       delete lm_to_add;
     }
 
+    lm_to_add_orig->PrintStats();
+    if (carpa_lm_to_subtract_fst != NULL)
+      carpa_lm_to_subtract_fst->PrintStats();
     delete lm_to_subtract_fst;
     delete lm_to_add_orig;
     delete lm_to_subtract_det_backoff;
@@ -199,6 +226,8 @@ int main(int argc, char *argv[]) {
     delete const_arpa;
     delete carpa_lm_to_subtract_fst;
 
+    if (info.normalizer != NULL)
+      info.normalizer->PrintStats();
     KALDI_LOG << "Overall, succeeded for " << num_done
               << " lattices, failed for " << num_err;
     return (num_done != 0 ? 0 : 1);
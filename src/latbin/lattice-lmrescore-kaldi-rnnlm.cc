@@ -25,6 +25,7 @@
 #include "lat/kaldi-lattice.h"
 #include "lat/lattice-functions.h"
 #include "rnnlm/rnnlm-lattice-rescoring.h"
+#include "rnnlm/rnnlm-utils.h"
 #include "util/common-utils.h"
 #include "nnet3/nnet-utils.h"
 
@@ -49,6 +50,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
+    std::string unigram_probs_rxfilename;
 
     int32 max_ngram_order = 3;
     BaseFloat lm_scale = 1.0;
@@ -59,6 +61,10 @@ int main(int argc, char *argv[]) {
         "If positive, allow RNNLM histories longer than this to be identified "
         "with each other for rescoring purposes (an approximation that "
         "saves time and reduces output lattice size).");
+    po.Register("unigram-probs", &unigram_probs_rxfilename, "File with the "
+                "unigram probability of each word, with lines '<word-id> "
+                "<prob>' (e.g. exp/rnnlm/config/unigram_probs.txt); needed "
+                "with --normalization-method=sampled.");
     opts.Register(&po);
 
     po.Read(argc, argv);
@@ -85,7 +91,15 @@ int main(int argc, char *argv[]) {
     CuMatrix<BaseFloat> word_embedding_mat;
     ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
 
-    const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    std::vector<BaseFloat> unigram_probs;
+    if (!unigram_probs_rxfilename.empty()) {
+      Input ki(unigram_probs_rxfilename);
+      rnnlm::ReadUnigramProbs(ki.Stream(), word_embedding_mat.NumRows(),
+                              &unigram_probs);
+    }
+    const rnnlm::RnnlmComputeStateInfo info(
+        opts, rnnlm, word_embedding_mat,
+        unigram_probs_rxfilename.empty() ? NULL : &unigram_probs);
 
     // Reads and writes as compact lattice.
     SequentialCompactLatticeReader compact_lattice_reader(lats_rspecifier);
@@ -138,6 +152,9 @@ int main(int argc, char *argv[]) {
       rnnlm_fst.Clear();
     }
 
+    rnnlm_fst.PrintStats();
+    if (info.normalizer != NULL)
+      info.normalizer->PrintStats();
     KALDI_LOG << "Done " << n_done << " lattices, failed for " << n_fail;
     return (n_done != 0 ? 0 : 1);
   } catch(const std::exception &e) {
@@ -0,0 +1,231 @@
+// latbin/lattice-lmrescore-pruned-parallel.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "fstext/fstext-lib.h"
+#include "fstext/kaldi-fst-io.h"
+#include "lm/const-arpa-lm.h"
+#include "lat/kaldi-lattice.h"
+#include "lat/lattice-functions.h"
+#include "lat/compose-lattice-pruned.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+class LmRescorePrunedTask {
+ public:
+  // Initializer takes ownership of "clat".  Exactly one of "lm_to_add_fst" and
+  // "const_arpa" must be non-NULL.
+  LmRescorePrunedTask(const ComposeLatticePrunedOptions &compose_opts,
+                      const fst::VectorFst<fst::StdArc> &lm_to_subtract_fst,
+                      const fst::VectorFst<fst::StdArc> *lm_to_add_fst,
+                      const ConstArpaLm *const_arpa,
+                      int32 max_cached_histories,
+                      BaseFloat lm_scale,
+                      BaseFloat acoustic_scale,
+                      const std::string &key,
+                      CompactLattice *clat,
+                      CompactLatticeWriter *clat_writer,
+                      int32 *num_done,
+                      int32 *num_err):
+      compose_opts_(compose_opts), lm_to_subtract_fst_(lm_to_subtract_fst),
+      lm_to_add_fst_(lm_to_add_fst), const_arpa_(const_arpa),
+      max_cached_histories_(max_cached_histories), lm_scale_(lm_scale),
+      acoustic_scale_(acoustic_scale), key_(key), clat_(clat),
+      clat_writer_(clat_writer), num_done_(num_done), num_err_(num_err) { }
+
+  void operator () () {
+    using fst::StdArc;
+    // The LMs are shared between the threads; the on-demand FSTs, which cache
+    // the states they visit, are created for each lattice.
+    fst::BackoffDeterministicOnDemandFst<StdArc> lm_to_subtract_det_backoff(
+        lm_to_subtract_fst_);
+    fst::ScaleDeterministicOnDemandFst lm_to_subtract_det_scale(
+        -lm_scale_, &lm_to_subtract_det_backoff);
+    fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig;
+    ConstArpaLmDeterministicFst *const_arpa_fst = NULL;
+    if (const_arpa_ != NULL) {
+      const_arpa_fst = new ConstArpaLmDeterministicFst(*const_arpa_,
+                                                       max_cached_histories_);
+      lm_to_add_orig = const_arpa_fst;
+    } else {
+      lm_to_add_orig = new fst::BackoffDeterministicOnDemandFst<StdArc>(
+          *lm_to_add_fst_);
+    }
+    fst::ScaleDeterministicOnDemandFst lm_to_add(lm_scale_, lm_to_add_orig);
+
+    if (acoustic_scale_ != 1.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(acoustic_scale_), clat_);
+    TopSortCompactLatticeIfNeeded(clat_);
+
+    fst::ComposeDeterministicOnDemandFst<StdArc> combined_lms(
+        &lm_to_subtract_det_scale, &lm_to_add);
+    ComposeCompactLatticePruned(compose_opts_, *clat_, &combined_lms,
+                                &composed_clat_);
+    if (const_arpa_fst != NULL && GetVerboseLevel() >= 2)
+      const_arpa_fst->PrintStats();
+    delete lm_to_add_orig;
+    delete clat_;  // This is no longer needed so we can delete it now.
+    clat_ = NULL;
+
+    if (composed_clat_.NumStates() != 0 && acoustic_scale_ != 1.0)
+      fst::ScaleLattice(fst::AcousticLatticeScale(1.0 / acoustic_scale_),
+                        &composed_clat_);
+  }
+
+  ~LmRescorePrunedTask() {
+    // The destructors are called in the original order of the lattices, from
+    // one thread, so it is safe to write and update the counts here.
+    if (composed_clat_.NumStates() == 0) {
+      // Something went wrong.  A warning will already have been printed.
+      (*num_err_)++;
+    } else {
+      clat_writer_->Write(key_, composed_clat_);
+      (*num_done_)++;
+    }
+  }
+
+ private:
+  const ComposeLatticePrunedOptions &compose_opts_;
+  const fst::VectorFst<fst::StdArc> &lm_to_subtract_fst_;
+  const fst::VectorFst<fst::StdArc> *lm_to_add_fst_;
+  const ConstArpaLm *const_arpa_;
+  int32 max_cached_histories_;
+  BaseFloat lm_scale_;
+  BaseFloat acoustic_scale_;
+  std::string key_;
+  CompactLattice *clat_;  // The lattice we're working on.  Owned locally.
+  CompactLattice composed_clat_;  // The output of our process.  Will be
+                                  // written to clat_writer_ in the destructor.
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int32 *num_err_;
+};
+
+}  // namespace kaldi
+
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    typedef kaldi::int32 int32;
+    using fst::VectorFst;
+    using fst::StdArc;
+
+    const char *usage =
+        "This is a version of lattice-lmrescore-pruned that accepts the\n"
+        "--num-threads option: the lattices are rescored in parallel, sharing\n"
+        "one copy of each language model, and are written in the input order.\n"
+        "See lattice-lmrescore-pruned for more information.\n"
+        "\n"
+        "Usage: lattice-lmrescore-pruned-parallel [options] <lm-to-subtract> "
+        "<lm-to-add> <lattice-rspecifier> <lattice-wspecifier>\n"
+        " e.g.: lattice-lmrescore-pruned-parallel --num-threads=8 \\\n"
+        "      --acoustic-scale=0.1 --add-const-arpa=true \\\n"
+        "      data/lang/G.fst data/lang_fg/G.carpa ark:in.lats ark:out.lats\n";
+
+    ParseOptions po(usage);
+
+    // the options for the composition include --lattice-compose-beam,
+    // --max-arcs and --growth-ratio.
+    ComposeLatticePrunedOptions compose_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+    BaseFloat lm_scale = 1.0;
+    BaseFloat acoustic_scale = 1.0;
+    bool add_const_arpa = false;
+    bool mmap = false;
+    int32 max_cached_histories = 0;
+
+    po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
+                "will be applied to <lm-to-subtract>.");
+    po.Register("acoustic-scale", &acoustic_scale, "Scaling factor for acoustic "
+                "probabilities (e.g. 0.1 for non-chain systems); important because "
+                "of its effect on pruning.");
+    po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
+                "to be in const-arpa format; if false it's expected to be in FST"
+                "format.");
+    po.Register("mmap", &mmap, "If true (and --add-const-arpa=true), "
+                "memory-map <lm-to-add> read-only instead of reading it into "
+                "memory.");
+    po.Register("max-cached-histories", &max_cached_histories, "If positive "
+                "(and --add-const-arpa=true), the maximum number of LM "
+                "histories to remember for each lattice; the least recently "
+                "used ones are forgotten.  This bounds the memory used on long "
+                "lattices.");
+    compose_opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 4) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    if (acoustic_scale == 0.0)
+      KALDI_ERR << "Acoustic scale cannot be zero.";
+
+    std::string lm_to_subtract_rxfilename = po.GetArg(1),
+        lm_to_add_rxfilename = po.GetArg(2),
+        lats_rspecifier = po.GetArg(3),
+        lats_wspecifier = po.GetArg(4);
+
+    KALDI_LOG << "Reading LMs...";
+    VectorFst<StdArc> *lm_to_subtract_fst = fst::ReadAndPrepareLmFst(
+        lm_to_subtract_rxfilename);
+    VectorFst<StdArc> *lm_to_add_fst = NULL;
+    ConstArpaLm const_arpa;
+    if (add_const_arpa) {
+      ReadConstArpaLm(lm_to_add_rxfilename, mmap, &const_arpa);
+    } else {
+      lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
+    }
+    KALDI_LOG << "Done.";
+
+    // We read and write as CompactLattice.
+    SequentialCompactLatticeReader clat_reader(lats_rspecifier);
+    CompactLatticeWriter compact_lattice_writer(lats_wspecifier);
+
+    TaskSequencer<LmRescorePrunedTask> sequencer(sequencer_config);
+
+    int32 num_done = 0, num_err = 0;
+    for (; !clat_reader.Done(); clat_reader.Next()) {
+      std::string key = clat_reader.Key();
+      // will give ownership to "task" below.
+      CompactLattice *clat = new CompactLattice(clat_reader.Value());
+      clat_reader.FreeCurrent();
+      LmRescorePrunedTask *task = new LmRescorePrunedTask(
+          compose_opts, *lm_to_subtract_fst, lm_to_add_fst,
+          (add_const_arpa ? &const_arpa : NULL), max_cached_histories,
+          lm_scale, acoustic_scale, key, clat, &compact_lattice_writer,
+          &num_done, &num_err);
+      sequencer.Run(task);
+    }
+    sequencer.Wait();
+
+    delete lm_to_subtract_fst;
+    delete lm_to_add_fst;
+
+    KALDI_LOG << "Overall, succeeded for " << num_done
+              << " lattices, failed for " << num_err;
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception &e) {
+    std::cerr << e.what();
+    return -1;
+  }
+}
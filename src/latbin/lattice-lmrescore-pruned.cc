@@ -60,6 +60,8 @@ int main(int argc, char *argv[]) {
     BaseFloat lm_scale = 1.0;
     BaseFloat acoustic_scale = 1.0;
     bool add_const_arpa = false;
+    bool mmap = false;
+    int32 max_cached_histories = 0;
 
     po.Register("lm-scale", &lm_scale, "Scaling factor for <lm-to-add>; its negative "
                 "will be applied to <lm-to-subtract>.");
@@ -69,7 +71,13 @@ int main(int argc, char *argv[]) {
     po.Register("add-const-arpa", &add_const_arpa, "If true, <lm-to-add> is expected"
                 "to be in const-arpa format; if false it's expected to be in FST"
                 "format.");
-
+    po.Register("mmap", &mmap, "If true (and --add-const-arpa=true), "
+                "memory-map <lm-to-add> read-only instead of reading it into "
+                "memory.");
+    po.Register("max-cached-histories", &max_cached_histories, "If positive "
+                "(and --add-const-arpa=true), the maximum number of LM "
+                "histories to remember; the least recently used ones are "
+                "forgotten.  This bounds the memory used on long lattices.");
 
     po.Read(argc, argv);
 
@@ -89,7 +97,7 @@ int main(int argc, char *argv[]) {
     VectorFst<StdArc> *lm_to_add_fst = NULL;
     ConstArpaLm const_arpa;
     if (add_const_arpa) {
-      ReadKaldiObject(lm_to_add_rxfilename, &const_arpa);
+      ReadConstArpaLm(lm_to_add_rxfilename, mmap, &const_arpa);
     } else {
       lm_to_add_fst = fst::ReadAndPrepareLmFst(lm_to_add_rxfilename);
     }
@@ -101,8 +109,11 @@ int main(int argc, char *argv[]) {
 
     fst::DeterministicOnDemandFst<StdArc> *lm_to_add_orig = NULL,
         *lm_to_add = NULL;
+    ConstArpaLmDeterministicFst *const_arpa_fst = NULL;
     if (add_const_arpa) {
-      lm_to_add = new ConstArpaLmDeterministicFst(const_arpa);
+      const_arpa_fst = new ConstArpaLmDeterministicFst(const_arpa,
+                                                       max_cached_histories);
+      lm_to_add = const_arpa_fst;
     } else {
       lm_to_add = new fst::BackoffDeterministicOnDemandFst<StdArc>(
           *lm_to_add_fst);
@@ -159,7 +170,16 @@ int main(int argc, char *argv[]) {
         compact_lattice_writer.Write(key, composed_clat);
         num_done++;
       }
+      // The states of combined_lms are gone, so we can also forget those of
+      // the LM; otherwise they would accumulate over all the lattices.
+      if (const_arpa_fst != NULL) {
+        if (GetVerboseLevel() >= 2)
+          const_arpa_fst->PrintStats();
+        const_arpa_fst->Clear();
+      }
     }
+    if (const_arpa_fst != NULL)
+      const_arpa_fst->PrintStats();
     delete lm_to_subtract_fst;
     delete lm_to_add_fst;
     delete lm_to_add_orig;
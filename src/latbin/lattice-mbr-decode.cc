@@ -39,6 +39,9 @@ int main(int argc, char *argv[]) {
         "Note: times will only be very meaningful if you first use lattice-word-align.\n"
         "If you need ctm-format output, don't use this program but use lattice-to-ctm-conf\n"
         "with --decode-mbr=true.\n"
+        "For long recordings, use e.g. --segment-frames=3000 (and\n"
+        "--num-segment-threads) to split the lattices at confident points and\n"
+        "decode the pieces separately.\n"
         "\n"
         "Usage: lattice-mbr-decode [options]  lattice-rspecifier "
         "transcriptions-wspecifier [ bayes-risk-wspecifier "
@@ -60,8 +63,11 @@ int main(int argc, char *argv[]) {
                 "words [for debug output]");
     po.Register("one-best-times", &one_best_times, "If true, output times "
                 "corresponding to one-best, not whole sausage.");
+    MinimumBayesRiskOptions mbr_opts;
+    mbr_opts.Register(&po);
 
     po.Read(argc, argv);
+    mbr_opts.Check();
 
     if (po.NumArgs() < 2 || po.NumArgs() > 5) {
       po.PrintUsage();
@@ -100,7 +106,7 @@ int main(int argc, char *argv[]) {
       clat_reader.FreeCurrent();
       fst::ScaleLattice(fst::LatticeScale(lm_scale, acoustic_scale), &clat);
 
-      MinimumBayesRisk mbr(clat);
+      MinimumBayesRisk mbr(clat, mbr_opts);
 
       if (trans_wspecifier != "")
         trans_writer.Write(key, mbr.GetOneBest());
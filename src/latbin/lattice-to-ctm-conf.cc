@@ -77,6 +77,7 @@ int main(int argc, char *argv[]) {
     mbr_opts.Register(&po);
 
     po.Read(argc, argv);
+    mbr_opts.Check();
 
     if (po.NumArgs() != 2 && po.NumArgs() != 3 && po.NumArgs() != 4) {
       po.PrintUsage();
@@ -0,0 +1,143 @@
+// lm/const-arpa-lm-streaming-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "base/kaldi-math.h"
+#include "lm/const-arpa-lm.h"
+#include "lm/const-arpa-lm-streaming.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+static const int32 kBos = 1, kEos = 2;
+
+// Writes a random ARPA file with integer words to 'filename'.  Every n-gram's
+// history is present as a lower-order n-gram; the n-grams of each order are
+// in random order, and some of the backoffs are zero (or absent).
+static void WriteRandomArpa(int32 ngram_order, const std::string &filename) {
+  int32 num_words = RandInt(3, 20);
+  std::vector<std::vector<std::vector<int32> > > ngrams(ngram_order);
+  for (int32 w = 1; w <= num_words; w++)
+    ngrams[0].push_back(std::vector<int32>(1, w));
+  for (int32 order = 2; order <= ngram_order; order++) {
+    std::set<std::vector<int32> > seen;
+    const std::vector<std::vector<int32> > &lower = ngrams[order - 2];
+    int32 num_ngrams = RandInt(0, 3 * lower.size());
+    for (int32 i = 0; i < num_ngrams; i++) {
+      std::vector<int32> ngram = lower[RandInt(0, lower.size() - 1)];
+      if (ngram.back() == kEos) continue;
+      ngram.push_back(RandInt(2, num_words));
+      if (seen.insert(ngram).second)
+        ngrams[order - 1].push_back(ngram);
+    }
+  }
+  std::ofstream os(filename.c_str());
+  os << "\n\\data\\\n";
+  for (int32 order = 1; order <= ngram_order; order++)
+    os << "ngram " << order << "=" << ngrams[order - 1].size() << "\n";
+  for (int32 order = 1; order <= ngram_order; order++) {
+    os << "\n\\" << order << "-grams:\n";
+    std::vector<std::vector<int32> > &this_order = ngrams[order - 1];
+    std::random_shuffle(this_order.begin(), this_order.end());
+    for (size_t i = 0; i < this_order.size(); i++) {
+      os << (-RandUniform() * 5.0);
+      for (size_t j = 0; j < this_order[i].size(); j++)
+        os << (j == 0 ? '\t' : ' ') << this_order[i][j];
+      if (order < ngram_order && RandInt(0, 2) != 0)
+        os << '\t' << (RandInt(0, 1) == 0 ? 0.0 : -RandUniform());
+      os << "\n";
+    }
+  }
+  os << "\n\\end\\\n";
+}
+
+static std::string ReadFileContents(const std::string &filename) {
+  std::ifstream is(filename.c_str(), std::ios::binary);
+  std::ostringstream os;
+  os << is.rdbuf();
+  return os.str();
+}
+
+static std::string ConstArpaToArpa(const std::string &filename, bool mmap) {
+  ConstArpaLm lm;
+  ReadConstArpaLm(filename, mmap, &lm);
+  // Files written to a regular file always have their LmStates aligned.
+  KALDI_ASSERT(lm.IsMapped() == mmap);
+  std::ostringstream os;
+  lm.WriteArpa(os);
+  return os.str();
+}
+
+// Checks that the streaming builder writes exactly what BuildConstArpaLm()
+// writes, with a memory limit small enough that many temporary files are
+// needed.
+void UnitTestStreamingConstArpaLm() {
+  ArpaParseOptions options;
+  options.bos_symbol = kBos;
+  options.eos_symbol = kEos;
+  options.unk_symbol = (RandInt(0, 1) == 0 ? -1 : 3);
+  int32 ngram_order = RandInt(1, 4);
+  std::string arpa = "tmp.const-arpa-lm-streaming-test.arpa",
+      normal = "tmp.const-arpa-lm-streaming-test.normal",
+      streaming = "tmp.const-arpa-lm-streaming-test.streaming";
+  WriteRandomArpa(ngram_order, arpa);
+
+  BuildConstArpaLm(options, arpa, normal);
+  StreamingConstArpaLmOptions config;
+  config.max_memory_mb = 0.0001 * RandInt(1, 10);
+  config.num_threads = RandInt(1, 3);
+  BuildConstArpaLmStreaming(options, config, arpa, streaming);
+  KALDI_ASSERT(ReadFileContents(normal) == ReadFileContents(streaming));
+
+  // Now force the use of the overflow buffer; the addresses are then
+  // different from BuildConstArpaLm(), but the model should be the same.  We
+  // also check that the model is the same when it is memory-mapped.
+  {
+    StreamingConstArpaLmBuilder lm_builder(options, config);
+    lm_builder.SetMaxAddressOffset(RandInt(1, 10));
+    Input ki(arpa);
+    lm_builder.Read(ki.Stream());
+    WriteKaldiObject(lm_builder, streaming, true);
+  }
+  KALDI_ASSERT(ConstArpaToArpa(normal, false) ==
+               ConstArpaToArpa(streaming, true));
+  KALDI_ASSERT(ConstArpaToArpa(normal, true) ==
+               ConstArpaToArpa(normal, false));
+
+  unlink(arpa.c_str());
+  unlink(normal.c_str());
+  unlink(streaming.c_str());
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    UnitTestStreamingConstArpaLm();
+  KALDI_LOG << "Tests succeeded.";
+  return 0;
+}
@@ -0,0 +1,534 @@
+// lm/const-arpa-lm-streaming.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <sstream>
+
+#ifndef _MSC_VER
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include "lm/const-arpa-lm-streaming.h"
+#include "lm/const-arpa-lm.h"
+#include "util/kaldi-io.h"
+
+namespace kaldi {
+
+// The size, in int32s, of the buffers we use for reading and writing
+// temporary files.
+static const size_t kTempFileBufferSize = 1 << 20;
+
+// An anonymous temporary file, which is deleted when it is closed; we read and
+// write it in units of int32.
+class StreamingConstArpaLmBuilder::TempFile {
+ public:
+  explicit TempFile(const std::string &dir): file_(NULL) {
+#ifndef _MSC_VER
+    if (!dir.empty()) {
+      std::string name = dir + "/kaldi-const-arpa.XXXXXX";
+      std::vector<char> name_buf(name.begin(), name.end());
+      name_buf.push_back('\0');
+      int fd = mkstemp(&(name_buf[0]));
+      if (fd < 0)
+        KALDI_ERR << "Could not create temporary file in " << dir << ": "
+                  << strerror(errno);
+      unlink(&(name_buf[0]));  // The file goes away when we close it.
+      file_ = fdopen(fd, "w+b");
+    } else {
+      file_ = std::tmpfile();
+    }
+#else
+    if (!dir.empty())
+      KALDI_WARN << "--temp-dir is not supported on Windows; ignoring it.";
+    file_ = std::tmpfile();
+#endif
+    if (file_ == NULL)
+      KALDI_ERR << "Could not create temporary file: " << strerror(errno);
+  }
+
+  ~TempFile() { std::fclose(file_); }
+
+  void Write(const int32 *data, size_t n) {
+    if (n > 0 && std::fwrite(data, sizeof(int32), n, file_) != n)
+      KALDI_ERR << "Error writing temporary file (disk full?): "
+                << strerror(errno);
+  }
+
+  void Read(int32 *data, size_t n) {
+    if (n > 0 && std::fread(data, sizeof(int32), n, file_) != n)
+      KALDI_ERR << "Error reading temporary file.";
+  }
+
+  // Seeks to the int32 with index 'pos'.  Must be called when switching
+  // between writing and reading.
+  void Seek(int64 pos) {
+#ifdef _MSC_VER
+    int ret = _fseeki64(file_, pos * sizeof(int32), SEEK_SET);
+#else
+    int ret = fseeko(file_, pos * sizeof(int32), SEEK_SET);
+#endif
+    if (ret != 0)
+      KALDI_ERR << "Error seeking in temporary file: " << strerror(errno);
+  }
+
+ private:
+  FILE *file_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(TempFile);
+};
+
+
+// Compares n-gram records by their words; the words are padded with zeros,
+// which sorts a sequence before any longer one that it is a prefix of, as for
+// std::vector<int32>.
+struct NGramRecordLessThan {
+  explicit NGramRecordLessThan(int32 ngram_order): ngram_order(ngram_order) { }
+  bool operator () (const int32 *a, const int32 *b) const {
+    return std::lexicographical_compare(a, a + ngram_order, b, b + ngram_order);
+  }
+  int32 ngram_order;
+};
+
+struct NGramRecordGreaterThan {
+  explicit NGramRecordGreaterThan(int32 ngram_order): less(ngram_order) { }
+  bool operator () (const int32 *a, const int32 *b) const {
+    return less(b, a);
+  }
+  NGramRecordLessThan less;
+};
+
+
+// This is the task that we give to the TaskSequencer: it sorts a chunk of
+// records in decreasing order and writes them to a run.
+class StreamingConstArpaLmBuilder::SortTask {
+ public:
+  SortTask(int32 ngram_order, std::vector<int32> *records, TempFile *run):
+      ngram_order_(ngram_order), run_(run) {
+    records_.swap(*records);
+  }
+
+  void operator () () {
+    int32 record_size = ngram_order_ + 2;
+    size_t num_records = records_.size() / record_size;
+    std::vector<const int32*> sorted(num_records);
+    for (size_t i = 0; i < num_records; i++)
+      sorted[i] = &(records_[i * record_size]);
+    std::sort(sorted.begin(), sorted.end(),
+              NGramRecordGreaterThan(ngram_order_));
+    std::vector<int32> buffer;
+    buffer.reserve(kTempFileBufferSize + record_size);
+    for (size_t i = 0; i < num_records; i++) {
+      buffer.insert(buffer.end(), sorted[i], sorted[i] + record_size);
+      if (buffer.size() >= kTempFileBufferSize) {
+        run_->Write(&(buffer[0]), buffer.size());
+        buffer.clear();
+      }
+    }
+    if (!buffer.empty())
+      run_->Write(&(buffer[0]), buffer.size());
+  }
+
+ private:
+  int32 ngram_order_;
+  std::vector<int32> records_;
+  TempFile *run_;
+};
+
+
+StreamingConstArpaLmBuilder::StreamingConstArpaLmBuilder(
+    const ArpaParseOptions &options,
+    const StreamingConstArpaLmOptions &config):
+    ArpaFileParser(options, NULL), config_(config),
+    max_address_offset_(pow(2, 30) - 1), ngram_order_(0), record_size_(0),
+    chunk_records_(0), sequencer_(NULL), states_(NULL), lm_states_size_(0),
+    num_words_(0), is_built_(false) {
+  if (config_.num_threads < 1)
+    KALDI_ERR << "--num-threads must be at least 1.";
+  if (config_.max_memory_mb <= 0.0)
+    KALDI_ERR << "--max-memory must be positive.";
+}
+
+StreamingConstArpaLmBuilder::~StreamingConstArpaLmBuilder() {
+  delete sequencer_;  // Waits for any sorting tasks that are still running.
+  for (size_t i = 0; i < runs_.size(); i++)
+    delete runs_[i].file;
+  delete states_;
+}
+
+void StreamingConstArpaLmBuilder::SetMaxAddressOffset(
+    const int32 max_address_offset) {
+  KALDI_WARN << "You are changing <max_address_offset_>; the default should "
+             << "not be changed unless you are in testing mode.";
+  max_address_offset_ = max_address_offset;
+}
+
+void StreamingConstArpaLmBuilder::HeaderAvailable() {
+  ngram_order_ = NgramCounts().size();
+  record_size_ = ngram_order_ + 2;
+  // The chunk being filled, plus one being sorted by each thread, have to fit
+  // in the memory limit.  Sorting needs a pointer per record.
+  double bytes_per_record = sizeof(int32) * record_size_ + sizeof(int32*),
+      max_bytes = config_.max_memory_mb * 1048576.0;
+  chunk_records_ = std::max<int64>(
+      1, max_bytes / (bytes_per_record * (config_.num_threads + 1)));
+  chunk_.reserve(std::min<int64>(chunk_records_ * record_size_,
+                                 kTempFileBufferSize));
+  TaskSequencerConfig sequencer_config;
+  sequencer_config.num_threads = config_.num_threads;
+  sequencer_config.num_threads_total = config_.num_threads;
+  delete sequencer_;
+  sequencer_ = new TaskSequencer<SortTask>(sequencer_config);
+}
+
+void StreamingConstArpaLmBuilder::ConsumeNGram(const NGram &ngram) {
+  int32 cur_order = ngram.words.size();
+  KALDI_ASSERT(cur_order <= ngram_order_);
+  chunk_.insert(chunk_.end(), ngram.words.begin(), ngram.words.end());
+  chunk_.resize(chunk_.size() + ngram_order_ - cur_order, 0);
+  chunk_.push_back(Int32AndFloat(ngram.logprob).i);
+  chunk_.push_back(Int32AndFloat(ngram.backoff).i);
+  if (static_cast<int64>(chunk_.size()) >= chunk_records_ * record_size_)
+    SpillChunk();
+}
+
+void StreamingConstArpaLmBuilder::SpillChunk() {
+  if (chunk_.empty())
+    return;
+  Run run;
+  run.file = new TempFile(config_.temp_dir);
+  run.num_records = chunk_.size() / record_size_;
+  runs_.push_back(run);
+  // The SortTask takes the contents of chunk_.
+  sequencer_->Run(new SortTask(ngram_order_, &chunk_, run.file));
+  chunk_.clear();
+}
+
+void StreamingConstArpaLmBuilder::ReportMissingParent(
+    const Level &level) const {
+  KALDI_ASSERT(!level.children.empty());
+  int32 order = level.history.size();
+  std::ostringstream ss;
+  for (int32 i = 0; i < order; i++)
+    ss << (i == 0 ? '[' : ' ') << level.history[i];
+  ss << ' ' << level.children.back().word << ']';
+  KALDI_ERR << (order + 1) << "-gram " << ss.str() << " does not have "
+            << "a parent model " << order << "-gram.";
+}
+
+void StreamingConstArpaLmBuilder::FlushStates() {
+  if (!states_buffer_.empty()) {
+    states_->Write(&(states_buffer_[0]), states_buffer_.size());
+    states_buffer_.clear();
+  }
+}
+
+void StreamingConstArpaLmBuilder::ProcessRecord(const int32 *record) {
+  const int32 *words = record;
+  int32 order = 0;
+  while (order < ngram_order_ && words[order] != 0)
+    order++;
+  KALDI_ASSERT(order > 0);
+  Int32AndFloat logprob(record[ngram_order_]),
+      backoff(record[ngram_order_ + 1]);
+
+  if (!prev_words_.empty() &&
+      std::equal(words, words + ngram_order_, prev_words_.begin())) {
+    std::ostringstream os;
+    os << "[ ";
+    for (int32 i = 0; i < order; i++)
+      os << words[i] << " ";
+    os << "]";
+    KALDI_ERR << "N-gram " << os.str() << " appears twice in the arpa file";
+  }
+  prev_words_.assign(words, words + ngram_order_);
+
+  // All the descendants of this n-gram came just before it, so anything that
+  // is still waiting for a parent of a higher order than this one never had
+  // a parent.
+  for (int32 k = order + 1; k < ngram_order_; k++)
+    if (!levels_[k].children.empty())
+      ReportMissingParent(levels_[k]);
+
+  std::vector<Child> children;  // in decreasing order of word.
+  if (order < ngram_order_) {
+    Level &level = levels_[order];
+    if (!level.children.empty()) {
+      if (!std::equal(words, words + order, level.history.begin()))
+        ReportMissingParent(level);
+      children.swap(level.children);
+    }
+  }
+
+  Child me;
+  me.word = words[order - 1];
+  me.end_offset = 0;
+  me.leaf_info = 0;
+  int32 num_children = children.size();
+  // This is the condition under which ConstArpaLmBuilder creates an LmState
+  // (i.e. the LmState's MemSize() is nonzero).
+  if (order == 1 || num_children > 0 || backoff.f != 0.0) {
+    int64 mem_size = 3 + 2 * num_children,
+        end_offset = lm_states_size_ + mem_size;
+    std::vector<int32> state(mem_size);
+    state[0] = logprob.i;
+    state[1] = backoff.i;
+    state[2] = num_children;
+    // We go through the children in decreasing order, which is the reverse
+    // of the order in which ConstArpaLmBuilder allocates overflow-buffer
+    // entries.
+    for (int32 i = 0; i < num_children; i++) {
+      const Child &child = children[i];
+      int32 j = num_children - 1 - i,  // position of child in the LmState.
+          child_info;
+      if (child.end_offset == 0) {
+        child_info = child.leaf_info;
+      } else {
+        int64 offset = end_offset - child.end_offset;
+        KALDI_ASSERT(offset > 0);
+        if (offset <= max_address_offset_) {
+          child_info = offset * 2;
+          child_info |= 1;
+        } else {
+          // This is fixed in Write(), once we know the number of entries;
+          // the position is that of the child info in states_.
+          child_info = 0;
+          overflow_end_offsets_.push_back(child.end_offset);
+          overflow_positions_.push_back(lm_states_size_ + mem_size - 1 -
+                                        (4 + 2 * j));
+        }
+      }
+      state[3 + 2 * j] = child.word;
+      state[4 + 2 * j] = child_info;
+    }
+    states_buffer_.insert(states_buffer_.end(), state.rbegin(), state.rend());
+    if (states_buffer_.size() >= kTempFileBufferSize)
+      FlushStates();
+    lm_states_size_ = end_offset;
+    me.end_offset = end_offset;
+    if (order == 1) {
+      if (me.word >= num_words_) {
+        num_words_ = me.word + 1;
+        unigram_end_offsets_.resize(num_words_, 0);
+      }
+      unigram_end_offsets_[me.word] = end_offset;
+    }
+  } else {
+    // A leaf: its logprob goes directly in its parent's child info, with the
+    // last bit set to 0 so the child info is even.
+    me.leaf_info = logprob.i & ~1;
+  }
+
+  if (order > 1) {
+    Level &parent = levels_[order - 1];
+    if (parent.children.empty())
+      parent.history.assign(words, words + order - 1);
+    else if (!std::equal(words, words + order - 1, parent.history.begin()))
+      ReportMissingParent(parent);
+    parent.children.push_back(me);
+  }
+}
+
+void StreamingConstArpaLmBuilder::ReadComplete() {
+  // Sort the remaining n-grams and wait for all the runs to be written.
+  SpillChunk();
+  sequencer_->Wait();
+  std::vector<int32>().swap(chunk_);
+  int64 num_records = 0;
+  for (size_t i = 0; i < runs_.size(); i++)
+    num_records += runs_[i].num_records;
+  KALDI_LOG << "Sorted " << num_records << " n-grams into " << runs_.size()
+            << " temporary files; merging them.";
+
+  // Set up the merge.  Each run has a buffer, and 'heap' holds the index of
+  // each run that is not finished, ordered by its current record.
+  int32 num_runs = runs_.size();
+  int64 buffer_records = std::max<int64>(
+      1, std::min<int64>(kTempFileBufferSize / record_size_,
+                         chunk_records_ / std::max(num_runs, 1)));
+  std::vector<std::vector<int32> > buffers(num_runs);
+  std::vector<int64> records_left(num_runs), buffer_pos(num_runs, 0);
+  for (int32 i = 0; i < num_runs; i++) {
+    runs_[i].file->Seek(0);
+    records_left[i] = runs_[i].num_records;
+  }
+  // Loads the next records of run i into its buffer; returns false if there
+  // are none.
+  struct Loader {
+    static bool Load(TempFile *file, int32 record_size, int64 buffer_records,
+                     int64 *records_left, std::vector<int32> *buffer,
+                     int64 *buffer_pos) {
+      int64 n = std::min(*records_left, buffer_records);
+      if (n == 0) return false;
+      buffer->resize(n * record_size);
+      file->Read(&((*buffer)[0]), buffer->size());
+      *records_left -= n;
+      *buffer_pos = 0;
+      return true;
+    }
+  };
+  struct HeapLessThan {
+    HeapLessThan(const std::vector<std::vector<int32> > &buffers,
+                 const std::vector<int64> &buffer_pos, int32 ngram_order):
+        buffers(buffers), buffer_pos(buffer_pos), less(ngram_order) { }
+    bool operator () (int32 a, int32 b) const {
+      return less(&(buffers[a][buffer_pos[a]]), &(buffers[b][buffer_pos[b]]));
+    }
+    const std::vector<std::vector<int32> > &buffers;
+    const std::vector<int64> &buffer_pos;
+    NGramRecordLessThan less;
+  };
+  std::priority_queue<int32, std::vector<int32>, HeapLessThan> heap(
+      HeapLessThan(buffers, buffer_pos, ngram_order_));
+  for (int32 i = 0; i < num_runs; i++)
+    if (Loader::Load(runs_[i].file, record_size_, buffer_records,
+                     &(records_left[i]), &(buffers[i]), &(buffer_pos[i])))
+      heap.push(i);
+
+  states_ = new TempFile(config_.temp_dir);
+  levels_.resize(ngram_order_);
+  while (!heap.empty()) {
+    int32 i = heap.top();
+    heap.pop();
+    ProcessRecord(&(buffers[i][buffer_pos[i]]));
+    buffer_pos[i] += record_size_;
+    if (buffer_pos[i] < static_cast<int64>(buffers[i].size()) ||
+        Loader::Load(runs_[i].file, record_size_, buffer_records,
+                     &(records_left[i]), &(buffers[i]), &(buffer_pos[i])))
+      heap.push(i);
+  }
+  for (int32 k = 1; k < ngram_order_; k++)
+    if (!levels_[k].children.empty())
+      ReportMissingParent(levels_[k]);
+  FlushStates();
+  levels_.clear();
+
+  // We don't need the runs any more.
+  for (size_t i = 0; i < runs_.size(); i++)
+    delete runs_[i].file;
+  runs_.clear();
+
+  // These are checked in ConstArpaLm's constructor, in the non-streaming
+  // case.
+  const ArpaParseOptions &options = Options();
+  KALDI_ASSERT(ngram_order_ > 0);
+  KALDI_ASSERT(options.bos_symbol < num_words_ && options.bos_symbol > 0);
+  KALDI_ASSERT(options.eos_symbol < num_words_ && options.eos_symbol > 0);
+  KALDI_ASSERT(options.unk_symbol < num_words_ &&
+               (options.unk_symbol > 0 || options.unk_symbol == -1));
+  is_built_ = true;
+}
+
+void StreamingConstArpaLmBuilder::Write(std::ostream &os, bool binary) const {
+  if (!binary) {
+    KALDI_ERR << "text-mode writing is not implemented for "
+              << "StreamingConstArpaLmBuilder.";
+  }
+  KALDI_ASSERT(is_built_);
+  const ArpaParseOptions &options = Options();
+
+  // See ConstArpaLm::Write() for the format.
+  WriteToken(os, binary, "<ConstArpaLm>");
+
+  WriteToken(os, binary, "<LmInfo>");
+  WriteBasicType(os, binary, options.bos_symbol);
+  WriteBasicType(os, binary, options.eos_symbol);
+  WriteBasicType(os, binary, options.unk_symbol);
+  WriteBasicType(os, binary, ngram_order_);
+  WriteToken(os, binary, "</LmInfo>");
+
+  // The LmStates are in states_ in reverse order, so we copy them starting
+  // from the end, a block at a time.  At the same time we fill in the child
+  // infos that point into the overflow buffer.  overflow_positions_ is in
+  // increasing order, and entry i of it corresponds to entry (num_overflow -
+  // 1 - i) of the overflow buffer.
+  WriteConstArpaLmStatesToken(os, binary);
+  WriteBasicType(os, binary, lm_states_size_);
+  int32 num_overflow = overflow_positions_.size();
+  int32 overflow_index = num_overflow - 1;
+  std::vector<int32> buffer;
+  for (int64 end = lm_states_size_; end > 0; ) {
+    int64 start = std::max<int64>(0, end - kTempFileBufferSize);
+    buffer.resize(end - start);
+    states_->Seek(start);
+    states_->Read(&(buffer[0]), buffer.size());
+    std::reverse(buffer.begin(), buffer.end());
+    for (; overflow_index >= 0 &&
+             overflow_positions_[overflow_index] >= start; overflow_index--) {
+      int32 child_info = (num_overflow - 1 - overflow_index) * 2;
+      child_info |= 1;
+      child_info *= -1;
+      buffer[end - 1 - overflow_positions_[overflow_index]] = child_info;
+    }
+    os.write(reinterpret_cast<const char*>(&(buffer[0])),
+             sizeof(int32) * buffer.size());
+    end = start;
+  }
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmStates> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmStates>");
+
+  // As in ConstArpaLm::Write(), addresses are written as offsets into the
+  // LmStates plus one, or zero for NULL.
+  WriteToken(os, binary, "<LmUnigram>");
+  WriteBasicType(os, binary, num_words_);
+  std::vector<int64> addresses(num_words_);
+  for (int32 i = 0; i < num_words_; i++)
+    addresses[i] = (unigram_end_offsets_[i] == 0) ? 0 :
+        lm_states_size_ - unigram_end_offsets_[i] + 1;
+  if (num_words_ > 0)
+    os.write(reinterpret_cast<const char*>(&(addresses[0])),
+             sizeof(int64) * num_words_);
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmUnigram> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmUnigram>");
+
+  WriteToken(os, binary, "<LmOverflow>");
+  WriteBasicType(os, binary, num_overflow);
+  addresses.resize(num_overflow);
+  for (int32 i = 0; i < num_overflow; i++)
+    addresses[i] = lm_states_size_ -
+        overflow_end_offsets_[num_overflow - 1 - i] + 1;
+  if (num_overflow > 0)
+    os.write(reinterpret_cast<const char*>(&(addresses[0])),
+             sizeof(int64) * num_overflow);
+  if (!os.good()) {
+    KALDI_ERR << "ConstArpaLm <LmOverflow> section writing failed.";
+  }
+  WriteToken(os, binary, "</LmOverflow>");
+  WriteToken(os, binary, "</ConstArpaLm>");
+}
+
+bool BuildConstArpaLmStreaming(const ArpaParseOptions &options,
+                               const StreamingConstArpaLmOptions &config,
+                               const std::string &arpa_rxfilename,
+                               const std::string &const_arpa_wxfilename) {
+  StreamingConstArpaLmBuilder lm_builder(options, config);
+  KALDI_LOG << "Reading " << arpa_rxfilename;
+  Input ki(arpa_rxfilename);
+  lm_builder.Read(ki.Stream());
+  WriteKaldiObject(lm_builder, const_arpa_wxfilename, true);
+  return true;
+}
+
+}  // namespace kaldi
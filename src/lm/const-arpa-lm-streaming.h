@@ -0,0 +1,217 @@
+// lm/const-arpa-lm-streaming.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_LM_CONST_ARPA_LM_STREAMING_H_
+#define KALDI_LM_CONST_ARPA_LM_STREAMING_H_
+
+#include <string>
+#include <vector>
+
+#include "base/kaldi-common.h"
+#include "itf/options-itf.h"
+#include "lm/arpa-file-parser.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+/**
+   This file provides a way to build the ConstArpaLm format (see
+   const-arpa-lm.h) from an ARPA file using a bounded amount of memory, for
+   language models that are too large for ConstArpaLmBuilder, which keeps an
+   LmState object and a hash-table entry for every n-gram before it creates the
+   output.  The output is byte-for-byte the same as what BuildConstArpaLm()
+   writes.
+
+   The ConstArpaLm layout puts the LmStates in lexicographic order of their
+   word sequences, which is a depth-first traversal of the n-gram trie; but an
+   ARPA file lists the n-grams by order, and within each order they are not
+   in general in numerical order of the word-ids (e.g. after
+   utils/map_arpa_lm.pl).  So we proceed as follows:
+
+    1. While the ARPA file is parsed (by ArpaFileParser), each n-gram is
+       appended as a fixed-size record (the words padded with zeros, the
+       logprob and the backoff) to a buffer.  When the buffer is full it is
+       handed to a background thread that sorts it in decreasing lexicographic
+       order and writes it to a temporary file (a "run"), while parsing goes
+       on into a new buffer.  The number of such threads is --num-threads.
+    2. The runs are merged, giving all the n-grams in decreasing lexicographic
+       order.  In this order every n-gram comes immediately after all of its
+       descendants in the trie, so when we see it we already know its
+       children and the size and position of all the LmStates that follow
+       it.  That is all that is needed to write its LmState, with the relative
+       addresses of its children.  The only things we keep in memory are the
+       children of the n-grams on the current path from the root (i.e. one
+       list per order), plus one entry per word for the unigram table and
+       one per overflow-buffer entry.
+    3. The LmStates are written to another temporary file in reverse order,
+       and Write() copies them out in the right order.
+
+   Memory use is therefore bounded by --max-memory plus the size of the
+   vocabulary and of the largest set of children of any single history, and
+   the disk space needed is about twice the size of the n-grams in binary
+   form plus the size of the output.
+ */
+struct StreamingConstArpaLmOptions {
+  BaseFloat max_memory_mb;
+  int32 num_threads;
+  std::string temp_dir;
+
+  StreamingConstArpaLmOptions(): max_memory_mb(1024.0), num_threads(1) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("max-memory", &max_memory_mb, "Approximate limit, in "
+                   "megabytes, on the memory used to sort the n-grams (only "
+                   "relevant in streaming mode).");
+    opts->Register("num-threads", &num_threads, "Number of threads used to "
+                   "sort the n-grams while the ARPA file is being parsed (only "
+                   "relevant in streaming mode).");
+    opts->Register("temp-dir", &temp_dir, "Directory for temporary files "
+                   "(only relevant in streaming mode); if empty, the system's "
+                   "default temporary directory is used.");
+  }
+};
+
+
+/// Builds the ConstArpaLm format from an ARPA file that has been converted to
+/// integers, using bounded memory; see the comment above for how it works.
+/// Use it by calling Read() (from ArpaFileParser) and then Write().
+class StreamingConstArpaLmBuilder: public ArpaFileParser {
+ public:
+  StreamingConstArpaLmBuilder(const ArpaParseOptions &options,
+                              const StreamingConstArpaLmOptions &config);
+
+  ~StreamingConstArpaLmBuilder();
+
+  /// Writes the ConstArpaLm; this is the same format as ConstArpaLm::Write().
+  /// Must be called after Read().
+  void Write(std::ostream &os, bool binary) const;
+
+  /// As ConstArpaLmBuilder::SetMaxAddressOffset(); for testing only.
+  void SetMaxAddressOffset(const int32 max_address_offset);
+
+ protected:
+  // ArpaFileParser overrides.
+  virtual void HeaderAvailable();
+  virtual void ConsumeNGram(const NGram &ngram);
+  virtual void ReadComplete();
+
+ private:
+  class TempFile;
+  class SortTask;
+
+  struct Run {
+    TempFile *file;
+    int64 num_records;
+  };
+
+  // A child of an n-gram whose LmState has not been written yet.
+  struct Child {
+    int32 word;
+    // If the child has an LmState, the distance from its start to the end of
+    // the LmStates array (i.e. the LmState's size plus that of all the ones
+    // after it); zero if it is a leaf.
+    int64 end_offset;
+    // If the child is a leaf, its logprob as it is stored in the child info.
+    int32 leaf_info;
+  };
+
+  // The children seen so far of the n-gram 'history', whose order is the
+  // index of this Level in levels_.
+  struct Level {
+    std::vector<int32> history;
+    std::vector<Child> children;
+  };
+
+  // Sorts and writes out the n-grams in chunk_ (in the background, if
+  // possible).
+  void SpillChunk();
+
+  // Processes one n-gram record, in decreasing lexicographic order; this is
+  // the second phase described above.
+  void ProcessRecord(const int32 *record);
+
+  // Called when 'level' has children whose parent does not exist.
+  void ReportMissingParent(const Level &level) const;
+
+  void FlushStates();
+
+  StreamingConstArpaLmOptions config_;
+
+  // Maximum relative address for the child; as in ConstArpaLmBuilder.
+  int32 max_address_offset_;
+
+  int32 ngram_order_;
+
+  // The number of int32s in a record: ngram_order_ words, the logprob and the
+  // backoff (the floats are stored as their bit patterns).
+  int32 record_size_;
+
+  // The number of records in a chunk.
+  int64 chunk_records_;
+
+  // The records not yet sorted.
+  std::vector<int32> chunk_;
+
+  TaskSequencer<SortTask> *sequencer_;
+
+  std::vector<Run> runs_;
+
+  // Everything below is for the second phase.
+
+  // The LmStates, in reverse order (i.e. the LmStates array reversed
+  // element by element), and a buffer for writing them.
+  TempFile *states_;
+  std::vector<int32> states_buffer_;
+
+  // The total size of the LmStates written so far.
+  int64 lm_states_size_;
+
+  // Indexed by order; see struct Level.  levels_[0] is unused, because the
+  // unigrams go in unigram_end_offsets_ instead.
+  std::vector<Level> levels_;
+
+  // The previous record, to detect duplicates.
+  std::vector<int32> prev_words_;
+
+  // Indexed by word, the end offset (see struct Child) of each unigram's
+  // LmState, or zero if there is no such unigram.
+  std::vector<int64> unigram_end_offsets_;
+
+  // For each entry of the overflow buffer, in reverse order, the end offset
+  // of the LmState it points to and the position in states_ of the child
+  // info that refers to it (which has to be corrected when we know the number
+  // of entries).
+  std::vector<int64> overflow_end_offsets_;
+  std::vector<int64> overflow_positions_;
+
+  // Index of largest word-id plus one.
+  int32 num_words_;
+
+  bool is_built_;
+};
+
+
+/// Reads in an ARPA format language model and converts it into ConstArpaLm
+/// format, as BuildConstArpaLm() does, but using StreamingConstArpaLmBuilder.
+bool BuildConstArpaLmStreaming(const ArpaParseOptions &options,
+                               const StreamingConstArpaLmOptions &config,
+                               const std::string &arpa_rxfilename,
+                               const std::string &const_arpa_wxfilename);
+
+}  // namespace kaldi
+
+#endif  // KALDI_LM_CONST_ARPA_LM_STREAMING_H_
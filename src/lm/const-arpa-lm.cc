@@ -18,6 +18,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -511,7 +512,7 @@ void ConstArpaLm::Write(std::ostream &os, bool binary) const {
   WriteToken(os, binary, "</LmInfo>");
 
   // LmStates section.
-  WriteToken(os, binary, "<LmStates>");
+  WriteConstArpaLmStatesToken(os, binary);
   WriteBasicType(os, binary, lm_states_size_);
   os.write(reinterpret_cast<char *>(lm_states_),
            sizeof(int32) * lm_states_size_);
@@ -603,11 +604,24 @@ void ConstArpaLm::ReadInternal(std::istream &is, bool binary) {
   // LmStates section.
   ExpectToken(is, binary, "<LmStates>");
   ReadBasicType(is, binary, &lm_states_size_);
-  lm_states_ = new int32[lm_states_size_];
-  is.read(reinterpret_cast<char *>(lm_states_),
-          sizeof(int32) * lm_states_size_);
-  if (!is.good()) {
+  MappedStreambuf *mapped = dynamic_cast<MappedStreambuf*>(is.rdbuf());
+  if (mapped != NULL && mapped->Remaining() < sizeof(int32) * lm_states_size_)
     KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
+  if (mapped != NULL &&
+      reinterpret_cast<size_t>(mapped->Current()) % sizeof(int32) == 0) {
+    // The LmStates are never modified, so we can use them from the read-only
+    // mapping.
+    mapped_file_ = mapped->File();
+    lm_states_ = reinterpret_cast<int32*>(
+        const_cast<char*>(mapped->Current()));
+    mapped->Advance(sizeof(int32) * lm_states_size_);
+  } else {
+    lm_states_ = new int32[lm_states_size_];
+    is.read(reinterpret_cast<char *>(lm_states_),
+            sizeof(int32) * lm_states_size_);
+    if (!is.good()) {
+      KALDI_ERR << "ConstArpaLm <LmStates> section reading failed.";
+    }
   }
   ExpectToken(is, binary, "</LmStates>");
 
@@ -1011,18 +1025,40 @@ void ConstArpaLm::WriteArpa(std::ostream &os) const {
 }
 
 ConstArpaLmDeterministicFst::ConstArpaLmDeterministicFst(
-    const ConstArpaLm& lm) : lm_(lm) {
+    const ConstArpaLm& lm, int32 max_cached_histories):
+    wseq_to_state_(max_cached_histories), max_num_states_(0), num_arcs_(0),
+    num_arcs_to_existing_states_(0), lm_(lm) {
+  KALDI_ASSERT(max_cached_histories >= 0);
+  start_state_ = 0;
+  Clear();
+}
+
+void ConstArpaLmDeterministicFst::Clear() {
+  max_num_states_ = std::max(max_num_states_, states_.size());
+  states_.clear();
+  wseq_to_state_.Clear();
   // Creates a history state for <s>.
   std::vector<Label> bos_state(1, lm_.BosSymbol());
-  state_to_wseq_.push_back(bos_state);
-  wseq_to_state_[bos_state] = 0;
-  start_state_ = 0;
+  states_.push_back(StateInfo(fst::kNoStateId, lm_.BosSymbol(), 1));
+  wseq_to_state_.Insert(bos_state, start_state_);
+}
+
+void ConstArpaLmDeterministicFst::GetWordSequence(
+    StateId s, std::vector<Label> *wseq) const {
+  int32 length = states_[s].length;
+  wseq->resize(length);
+  for (int32 i = length - 1; i >= 0; i--) {
+    KALDI_ASSERT(s != fst::kNoStateId);
+    (*wseq)[i] = states_[s].word;
+    s = states_[s].parent;
+  }
 }
 
 fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
   // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  const std::vector<Label>& wseq = state_to_wseq_[s];
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
+  std::vector<Label> wseq;
+  GetWordSequence(s, &wseq);
   float logprob = lm_.GetNgramLogprob(lm_.EosSymbol(), wseq);
   return Weight(-logprob);
 }
@@ -1030,8 +1066,9 @@ fst::StdArc::Weight ConstArpaLmDeterministicFst::Final(StateId s) {
 bool ConstArpaLmDeterministicFst::GetArc(StateId s,
                                          Label ilabel, fst::StdArc *oarc) {
   // At this point, we should have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-  std::vector<Label> wseq = state_to_wseq_[s];
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
+  std::vector<Label> wseq;
+  GetWordSequence(s, &wseq);
 
   float logprob = lm_.GetNgramLogprob(ilabel, wseq);
   if (logprob == std::numeric_limits<float>::min()) {
@@ -1050,27 +1087,80 @@ bool ConstArpaLmDeterministicFst::GetArc(StateId s,
     wseq.erase(wseq.begin(), wseq.begin() + 1);
   }
 
-  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
-      wseq, static_cast<Label>(state_to_wseq_.size()));
-
-  // Attemps to insert the current <wseq_state_pair>. If the pair already exists
-  // then it returns false.
-  typedef MapType::iterator IterType;
-  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
-
-  // If the pair was just inserted, then also add it to <state_to_wseq_>.
-  if (result.second == true)
-    state_to_wseq_.push_back(wseq);
+  num_arcs_++;
+  StateId nextstate;
+  const StateId *existing_state = wseq_to_state_.Find(wseq);
+  if (existing_state != NULL) {
+    nextstate = *existing_state;
+    num_arcs_to_existing_states_++;
+  } else {
+    nextstate = states_.size();
+    states_.push_back(StateInfo(s, ilabel, wseq.size()));
+    wseq_to_state_.Insert(wseq, nextstate);
+  }
 
   // Creates the arc.
   oarc->ilabel = ilabel;
   oarc->olabel = ilabel;
-  oarc->nextstate = result.first->second;
+  oarc->nextstate = nextstate;
   oarc->weight = Weight(-logprob);
 
   return true;
 }
 
+void ConstArpaLmDeterministicFst::PrintStats() const {
+  // The histories are stored in the cache's hash map (key, value, iterator
+  // and pointer to the next element) and its list (two pointers and the key
+  // pointer), with heap storage for the words.
+  size_t cache_bytes = wseq_to_state_.Size() *
+      (sizeof(std::vector<Label>) + sizeof(StateId) + 6 * sizeof(void*) +
+       (lm_.NgramOrder() - 1) * sizeof(Label));
+  KALDI_LOG << "ConstArpaLmDeterministicFst has " << states_.size()
+            << " states (" << (states_.size() * sizeof(StateInfo))
+            << " bytes; at most " << std::max(max_num_states_, states_.size())
+            << " states between calls to Clear()) and caches "
+            << wseq_to_state_.Size()
+            << " histories (about " << cache_bytes << " bytes, limit is "
+            << wseq_to_state_.Capacity() << ", 0 for none); "
+            << num_arcs_to_existing_states_ << " of " << num_arcs_
+            << " arcs led to existing states.";
+}
+
+void WriteConstArpaLmStatesToken(std::ostream &os, bool binary) {
+  // The LmStates start after the token, its terminating space, and the int64
+  // size, which WriteBasicType() writes as a size byte then 8 bytes.
+  const int64 kAlignment = 64,
+      kOffset = strlen("<LmStates>") + 1 + 1 + sizeof(int64);
+  int64 pos = os.tellp();
+  if (pos >= 0) {
+    int64 padding = (kAlignment - (pos + kOffset) % kAlignment) % kAlignment;
+    for (int64 i = 0; i < padding; i++)
+      os.put(' ');
+  }
+  WriteToken(os, binary, "<LmStates>");
+}
+
+void ReadConstArpaLm(const std::string &rxfilename, bool mmap,
+                     ConstArpaLm *lm) {
+  if (!mmap) {
+    ReadKaldiObject(rxfilename, lm);
+    return;
+  }
+  bool binary_in;
+  Input ki;
+  if (!ki.OpenMapped(rxfilename, &binary_in))
+    KALDI_ERR << "Failed to read ConstArpaLm from " << rxfilename;
+  // The ConstArpaLm keeps the mapping alive after <ki> is closed.
+  lm->Read(ki.Stream(), binary_in);
+  if (!lm->IsMapped()) {
+    KALDI_WARN << "Could not use the LmStates in " << rxfilename
+               << " from a memory mapping, so they were copied; this happens "
+               << "if it is not a regular file, or if it was written in an "
+               << "old format or to a pipe. Re-create it with "
+               << "arpa-to-const-arpa to avoid this.";
+  }
+}
+
 bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename) {
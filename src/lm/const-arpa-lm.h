@@ -20,6 +20,7 @@
 #ifndef KALDI_LM_CONST_ARPA_LM_H_
 #define KALDI_LM_CONST_ARPA_LM_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,6 +28,8 @@
 #include "fstext/deterministic-fst.h"
 #include "lm/arpa-file-parser.h"
 #include "util/common-utils.h"
+#include "util/kaldi-mapped-file.h"
+#include "util/lru-cache.h"
 
 namespace kaldi {
 
@@ -248,16 +251,23 @@ class ConstArpaLm {
 
   ~ConstArpaLm() {
     if (memory_assigned_) {
-      delete[] lm_states_;
+      if (mapped_file_ == NULL)
+        delete[] lm_states_;
       delete[] unigram_states_;
       delete[] overflow_buffer_;
     }
   }
 
   // Reads the ConstArpaLm format language model. It calls ReadInternal() or
-  // ReadInternalOldFormat() to do the actual reading.
+  // ReadInternalOldFormat() to do the actual reading. If <is> reads from a
+  // memory-mapped file (see Input::OpenMapped()), and the LmStates are
+  // suitably aligned in the file, we use the LmStates directly from the
+  // mapping rather than copying them; see ReadConstArpaLm().
   void Read(std::istream &is, bool binary);
 
+  // Returns true if the LmStates are in a memory-mapped file.
+  bool IsMapped() const { return mapped_file_ != NULL; }
+
   // Writes the language model in ConstArpaLm format.
   void Write(std::ostream &os, bool binary) const;
 
@@ -328,6 +338,11 @@ class ConstArpaLm {
   // Makes sure that the language model has been loaded before using it.
   bool initialized_;
 
+  // If the LmStates were read from a memory-mapped file, this keeps the
+  // mapping alive; <lm_states_> then points into it and is not ours to
+  // delete.
+  std::shared_ptr<const MappedFile> mapped_file_;
+
   // Integer corresponds to <s>.
   int32 bos_symbol_;
 
@@ -387,6 +402,16 @@ class ConstArpaLm {
 /**
  This class wraps a ConstArpaLm format language model with the interface defined
  in DeterministicOnDemandFst.
+
+ Each state is a history state of the LM, i.e. a word sequence of at most
+ NgramOrder() - 1 words.  To bound the memory used on long lattices, the word
+ sequences are not stored per state: state s was created by GetArc() from state
+ "parent" with label "word", and its word sequence is the last "length" words of
+ that of the parent followed by "word", so we store just those three numbers.
+ The map from word sequences to states, which we use to give the same state to
+ the same history, is an LRU cache of at most "max_cached_histories" histories;
+ when a history that was evicted is seen again it gets a new state, which is
+ correct but makes the composed lattice less compact.
  */
 class ConstArpaLmDeterministicFst
   : public fst::DeterministicOnDemandFst<fst::StdArc> {
@@ -395,7 +420,10 @@ class ConstArpaLmDeterministicFst
   typedef fst::StdArc::StateId StateId;
   typedef fst::StdArc::Label Label;
 
-  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm);
+  /// "max_cached_histories" is the size of the cache described above; 0 means
+  /// no limit.
+  explicit ConstArpaLmDeterministicFst(const ConstArpaLm& lm,
+                                       int32 max_cached_histories = 0);
 
   // We cannot use "const" because the pure virtual function in the interface is
   // not const.
@@ -407,12 +435,39 @@ class ConstArpaLmDeterministicFst
 
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
+  /// Forgets all the states except the start state, so the memory used does
+  /// not grow when the same object is used for many lattices.  The state-ids
+  /// returned before must not be used afterwards (so any FST composed with
+  /// this one must be reconstructed, too).
+  void Clear();
+
+  /// Prints the number of states and cached histories and the approximate
+  /// memory they use, and how many arcs led to existing states since the
+  /// object was created.
+  void PrintStats() const;
+
  private:
-  typedef unordered_map<std::vector<Label>,
-                        StateId, VectorHasher<Label> > MapType;
+  struct StateInfo {
+    StateId parent;
+    Label word;
+    int32 length;
+    StateInfo(StateId parent, Label word, int32 length):
+        parent(parent), word(word), length(length) { }
+  };
+
+  // Outputs the word sequence of state s.
+  void GetWordSequence(StateId s, std::vector<Label> *wseq) const;
+
+  typedef LruCache<std::vector<Label>, StateId, VectorHasher<Label> > MapType;
   StateId start_state_;
   MapType wseq_to_state_;
-  std::vector<std::vector<Label> > state_to_wseq_;
+  std::vector<StateInfo> states_;
+  // The largest size states_ had before a call to Clear().
+  size_t max_num_states_;
+  // The number of calls to GetArc() that succeeded, and how many of them led
+  // to an existing state.
+  int64 num_arcs_;
+  int64 num_arcs_to_existing_states_;
   const ConstArpaLm& lm_;
 };
 
@@ -423,6 +478,26 @@ bool BuildConstArpaLm(const ArpaParseOptions& options,
                       const std::string& arpa_rxfilename,
                       const std::string& const_arpa_wxfilename);
 
+// Reads a ConstArpaLm format language model from <rxfilename>. If <mmap> is
+// true and <rxfilename> is a regular file, the file is memory-mapped read-only
+// and the LmStates, which are nearly all of the model, are not copied: loading
+// is then almost instant and all processes that read the same file share the
+// same physical memory. This requires the LmStates to be aligned in the file,
+// which is the case for files written by ConstArpaLm::Write() to a regular
+// file (see WriteConstArpaLmStatesToken()); otherwise we copy them, with a
+// warning.
+void ReadConstArpaLm(const std::string &rxfilename, bool mmap,
+                     ConstArpaLm *lm);
+
+// Writes the <LmStates> token that starts the LmStates section of the
+// ConstArpaLm format. It is preceded by as many spaces as are needed for the
+// LmStates array (which comes after the int64 size) to start at a multiple of
+// 64 bytes from the start of the output, so that it can be used directly from
+// a memory-mapped file; token-reading skips the spaces, so this does not
+// change the format. If the position in <os> is not known (e.g. for a pipe),
+// there is no padding.
+void WriteConstArpaLmStatesToken(std::ostream &os, bool binary);
+
 }  // namespace kaldi
 
 #endif  // KALDI_LM_CONST_ARPA_LM_H_
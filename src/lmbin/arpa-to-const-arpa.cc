@@ -20,6 +20,7 @@
 #include <string>
 
 #include "lm/const-arpa-lm.h"
+#include "lm/const-arpa-lm-streaming.h"
 #include "util/parse-options.h"
 
 int main(int argc, char *argv[]) {
@@ -38,6 +39,10 @@ int main(int argc, char *argv[]) {
         "format language model to integers using utils/map_arpa_m.pl, and\n"
         "then use this program to build a ConstArpaLm format language model.\n"
         "\n"
+        "For very large language models, use --streaming=true, which sorts the\n"
+        "n-grams on disk (see --max-memory, --num-threads and --temp-dir) and\n"
+        "writes the same output using much less memory.\n"
+        "\n"
         "Usage: arpa-to-const-arpa [opts] <input-arpa> <const-arpa>\n"
         " e.g.: arpa-to-const-arpa --bos-symbol=1 --eos-symbol=2 \\\n"
         "                          arpa.txt const_arpa";
@@ -46,6 +51,11 @@ int main(int argc, char *argv[]) {
 
     ArpaParseOptions options;
     options.Register(&po);
+    bool streaming = false;
+    StreamingConstArpaLmOptions streaming_opts;
+    streaming_opts.Register(&po);
+    po.Register("streaming", &streaming, "If true, build the ConstArpaLm "
+                "using bounded memory, with temporary files.");
 
     // Ideally, these registrations would be in ArpaParseOptions, but some
     // programs want integers and other want symbols, so we register them
@@ -75,8 +85,12 @@ int main(int argc, char *argv[]) {
     std::string arpa_rxfilename = po.GetArg(1),
         const_arpa_wxfilename = po.GetOptArg(2);
 
-    bool ans = BuildConstArpaLm(options, arpa_rxfilename,
-                                const_arpa_wxfilename);
+    bool ans;
+    if (streaming)
+      ans = BuildConstArpaLmStreaming(options, streaming_opts,
+                                      arpa_rxfilename, const_arpa_wxfilename);
+    else
+      ans = BuildConstArpaLm(options, arpa_rxfilename, const_arpa_wxfilename);
     if (ans)
       return 0;
     else
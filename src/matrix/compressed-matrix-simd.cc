@@ -0,0 +1,708 @@
+// matrix/compressed-matrix-simd.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "matrix/compressed-matrix-simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+// We need function-level target attributes and __builtin_cpu_supports(), so
+// the kernels are only compiled with GCC >= 5 and clang, on x86.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define KALDI_COMPRESSED_MATRIX_SIMD 1
+#include <immintrin.h>
+// Note: we deliberately don't enable FMA, so that the compiler can't fuse
+// multiplications and additions; this keeps the results identical to those of
+// the scalar code.
+#define KALDI_TARGET_AVX2 __attribute__((target("avx2")))
+#define KALDI_TARGET_AVX512 __attribute__((target("avx512f")))
+#if defined(__GNUC__) && !defined(__clang__)
+// Some versions of GCC's AVX-512 headers give spurious warnings about the
+// "undefined" vectors that they use internally.
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#endif
+
+namespace kaldi {
+
+namespace {
+
+// The scalar code below is used for the parts of the matrix that do not fill
+// a whole vector.  These functions, and the vector code, follow the ones in
+// CompressedMatrix exactly, including the precision of each operation, so that
+// the results are the same whichever code is used.
+
+inline int32 FloatToCode(float min_value, float range, int32 max_code,
+                         float value) {
+  float f = (value - min_value) / range;
+  if (f > 1.0) f = 1.0;
+  if (f < 0.0) f = 0.0;
+  return static_cast<int>(f * max_code + 0.499);
+}
+
+inline uint8 FloatToCharScalar(const float *p, float value) {
+  float p0 = p[0], p25 = p[1], p75 = p[2], p100 = p[3];
+  int ans;
+  if (value < p25) {
+    float f = (value - p0) / (p25 - p0);
+    ans = static_cast<int>(f * 64 + 0.5);
+    if (ans < 0) ans = 0;
+    if (ans > 64) ans = 64;
+  } else if (value < p75) {
+    float f = (value - p25) / (p75 - p25);
+    ans = 64 + static_cast<int>(f * 128 + 0.5);
+    if (ans < 64) ans = 64;
+    if (ans > 192) ans = 192;
+  } else {
+    float f = (value - p75) / (p100 - p75);
+    ans = 192 + static_cast<int>(f * 63 + 0.5);
+    if (ans < 192) ans = 192;
+    if (ans > 255) ans = 255;
+  }
+  return static_cast<uint8>(ans);
+}
+
+inline float CharToFloatScalar(const float *p, uint8 value) {
+  float p0 = p[0], p25 = p[1], p75 = p[2], p100 = p[3];
+  if (value <= 64) {
+    return p0 + (p25 - p0) * value * (1/64.0);
+  } else if (value <= 192) {
+    return p25 + (p75 - p25) * (value - 64) * (1/128.0);
+  } else {
+    return p75 + (p100 - p75) * (value - 192) * (1/63.0);
+  }
+}
+
+template<typename Real>
+void CharToFloatScalar(const uint8 *in, int32 in_col_stride,
+                       int32 row_begin, int32 row_end,
+                       int32 col_begin, int32 col_end,
+                       const float *percentiles,
+                       Real *out, int32 out_stride) {
+  for (int32 c = col_begin; c < col_end; c++) {
+    const uint8 *col_in = in + c * in_col_stride;
+    for (int32 r = row_begin; r < row_end; r++)
+      out[r * out_stride + c] = CharToFloatScalar(percentiles + 4 * c,
+                                                  col_in[r]);
+  }
+}
+
+template<typename Real>
+void FloatToCharScalar(const Real *in, int32 in_stride,
+                       int32 num_rows, int32 row_begin, int32 row_end,
+                       int32 col_begin, int32 col_end,
+                       const float *percentiles, uint8 *out) {
+  for (int32 c = col_begin; c < col_end; c++)
+    for (int32 r = row_begin; r < row_end; r++)
+      out[c * num_rows + r] = FloatToCharScalar(percentiles + 4 * c,
+                                                in[r * in_stride + c]);
+}
+
+
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+
+CompressedMatrixSimdType DetectSimd() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return kCompressedMatrixAvx512;
+  if (__builtin_cpu_supports("avx2"))
+    return kCompressedMatrixAvx2;
+  return kCompressedMatrixNoSimd;
+}
+
+/////////////////////////// AVX2 ///////////////////////////
+
+KALDI_TARGET_AVX2 inline __m256 Load8(const float *in) {
+  return _mm256_loadu_ps(in);
+}
+KALDI_TARGET_AVX2 inline __m256 Load8(const double *in) {
+  __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(in)),
+      hi = _mm256_cvtpd_ps(_mm256_loadu_pd(in + 4));
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+KALDI_TARGET_AVX2 inline void Store8(__m256 v, float *out) {
+  _mm256_storeu_ps(out, v);
+}
+KALDI_TARGET_AVX2 inline void Store8(__m256 v, double *out) {
+  _mm256_storeu_pd(out, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+  _mm256_storeu_pd(out + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+// Returns static_cast<int>(t[i] + 0.5) (or 0.499), with the addition done in
+// double precision as in the scalar code.
+KALDI_TARGET_AVX2 inline __m256i RoundCodes8(__m256 t, __m256d half) {
+  __m128i lo = _mm256_cvttpd_epi32(
+      _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(t)), half)),
+      hi = _mm256_cvttpd_epi32(
+      _mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(t, 1)), half));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+template<typename Real> KALDI_TARGET_AVX2
+void Uint8ToFloatAvx2(const uint8 *in, int32 in_stride,
+                      int32 num_rows, int32 num_cols,
+                      float min_value, float increment,
+                      Real *out, int32 out_stride) {
+  __m256 min_v = _mm256_set1_ps(min_value), inc_v = _mm256_set1_ps(increment);
+  for (int32 r = 0; r < num_rows; r++, in += in_stride, out += out_stride) {
+    int32 c = 0;
+    for (; c + 8 <= num_cols; c += 8) {
+      __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + c));
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b));
+      Store8(_mm256_add_ps(min_v, _mm256_mul_ps(f, inc_v)), out + c);
+    }
+    for (; c < num_cols; c++)
+      out[c] = min_value + in[c] * increment;
+  }
+}
+
+template<typename Real> KALDI_TARGET_AVX2
+void Uint16ToFloatAvx2(const uint16 *in, int32 in_stride,
+                       int32 num_rows, int32 num_cols,
+                       float min_value, float increment,
+                       Real *out, int32 out_stride) {
+  __m256 min_v = _mm256_set1_ps(min_value), inc_v = _mm256_set1_ps(increment);
+  for (int32 r = 0; r < num_rows; r++, in += in_stride, out += out_stride) {
+    int32 c = 0;
+    for (; c + 8 <= num_cols; c += 8) {
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + c));
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(b));
+      Store8(_mm256_add_ps(min_v, _mm256_mul_ps(f, inc_v)), out + c);
+    }
+    for (; c < num_cols; c++)
+      out[c] = min_value + in[c] * increment;
+  }
+}
+
+// Uncompresses the codes in 'v' (one column per element) given the percentiles
+// of the columns and their differences d0 = p25 - p0 etc.  As in the scalar
+// code, the product (d * code) is computed in float and the rest in double.
+KALDI_TARGET_AVX2 inline __m256 CharToFloat8(
+    __m256i v, __m256 p0, __m256 d0, __m256 p25, __m256 d1,
+    __m256 p75, __m256 d2) {
+  const __m256i c64 = _mm256_set1_epi32(64), c192 = _mm256_set1_epi32(192);
+  const __m256d scale0 = _mm256_set1_pd(1/64.0),
+      scale1 = _mm256_set1_pd(1/128.0), scale2 = _mm256_set1_pd(1/63.0);
+  __m256i gt64 = _mm256_cmpgt_epi32(v, c64), gt192 = _mm256_cmpgt_epi32(v, c192);
+  __m256 m1 = _mm256_castsi256_ps(gt64), m2 = _mm256_castsi256_ps(gt192);
+  __m256 base = _mm256_blendv_ps(_mm256_blendv_ps(p0, p25, m1), p75, m2),
+      d = _mm256_blendv_ps(_mm256_blendv_ps(d0, d1, m1), d2, m2);
+  __m256i offset = _mm256_blendv_epi8(
+      _mm256_and_si256(gt64, c64), c192, gt192);
+  __m256 t = _mm256_mul_ps(d, _mm256_cvtepi32_ps(_mm256_sub_epi32(v, offset)));
+  __m128 ans[2];
+  for (int32 h = 0; h < 2; h++) {
+    __m128i m1h = h == 0 ? _mm256_castsi256_si128(gt64) :
+        _mm256_extracti128_si256(gt64, 1),
+        m2h = h == 0 ? _mm256_castsi256_si128(gt192) :
+        _mm256_extracti128_si256(gt192, 1);
+    __m256d m1d = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(m1h)),
+        m2d = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(m2h));
+    __m256d scale = _mm256_blendv_pd(_mm256_blendv_pd(scale0, scale1, m1d),
+                                     scale2, m2d);
+    __m128 th = h == 0 ? _mm256_castps256_ps128(t) : _mm256_extractf128_ps(t, 1),
+        bh = h == 0 ? _mm256_castps256_ps128(base) :
+        _mm256_extractf128_ps(base, 1);
+    ans[h] = _mm256_cvtpd_ps(_mm256_add_pd(
+        _mm256_cvtps_pd(bh), _mm256_mul_pd(_mm256_cvtps_pd(th), scale)));
+  }
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(ans[0]), ans[1], 1);
+}
+
+template<typename Real> KALDI_TARGET_AVX2
+void CharToFloatAvx2(const uint8 *in, int32 in_col_stride,
+                     int32 num_rows, int32 num_cols,
+                     const float *percentiles,
+                     Real *out, int32 out_stride) {
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+  int32 num_rows4 = num_rows - num_rows % 4, c = 0;
+  for (; c + 8 <= num_cols; c += 8) {
+    float p[4][8];
+    for (int32 i = 0; i < 8; i++)
+      for (int32 j = 0; j < 4; j++)
+        p[j][i] = percentiles[4 * (c + i) + j];
+    __m256 p0 = _mm256_loadu_ps(p[0]), p25 = _mm256_loadu_ps(p[1]),
+        p75 = _mm256_loadu_ps(p[2]), p100 = _mm256_loadu_ps(p[3]),
+        d0 = _mm256_sub_ps(p25, p0), d1 = _mm256_sub_ps(p75, p25),
+        d2 = _mm256_sub_ps(p100, p75);
+    // Element i of 'index' is the offset of column c + i.
+    __m256i index = _mm256_mullo_epi32(
+        _mm256_setr_epi32(c, c + 1, c + 2, c + 3, c + 4, c + 5, c + 6, c + 7),
+        _mm256_set1_epi32(in_col_stride));
+    for (int32 r = 0; r < num_rows4; r += 4) {
+      // Each 32-bit element of 'bytes' contains the codes for rows r to r + 3
+      // of one column.
+      __m256i bytes = _mm256_i32gather_epi32(
+          reinterpret_cast<const int*>(in + r), index, 1);
+      Real *o = out + r * out_stride + c;
+      Store8(CharToFloat8(_mm256_and_si256(bytes, byte_mask),
+                          p0, d0, p25, d1, p75, d2), o);
+      Store8(CharToFloat8(_mm256_and_si256(_mm256_srli_epi32(bytes, 8),
+                                           byte_mask),
+                          p0, d0, p25, d1, p75, d2),
+             o + out_stride);
+      Store8(CharToFloat8(_mm256_and_si256(_mm256_srli_epi32(bytes, 16),
+                                           byte_mask),
+                          p0, d0, p25, d1, p75, d2),
+             o + 2 * out_stride);
+      Store8(CharToFloat8(_mm256_srli_epi32(bytes, 24),
+                          p0, d0, p25, d1, p75, d2),
+             o + 3 * out_stride);
+    }
+    CharToFloatScalar(in, in_col_stride, num_rows4, num_rows, c, c + 8,
+                      percentiles, out, out_stride);
+  }
+  CharToFloatScalar(in, in_col_stride, 0, num_rows, c, num_cols,
+                    percentiles, out, out_stride);
+}
+
+template<typename Real, typename Int> KALDI_TARGET_AVX2
+void FloatToIntAvx2(const Real *in, int32 in_stride,
+                    int32 num_rows, int32 num_cols,
+                    float min_value, float range, Int *out) {
+  const int32 max_code = (sizeof(Int) == 1 ? 255 : 65535);
+  const __m256 min_v = _mm256_set1_ps(min_value),
+      range_v = _mm256_set1_ps(range), zero = _mm256_setzero_ps(),
+      one = _mm256_set1_ps(1.0f), max_code_v = _mm256_set1_ps(max_code);
+  const __m256d half = _mm256_set1_pd(0.499);
+  for (int32 r = 0; r < num_rows; r++, in += in_stride, out += num_cols) {
+    int32 c = 0;
+    for (; c + 8 <= num_cols; c += 8) {
+      __m256 f = _mm256_div_ps(_mm256_sub_ps(Load8(in + c), min_v), range_v);
+      // The order of the arguments of max and min makes NaNs become 0, as in
+      // the scalar code.
+      f = _mm256_min_ps(_mm256_max_ps(f, zero), one);
+      __m256i codes = RoundCodes8(_mm256_mul_ps(f, max_code_v), half);
+      __m128i codes16 = _mm_packus_epi32(_mm256_castsi256_si128(codes),
+                                         _mm256_extracti128_si256(codes, 1));
+      if (sizeof(Int) == 1)
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + c),
+                         _mm_packus_epi16(codes16, codes16));
+      else
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + c), codes16);
+    }
+    for (; c < num_cols; c++)
+      out[c] = FloatToCode(min_value, range, max_code, in[c]);
+  }
+}
+
+template<typename Real> KALDI_TARGET_AVX2
+void FloatToCharAvx2(const Real *in, int32 in_stride,
+                     int32 num_rows, int32 num_cols,
+                     const float *percentiles, uint8 *out) {
+  const __m256d half = _mm256_set1_pd(0.5);
+  int32 num_rows4 = num_rows - num_rows % 4, c = 0;
+  for (; c + 8 <= num_cols; c += 8) {
+    float p[4][8];
+    for (int32 i = 0; i < 8; i++)
+      for (int32 j = 0; j < 4; j++)
+        p[j][i] = percentiles[4 * (c + i) + j];
+    const __m256 p0 = _mm256_loadu_ps(p[0]), p25 = _mm256_loadu_ps(p[1]),
+        p75 = _mm256_loadu_ps(p[2]), p100 = _mm256_loadu_ps(p[3]),
+        d0 = _mm256_sub_ps(p25, p0), d1 = _mm256_sub_ps(p75, p25),
+        d2 = _mm256_sub_ps(p100, p75),
+        mult0 = _mm256_set1_ps(64.0f), mult1 = _mm256_set1_ps(128.0f),
+        mult2 = _mm256_set1_ps(63.0f);
+    const __m256i off0 = _mm256_setzero_si256(),
+        off1 = _mm256_set1_epi32(64), off2 = _mm256_set1_epi32(192),
+        max2 = _mm256_set1_epi32(255);
+    for (int32 r = 0; r < num_rows4; r += 4) {
+      __m256i word = _mm256_setzero_si256();
+      for (int32 k = 0; k < 4; k++) {
+        __m256 x = Load8(in + (r + k) * in_stride + c);
+        __m256 lt25 = _mm256_cmp_ps(x, p25, _CMP_LT_OQ),
+            lt75 = _mm256_cmp_ps(x, p75, _CMP_LT_OQ);
+        __m256i lt25i = _mm256_castps_si256(lt25),
+            lt75i = _mm256_castps_si256(lt75);
+        __m256 base = _mm256_blendv_ps(_mm256_blendv_ps(p75, p25, lt75),
+                                       p0, lt25),
+            den = _mm256_blendv_ps(_mm256_blendv_ps(d2, d1, lt75), d0, lt25),
+            mult = _mm256_blendv_ps(_mm256_blendv_ps(mult2, mult1, lt75),
+                                    mult0, lt25);
+        __m256i lo = _mm256_blendv_epi8(_mm256_blendv_epi8(off2, off1, lt75i),
+                                        off0, lt25i),
+            hi = _mm256_blendv_epi8(_mm256_blendv_epi8(max2, off2, lt75i),
+                                    off1, lt25i);
+        __m256 f = _mm256_div_ps(_mm256_sub_ps(x, base), den);
+        __m256i code = _mm256_add_epi32(
+            lo, RoundCodes8(_mm256_mul_ps(f, mult), half));
+        code = _mm256_min_epi32(_mm256_max_epi32(code, lo), hi);
+        word = _mm256_or_si256(word, _mm256_slli_epi32(code, 8 * k));
+      }
+      // Element i of 'word' contains the codes for rows r to r + 3 of column
+      // c + i, which are consecutive in 'out'.
+      int32 words[8];
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), word);
+      for (int32 i = 0; i < 8; i++)
+        std::memcpy(out + (c + i) * num_rows + r, words + i, 4);
+    }
+    FloatToCharScalar(in, in_stride, num_rows, num_rows4, num_rows, c, c + 8,
+                      percentiles, out);
+  }
+  FloatToCharScalar(in, in_stride, num_rows, 0, num_rows, c, num_cols,
+                    percentiles, out);
+}
+
+/////////////////////////// AVX-512 ///////////////////////////
+
+KALDI_TARGET_AVX512 inline __m512 Load16(const float *in) {
+  return _mm512_loadu_ps(in);
+}
+KALDI_TARGET_AVX512 inline __m512 Load16(const double *in) {
+  __m256 lo = _mm512_cvtpd_ps(_mm512_loadu_pd(in)),
+      hi = _mm512_cvtpd_ps(_mm512_loadu_pd(in + 8));
+  return _mm512_castpd_ps(_mm512_insertf64x4(
+      _mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+}
+KALDI_TARGET_AVX512 inline void Store16(__m512 v, float *out) {
+  _mm512_storeu_ps(out, v);
+}
+KALDI_TARGET_AVX512 inline void Store16(__m512 v, double *out) {
+  __m256 lo = _mm512_castps512_ps256(v),
+      hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+  _mm512_storeu_pd(out, _mm512_cvtps_pd(lo));
+  _mm512_storeu_pd(out + 8, _mm512_cvtps_pd(hi));
+}
+
+KALDI_TARGET_AVX512 inline __m512i RoundCodes16(__m512 t, __m512d half) {
+  __m256 t_lo = _mm512_castps512_ps256(t),
+      t_hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(t), 1));
+  __m256i lo = _mm512_cvttpd_epi32(_mm512_add_pd(_mm512_cvtps_pd(t_lo), half)),
+      hi = _mm512_cvttpd_epi32(_mm512_add_pd(_mm512_cvtps_pd(t_hi), half));
+  return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+}
+
+template<typename Real> KALDI_TARGET_AVX512
+void Uint8ToFloatAvx512(const uint8 *in, int32 in_stride,
+                        int32 num_rows, int32 num_cols,
+                        float min_value, float increment,
+                        Real *out, int32 out_stride) {
+  __m512 min_v = _mm512_set1_ps(min_value), inc_v = _mm512_set1_ps(increment);
+  for (int32 r = 0; r < num_rows; r++, in += in_stride, out += out_stride) {
+    int32 c = 0;
+    for (; c + 16 <= num_cols; c += 16) {
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + c));
+      __m512 f = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(b));
+      Store16(_mm512_add_ps(min_v, _mm512_mul_ps(f, inc_v)), out + c);
+    }
+    for (; c < num_cols; c++)
+      out[c] = min_value + in[c] * increment;
+  }
+}
+
+template<typename Real> KALDI_TARGET_AVX512
+void Uint16ToFloatAvx512(const uint16 *in, int32 in_stride,
+                         int32 num_rows, int32 num_cols,
+                         float min_value, float increment,
+                         Real *out, int32 out_stride) {
+  __m512 min_v = _mm512_set1_ps(min_value), inc_v = _mm512_set1_ps(increment);
+  for (int32 r = 0; r < num_rows; r++, in += in_stride, out += out_stride) {
+    int32 c = 0;
+    for (; c + 16 <= num_cols; c += 16) {
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + c));
+      __m512 f = _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(b));
+      Store16(_mm512_add_ps(min_v, _mm512_mul_ps(f, inc_v)), out + c);
+    }
+    for (; c < num_cols; c++)
+      out[c] = min_value + in[c] * increment;
+  }
+}
+
+KALDI_TARGET_AVX512 inline __m512 CharToFloat16(
+    __m512i v, __m512 p0, __m512 d0, __m512 p25, __m512 d1,
+    __m512 p75, __m512 d2) {
+  const __m512i c64 = _mm512_set1_epi32(64), c192 = _mm512_set1_epi32(192);
+  const __m512d scale0 = _mm512_set1_pd(1/64.0),
+      scale1 = _mm512_set1_pd(1/128.0), scale2 = _mm512_set1_pd(1/63.0);
+  __mmask16 gt64 = _mm512_cmpgt_epi32_mask(v, c64),
+      gt192 = _mm512_cmpgt_epi32_mask(v, c192);
+  __m512 base = _mm512_mask_blend_ps(gt192, _mm512_mask_blend_ps(gt64, p0, p25),
+                                     p75),
+      d = _mm512_mask_blend_ps(gt192, _mm512_mask_blend_ps(gt64, d0, d1), d2);
+  __m512i offset = _mm512_mask_blend_epi32(
+      gt192, _mm512_maskz_mov_epi32(gt64, c64), c192);
+  __m512 t = _mm512_mul_ps(d, _mm512_cvtepi32_ps(_mm512_sub_epi32(v, offset)));
+  __m256 ans[2];
+  for (int32 h = 0; h < 2; h++) {
+    __mmask8 m1 = static_cast<__mmask8>(gt64 >> (8 * h)),
+        m2 = static_cast<__mmask8>(gt192 >> (8 * h));
+    __m512d scale = _mm512_mask_blend_pd(
+        m2, _mm512_mask_blend_pd(m1, scale0, scale1), scale2);
+    __m256 th = h == 0 ? _mm512_castps512_ps256(t) : _mm256_castpd_ps(
+        _mm512_extractf64x4_pd(_mm512_castps_pd(t), 1)),
+        bh = h == 0 ? _mm512_castps512_ps256(base) : _mm256_castpd_ps(
+            _mm512_extractf64x4_pd(_mm512_castps_pd(base), 1));
+    ans[h] = _mm512_cvtpd_ps(_mm512_add_pd(
+        _mm512_cvtps_pd(bh), _mm512_mul_pd(_mm512_cvtps_pd(th), scale)));
+  }
+  return _mm512_castpd_ps(_mm512_insertf64x4(
+      _mm512_castps_pd(_mm512_castps256_ps512(ans[0])),
+      _mm256_castps_pd(ans[1]), 1));
+}
+
+template<typename Real> KALDI_TARGET_AVX512
+void CharToFloatAvx512(const uint8 *in, int32 in_col_stride,
+                       int32 num_rows, int32 num_cols,
+                       const float *percentiles,
+                       Real *out, int32 out_stride) {
+  const __m512i byte_mask = _mm512_set1_epi32(0xff);
+  int32 num_rows4 = num_rows - num_rows % 4, c = 0;
+  for (; c + 16 <= num_cols; c += 16) {
+    float p[4][16];
+    for (int32 i = 0; i < 16; i++)
+      for (int32 j = 0; j < 4; j++)
+        p[j][i] = percentiles[4 * (c + i) + j];
+    __m512 p0 = _mm512_loadu_ps(p[0]), p25 = _mm512_loadu_ps(p[1]),
+        p75 = _mm512_loadu_ps(p[2]), p100 = _mm512_loadu_ps(p[3]),
+        d0 = _mm512_sub_ps(p25, p0), d1 = _mm512_sub_ps(p75, p25),
+        d2 = _mm512_sub_ps(p100, p75);
+    __m512i index = _mm512_mullo_epi32(
+        _mm512_add_epi32(_mm512_set1_epi32(c),
+                         _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                           11, 12, 13, 14, 15)),
+        _mm512_set1_epi32(in_col_stride));
+    for (int32 r = 0; r < num_rows4; r += 4) {
+      __m512i bytes = _mm512_i32gather_epi32(index, in + r, 1);
+      Real *o = out + r * out_stride + c;
+      Store16(CharToFloat16(_mm512_and_si512(bytes, byte_mask),
+                            p0, d0, p25, d1, p75, d2), o);
+      Store16(CharToFloat16(_mm512_and_si512(_mm512_srli_epi32(bytes, 8),
+                                             byte_mask),
+                            p0, d0, p25, d1, p75, d2),
+              o + out_stride);
+      Store16(CharToFloat16(_mm512_and_si512(_mm512_srli_epi32(bytes, 16),
+                                             byte_mask),
+                            p0, d0, p25, d1, p75, d2),
+              o + 2 * out_stride);
+      Store16(CharToFloat16(_mm512_srli_epi32(bytes, 24),
+                            p0, d0, p25, d1, p75, d2),
+              o + 3 * out_stride);
+    }
+    CharToFloatScalar(in, in_col_stride, num_rows4, num_rows, c, c + 16,
+                      percentiles, out, out_stride);
+  }
+  // Use AVX2 for any remaining block of 8 columns (it does the scalar part
+  // too).
+  if (c < num_cols)
+    CharToFloatAvx2(in + c * in_col_stride, in_col_stride, num_rows,
+                    num_cols - c, percentiles + 4 * c, out + c, out_stride);
+}
+
+template<typename Real, typename Int> KALDI_TARGET_AVX512
+void FloatToIntAvx512(const Real *in, int32 in_stride,
+                      int32 num_rows, int32 num_cols,
+                      float min_value, float range, Int *out) {
+  const int32 max_code = (sizeof(Int) == 1 ? 255 : 65535);
+  const __m512 min_v = _mm512_set1_ps(min_value),
+      range_v = _mm512_set1_ps(range), zero = _mm512_setzero_ps(),
+      one = _mm512_set1_ps(1.0f), max_code_v = _mm512_set1_ps(max_code);
+  const __m512d half = _mm512_set1_pd(0.499);
+  for (int32 r = 0; r < num_rows; r++, in += in_stride, out += num_cols) {
+    int32 c = 0;
+    for (; c + 16 <= num_cols; c += 16) {
+      __m512 f = _mm512_div_ps(_mm512_sub_ps(Load16(in + c), min_v), range_v);
+      f = _mm512_min_ps(_mm512_max_ps(f, zero), one);
+      __m512i codes = RoundCodes16(_mm512_mul_ps(f, max_code_v), half);
+      if (sizeof(Int) == 1)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + c),
+                         _mm512_cvtepi32_epi8(codes));
+      else
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + c),
+                            _mm512_cvtepi32_epi16(codes));
+    }
+    for (; c < num_cols; c++)
+      out[c] = FloatToCode(min_value, range, max_code, in[c]);
+  }
+}
+
+template<typename Real> KALDI_TARGET_AVX512
+void FloatToCharAvx512(const Real *in, int32 in_stride,
+                       int32 num_rows, int32 num_cols,
+                       const float *percentiles, uint8 *out) {
+  const __m512d half = _mm512_set1_pd(0.5);
+  int32 num_rows4 = num_rows - num_rows % 4, c = 0;
+  for (; c + 16 <= num_cols; c += 16) {
+    float p[4][16];
+    for (int32 i = 0; i < 16; i++)
+      for (int32 j = 0; j < 4; j++)
+        p[j][i] = percentiles[4 * (c + i) + j];
+    const __m512 p0 = _mm512_loadu_ps(p[0]), p25 = _mm512_loadu_ps(p[1]),
+        p75 = _mm512_loadu_ps(p[2]), p100 = _mm512_loadu_ps(p[3]),
+        d0 = _mm512_sub_ps(p25, p0), d1 = _mm512_sub_ps(p75, p25),
+        d2 = _mm512_sub_ps(p100, p75),
+        mult0 = _mm512_set1_ps(64.0f), mult1 = _mm512_set1_ps(128.0f),
+        mult2 = _mm512_set1_ps(63.0f);
+    const __m512i off0 = _mm512_setzero_si512(),
+        off1 = _mm512_set1_epi32(64), off2 = _mm512_set1_epi32(192),
+        max2 = _mm512_set1_epi32(255);
+    for (int32 r = 0; r < num_rows4; r += 4) {
+      __m512i word = _mm512_setzero_si512();
+      for (int32 k = 0; k < 4; k++) {
+        __m512 x = Load16(in + (r + k) * in_stride + c);
+        __mmask16 lt25 = _mm512_cmp_ps_mask(x, p25, _CMP_LT_OQ),
+            lt75 = _mm512_cmp_ps_mask(x, p75, _CMP_LT_OQ);
+        __m512 base = _mm512_mask_blend_ps(
+            lt25, _mm512_mask_blend_ps(lt75, p75, p25), p0),
+            den = _mm512_mask_blend_ps(
+                lt25, _mm512_mask_blend_ps(lt75, d2, d1), d0),
+            mult = _mm512_mask_blend_ps(
+                lt25, _mm512_mask_blend_ps(lt75, mult2, mult1), mult0);
+        __m512i lo = _mm512_mask_blend_epi32(
+            lt25, _mm512_mask_blend_epi32(lt75, off2, off1), off0),
+            hi = _mm512_mask_blend_epi32(
+                lt25, _mm512_mask_blend_epi32(lt75, max2, off2), off1);
+        __m512 f = _mm512_div_ps(_mm512_sub_ps(x, base), den);
+        __m512i code = _mm512_add_epi32(
+            lo, RoundCodes16(_mm512_mul_ps(f, mult), half));
+        code = _mm512_min_epi32(_mm512_max_epi32(code, lo), hi);
+        word = _mm512_or_si512(word, _mm512_slli_epi32(code, 8 * k));
+      }
+      int32 words[16];
+      _mm512_storeu_si512(words, word);
+      for (int32 i = 0; i < 16; i++)
+        std::memcpy(out + (c + i) * num_rows + r, words + i, 4);
+    }
+    FloatToCharScalar(in, in_stride, num_rows, num_rows4, num_rows, c, c + 16,
+                      percentiles, out);
+  }
+  FloatToCharScalar(in, in_stride, num_rows, 0, num_rows, c, num_cols,
+                    percentiles, out);
+}
+
+#endif  // KALDI_COMPRESSED_MATRIX_SIMD
+
+// The current setting; -1 means not yet initialized.
+std::atomic<int> compressed_matrix_simd(-1);
+
+}  // namespace
+
+
+CompressedMatrixSimdType CompressedMatrixSimdSupported() {
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+  static const CompressedMatrixSimdType ans = DetectSimd();
+  return ans;
+#else
+  return kCompressedMatrixNoSimd;
+#endif
+}
+
+CompressedMatrixSimdType GetCompressedMatrixSimd() {
+  int ans = compressed_matrix_simd.load(std::memory_order_relaxed);
+  if (ans < 0) {
+    ans = CompressedMatrixSimdSupported();
+    compressed_matrix_simd.store(ans, std::memory_order_relaxed);
+  }
+  return static_cast<CompressedMatrixSimdType>(ans);
+}
+
+CompressedMatrixSimdType SetCompressedMatrixSimd(
+    CompressedMatrixSimdType type) {
+  CompressedMatrixSimdType ans = GetCompressedMatrixSimd();
+  compressed_matrix_simd.store(std::min(type, CompressedMatrixSimdSupported()),
+                               std::memory_order_relaxed);
+  return ans;
+}
+
+#ifdef KALDI_COMPRESSED_MATRIX_SIMD
+#define KALDI_COMPRESSED_MATRIX_DISPATCH(name, ...) \
+  switch (GetCompressedMatrixSimd()) {              \
+    case kCompressedMatrixAvx512:                   \
+      name ## Avx512(__VA_ARGS__);                  \
+      return;                                       \
+    case kCompressedMatrixAvx2:                     \
+      name ## Avx2(__VA_ARGS__);                    \
+      return;                                       \
+    default:                                        \
+      KALDI_ERR << "SIMD is not enabled for CompressedMatrix."; \
+  }
+#else
+#define KALDI_COMPRESSED_MATRIX_DISPATCH(name, ...) \
+  KALDI_ERR << "SIMD is not supported for CompressedMatrix in this build.";
+#endif
+
+template<typename Real>
+void SimdUint8ToFloat(const uint8 *in, int32 in_stride,
+                      int32 num_rows, int32 num_cols,
+                      float min_value, float increment,
+                      Real *out, int32 out_stride) {
+  KALDI_COMPRESSED_MATRIX_DISPATCH(Uint8ToFloat, in, in_stride, num_rows,
+                                   num_cols, min_value, increment,
+                                   out, out_stride);
+}
+
+template<typename Real>
+void SimdUint16ToFloat(const uint16 *in, int32 in_stride,
+                       int32 num_rows, int32 num_cols,
+                       float min_value, float increment,
+                       Real *out, int32 out_stride) {
+  KALDI_COMPRESSED_MATRIX_DISPATCH(Uint16ToFloat, in, in_stride, num_rows,
+                                   num_cols, min_value, increment,
+                                   out, out_stride);
+}
+
+template<typename Real>
+void SimdCharToFloat(const uint8 *in, int32 in_col_stride,
+                     int32 num_rows, int32 num_cols,
+                     const float *percentiles,
+                     Real *out, int32 out_stride) {
+  KALDI_COMPRESSED_MATRIX_DISPATCH(CharToFloat, in, in_col_stride, num_rows,
+                                   num_cols, percentiles, out, out_stride);
+}
+
+template<typename Real>
+void SimdFloatToUint8(const Real *in, int32 in_stride,
+                      int32 num_rows, int32 num_cols,
+                      float min_value, float range, uint8 *out) {
+  KALDI_COMPRESSED_MATRIX_DISPATCH(FloatToInt, in, in_stride, num_rows,
+                                   num_cols, min_value, range, out);
+}
+
+template<typename Real>
+void SimdFloatToUint16(const Real *in, int32 in_stride,
+                       int32 num_rows, int32 num_cols,
+                       float min_value, float range, uint16 *out) {
+  KALDI_COMPRESSED_MATRIX_DISPATCH(FloatToInt, in, in_stride, num_rows,
+                                   num_cols, min_value, range, out);
+}
+
+template<typename Real>
+void SimdFloatToChar(const Real *in, int32 in_stride,
+                     int32 num_rows, int32 num_cols,
+                     const float *percentiles, uint8 *out) {
+  KALDI_COMPRESSED_MATRIX_DISPATCH(FloatToChar, in, in_stride, num_rows,
+                                   num_cols, percentiles, out);
+}
+
+#define KALDI_COMPRESSED_MATRIX_INSTANTIATE(Real)                            \
+  template void SimdUint8ToFloat(const uint8 *, int32, int32, int32, float,  \
+                                 float, Real *, int32);                      \
+  template void SimdUint16ToFloat(const uint16 *, int32, int32, int32,       \
+                                  float, float, Real *, int32);              \
+  template void SimdCharToFloat(const uint8 *, int32, int32, int32,          \
+                                const float *, Real *, int32);               \
+  template void SimdFloatToUint8(const Real *, int32, int32, int32, float,   \
+                                 float, uint8 *);                            \
+  template void SimdFloatToUint16(const Real *, int32, int32, int32, float,  \
+                                  float, uint16 *);                          \
+  template void SimdFloatToChar(const Real *, int32, int32, int32,           \
+                                const float *, uint8 *);
+
+KALDI_COMPRESSED_MATRIX_INSTANTIATE(float)
+KALDI_COMPRESSED_MATRIX_INSTANTIATE(double)
+
+}  // namespace kaldi
@@ -0,0 +1,114 @@
+// matrix/compressed-matrix-simd.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_MATRIX_COMPRESSED_MATRIX_SIMD_H_
+#define KALDI_MATRIX_COMPRESSED_MATRIX_SIMD_H_
+
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup matrix_group
+/// @{
+
+/**
+   This file declares the vectorized kernels that class CompressedMatrix uses to
+   compress and uncompress its data.  They are compiled for AVX2 and AVX-512
+   (using function-level target attributes, so no special compiler flags are
+   needed), and the instruction set is chosen at run time depending on what the
+   CPU supports.  On other CPUs and compilers, CompressedMatrix uses its own
+   scalar code; you can tell which case applies from GetCompressedMatrixSimd().
+
+   The kernels do each floating point operation in the same precision and in
+   the same order as the scalar code in CompressedMatrix (they don't use fused
+   multiply-add), so they give exactly the same results.
+ */
+
+enum CompressedMatrixSimdType {
+  kCompressedMatrixNoSimd = 0,  // Use the scalar code in CompressedMatrix.
+  kCompressedMatrixAvx2 = 1,
+  kCompressedMatrixAvx512 = 2
+};
+
+/// Returns the best instruction set that this build and this CPU support.
+CompressedMatrixSimdType CompressedMatrixSimdSupported();
+
+/// Returns the instruction set that CompressedMatrix is currently using; this
+/// is initially CompressedMatrixSimdSupported().
+CompressedMatrixSimdType GetCompressedMatrixSimd();
+
+/// Sets the instruction set that CompressedMatrix will use (e.g. for testing,
+/// or to compare speeds); if 'type' is not supported, the best supported one
+/// below it is used.  Returns the previous setting.
+CompressedMatrixSimdType SetCompressedMatrixSimd(CompressedMatrixSimdType type);
+
+
+// The functions below must only be called if GetCompressedMatrixSimd() !=
+// kCompressedMatrixNoSimd.  'in' and 'out' are row-major with the given
+// strides, except where stated otherwise.
+
+/// Sets out[r * out_stride + c] = min_value + increment * in[r * in_stride + c]
+/// for 0 <= r < num_rows, 0 <= c < num_cols.  This is the kOneByte format.
+template<typename Real>
+void SimdUint8ToFloat(const uint8 *in, int32 in_stride,
+                      int32 num_rows, int32 num_cols,
+                      float min_value, float increment,
+                      Real *out, int32 out_stride);
+
+/// As SimdUint8ToFloat but for 16-bit data; this is the kTwoByte format.
+template<typename Real>
+void SimdUint16ToFloat(const uint16 *in, int32 in_stride,
+                       int32 num_rows, int32 num_cols,
+                       float min_value, float increment,
+                       Real *out, int32 out_stride);
+
+/// Uncompresses the kOneByteWithColHeaders format.  'in' is column-major: the
+/// byte for row r, column c is in[c * in_col_stride + r].  'percentiles' has
+/// four values for each column c, the 0th, 25th, 75th and 100th percentiles
+/// (as floats) at percentiles[4 * c] ... percentiles[4 * c + 3].
+template<typename Real>
+void SimdCharToFloat(const uint8 *in, int32 in_col_stride,
+                     int32 num_rows, int32 num_cols,
+                     const float *percentiles,
+                     Real *out, int32 out_stride);
+
+/// Sets out[r * num_cols + c] to the 8-bit code of in[r * in_stride + c] given
+/// the range [min_value, min_value + range]; this is the kOneByte format.
+template<typename Real>
+void SimdFloatToUint8(const Real *in, int32 in_stride,
+                      int32 num_rows, int32 num_cols,
+                      float min_value, float range, uint8 *out);
+
+/// As SimdFloatToUint8 but for 16-bit codes; this is the kTwoByte format.
+template<typename Real>
+void SimdFloatToUint16(const Real *in, int32 in_stride,
+                       int32 num_rows, int32 num_cols,
+                       float min_value, float range, uint16 *out);
+
+/// Compresses to the kOneByteWithColHeaders format, given the percentiles of
+/// each column (laid out as for SimdCharToFloat()).  'out' is column-major: the
+/// byte for row r, column c is written to out[c * num_rows + r].
+template<typename Real>
+void SimdFloatToChar(const Real *in, int32 in_stride,
+                     int32 num_rows, int32 num_cols,
+                     const float *percentiles, uint8 *out);
+
+/// @} end of \addtogroup matrix_group
+
+}  // namespace kaldi
+
+#endif  // KALDI_MATRIX_COMPRESSED_MATRIX_SIMD_H_
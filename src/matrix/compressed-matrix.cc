@@ -20,6 +20,7 @@
 // limitations under the License.
 
 #include "matrix/compressed-matrix.h"
+#include "matrix/compressed-matrix-simd.h"
 #include <algorithm>
 
 namespace kaldi {
@@ -145,7 +146,30 @@ void CompressedMatrix::CopyFromMat(
   *(reinterpret_cast<GlobalHeader*>(data_)) = global_header;
 
   DataFormat format = static_cast<DataFormat>(global_header.format);
-  if (format == kOneByteWithColHeaders) {
+  if (GetCompressedMatrixSimd() != kCompressedMatrixNoSimd) {
+    int32 num_rows = mat.NumRows(), num_cols = mat.NumCols();
+    char *data = static_cast<char*>(data_) + sizeof(GlobalHeader);
+    if (format == kOneByteWithColHeaders) {
+      PerColHeader *header_data = reinterpret_cast<PerColHeader*>(data);
+      for (int32 col = 0; col < num_cols; col++)
+        ComputeColHeader(global_header, mat.Data() + col, mat.Stride(),
+                         num_rows, header_data + col);
+      std::vector<float> percentiles;
+      GetPercentiles(global_header, header_data, num_cols, &percentiles);
+      SimdFloatToChar(mat.Data(), mat.Stride(), num_rows, num_cols,
+                      percentiles.data(),
+                      reinterpret_cast<uint8*>(header_data + num_cols));
+    } else if (format == kTwoByte) {
+      SimdFloatToUint16(mat.Data(), mat.Stride(), num_rows, num_cols,
+                        global_header.min_value, global_header.range,
+                        reinterpret_cast<uint16*>(data));
+    } else {
+      KALDI_ASSERT(format == kOneByte);
+      SimdFloatToUint8(mat.Data(), mat.Stride(), num_rows, num_cols,
+                       global_header.min_value, global_header.range,
+                       reinterpret_cast<uint8*>(data));
+    }
+  } else if (format == kOneByteWithColHeaders) {
     PerColHeader *header_data =
         reinterpret_cast<PerColHeader*>(static_cast<char*>(data_) +
                                         sizeof(GlobalHeader));
@@ -500,6 +524,20 @@ inline float CompressedMatrix::CharToFloat(
 }
 
 
+void CompressedMatrix::GetPercentiles(const GlobalHeader &global_header,
+                                      const PerColHeader *header,
+                                      int32 num_cols,
+                                      std::vector<float> *percentiles) {
+  percentiles->resize(4 * num_cols);
+  float *p = percentiles->data();
+  for (int32 c = 0; c < num_cols; c++, header++, p += 4) {
+    p[0] = Uint16ToFloat(global_header, header->percentile_0);
+    p[1] = Uint16ToFloat(global_header, header->percentile_25);
+    p[2] = Uint16ToFloat(global_header, header->percentile_75);
+    p[3] = Uint16ToFloat(global_header, header->percentile_100);
+  }
+}
+
 template<typename Real>  // static
 void CompressedMatrix::CompressColumn(
     const GlobalHeader &global_header,
@@ -631,7 +669,9 @@ void CompressedMatrix::CopyToMat(MatrixBase<Real> *mat,
   KALDI_ASSERT(mat->NumCols() == num_cols);
 
   DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
+  if (GetCompressedMatrixSimd() != kCompressedMatrixNoSimd) {
+    CopyToMat(0, 0, mat);
+  } else if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
                                                 h->num_cols);
@@ -790,7 +830,32 @@ void CompressedMatrix::CopyToMat(int32 row_offset,
       tgt_cols = dest->NumCols(), tgt_rows = dest->NumRows();
 
   DataFormat format = static_cast<DataFormat>(h->format);
-  if (format == kOneByteWithColHeaders) {
+  if (GetCompressedMatrixSimd() != kCompressedMatrixNoSimd) {
+    if (format == kOneByteWithColHeaders) {
+      const PerColHeader *per_col_header =
+          reinterpret_cast<const PerColHeader*>(h + 1);
+      const uint8 *byte_data =
+          reinterpret_cast<const uint8*>(per_col_header + num_cols);
+      std::vector<float> percentiles;
+      GetPercentiles(*h, per_col_header + col_offset, tgt_cols, &percentiles);
+      SimdCharToFloat(byte_data + col_offset * num_rows + row_offset,
+                      num_rows, tgt_rows, tgt_cols, percentiles.data(),
+                      dest->Data(), dest->Stride());
+    } else if (format == kTwoByte) {
+      const uint16 *data = reinterpret_cast<const uint16*>(h + 1) +
+          col_offset + (num_cols * row_offset);
+      SimdUint16ToFloat(data, num_cols, tgt_rows, tgt_cols, h->min_value,
+                        static_cast<float>(h->range * (1.0 / 65535.0)),
+                        dest->Data(), dest->Stride());
+    } else {
+      KALDI_ASSERT(format == kOneByte);
+      const uint8 *data = reinterpret_cast<const uint8*>(h + 1) +
+          col_offset + (num_cols * row_offset);
+      SimdUint8ToFloat(data, num_cols, tgt_rows, tgt_cols, h->min_value,
+                       static_cast<float>(h->range * (1.0 / 255.0)),
+                       dest->Data(), dest->Stride());
+    }
+  } else if (format == kOneByteWithColHeaders) {
     PerColHeader *per_col_header = reinterpret_cast<PerColHeader*>(h+1);
     uint8 *byte_data = reinterpret_cast<uint8*>(per_col_header +
                                                 h->num_cols);
@@ -258,6 +258,13 @@ class CompressedMatrix {
   static inline float Uint16ToFloat(const GlobalHeader &global_header,
                                     uint16 value);
 
+  // this is used only in the kOneByteWithColHeaders compression format, by
+  // the SIMD code (see compressed-matrix-simd.h); it outputs the four
+  // percentiles of each of the 'num_cols' columns, as floats.
+  static void GetPercentiles(const GlobalHeader &global_header,
+                             const PerColHeader *header, int32 num_cols,
+                             std::vector<float> *percentiles);
+
   // this is used only in the kOneByteWithColHeaders compression format.
   static inline uint8 FloatToChar(float p0, float p25,
                                           float p75, float p100,
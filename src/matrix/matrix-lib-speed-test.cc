@@ -22,6 +22,7 @@
 // limitations under the License.
 
 #include "matrix/matrix-lib.h"
+#include "matrix/compressed-matrix-simd.h"
 #include "base/timer.h"
 #include <numeric>
 
@@ -254,6 +255,48 @@ static void UnitTestAddVecToColsSpeed() {
   CsvResult<Real>(__func__, sizes.size(), t.Elapsed(), "seconds");
 }
 
+template<typename Real>
+static void UnitTestCompressedMatrixSpeed() {
+  Timer t;
+  const char *method_names[] = { "speech-feature", "two-byte", "one-byte" };
+  CompressionMethod methods[] = { kSpeechFeature, kTwoByteAuto, kOneByteAuto };
+  const char *simd_names[] = { "scalar", "avx2", "avx512" };
+  std::vector<MatrixIndexT> sizes;
+  sizes.push_back(40);
+  sizes.push_back(440);
+  CompressedMatrixSimdType prev = GetCompressedMatrixSimd();
+  for (size_t i = 0; i < sizes.size(); i++) {
+    MatrixIndexT size = sizes[i];
+    Matrix<Real> M(1000, size), M2(1000, size);
+    M.SetRandn();
+    for (int32 m = 0; m < 3; m++) {
+      for (int32 s = kCompressedMatrixNoSimd;
+           s <= CompressedMatrixSimdSupported(); s++) {
+        SetCompressedMatrixSimd(static_cast<CompressedMatrixSimdType>(s));
+        std::string name = std::string(method_names[m]) + "," + simd_names[s];
+        BaseFloat time_in_secs = 0.05, num_elements = M.NumRows() * size;
+        CompressedMatrix cmat;
+        int32 iter = 0;
+        Timer t1;
+        for (; t1.Elapsed() < time_in_secs; iter++)
+          cmat.CopyFromMat(M, methods[m]);
+        CsvResult<Real>("CompressedMatrix compress " + name, size,
+                        num_elements * iter / (t1.Elapsed() * 1.0e+06),
+                        "million elements per second");
+        iter = 0;
+        Timer t2;
+        for (; t2.Elapsed() < time_in_secs; iter++)
+          cmat.CopyToMat(&M2);
+        CsvResult<Real>("CompressedMatrix uncompress " + name, size,
+                        num_elements * iter / (t2.Elapsed() * 1.0e+06),
+                        "million elements per second");
+      }
+    }
+  }
+  SetCompressedMatrixSimd(prev);
+  CsvResult<Real>(__func__, sizes.size(), t.Elapsed(), "seconds");
+}
+
 template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestRealFftSpeed<Real>();
   UnitTestSplitRadixRealFftSpeed<Real>();
@@ -263,6 +306,7 @@ template<typename Real> static void MatrixUnitSpeedTest() {
   UnitTestAddColSumMatSpeed<Real>();
   UnitTestAddVecToRowsSpeed<Real>();
   UnitTestAddVecToColsSpeed<Real>();
+  UnitTestCompressedMatrixSpeed<Real>();
 }
 
 } // namespace kaldi
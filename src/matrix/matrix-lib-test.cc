@@ -24,6 +24,7 @@
 // limitations under the License.
 
 #include "matrix/matrix-lib.h"
+#include "matrix/compressed-matrix-simd.h"
 #include "util/stl-utils.h"
 #include <numeric>
 #include <time.h> // This is only needed for UnitTestSvdSpeed, you can
@@ -4459,6 +4460,58 @@ static void UnitTestExtractCompressedMatrix() {
   }
 }
 
+template<typename Real>
+static void UnitTestCompressedMatrixSimd() {
+  if (CompressedMatrixSimdSupported() == kCompressedMatrixNoSimd) {
+    KALDI_LOG << "Not testing SIMD compression: not supported.";
+    return;
+  }
+  for (int32 i = 0; i < 40; i++) {
+    // Make sure the sizes are big enough to exercise the vectorized code and
+    // not multiples of the vector sizes, so the remainders are tested too.
+    MatrixIndexT num_rows = RandInt(1, 70), num_cols = RandInt(1, 50);
+    Matrix<Real> mat(num_rows, num_cols);
+    mat.SetRandn();
+    if (RandInt(0, 1) == 0)
+      mat.Row(RandInt(0, num_rows - 1)).Set(RandGauss() * 4.0);
+    CompressionMethod methods[] = { kAutomaticMethod, kSpeechFeature,
+                                    kTwoByteAuto, kOneByteAuto };
+    CompressionMethod method = methods[RandInt(0, 3)];
+    CompressedMatrixSimdType simd = static_cast<CompressedMatrixSimdType>(
+        RandInt(kCompressedMatrixAvx2, CompressedMatrixSimdSupported()));
+
+    CompressedMatrixSimdType prev = SetCompressedMatrixSimd(
+        kCompressedMatrixNoSimd);
+    CompressedMatrix cmat_scalar(mat, method);
+    SetCompressedMatrixSimd(simd);
+    CompressedMatrix cmat_simd(mat, method);
+
+    // The SIMD code should give exactly the same results as the scalar code.
+    std::ostringstream os_scalar, os_simd;
+    cmat_scalar.Write(os_scalar, true);
+    cmat_simd.Write(os_simd, true);
+    KALDI_ASSERT(os_scalar.str() == os_simd.str());
+
+    Matrix<Real> mat_simd(num_rows, num_cols), mat_scalar(num_rows, num_cols);
+    cmat_scalar.CopyToMat(&mat_simd);
+    SetCompressedMatrixSimd(kCompressedMatrixNoSimd);
+    cmat_scalar.CopyToMat(&mat_scalar);
+    AssertEqual(mat_simd, mat_scalar, 0.0);
+
+    MatrixIndexT row_offset = RandInt(0, num_rows - 1),
+        col_offset = RandInt(0, num_cols - 1),
+        sub_num_rows = RandInt(1, num_rows - row_offset),
+        sub_num_cols = RandInt(1, num_cols - col_offset);
+    Matrix<Real> sub_simd(sub_num_rows, sub_num_cols),
+        sub_scalar(sub_num_rows, sub_num_cols);
+    cmat_scalar.CopyToMat(row_offset, col_offset, &sub_scalar);
+    SetCompressedMatrixSimd(simd);
+    cmat_scalar.CopyToMat(row_offset, col_offset, &sub_simd);
+    AssertEqual(sub_simd, sub_scalar, 0.0);
+    SetCompressedMatrixSimd(prev);
+  }
+}
+
 
 template<typename Real>
 static void UnitTestTridiag() {
@@ -4599,6 +4652,7 @@ template<typename Real> static void MatrixUnitTest(bool full_test) {
   UnitTestCompressedMatrix<Real>();
   UnitTestCompressedMatrix2<Real>();
   UnitTestExtractCompressedMatrix<Real>();
+  UnitTestCompressedMatrixSimd<Real>();
   UnitTestResize<Real>();
   UnitTestResizeCopyDataDifferentStrideType<Real>();
   UnitTestNonsymmetricPower<Real>();
@@ -27,35 +27,39 @@ namespace nnet3 {
 
 DecodableNnetSimpleLoopedInfo::DecodableNnetSimpleLoopedInfo(
     const NnetSimpleLoopedComputationOptions &opts,
-    Nnet *nnet):
+    Nnet *nnet,
+    CachingOptimizingCompiler *compiler):
     opts(opts), nnet(*nnet) {
-  Init(opts, nnet);
+  Init(opts, nnet, compiler);
 }
 
 DecodableNnetSimpleLoopedInfo::DecodableNnetSimpleLoopedInfo(
     const NnetSimpleLoopedComputationOptions &opts,
     const Vector<BaseFloat> &priors,
-    Nnet *nnet):
+    Nnet *nnet,
+    CachingOptimizingCompiler *compiler):
     opts(opts), nnet(*nnet), log_priors(priors) {
   if (log_priors.Dim() != 0)
     log_priors.ApplyLog();
-  Init(opts, nnet);
+  Init(opts, nnet, compiler);
 }
 
 
 DecodableNnetSimpleLoopedInfo::DecodableNnetSimpleLoopedInfo(
     const NnetSimpleLoopedComputationOptions &opts,
-    AmNnetSimple *am_nnet):
+    AmNnetSimple *am_nnet,
+    CachingOptimizingCompiler *compiler):
     opts(opts), nnet(am_nnet->GetNnet()), log_priors(am_nnet->Priors()) {
   if (log_priors.Dim() != 0)
     log_priors.ApplyLog();
-  Init(opts, &(am_nnet->GetNnet()));
+  Init(opts, &(am_nnet->GetNnet()), compiler);
 }
 
 
 void DecodableNnetSimpleLoopedInfo::Init(
     const NnetSimpleLoopedComputationOptions &opts,
-    Nnet *nnet) {
+    Nnet *nnet,
+    CachingOptimizingCompiler *compiler) {
   opts.Check();
   KALDI_ASSERT(IsSimpleNnet(*nnet));
   has_ivectors = (nnet->InputDim("ivector") > 0);
@@ -83,9 +87,13 @@ void DecodableNnetSimpleLoopedInfo::Init(
                                  num_sequences,
                                  &request1, &request2, &request3);
 
-  CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
-                &computation);
-  computation.ComputeCudaIndexes();
+  if (compiler != NULL) {
+    computation = *(compiler->CompileLooped(request1, request2, request3));
+  } else {
+    CompileLooped(*nnet, opts.optimize_config, request1, request2, request3,
+                  &computation);
+    computation.ComputeCudaIndexes();
+  }
   if (GetVerboseLevel() >= 3) {
     KALDI_VLOG(3) << "Computation is:";
     computation.Print(std::cerr, *nnet);
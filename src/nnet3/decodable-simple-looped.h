@@ -103,21 +103,29 @@ class DecodableNnetSimpleLoopedInfo  {
  public:
   // The constructor takes a non-const pointer to 'nnet' because it may have to
   // modify it to be able to take multiple iVectors.
+  // If 'compiler' is non-NULL, the computation is obtained from it (so it
+  // may come from a computation cache that was read from disk, see
+  // nnet3-compile-computation-cache); it must have been constructed with the
+  // same 'nnet' and with opts.optimize_config.
   DecodableNnetSimpleLoopedInfo(const NnetSimpleLoopedComputationOptions &opts,
-                                Nnet *nnet);
+                                Nnet *nnet,
+                                CachingOptimizingCompiler *compiler = NULL);
 
   // This constructor takes the priors from class AmNnetSimple (so it can divide by
   // them).
   DecodableNnetSimpleLoopedInfo(const NnetSimpleLoopedComputationOptions &opts,
-                                AmNnetSimple *nnet);
+                                AmNnetSimple *nnet,
+                                CachingOptimizingCompiler *compiler = NULL);
 
   // this constructor is for use in testing.
   DecodableNnetSimpleLoopedInfo(const NnetSimpleLoopedComputationOptions &opts,
                                 const Vector<BaseFloat> &priors,
-                                Nnet *nnet);
+                                Nnet *nnet,
+                                CachingOptimizingCompiler *compiler = NULL);
 
   void Init(const NnetSimpleLoopedComputationOptions &opts,
-            Nnet *nnet);
+            Nnet *nnet,
+            CachingOptimizingCompiler *compiler = NULL);
 
   const NnetSimpleLoopedComputationOptions &opts;
 
@@ -23,6 +23,79 @@
 namespace kaldi {
 namespace nnet3 {
 
+// Creates the computation request for one chunk of DecodableNnetSimple.  The
+// times are shifted so that the first output frame has t = 0, which makes the
+// requests for most chunks the same, so they can be cached by the compiler.
+// The input is for frames first_input_t <= t < first_input_t +
+// num_input_frames (relative to the first output frame).
+static void CreateChunkComputationRequest(int32 first_input_t,
+                                          int32 num_input_frames,
+                                          bool has_ivector,
+                                          int32 num_subsampled_frames,
+                                          int32 frame_subsampling_factor,
+                                          ComputationRequest *request) {
+  request->need_model_derivative = false;
+  request->store_component_stats = false;
+
+  // First add the regular features-- named "input".
+  request->inputs.clear();
+  request->inputs.reserve(2);
+  request->inputs.push_back(
+      IoSpecification("input", first_input_t,
+                      first_input_t + num_input_frames));
+  if (has_ivector) {
+    std::vector<Index> indexes;
+    indexes.push_back(Index(0, 0, 0));
+    request->inputs.push_back(IoSpecification("ivector", indexes));
+  }
+  IoSpecification output_spec;
+  output_spec.name = "output";
+  output_spec.has_deriv = false;
+  output_spec.indexes.resize(num_subsampled_frames);
+  // leave n and x values at 0 (the constructor sets these).
+  for (int32 i = 0; i < num_subsampled_frames; i++)
+    output_spec.indexes[i].t = i * frame_subsampling_factor;
+  request->outputs.resize(1);
+  request->outputs[0].Swap(&output_spec);
+}
+
+// Rounds up opts->frames_per_chunk to a multiple of the frame-subsampling
+// factor and the nnet's modulus, if necessary.
+static void CheckAndFixFramesPerChunk(const Nnet &nnet,
+                                      NnetSimpleComputationOptions *opts) {
+  static bool warned_frames_per_chunk = false;
+  int32 nnet_modulus = nnet.Modulus();
+  if (opts->frame_subsampling_factor < 1 ||
+      opts->frames_per_chunk < 1)
+    KALDI_ERR << "--frame-subsampling-factor and --frames-per-chunk must be > 0";
+  KALDI_ASSERT(nnet_modulus > 0);
+  int32 n = Lcm(opts->frame_subsampling_factor, nnet_modulus);
+
+  if (opts->frames_per_chunk % n != 0) {
+    // round up to the nearest multiple of n.
+    int32 frames_per_chunk = n * ((opts->frames_per_chunk + n - 1) / n);
+    if (!warned_frames_per_chunk) {
+      warned_frames_per_chunk = true;
+      if (nnet_modulus == 1) {
+        // simpler error message.
+        KALDI_LOG << "Increasing --frames-per-chunk from "
+                  << opts->frames_per_chunk << " to "
+                  << frames_per_chunk << " to make it a multiple of "
+                  << "--frame-subsampling-factor="
+                  << opts->frame_subsampling_factor;
+      } else {
+        KALDI_LOG << "Increasing --frames-per-chunk from "
+                  << opts->frames_per_chunk << " to "
+                  << frames_per_chunk << " due to "
+                  << "--frame-subsampling-factor="
+                  << opts->frame_subsampling_factor << " and "
+                  << "nnet shift-invariance modulus = " << nnet_modulus;
+      }
+    }
+    opts->frames_per_chunk = frames_per_chunk;
+  }
+}
+
 
 DecodableNnetSimple::DecodableNnetSimple(
     const NnetSimpleComputationOptions &opts,
@@ -218,35 +291,13 @@ void DecodableNnetSimple::DoNnetComputation(
     const VectorBase<BaseFloat> &ivector,
     int32 output_t_start,
     int32 num_subsampled_frames) {
+  // We shift the 'input' and 'output' to a consistent time, to take advantage
+  // of caching in the compiler.
   ComputationRequest request;
-  request.need_model_derivative = false;
-  request.store_component_stats = false;
-
-  bool shift_time = true; // shift the 'input' and 'output' to a consistent
-  // time, to take advantage of caching in the compiler.
-  // An optimization.
-  int32 time_offset = (shift_time ? -output_t_start : 0);
-
-  // First add the regular features-- named "input".
-  request.inputs.reserve(2);
-  request.inputs.push_back(
-      IoSpecification("input", time_offset + input_t_start,
-                      time_offset + input_t_start + input_feats.NumRows()));
-  if (ivector.Dim() != 0) {
-    std::vector<Index> indexes;
-    indexes.push_back(Index(0, 0, 0));
-    request.inputs.push_back(IoSpecification("ivector", indexes));
-  }
-  IoSpecification output_spec;
-  output_spec.name = "output";
-  output_spec.has_deriv = false;
   int32 subsample = opts_.frame_subsampling_factor;
-  output_spec.indexes.resize(num_subsampled_frames);
-  // leave n and x values at 0 (the constructor sets these).
-  for (int32 i = 0; i < num_subsampled_frames; i++)
-    output_spec.indexes[i].t = time_offset + output_t_start + i * subsample;
-  request.outputs.resize(1);
-  request.outputs[0].Swap(&output_spec);
+  CreateChunkComputationRequest(input_t_start - output_t_start,
+                                input_feats.NumRows(), ivector.Dim() != 0,
+                                num_subsampled_frames, subsample, &request);
 
   std::shared_ptr<const NnetComputation> computation = compiler_.Compile(request);
   Nnet *nnet_to_update = NULL;  // we're not doing any update.
@@ -276,37 +327,51 @@ void DecodableNnetSimple::DoNnetComputation(
 }
 
 void DecodableNnetSimple::CheckAndFixConfigs() {
-  static bool warned_frames_per_chunk = false;
-  int32 nnet_modulus = nnet_.Modulus();
-  if (opts_.frame_subsampling_factor < 1 ||
-      opts_.frames_per_chunk < 1)
-    KALDI_ERR << "--frame-subsampling-factor and --frames-per-chunk must be > 0";
-  KALDI_ASSERT(nnet_modulus > 0);
-  int32 n = Lcm(opts_.frame_subsampling_factor, nnet_modulus);
+  CheckAndFixFramesPerChunk(nnet_, &opts_);
+}
 
-  if (opts_.frames_per_chunk % n != 0) {
-    // round up to the nearest multiple of n.
-    int32 frames_per_chunk = n * ((opts_.frames_per_chunk + n - 1) / n);
-    if (!warned_frames_per_chunk) {
-      warned_frames_per_chunk = true;
-      if (nnet_modulus == 1) {
-        // simpler error message.
-        KALDI_LOG << "Increasing --frames-per-chunk from "
-                  << opts_.frames_per_chunk << " to "
-                  << frames_per_chunk << " to make it a multiple of "
-                  << "--frame-subsampling-factor="
-                  << opts_.frame_subsampling_factor;
-      } else {
-        KALDI_LOG << "Increasing --frames-per-chunk from "
-                  << opts_.frames_per_chunk << " to "
-                  << frames_per_chunk << " due to "
-                  << "--frame-subsampling-factor="
-                  << opts_.frame_subsampling_factor << " and "
-                  << "nnet shift-invariance modulus = " << nnet_modulus;
+int32 CompileDecodableNnetSimpleComputations(
+    const NnetSimpleComputationOptions &opts_in,
+    const Nnet &nnet,
+    CachingOptimizingCompiler *compiler) {
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  NnetSimpleComputationOptions opts(opts_in);
+  CheckAndFixFramesPerChunk(nnet, &opts);
+  KALDI_ASSERT(opts.extra_left_context >= 0 && opts.extra_right_context >= 0);
+  int32 nnet_left_context, nnet_right_context;
+  ComputeSimpleNnetContext(nnet, &nnet_left_context, &nnet_right_context);
+  // DecodableNnetSimple gives the 'ivector' input whenever the nnet has one
+  // (it's an error if the user doesn't supply iVectors).
+  bool has_ivector = (nnet.InputDim("ivector") > 0);
+  int32 subsample = opts.frame_subsampling_factor,
+      subsampled_frames_per_chunk = opts.frames_per_chunk / subsample,
+      num_requests = 0;
+  // This mirrors the logic of DecodableNnetSimple::EnsureFrameIsComputed().
+  for (int32 n = 1; n <= subsampled_frames_per_chunk; n++) {
+    for (int32 is_first = 0; is_first <= 1; is_first++) {
+      for (int32 is_last = 0; is_last <= 1; is_last++) {
+        // only the last chunk of an utterance can be shorter than the others.
+        if (!is_last && n < subsampled_frames_per_chunk)
+          continue;
+        int32 extra_left_context = opts.extra_left_context,
+            extra_right_context = opts.extra_right_context;
+        if (is_first && opts.extra_left_context_initial >= 0)
+          extra_left_context = opts.extra_left_context_initial;
+        if (is_last && opts.extra_right_context_final >= 0)
+          extra_right_context = opts.extra_right_context_final;
+        int32 left_context = nnet_left_context + extra_left_context,
+            right_context = nnet_right_context + extra_right_context,
+            num_input_frames = left_context + (n - 1) * subsample + 1 +
+                               right_context;
+        ComputationRequest request;
+        CreateChunkComputationRequest(-left_context, num_input_frames,
+                                      has_ivector, n, subsample, &request);
+        compiler->Compile(request);
+        num_requests++;
       }
     }
-    opts_.frames_per_chunk = frames_per_chunk;
   }
+  return num_requests;
 }
 
 
@@ -246,6 +246,21 @@ class DecodableNnetSimple {
   int32 current_log_post_subsampled_offset_;
 };
 
+/**
+   Compiles, using 'compiler', all the computations that class
+   DecodableNnetSimple may need when decoding with neural net 'nnet' and options
+   'opts', i.e. one for each size of chunk and each combination of the chunk
+   being at the start and/or end of the utterance, so that they are in the
+   compiler's cache.  'compiler' must have been constructed with 'nnet' and
+   opts.optimize_config.  This is used to create computation caches that
+   decoding programs can read at startup (see nnet3-compile-computation-cache).
+   Returns the number of computation requests (some of which may be the same).
+*/
+int32 CompileDecodableNnetSimpleComputations(
+    const NnetSimpleComputationOptions &opts,
+    const Nnet &nnet,
+    CachingOptimizingCompiler *compiler);
+
 class DecodableAmNnetSimple: public DecodableInterface {
  public:
   /**
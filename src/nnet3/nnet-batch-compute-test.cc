@@ -0,0 +1,294 @@
+// nnet3/nnet-batch-compute-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/decodable-online-looped.h"
+#include "nnet3/nnet-test-utils.h"
+#include "nnet3/nnet-utils.h"
+#include "hmm/hmm-test-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// Returns true if the output of "nnet" for a frame does not depend on how the
+// utterance is split into chunks, so that the batched computation should give
+// the same answer as DecodableNnetSimple.  (See TestNnetDecodable() in
+// nnet-compute-test.cc for why the other nnets are excluded.)
+bool NnetIsChunkingInvariant(const Nnet &nnet) {
+  return !NnetIsRecurrent(nnet) &&
+      nnet.Info().find("statistics-extraction") == std::string::npos &&
+      nnet.Info().find("TimeHeightConvolutionComponent") == std::string::npos &&
+      nnet.Info().find("RestrictedAttentionComponent") == std::string::npos;
+}
+
+// Checks that NnetBatchComputer, given several utterances at once, gives the
+// same output as DecodableNnetSimple for each of them.
+void TestNnetBatchComputer(const Nnet &nnet) {
+  int32 input_dim = nnet.InputDim("input"),
+      output_dim = nnet.OutputDim("output"),
+      ivector_dim = std::max<int32>(0, nnet.InputDim("ivector"));
+
+  Vector<BaseFloat> priors(RandInt(0, 1) == 0 ? output_dim : 0);
+  if (priors.Dim() != 0) {
+    priors.SetRandn();
+    priors.ApplyExp();
+  }
+
+  NnetBatchComputerOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  opts.acoustic_scale = 0.1 * RandInt(1, 10);
+  opts.minibatch_size = RandInt(1, 4);
+  opts.max_wait_ms = RandInt(-1, 1);
+  NnetBatchComputer computer(opts, nnet, priors);
+
+  int32 num_utts = RandInt(1, 4);
+  std::vector<Matrix<BaseFloat> > inputs(num_utts);
+  std::vector<Vector<BaseFloat> > ivectors(num_utts);
+  std::vector<std::vector<NnetInferenceTask*> > tasks(num_utts);
+  for (int32 u = 0; u < num_utts; u++) {
+    inputs[u].Resize(RandInt(1, 80), input_dim);
+    inputs[u].SetRandn();
+    ivectors[u].Resize(ivector_dim);
+    ivectors[u].SetRandn();
+    computer.SplitUtteranceIntoTasks(
+        inputs[u], (ivector_dim != 0 ? &(ivectors[u]) : NULL), NULL, 1,
+        &(tasks[u]));
+    for (size_t i = 0; i < tasks[u].size(); i++)
+      computer.AcceptTask(tasks[u][i]);
+  }
+
+  NnetSimpleComputationOptions simple_opts(opts);
+  CachingOptimizingCompiler compiler(nnet, simple_opts.optimize_config);
+  for (int32 u = 0; u < num_utts; u++) {
+    int32 num_frames = inputs[u].NumRows(),
+        frames_per_task = computer.SubsampledFramesPerChunk();
+    DecodableNnetSimple decodable(simple_opts, nnet, priors, inputs[u],
+                                  &compiler,
+                                  (ivector_dim != 0 ? &(ivectors[u]) : NULL));
+    KALDI_ASSERT(decodable.NumFrames() == num_frames);
+    for (size_t i = 0; i < tasks[u].size(); i++)
+      computer.WaitForTask(tasks[u][i]);
+    Vector<BaseFloat> output(output_dim);
+    for (int32 t = 0; t < num_frames; t++) {
+      decodable.GetOutputForFrame(t, &output);
+      int32 i = std::min<int32>(t / frames_per_task, tasks[u].size() - 1);
+      const NnetInferenceTask &task = *(tasks[u][i]);
+      SubVector<BaseFloat> batch_output(task.output,
+                                        t - task.first_output_frame);
+      KALDI_ASSERT(batch_output.ApproxEqual(output));
+    }
+    DeletePointers(&(tasks[u]));
+  }
+}
+
+// A feature source whose frames become available a few at a time, as in online
+// decoding.
+class IncrementalMatrixFeature: public OnlineFeatureInterface {
+ public:
+  explicit IncrementalMatrixFeature(const MatrixBase<BaseFloat> &mat):
+      mat_(mat), num_frames_ready_(0) { }
+
+  void AddFrames(int32 num_frames) {
+    num_frames_ready_ = std::min(num_frames_ready_ + num_frames,
+                                 mat_.NumRows());
+  }
+
+  virtual int32 Dim() const { return mat_.NumCols(); }
+
+  virtual BaseFloat FrameShiftInSeconds() const { return 0.01f; }
+
+  virtual int32 NumFramesReady() const { return num_frames_ready_; }
+
+  virtual void GetFrame(int32 frame, VectorBase<BaseFloat> *feat) {
+    KALDI_ASSERT(frame < num_frames_ready_);
+    feat->CopyFromVec(mat_.Row(frame));
+  }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    return (frame + 1 == mat_.NumRows());
+  }
+
+ private:
+  const MatrixBase<BaseFloat> &mat_;
+  int32 num_frames_ready_;
+};
+
+// Checks that several streams decoded with DecodableAmNnetBatchOnline, which
+// share one NnetBatchComputer and whose features arrive in pieces, give the
+// same log-likelihoods as DecodableAmNnetLoopedOnline does for each of them.
+// This includes recurrent nnets, whose state the batched computation carries
+// over between chunks.
+void TestDecodableAmNnetBatchOnline(const TransitionModel &trans_model,
+                                    const Nnet &nnet) {
+  int32 input_dim = nnet.InputDim("input"),
+      output_dim = nnet.OutputDim("output"),
+      ivector_dim = std::max<int32>(0, nnet.InputDim("ivector"));
+
+  Vector<BaseFloat> priors(RandInt(0, 1) == 0 ? output_dim : 0);
+  if (priors.Dim() != 0) {
+    priors.SetRandn();
+    priors.ApplyExp();
+  }
+
+  NnetBatchComputerOptions opts;
+  opts.frames_per_chunk = RandInt(5, 25);
+  opts.extra_left_context_initial = RandInt(-1, 2);
+  opts.acoustic_scale = 0.1 * RandInt(1, 10);
+  opts.minibatch_size = RandInt(1, 4);
+  opts.max_wait_ms = RandInt(-1, 1);
+  NnetBatchComputer computer(opts, nnet, priors);
+
+  NnetSimpleLoopedComputationOptions looped_opts;
+  looped_opts.frames_per_chunk = computer.GetOptions().frames_per_chunk;
+  looped_opts.extra_left_context_initial =
+      std::max<int32>(0, opts.extra_left_context_initial);
+  looped_opts.acoustic_scale = opts.acoustic_scale;
+  // caution: this modifies the nnet, by changing how it consumes iVectors.
+  Nnet looped_nnet(nnet);
+  DecodableNnetSimpleLoopedInfo info(looped_opts, priors, &looped_nnet);
+
+  int32 num_streams = RandInt(1, 4);
+  std::vector<Matrix<BaseFloat> > feats(num_streams), ivectors(num_streams);
+  std::vector<IncrementalMatrixFeature*> batch_feats(num_streams),
+      batch_ivectors(num_streams, NULL);
+  std::vector<DecodableAmNnetBatchOnline*> batch_decodables(num_streams);
+  std::vector<IncrementalMatrixFeature*> looped_feats(num_streams),
+      looped_ivectors(num_streams, NULL);
+  std::vector<DecodableAmNnetLoopedOnline*> looped_decodables(num_streams);
+  for (int32 s = 0; s < num_streams; s++) {
+    feats[s].Resize(RandInt(1, 80), input_dim);
+    feats[s].SetRandn();
+    batch_feats[s] = new IncrementalMatrixFeature(feats[s]);
+    looped_feats[s] = new IncrementalMatrixFeature(feats[s]);
+    looped_feats[s]->AddFrames(feats[s].NumRows());
+    if (ivector_dim != 0) {
+      // The iVectors don't change with time, so it does not matter which
+      // frame each decodable takes them from.
+      Vector<BaseFloat> ivector(ivector_dim);
+      ivector.SetRandn();
+      ivectors[s].Resize(feats[s].NumRows(), ivector_dim);
+      ivectors[s].CopyRowsFromVec(ivector);
+      batch_ivectors[s] = new IncrementalMatrixFeature(ivectors[s]);
+      looped_ivectors[s] = new IncrementalMatrixFeature(ivectors[s]);
+      looped_ivectors[s]->AddFrames(ivectors[s].NumRows());
+    }
+    batch_decodables[s] = new DecodableAmNnetBatchOnline(
+        &computer, trans_model, batch_feats[s], batch_ivectors[s]);
+    looped_decodables[s] = new DecodableAmNnetLoopedOnline(
+        trans_model, info, looped_feats[s], looped_ivectors[s]);
+  }
+
+  std::vector<int32> num_frames_checked(num_streams, 0);
+  int32 num_streams_done = 0;
+  while (num_streams_done < num_streams) {
+    num_streams_done = 0;
+    for (int32 s = 0; s < num_streams; s++) {
+      int32 num_new_frames = RandInt(0, 30);
+      batch_feats[s]->AddFrames(num_new_frames);
+      if (batch_ivectors[s] != NULL)
+        batch_ivectors[s]->AddFrames(num_new_frames);
+      DecodableAmNnetBatchOnline *decodable = batch_decodables[s];
+      decodable->AdvanceChunks();
+      if (decodable->InputFinished() && RandInt(0, 1) == 0)
+        decodable->WaitForAllOutput();
+      for (; num_frames_checked[s] < decodable->NumFramesReady();
+           num_frames_checked[s]++) {
+        int32 t = num_frames_checked[s];
+        for (int32 i = 1; i <= trans_model.NumTransitionIds(); i++) {
+          BaseFloat batch_loglike = decodable->LogLikelihood(t, i),
+              looped_loglike = looped_decodables[s]->LogLikelihood(t, i);
+          KALDI_ASSERT(ApproxEqual(batch_loglike, looped_loglike, 0.01) ||
+                       fabs(batch_loglike - looped_loglike) < 1.0e-04);
+        }
+        KALDI_ASSERT(decodable->IsLastFrame(t) ==
+                     (t + 1 == feats[s].NumRows()));
+      }
+      if (num_frames_checked[s] == feats[s].NumRows())
+        num_streams_done++;
+    }
+  }
+  for (int32 s = 0; s < num_streams; s++) {
+    delete batch_decodables[s];
+    delete looped_decodables[s];
+    delete batch_feats[s];
+    delete batch_ivectors[s];
+    delete looped_feats[s];
+    delete looped_ivectors[s];
+  }
+}
+
+void UnitTestNnetBatchCompute() {
+  for (int32 n = 0; n < 20; n++) {
+    struct NnetGenerationOptions gen_config;
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    if (!NnetIsChunkingInvariant(nnet))
+      continue;
+    SetBatchnormTestMode(true, &nnet);
+    SetDropoutTestMode(true, &nnet);
+    TestNnetBatchComputer(nnet);
+  }
+}
+
+void UnitTestDecodableAmNnetBatchOnline() {
+  for (int32 n = 0; n < 20; n++) {
+    TransitionModel *trans_model = GenRandTransitionModel(NULL);
+    struct NnetGenerationOptions gen_config;
+    gen_config.allow_ivector = (RandInt(0, 1) == 0);
+    gen_config.output_dim = trans_model->NumPdfs();
+    std::vector<std::string> configs;
+    GenerateConfigSequence(gen_config, &configs);
+    Nnet nnet;
+    for (size_t j = 0; j < configs.size(); j++) {
+      std::istringstream is(configs[j]);
+      nnet.ReadConfig(is);
+    }
+    // Some of the generated configs don't respect gen_config.output_dim.
+    if (nnet.OutputDim("output") == trans_model->NumPdfs()) {
+      SetBatchnormTestMode(true, &nnet);
+      SetDropoutTestMode(true, &nnet);
+      TestDecodableAmNnetBatchOnline(*trans_model, nnet);
+    }
+    delete trans_model;
+  }
+}
+
+} // namespace nnet3
+} // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::nnet3;
+  for (kaldi::int32 loop = 0; loop < 2; loop++) {
+#if HAVE_CUDA == 1
+    CuDevice::Instantiate().SetDebugStrideMode(true);
+    if (loop == 0)
+      CuDevice::Instantiate().SelectGpuId("no");
+    else
+      CuDevice::Instantiate().SelectGpuId("yes");
+#endif
+    UnitTestNnetBatchCompute();
+    UnitTestDecodableAmNnetBatchOnline();
+  }
+  KALDI_LOG << "Nnet batch-compute tests succeeded.";
+  return 0;
+}
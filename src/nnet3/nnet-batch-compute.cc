@@ -0,0 +1,842 @@
+// nnet3/nnet-batch-compute.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include "base/timer.h"
+#include "nnet3/nnet-batch-compute.h"
+#include "nnet3/nnet-compile-looped.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+bool NnetBatchComputer::TaskSignature::operator < (
+    const TaskSignature &other) const {
+  if (num_input_frames != other.num_input_frames)
+    return num_input_frames < other.num_input_frames;
+  if (first_input_t != other.first_input_t)
+    return first_input_t < other.first_input_t;
+  if (num_output_frames != other.num_output_frames)
+    return num_output_frames < other.num_output_frames;
+  if (has_ivector != other.has_ivector)
+    return has_ivector < other.has_ivector;
+  return looped_program_counter < other.looped_program_counter;
+}
+
+
+NnetBatchComputer::NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                                     const Nnet &nnet,
+                                     const VectorBase<BaseFloat> &priors):
+    opts_(opts),
+    nnet_(nnet),
+    output_dim_(nnet.OutputDim("output")),
+    log_priors_(priors),
+    compiler_(nnet, opts.optimize_config, opts.compiler_config),
+    looped_(NULL),
+    looped_nnet_(NULL),
+    num_tasks_accepted_(0),
+    num_waiting_(0),
+    is_shutting_down_(false),
+    num_minibatches_(0),
+    num_tasks_computed_(0),
+    num_padding_tasks_(0),
+    compute_seconds_(0.0) {
+  KALDI_ASSERT(IsSimpleNnet(nnet));
+  ComputeSimpleNnetContext(nnet, &nnet_left_context_, &nnet_right_context_);
+  log_priors_.ApplyLog();
+  CheckAndFixConfigs();
+  compute_thread_ = std::thread(&NnetBatchComputer::ComputeLoop, this);
+}
+
+
+void NnetBatchComputer::CheckAndFixConfigs() {
+  if (opts_.minibatch_size < 1)
+    KALDI_ERR << "--minibatch-size must be > 0";
+  if (opts_.frame_subsampling_factor < 1 ||
+      opts_.frames_per_chunk < 1)
+    KALDI_ERR << "--frame-subsampling-factor and --frames-per-chunk must be > 0";
+  if (opts_.extra_left_context < 0 || opts_.extra_right_context < 0)
+    KALDI_ERR << "--extra-left-context and --extra-right-context must be >= 0";
+  int32 nnet_modulus = nnet_.Modulus();
+  KALDI_ASSERT(nnet_modulus > 0);
+  int32 n = Lcm(opts_.frame_subsampling_factor, nnet_modulus);
+  if (opts_.frames_per_chunk % n != 0) {
+    // round up to the nearest multiple of n.
+    int32 frames_per_chunk = n * ((opts_.frames_per_chunk + n - 1) / n);
+    KALDI_LOG << "Increasing --frames-per-chunk from "
+              << opts_.frames_per_chunk << " to "
+              << frames_per_chunk << " due to "
+              << "--frame-subsampling-factor="
+              << opts_.frame_subsampling_factor << " and "
+              << "nnet shift-invariance modulus = " << nnet_modulus;
+    opts_.frames_per_chunk = frames_per_chunk;
+  }
+}
+
+
+void NnetBatchComputer::GetCurrentIvector(
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    int32 output_t_start, int32 num_output_frames,
+    Vector<BaseFloat> *ivector_out) const {
+  if (ivector != NULL) {
+    *ivector_out = *ivector;
+    return;
+  } else if (online_ivectors == NULL) {
+    return;
+  }
+  KALDI_ASSERT(online_ivector_period > 0);
+  // See DecodableNnetSimple::GetCurrentIvector() for explanation.
+  int32 frame_to_search = output_t_start + num_output_frames / 2;
+  int32 ivector_frame = frame_to_search / online_ivector_period;
+  KALDI_ASSERT(ivector_frame >= 0);
+  if (ivector_frame >= online_ivectors->NumRows()) {
+    int32 margin = ivector_frame - (online_ivectors->NumRows() - 1);
+    if (margin * online_ivector_period > 50) {
+      // Half a second seems like too long to be explainable as edge effects.
+      KALDI_ERR << "Could not get iVector for frame " << frame_to_search
+                << ", only available till frame "
+                << online_ivectors->NumRows()
+                << " * ivector-period=" << online_ivector_period
+                << " (mismatched --ivector-period?)";
+    }
+    ivector_frame = online_ivectors->NumRows() - 1;
+  }
+  *ivector_out = online_ivectors->Row(ivector_frame);
+}
+
+
+void NnetBatchComputer::CheckInputDims(int32 feature_dim,
+                                       int32 ivector_dim) const {
+  int32 nnet_input_dim = nnet_.InputDim("input"),
+      nnet_ivector_dim = std::max<int32>(0, nnet_.InputDim("ivector"));
+  if (feature_dim != nnet_input_dim)
+    KALDI_ERR << "Neural net expects 'input' features with dimension "
+              << nnet_input_dim << " but you provided "
+              << feature_dim;
+  if (ivector_dim != nnet_ivector_dim)
+    KALDI_ERR << "Neural net expects 'ivector' features with dimension "
+              << nnet_ivector_dim << " but you provided " << ivector_dim;
+}
+
+
+void NnetBatchComputer::GetChunkContext(bool is_first, bool is_last,
+                                        int32 *left_context,
+                                        int32 *right_context) const {
+  int32 extra_left_context = opts_.extra_left_context,
+      extra_right_context = opts_.extra_right_context;
+  if (is_first && opts_.extra_left_context_initial >= 0)
+    extra_left_context = opts_.extra_left_context_initial;
+  if (is_last && opts_.extra_right_context_final >= 0)
+    extra_right_context = opts_.extra_right_context_final;
+  *left_context = nnet_left_context_ + extra_left_context;
+  *right_context = nnet_right_context_ + extra_right_context;
+}
+
+
+void NnetBatchComputer::GetLoopedContext(int32 *left_context,
+                                         int32 *right_context) const {
+  *left_context = nnet_left_context_ +
+      std::max<int32>(0, opts_.extra_left_context_initial);
+  *right_context = nnet_right_context_;
+}
+
+
+void NnetBatchComputer::SplitUtteranceIntoTasks(
+    const MatrixBase<BaseFloat> &input,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period,
+    std::vector<NnetInferenceTask*> *tasks) const {
+  KALDI_ASSERT(!(ivector != NULL && online_ivectors != NULL));
+  KALDI_ASSERT(!(online_ivectors != NULL && online_ivector_period <= 0 &&
+                 "You need to set the --online-ivector-period option!"));
+  int32 feature_dim = input.NumCols(),
+      ivector_dim = (ivector != NULL ? ivector->Dim() :
+                     (online_ivectors != NULL ? online_ivectors->NumCols() : 0));
+  CheckInputDims(feature_dim, ivector_dim);
+
+  int32 num_frames = input.NumRows(),
+      subsampling_factor = opts_.frame_subsampling_factor,
+      num_subsampled_frames = (num_frames + subsampling_factor - 1) /
+                               subsampling_factor,
+      subsampled_frames_per_chunk = SubsampledFramesPerChunk(),
+      num_tasks = (num_subsampled_frames + subsampled_frames_per_chunk - 1) /
+                   subsampled_frames_per_chunk;
+  KALDI_ASSERT(num_frames > 0);
+
+  tasks->resize(num_tasks);
+  for (int32 i = 0; i < num_tasks; i++) {
+    int32 first_output_frame, num_output_frames;
+    if (num_subsampled_frames <= subsampled_frames_per_chunk) {
+      first_output_frame = 0;
+      num_output_frames = num_subsampled_frames;
+    } else {
+      // Shift the last chunk back so that all chunks have the same size.
+      first_output_frame = std::min<int32>(
+          i * subsampled_frames_per_chunk,
+          num_subsampled_frames - subsampled_frames_per_chunk);
+      num_output_frames = subsampled_frames_per_chunk;
+    }
+    bool is_first = (first_output_frame == 0),
+        is_last = (first_output_frame + num_output_frames ==
+                   num_subsampled_frames);
+    int32 left_context, right_context;
+    GetChunkContext(is_first, is_last, &left_context, &right_context);
+
+    // The 't' values here are relative to the first output frame of the
+    // chunk, which makes the computations of different chunks identical.
+    int32 first_input_t = -left_context,
+        last_input_t = (num_output_frames - 1) * subsampling_factor +
+                        right_context,
+        num_input_frames = last_input_t + 1 - first_input_t,
+        first_input_frame = first_output_frame * subsampling_factor +
+                            first_input_t;
+
+    NnetInferenceTask *task = new NnetInferenceTask();
+    task->input.Resize(num_input_frames, feature_dim, kUndefined);
+    for (int32 r = 0; r < num_input_frames; r++) {
+      int32 t = r + first_input_frame;
+      if (t < 0) t = 0;
+      if (t >= num_frames) t = num_frames - 1;
+      task->input.Row(r).CopyFromVec(input.Row(t));
+    }
+    task->first_input_t = first_input_t;
+    task->num_output_frames = num_output_frames;
+    task->first_output_frame = first_output_frame;
+    GetCurrentIvector(ivector, online_ivectors, online_ivector_period,
+                      first_output_frame * subsampling_factor,
+                      (num_output_frames - 1) * subsampling_factor,
+                      &(task->ivector));
+    (*tasks)[i] = task;
+  }
+}
+
+
+void NnetBatchComputer::AcceptTask(NnetInferenceTask *task) {
+  TaskSignature sig;
+  sig.num_input_frames = task->input.NumRows();
+  sig.first_input_t = task->first_input_t;
+  sig.num_output_frames = task->num_output_frames;
+  sig.has_ivector = (task->ivector.Dim() != 0);
+  sig.looped_program_counter = (task->is_looped ?
+                                task->looped_program_counter : -1);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    KALDI_ASSERT(!is_shutting_down_);
+    QueueElement elem;
+    elem.seq = num_tasks_accepted_++;
+    elem.arrival_time = timer_.Elapsed();
+    elem.task = task;
+    queues_[sig].push_back(elem);
+  }
+  condition_variable_.notify_one();
+}
+
+
+void NnetBatchComputer::WaitForTask(NnetInferenceTask *task) {
+  // If the task is already done, don't disturb the computation thread; it
+  // might otherwise decide to compute a partial minibatch.
+  if (task->semaphore.TryWait())
+    return;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_waiting_++;
+  }
+  condition_variable_.notify_one();
+  task->semaphore.Wait();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    num_waiting_--;
+  }
+}
+
+
+NnetBatchComputer::TaskQueue* NnetBatchComputer::ChooseQueue(
+    TaskSignature *sig, double *wait_seconds) {
+  *wait_seconds = -1.0;
+  // First preference: a full minibatch, choosing the queue with the oldest
+  // task.
+  std::map<TaskSignature, TaskQueue>::iterator iter = queues_.begin(),
+      end = queues_.end(), best_iter = end;
+  for (; iter != end; ++iter) {
+    if (iter->second.size() >= static_cast<size_t>(opts_.minibatch_size) &&
+        (best_iter == end ||
+         iter->second.front().seq < best_iter->second.front().seq))
+      best_iter = iter;
+  }
+  // Second preference, if --max-wait-ms >= 0: the queue whose oldest task has
+  // passed its deadline, if any (and the oldest such task).  Otherwise work
+  // out how long the background thread may sleep.
+  if (best_iter == end && opts_.max_wait_ms >= 0) {
+    double now = timer_.Elapsed(), max_wait = opts_.max_wait_ms / 1000.0,
+        min_remaining = std::numeric_limits<double>::infinity();
+    for (iter = queues_.begin(); iter != end; ++iter) {
+      double remaining = iter->second.front().arrival_time + max_wait - now;
+      if (remaining <= 0.0) {
+        if (best_iter == end ||
+            iter->second.front().seq < best_iter->second.front().seq)
+          best_iter = iter;
+      } else {
+        min_remaining = std::min(min_remaining, remaining);
+      }
+    }
+    if (best_iter == end && !queues_.empty())
+      *wait_seconds = min_remaining;
+  }
+  // Last preference, only if someone is waiting (or we are flushing the
+  // queues before exiting): the largest partial minibatch.
+  if (best_iter == end && (num_waiting_ > 0 || is_shutting_down_)) {
+    for (iter = queues_.begin(); iter != end; ++iter) {
+      if (best_iter == end ||
+          iter->second.size() > best_iter->second.size())
+        best_iter = iter;
+    }
+  }
+  if (best_iter == end)
+    return NULL;
+  *sig = best_iter->first;
+  return &(best_iter->second);
+}
+
+
+int32 NnetBatchComputer::GetActualMinibatchSize(int32 num_tasks) const {
+  KALDI_ASSERT(num_tasks > 0 && num_tasks <= opts_.minibatch_size);
+  int32 ans = 1;
+  while (ans < num_tasks)
+    ans *= 2;
+  return std::min<int32>(ans, opts_.minibatch_size);
+}
+
+
+void NnetBatchComputer::ComputeLoop() {
+  while (true) {
+    TaskSignature sig;
+    std::vector<NnetInferenceTask*> tasks;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      TaskQueue *queue;
+      double wait_seconds;
+      while ((queue = ChooseQueue(&sig, &wait_seconds)) == NULL) {
+        if (is_shutting_down_ && queues_.empty())
+          return;
+        if (wait_seconds >= 0.0)
+          condition_variable_.wait_for(
+              lock, std::chrono::duration<double>(wait_seconds));
+        else
+          condition_variable_.wait(lock);
+      }
+      while (!queue->empty() &&
+             tasks.size() < static_cast<size_t>(opts_.minibatch_size)) {
+        tasks.push_back(queue->front().task);
+        queue->pop_front();
+      }
+      if (queue->empty())
+        queues_.erase(sig);
+    }
+    DoComputation(sig, tasks);
+  }
+}
+
+
+void NnetBatchComputer::DoComputation(
+    const TaskSignature &sig,
+    const std::vector<NnetInferenceTask*> &tasks) {
+  if (sig.looped_program_counter >= 0) {
+    DoLoopedComputation(sig, tasks);
+    return;
+  }
+  Timer timer;
+  int32 num_tasks = tasks.size(),
+      minibatch_size = GetActualMinibatchSize(num_tasks),
+      num_input_frames = sig.num_input_frames,
+      num_output_frames = sig.num_output_frames,
+      subsampling_factor = opts_.frame_subsampling_factor;
+
+  ComputationRequest request;
+  request.need_model_derivative = false;
+  request.store_component_stats = false;
+  request.inputs.resize(sig.has_ivector ? 2 : 1);
+  IoSpecification &input_spec = request.inputs[0];
+  input_spec.name = "input";
+  input_spec.indexes.resize(minibatch_size * num_input_frames);
+  for (int32 n = 0; n < minibatch_size; n++)
+    for (int32 i = 0; i < num_input_frames; i++)
+      input_spec.indexes[n * num_input_frames + i] =
+          Index(n, sig.first_input_t + i, 0);
+  if (sig.has_ivector) {
+    IoSpecification &ivector_spec = request.inputs[1];
+    ivector_spec.name = "ivector";
+    ivector_spec.indexes.resize(minibatch_size);
+    for (int32 n = 0; n < minibatch_size; n++)
+      ivector_spec.indexes[n] = Index(n, 0, 0);
+  }
+  request.outputs.resize(1);
+  IoSpecification &output_spec = request.outputs[0];
+  output_spec.name = "output";
+  output_spec.indexes.resize(minibatch_size * num_output_frames);
+  for (int32 n = 0; n < minibatch_size; n++)
+    for (int32 i = 0; i < num_output_frames; i++)
+      output_spec.indexes[n * num_output_frames + i] =
+          Index(n, i * subsampling_factor, 0);
+
+  std::shared_ptr<const NnetComputation> computation =
+      compiler_.Compile(request);
+  Nnet *nnet_to_update = NULL;  // we're not doing any update.
+  NnetComputer computer(opts_.compute_config, *computation,
+                        nnet_, nnet_to_update);
+
+  // If we padded the minibatch, the padding sequences are copies of the last
+  // task; their output is discarded.
+  CuMatrix<BaseFloat> input(minibatch_size * num_input_frames,
+                            tasks[0]->input.NumCols(), kUndefined);
+  for (int32 n = 0; n < minibatch_size; n++) {
+    const NnetInferenceTask *task = tasks[std::min<int32>(n, num_tasks - 1)];
+    input.RowRange(n * num_input_frames,
+                   num_input_frames).CopyFromMat(task->input);
+  }
+  computer.AcceptInput("input", &input);
+  if (sig.has_ivector) {
+    CuMatrix<BaseFloat> ivectors(minibatch_size, tasks[0]->ivector.Dim(),
+                                 kUndefined);
+    for (int32 n = 0; n < minibatch_size; n++) {
+      const NnetInferenceTask *task = tasks[std::min<int32>(n, num_tasks - 1)];
+      ivectors.Row(n).CopyFromVec(task->ivector);
+    }
+    computer.AcceptInput("ivector", &ivectors);
+  }
+  computer.Run();
+  CuMatrix<BaseFloat> cu_output;
+  computer.GetOutputDestructive("output", &cu_output);
+  // subtract log-prior (divide by prior)
+  if (log_priors_.Dim() != 0)
+    cu_output.AddVecToRows(-1.0, log_priors_);
+  // apply the acoustic scale
+  cu_output.Scale(opts_.acoustic_scale);
+
+  for (int32 n = 0; n < num_tasks; n++) {
+    NnetInferenceTask *task = tasks[n];
+    task->output.Resize(num_output_frames, cu_output.NumCols(), kUndefined);
+    cu_output.RowRange(n * num_output_frames,
+                       num_output_frames).CopyToMat(&(task->output));
+    task->semaphore.Signal();
+  }
+  num_minibatches_++;
+  num_tasks_computed_ += num_tasks;
+  num_padding_tasks_ += minibatch_size - num_tasks;
+  compute_seconds_ += timer.Elapsed();
+}
+
+
+NnetBatchComputer::LoopedComputation*
+NnetBatchComputer::GetLoopedComputation() {
+  if (looped_ != NULL)
+    return looped_;
+  // As in DecodableNnetSimpleLoopedInfo, the iVector period is the chunk size.
+  int32 ivector_period = opts_.frames_per_chunk;
+  if (nnet_.InputDim("ivector") > 0) {
+    Nnet *nnet = new Nnet(nnet_);
+    ModifyNnetIvectorPeriod(ivector_period, nnet);
+    looped_nnet_ = nnet;
+  } else {
+    looped_nnet_ = &nnet_;
+  }
+  int32 left_context, right_context;
+  GetLoopedContext(&left_context, &right_context);
+  looped_ = new LoopedComputation();
+  ComputationRequest request3;
+  CreateLoopedComputationRequest(*looped_nnet_, opts_.frames_per_chunk,
+                                 opts_.frame_subsampling_factor,
+                                 ivector_period, left_context, right_context,
+                                 opts_.minibatch_size, &(looped_->request1),
+                                 &(looped_->request2), &request3);
+  // We assume that all chunks after the first one have the same number of
+  // inputs, which holds since the iVector period is the chunk size.
+  KALDI_ASSERT(looped_->request2.inputs.size() == request3.inputs.size());
+  for (size_t i = 0; i < request3.inputs.size(); i++)
+    KALDI_ASSERT(looped_->request2.inputs[i].indexes.size() ==
+                 request3.inputs[i].indexes.size());
+  // CreateLoopedComputationRequest() orders the indexes with 'n' varying
+  // slowest, but NnetComputer::GetSequenceStates() needs it to vary fastest
+  // in every matrix, including the inputs and outputs, so we sort them.
+  ComputationRequest *requests[3] = { &(looped_->request1),
+                                      &(looped_->request2), &request3 };
+  for (int32 r = 0; r < 3; r++) {
+    for (size_t i = 0; i < requests[r]->inputs.size(); i++)
+      std::sort(requests[r]->inputs[i].indexes.begin(),
+                requests[r]->inputs[i].indexes.end());
+    for (size_t i = 0; i < requests[r]->outputs.size(); i++)
+      std::sort(requests[r]->outputs[i].indexes.begin(),
+                requests[r]->outputs[i].indexes.end());
+  }
+  CompileLooped(*looped_nnet_, opts_.optimize_config, looped_->request1,
+                looped_->request2, request3, &(looped_->computation));
+  looped_->computation.ComputeCudaIndexes();
+  looped_->computers[0] = new NnetComputer(opts_.compute_config,
+                                           looped_->computation,
+                                           *looped_nnet_, NULL);
+  return looped_;
+}
+
+
+void NnetBatchComputer::DoLoopedComputation(
+    const TaskSignature &sig,
+    const std::vector<NnetInferenceTask*> &tasks) {
+  Timer timer;
+  LoopedComputation *looped = GetLoopedComputation();
+  int32 num_tasks = tasks.size(),
+      minibatch_size = opts_.minibatch_size,
+      program_counter = sig.looped_program_counter,
+      num_input_frames = sig.num_input_frames,
+      num_output_frames = sig.num_output_frames;
+  const ComputationRequest &request = (program_counter == 0 ?
+                                       looped->request1 : looped->request2);
+  KALDI_ASSERT(static_cast<int32>(request.inputs[0].indexes.size()) ==
+               minibatch_size * num_input_frames &&
+               static_cast<int32>(request.outputs[0].indexes.size()) ==
+               minibatch_size * num_output_frames &&
+               sig.has_ivector == (request.inputs.size() == 2));
+
+  KALDI_ASSERT(looped->computers.count(program_counter) != 0);
+  NnetComputer *computer = looped->computers[program_counter];
+  bool in_place = (looped->steady.count(program_counter) != 0);
+  if (!in_place)
+    computer = new NnetComputer(*computer);
+
+  // As in DoComputation(), the padding sequences are copies of the last task.
+  // The rows of the inputs and output are ordered with the sequence index
+  // varying fastest (see GetLoopedComputation()).
+  if (program_counter != 0) {
+    CuMatrix<BaseFloat> states(minibatch_size,
+                               computer->SequenceStateDim(minibatch_size),
+                               kUndefined);
+    for (int32 n = 0; n < minibatch_size; n++) {
+      const NnetInferenceTask *task = tasks[std::min<int32>(n, num_tasks - 1)];
+      KALDI_ASSERT(task->looped_state.Dim() == states.NumCols());
+      states.Row(n).CopyFromVec(task->looped_state);
+    }
+    computer->SetSequenceStates(states);
+  }
+  Matrix<BaseFloat> input(minibatch_size * num_input_frames,
+                         tasks[0]->input.NumCols(), kUndefined);
+  for (int32 n = 0; n < minibatch_size; n++) {
+    const NnetInferenceTask *task = tasks[std::min<int32>(n, num_tasks - 1)];
+    for (int32 i = 0; i < num_input_frames; i++)
+      input.Row(i * minibatch_size + n).CopyFromVec(task->input.Row(i));
+  }
+  CuMatrix<BaseFloat> cu_input;
+  cu_input.Swap(&input);
+  computer->AcceptInput("input", &cu_input);
+  if (sig.has_ivector) {
+    // As in DecodableNnetLoopedOnlineBase::AdvanceChunk(), we give the same
+    // iVector for all the 't' values for which the chunk needs one.
+    int32 ivectors_per_sequence = request.inputs[1].indexes.size() /
+        minibatch_size;
+    Matrix<BaseFloat> ivectors(minibatch_size * ivectors_per_sequence,
+                               tasks[0]->ivector.Dim(), kUndefined);
+    for (int32 n = 0; n < minibatch_size; n++) {
+      const NnetInferenceTask *task = tasks[std::min<int32>(n, num_tasks - 1)];
+      for (int32 i = 0; i < ivectors_per_sequence; i++)
+        ivectors.Row(i * minibatch_size + n).CopyFromVec(task->ivector);
+    }
+    CuMatrix<BaseFloat> cu_ivectors;
+    cu_ivectors.Swap(&ivectors);
+    computer->AcceptInput("ivector", &cu_ivectors);
+  }
+  computer->Run();
+  // We use GetOutput() rather than GetOutputDestructive() because the
+  // computer may be run again.
+  CuMatrix<BaseFloat> cu_output(computer->GetOutput("output"));
+  if (log_priors_.Dim() != 0)
+    cu_output.AddVecToRows(-1.0, log_priors_);
+  cu_output.Scale(opts_.acoustic_scale);
+  int32 next_program_counter = computer->ProgramCounter();
+  CuMatrix<BaseFloat> states(minibatch_size,
+                             computer->SequenceStateDim(minibatch_size),
+                             kUndefined);
+  computer->GetSequenceStates(&states);
+  if (!in_place) {
+    // Once we reach the loop of the computation, the computer returns to the
+    // same program counter and from then on we can run it in place.
+    if (next_program_counter == program_counter)
+      looped->steady.insert(program_counter);
+    if (looped->computers.count(next_program_counter) == 0)
+      looped->computers[next_program_counter] = computer;
+    else
+      delete computer;
+  }
+
+  Matrix<BaseFloat> output(cu_output.NumRows(), cu_output.NumCols(),
+                          kUndefined);
+  cu_output.CopyToMat(&output);
+  for (int32 n = 0; n < num_tasks; n++) {
+    NnetInferenceTask *task = tasks[n];
+    task->output.Resize(num_output_frames, output.NumCols(), kUndefined);
+    for (int32 i = 0; i < num_output_frames; i++)
+      task->output.Row(i).CopyFromVec(output.Row(i * minibatch_size + n));
+    task->looped_program_counter = next_program_counter;
+    task->looped_state.Resize(states.NumCols(), kUndefined);
+    states.Row(n).CopyToVec(&(task->looped_state));
+    task->semaphore.Signal();
+  }
+  num_minibatches_++;
+  num_tasks_computed_ += num_tasks;
+  num_padding_tasks_ += minibatch_size - num_tasks;
+  compute_seconds_ += timer.Elapsed();
+}
+
+
+NnetBatchComputer::~NnetBatchComputer() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    is_shutting_down_ = true;
+  }
+  condition_variable_.notify_one();
+  compute_thread_.join();
+  if (looped_ != NULL) {
+    std::map<int32, NnetComputer*>::iterator iter =
+        looped_->computers.begin();
+    for (; iter != looped_->computers.end(); ++iter)
+      delete iter->second;
+    delete looped_;
+  }
+  if (looped_nnet_ != &nnet_)
+    delete looped_nnet_;
+  if (num_minibatches_ > 0) {
+    KALDI_LOG << "Computed " << num_tasks_computed_ << " chunks in "
+              << num_minibatches_ << " minibatches (average minibatch size "
+              << (num_tasks_computed_ / static_cast<double>(num_minibatches_))
+              << ", plus " << num_padding_tasks_ << " padding chunks in "
+              << "total); nnet computation took " << compute_seconds_
+              << " seconds.";
+  }
+}
+
+
+DecodableAmNnetBatch::DecodableAmNnetBatch(
+    NnetBatchComputer *computer,
+    const TransitionModel &trans_model,
+    const MatrixBase<BaseFloat> &feats,
+    const VectorBase<BaseFloat> *ivector,
+    const MatrixBase<BaseFloat> *online_ivectors,
+    int32 online_ivector_period):
+    computer_(computer),
+    trans_model_(trans_model),
+    subsampled_frames_per_chunk_(computer->SubsampledFramesPerChunk()),
+    current_output_(NULL),
+    current_offset_(0),
+    current_num_frames_(0) {
+  int32 subsampling_factor = computer->GetOptions().frame_subsampling_factor;
+  num_frames_ = (feats.NumRows() + subsampling_factor - 1) /
+      subsampling_factor;
+  computer_->SplitUtteranceIntoTasks(feats, ivector, online_ivectors,
+                                     online_ivector_period, &tasks_);
+  task_done_.resize(tasks_.size(), false);
+  for (size_t i = 0; i < tasks_.size(); i++)
+    computer_->AcceptTask(tasks_[i]);
+}
+
+
+void DecodableAmNnetBatch::SetCurrentTask(int32 task_index) {
+  NnetInferenceTask *task = tasks_[task_index];
+  if (!task_done_[task_index]) {
+    computer_->WaitForTask(task);
+    task_done_[task_index] = true;
+  }
+  current_output_ = &(task->output);
+  current_offset_ = task->first_output_frame;
+  current_num_frames_ = task->num_output_frames;
+}
+
+
+BaseFloat DecodableAmNnetBatch::LogLikelihood(int32 frame,
+                                              int32 transition_id) {
+  if (frame < current_offset_ ||
+      frame >= current_offset_ + current_num_frames_) {
+    KALDI_ASSERT(frame >= 0 && frame < num_frames_);
+    SetCurrentTask(std::min<int32>(frame / subsampled_frames_per_chunk_,
+                                   tasks_.size() - 1));
+  }
+  int32 pdf_id = trans_model_.TransitionIdToPdf(transition_id);
+  return (*current_output_)(frame - current_offset_, pdf_id);
+}
+
+
+DecodableAmNnetBatch::~DecodableAmNnetBatch() {
+  for (size_t i = 0; i < tasks_.size(); i++) {
+    if (!task_done_[i])
+      computer_->WaitForTask(tasks_[i]);
+    delete tasks_[i];
+  }
+}
+
+
+
+DecodableAmNnetBatchOnline::DecodableAmNnetBatchOnline(
+    NnetBatchComputer *computer,
+    const TransitionModel &trans_model,
+    OnlineFeatureInterface *input_features,
+    OnlineFeatureInterface *ivector_features):
+    computer_(computer),
+    trans_model_(trans_model),
+    input_features_(input_features),
+    ivector_features_(ivector_features),
+    task_pending_(false),
+    num_chunks_submitted_(0),
+    num_frames_ready_(0),
+    num_subsampled_frames_(-1) {
+  computer_->CheckInputDims(input_features->Dim(),
+                            ivector_features != NULL ?
+                            ivector_features->Dim() : 0);
+}
+
+
+bool DecodableAmNnetBatchOnline::SubmitChunk() {
+  KALDI_ASSERT(!task_pending_);
+  int32 chunk_index = num_chunks_submitted_,
+      frames_per_chunk = computer_->GetOptions().frames_per_chunk,
+      subsampled_frames_per_chunk = computer_->SubsampledFramesPerChunk(),
+      first_output_frame = chunk_index * subsampled_frames_per_chunk;
+  if (num_subsampled_frames_ >= 0 &&
+      first_output_frame >= num_subsampled_frames_)
+    return false;  // The utterance is done.
+
+  // See DecodableNnetLoopedOnlineBase::AdvanceChunk().  Note: 'end' means
+  // one past the last.
+  int32 left_context, right_context;
+  computer_->GetLoopedContext(&left_context, &right_context);
+  int32 begin_input_frame, end_input_frame;
+  if (chunk_index == 0) {
+    begin_input_frame = -left_context;
+    end_input_frame = frames_per_chunk + right_context;
+  } else {
+    begin_input_frame = chunk_index * frames_per_chunk + right_context;
+    end_input_frame = begin_input_frame + frames_per_chunk;
+  }
+  int32 num_feature_frames = input_features_->NumFramesReady();
+  if (end_input_frame > num_feature_frames && num_subsampled_frames_ < 0)
+    return false;  // Wait for more input.
+
+  NnetInferenceTask *task = new NnetInferenceTask();
+  task->input.Resize(end_input_frame - begin_input_frame,
+                     input_features_->Dim(), kUndefined);
+  for (int32 t = begin_input_frame; t < end_input_frame; t++) {
+    // At the end of the input we pad with copies of the last frame, to flush
+    // out the last of the output.
+    int32 input_frame = std::max<int32>(
+        0, std::min<int32>(t, num_feature_frames - 1));
+    SubVector<BaseFloat> row(task->input, t - begin_input_frame);
+    input_features_->GetFrame(input_frame, &row);
+  }
+  task->first_input_t = begin_input_frame - chunk_index * frames_per_chunk;
+  task->num_output_frames = subsampled_frames_per_chunk;
+  task->first_output_frame = first_output_frame;
+  task->is_looped = true;
+  if (chunk_index > 0) {
+    task->looped_program_counter = tasks_.back()->looped_program_counter;
+    task->looped_state.Swap(&(tasks_.back()->looped_state));
+  }
+  if (ivector_features_ != NULL) {
+    // As in DecodableNnetLoopedOnlineBase::AdvanceChunk(), we use the most
+    // recent iVector that is available, but not one from the future.
+    task->ivector.Resize(ivector_features_->Dim());
+    int32 ivector_frame = std::min<int32>(
+        num_feature_frames - 1, ivector_features_->NumFramesReady() - 1);
+    if (ivector_frame >= 0)
+      ivector_features_->GetFrame(ivector_frame, &(task->ivector));
+  }
+  computer_->AcceptTask(task);
+  tasks_.push_back(task);
+  task_pending_ = true;
+  num_chunks_submitted_++;
+  return true;
+}
+
+
+void DecodableAmNnetBatchOnline::TaskDone() {
+  const NnetInferenceTask *task = tasks_.back();
+  num_frames_ready_ = task->first_output_frame + task->num_output_frames;
+  task_pending_ = false;
+}
+
+
+void DecodableAmNnetBatchOnline::AdvanceChunks() {
+  if (num_subsampled_frames_ < 0) {
+    int32 num_feature_frames = input_features_->NumFramesReady();
+    if (num_feature_frames > 0 &&
+        input_features_->IsLastFrame(num_feature_frames - 1)) {
+      int32 subsampling_factor = FrameSubsamplingFactor();
+      num_subsampled_frames_ = (num_feature_frames + subsampling_factor - 1) /
+          subsampling_factor;
+    }
+  }
+  while (true) {
+    if (task_pending_) {
+      if (!computer_->TryWaitForTask(tasks_.back()))
+        return;
+      TaskDone();
+    }
+    if (!SubmitChunk())
+      return;
+  }
+}
+
+
+void DecodableAmNnetBatchOnline::WaitForAllOutput() {
+  AdvanceChunks();
+  if (!InputFinished())
+    return;
+  while (task_pending_) {
+    computer_->WaitForTask(tasks_.back());
+    TaskDone();
+    AdvanceChunks();
+  }
+}
+
+
+BaseFloat DecodableAmNnetBatchOnline::LogLikelihood(int32 subsampled_frame,
+                                                    int32 transition_id) {
+  KALDI_ASSERT(subsampled_frame < num_frames_ready_);
+  // Discard chunks that end before this frame; they have all been waited
+  // for, and they are not the last chunk, which holds the state.
+  while (tasks_.front()->first_output_frame +
+         tasks_.front()->num_output_frames <= subsampled_frame) {
+    delete tasks_.front();
+    tasks_.pop_front();
+  }
+  const NnetInferenceTask *task = tasks_.front();
+  KALDI_ASSERT(subsampled_frame >= task->first_output_frame &&
+               "Frames must be accessed in order.");
+  int32 pdf_id = trans_model_.TransitionIdToPdf(transition_id);
+  return task->output(subsampled_frame - task->first_output_frame, pdf_id);
+}
+
+
+DecodableAmNnetBatchOnline::~DecodableAmNnetBatchOnline() {
+  if (task_pending_)
+    computer_->WaitForTask(tasks_.back());
+  for (size_t i = 0; i < tasks_.size(); i++)
+    delete tasks_[i];
+}
+
+
+} // namespace nnet3
+} // namespace kaldi
@@ -0,0 +1,542 @@
+// nnet3/nnet-batch-compute.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+#define KALDI_NNET3_NNET_BATCH_COMPUTE_H_
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "base/kaldi-common.h"
+#include "base/timer.h"
+#include "hmm/transition-model.h"
+#include "itf/decodable-itf.h"
+#include "itf/online-feature-itf.h"
+#include "nnet3/nnet-optimize.h"
+#include "nnet3/nnet-compute.h"
+#include "nnet3/am-nnet-simple.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "util/kaldi-semaphore.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+
+/**
+   This file contains code for doing neural net inference for many utterances
+   at once, in batches.  The situation it is intended for is multi-threaded
+   decoding (e.g. nnet3-latgen-faster-batch), where, with the per-utterance
+   decodable objects in nnet-am-decodable-simple.h, each thread does its own
+   small neural net computation; here, the decoding threads instead put
+   fixed-size chunks of their utterances ("tasks") into a queue shared by all
+   of them, and a single computation thread groups compatible tasks from
+   different utterances into large minibatches and runs them with one
+   NnetComputer, which makes for much more efficient matrix multiplies.
+*/
+
+
+struct NnetBatchComputerOptions: public NnetSimpleComputationOptions {
+  int32 minibatch_size;
+  int32 max_wait_ms;
+
+  NnetBatchComputerOptions(): minibatch_size(128), max_wait_ms(20) { }
+
+  void Register(OptionsItf *opts) {
+    NnetSimpleComputationOptions::Register(opts);
+    opts->Register("minibatch-size", &minibatch_size, "Maximum number of "
+                   "chunks (of size --frames-per-chunk, typically from "
+                   "different utterances) that are evaluated together in one "
+                   "neural net computation.");
+    opts->Register("max-wait-ms", &max_wait_ms, "If >= 0, the maximum time "
+                   "in milliseconds that a chunk may wait in the queue for a "
+                   "full minibatch to be formed before a partial minibatch is "
+                   "computed.  This bounds the latency in online decoding; "
+                   "if < 0, partial minibatches are computed only when "
+                   "some user is blocked waiting for the output.");
+  }
+};
+
+
+/**
+   class NnetInferenceTask represents a chunk of an utterance that is requested
+   to be computed.  This will be given to NnetBatchComputer, which will
+   aggregate the tasks and compute them in batches.
+ */
+struct NnetInferenceTask {
+  // The input frames, which are treated as being numbered t=0, t=1, etc.
+  // (If the first frame of input is at t < 0, 'first_input_t' says so).
+  Matrix<BaseFloat> input;
+
+  // The 't' value corresponding to the first row of 'input'; this will be
+  // minus the left-context of this chunk.  The output for t=0 corresponds to
+  // the first row of 'output'.
+  int32 first_input_t;
+
+  // The number of output frames computed for this task; the output t values
+  // are 0, frame_subsampling_factor, 2 * frame_subsampling_factor, ...
+  int32 num_output_frames;
+
+  // The index, in the (subsampled) frames of the whole utterance, of the
+  // first row of 'output'.
+  int32 first_output_frame;
+
+  // The iVector for this chunk, if the neural net takes iVectors; else empty.
+  Vector<BaseFloat> ivector;
+
+  // The output of the neural net, of dimension num_output_frames by the
+  // output dimension; priors have been subtracted and the acoustic scale
+  // applied.  Only valid after the computation is done (see 'semaphore').
+  Matrix<BaseFloat> output;
+
+  // If true, this task is a chunk of a stream that is computed with looped
+  // computation (see nnet-compile-looped.h); the input is then as for
+  // DecodableNnetLoopedOnline, i.e. the first chunk has the left and right
+  // context and the others have just the new frames.  If false, the task is
+  // computed from scratch with its own left and right context.
+  bool is_looped;
+
+  // For looped tasks: the program counter of the stream's computation after
+  // the previous chunk, and its state (see NnetComputer::GetSequenceStates()),
+  // which are 0 and empty for the first chunk.  After the computation, they
+  // describe the state after this chunk, and should be moved to the next
+  // chunk.
+  int32 looped_program_counter;
+  Vector<BaseFloat> looped_state;
+
+  // The computation thread signals this semaphore when 'output' has been
+  // set.  Users should not wait on it directly but via
+  // NnetBatchComputer::WaitForTask().
+  Semaphore semaphore;
+
+  NnetInferenceTask(): first_input_t(0), num_output_frames(0),
+                       first_output_frame(0), is_looped(false),
+                       looped_program_counter(0) { }
+};
+
+
+/**
+   NnetBatchComputer accepts NnetInferenceTasks from (possibly) multiple
+   threads, and computes them in a background thread.  Tasks that have the
+   same structure (the same number of input and output frames, the same
+   left-context, and the same presence or absence of iVectors) are merged into
+   a single minibatch.  Computations are compiled with a
+   CachingOptimizingCompiler that is only accessed from the background thread,
+   so no locking is needed for it.
+
+   The background thread computes a minibatch whenever enough tasks of one
+   structure have arrived to fill it; it computes partial minibatches only when
+   some user is blocked in WaitForTask() and there is no full minibatch to
+   compute, or (if --max-wait-ms >= 0) when the oldest task has been waiting
+   for longer than that.  Partial minibatches are padded up to a power of two (or to
+   --minibatch-size), which bounds the number of distinct computations we
+   need to compile.
+
+   Looped tasks (see NnetInferenceTask::is_looped) are computed with a looped
+   computation for --minibatch-size sequences.  Between chunks, the state of
+   each stream is stored in its task (see NnetComputer::GetSequenceStates()),
+   so that chunks from any streams that are at the same point of the
+   computation can share a minibatch.  The layout of the state depends on the
+   number of sequences, so looped minibatches are always padded to
+   --minibatch-size; for online decoding, set it to about the number of
+   concurrent streams.
+ */
+class NnetBatchComputer {
+ public:
+  /**
+     Constructor.  Starts the background computation thread.
+
+     @param [in] opts  Options struct; see its definition.  Its
+                       acoustic_scale is applied to the output.
+     @param [in] nnet  The neural net to compute with.  Must satisfy
+                       IsSimpleNnet(nnet).  It is retained as a reference.
+     @param [in] priors  Vector of priors-- if supplied and nonempty, we
+                       subtract the log of these priors from the nnet output.
+   */
+  NnetBatchComputer(const NnetBatchComputerOptions &opts,
+                    const Nnet &nnet,
+                    const VectorBase<BaseFloat> &priors);
+
+  /**
+     This splits a single utterance into a list of tasks, each covering a
+     chunk of --frames-per-chunk frames (before subsampling), with context
+     added as appropriate and the edges of the utterance padded by repeating
+     the first or last frame.  If the utterance is longer than one chunk, the
+     last chunk is shifted back so it ends at the end of the utterance and all
+     chunks are of the same size; this means the last chunk may overlap the
+     previous one.  The caller owns the newly allocated tasks.  The output
+     frame 'f' of the utterance is located in task
+     std::min<int32>(f / (frames_per_chunk / frame_subsampling_factor),
+                     tasks->size() - 1), at row f - task->first_output_frame.
+
+     The args 'ivector', 'online_ivectors' and 'online_ivector_period' have the
+     same meanings as for class DecodableNnetSimple.
+   */
+  void SplitUtteranceIntoTasks(
+      const MatrixBase<BaseFloat> &input,
+      const VectorBase<BaseFloat> *ivector,
+      const MatrixBase<BaseFloat> *online_ivectors,
+      int32 online_ivector_period,
+      std::vector<NnetInferenceTask*> *tasks) const;
+
+  /// Checks that the feature and iVector dimensions provided by the user match
+  /// what the neural net expects (ivector_dim should be 0 if there are no
+  /// iVectors); dies with an error if not.
+  void CheckInputDims(int32 feature_dim, int32 ivector_dim) const;
+
+  /// Outputs the total left and right context (including the extra context
+  /// from the options) required for a chunk; 'is_first' and 'is_last' say
+  /// whether the chunk is at the start or end of the utterance.  Chunks whose
+  /// first input frame is at t = -left_context relative to their first output
+  /// frame, with (num_output_frames - 1) * frame_subsampling_factor +
+  /// right_context + left_context + 1 input frames, are what the computation
+  /// expects.
+  void GetChunkContext(bool is_first, bool is_last,
+                       int32 *left_context, int32 *right_context) const;
+
+  /// Outputs the left and right context of the first chunk of a looped
+  /// computation, as DecodableNnetSimpleLoopedInfo does: the left context
+  /// includes --extra-left-context-initial, and there is no extra right
+  /// context.  The first chunk needs the input frames -left_context through
+  /// frames_per_chunk + right_context - 1; chunk c > 0 needs the
+  /// frames_per_chunk frames that start at c * frames_per_chunk +
+  /// right_context.
+  void GetLoopedContext(int32 *left_context, int32 *right_context) const;
+
+  /// Queues this task for computation; this may be called from any thread.
+  /// The task is retained as a pointer and must not be deleted until after
+  /// WaitForTask() has returned for it.
+  void AcceptTask(NnetInferenceTask *task);
+
+  /// Waits until the output of this task has been computed.  Must be called
+  /// exactly once for each task passed to AcceptTask().
+  void WaitForTask(NnetInferenceTask *task);
+
+  /// Returns true if the output of this task has been computed, without
+  /// blocking.  Once this has returned true for a task, the task counts as
+  /// having been waited for, and WaitForTask() must not be called for it.
+  /// This is for use in online decoding, where the caller wants to use
+  /// whatever output is ready without stalling.
+  bool TryWaitForTask(NnetInferenceTask *task) {
+    return task->semaphore.TryWait();
+  }
+
+  /// Returns the number of subsampled output frames per chunk.
+  int32 SubsampledFramesPerChunk() const {
+    return opts_.frames_per_chunk / opts_.frame_subsampling_factor;
+  }
+
+  int32 OutputDim() const { return output_dim_; }
+
+  const NnetBatchComputerOptions &GetOptions() const { return opts_; }
+
+  /// Stops the background thread (after it has computed any remaining tasks)
+  /// and prints some diagnostics.
+  ~NnetBatchComputer();
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(NnetBatchComputer);
+
+  // This struct identifies tasks that can be computed together.
+  struct TaskSignature {
+    int32 num_input_frames;
+    int32 first_input_t;
+    int32 num_output_frames;
+    bool has_ivector;
+    // -1 for tasks that are not looped; else the program counter of the
+    // looped computation that the task's state comes from.
+    int32 looped_program_counter;
+    bool operator < (const TaskSignature &other) const;
+  };
+
+  // The looped computation for --minibatch-size sequences.  request1 is
+  // for the first chunk of a stream and request2 for the others.  'computers'
+  // holds computers that are between calls to Run(), indexed by their program
+  // counter, which determines the layout of the states (the first few chunks
+  // of a looped computation are not part of the loop).  We run a copy of the
+  // computer, except for program counters in 'steady', for which the computer
+  // returns to the same program counter and can be run in place.
+  struct LoopedComputation {
+    ComputationRequest request1, request2;
+    NnetComputation computation;
+    std::map<int32, NnetComputer*> computers;
+    std::set<int32> steady;
+  };
+
+  // An element of a queue: the task, with a sequence number (smaller means
+  // older) used to prioritize the queues, and the time (in seconds, from
+  // timer_) at which it was accepted.
+  struct QueueElement {
+    int64 seq;
+    double arrival_time;
+    NnetInferenceTask *task;
+  };
+  // A queue of tasks that share a signature.
+  typedef std::deque<QueueElement> TaskQueue;
+
+  // Called from the constructor.  Checks and if necessary rounds
+  // frames_per_chunk, as DecodableNnetSimple does.
+  void CheckAndFixConfigs();
+
+  // The function run in the background thread.
+  void ComputeLoop();
+
+  // Chooses the queue to compute next, or returns NULL if there is nothing to
+  // compute right now.  In the latter case, if --max-wait-ms >= 0 and there
+  // are queued tasks, sets *wait_seconds to the time until the oldest of them
+  // reaches its deadline; otherwise sets it to -1.  Must be called with
+  // mutex_ locked.
+  TaskQueue *ChooseQueue(TaskSignature *sig, double *wait_seconds);
+
+  // Returns the number of sequences we will actually compute for a minibatch
+  // that contains 'num_tasks' real tasks (i.e. we pad partial minibatches).
+  int32 GetActualMinibatchSize(int32 num_tasks) const;
+
+  // Does the computation for these tasks, which all have the signature 'sig',
+  // and signals their semaphores.  Called without mutex_ locked.
+  void DoComputation(const TaskSignature &sig,
+                     const std::vector<NnetInferenceTask*> &tasks);
+
+  // Does the computation for looped tasks; called from DoComputation().
+  void DoLoopedComputation(const TaskSignature &sig,
+                           const std::vector<NnetInferenceTask*> &tasks);
+
+  // Returns looped_, compiling the looped computation if necessary.  Only
+  // called from the background thread.
+  LoopedComputation *GetLoopedComputation();
+
+  // Gets the iVector for a chunk, as DecodableNnetSimple::GetCurrentIvector().
+  void GetCurrentIvector(const VectorBase<BaseFloat> *ivector,
+                         const MatrixBase<BaseFloat> *online_ivectors,
+                         int32 online_ivector_period,
+                         int32 output_t_start, int32 num_output_frames,
+                         Vector<BaseFloat> *ivector_out) const;
+
+  NnetBatchComputerOptions opts_;
+  const Nnet &nnet_;
+  int32 nnet_left_context_;
+  int32 nnet_right_context_;
+  int32 output_dim_;
+  // the log priors (or the empty vector if the priors are not set in the model)
+  CuVector<BaseFloat> log_priors_;
+  // Only accessed from the background thread.
+  CachingOptimizingCompiler compiler_;
+  // The looped computation (NULL until we need it), and the neural net it
+  // uses: nnet_, or, if it takes iVectors, a copy of it modified by
+  // ModifyNnetIvectorPeriod() (which is owned by this class).  These are only
+  // accessed from the background thread.
+  LoopedComputation *looped_;
+  const Nnet *looped_nnet_;
+
+  // mutex_ protects the variables below it.
+  std::mutex mutex_;
+  // The background thread waits on this.  It is notified when a task is added,
+  // when someone starts waiting for a task, and when we are shutting down.
+  std::condition_variable condition_variable_;
+  std::map<TaskSignature, TaskQueue> queues_;
+  int64 num_tasks_accepted_;
+  // Used for the arrival times of tasks.
+  Timer timer_;
+  // The number of threads currently inside WaitForTask().
+  int32 num_waiting_;
+  bool is_shutting_down_;
+
+  // Diagnostics; only accessed from the background thread.
+  int64 num_minibatches_;
+  int64 num_tasks_computed_;
+  int64 num_padding_tasks_;
+  double compute_seconds_;
+
+  std::thread compute_thread_;
+};
+
+
+/**
+   This decodable object is for use in multi-threaded decoding where the
+   neural net computation is shared between threads via class
+   NnetBatchComputer.  Upon construction it splits the utterance into tasks and
+   gives them all to the NnetBatchComputer, so the computation can start
+   before the decoder needs the results; LogLikelihood() then waits for the
+   task containing the requested frame, if it is not already done.
+
+   Like DecodableAmNnetSimpleParallel, this object does not retain any
+   pointers to the features or iVectors, so the caller may delete them after
+   the constructor returns.
+ */
+class DecodableAmNnetBatch: public DecodableInterface {
+ public:
+  DecodableAmNnetBatch(NnetBatchComputer *computer,
+                       const TransitionModel &trans_model,
+                       const MatrixBase<BaseFloat> &feats,
+                       const VectorBase<BaseFloat> *ivector = NULL,
+                       const MatrixBase<BaseFloat> *online_ivectors = NULL,
+                       int32 online_ivector_period = 1);
+
+  virtual BaseFloat LogLikelihood(int32 frame, int32 transition_id);
+
+  virtual inline int32 NumFramesReady() const { return num_frames_; }
+
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  virtual bool IsLastFrame(int32 frame) const {
+    KALDI_ASSERT(frame < NumFramesReady());
+    return (frame == NumFramesReady() - 1);
+  }
+
+  // Waits for any tasks that have not been waited for yet, then deletes them.
+  ~DecodableAmNnetBatch();
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetBatch);
+
+  // Waits for task 'task_index' if we have not already done so, and sets
+  // current_output_ and current_offset_.
+  void SetCurrentTask(int32 task_index);
+
+  NnetBatchComputer *computer_;
+  const TransitionModel &trans_model_;
+  int32 num_frames_;
+  int32 subsampled_frames_per_chunk_;
+  std::vector<NnetInferenceTask*> tasks_;
+  // task_done_[i] is true if we have called WaitForTask() on tasks_[i].
+  std::vector<bool> task_done_;
+  // The output of the task we are currently reading from, and the first
+  // frame it covers, and the number of frames it covers.
+  const Matrix<BaseFloat> *current_output_;
+  int32 current_offset_;
+  int32 current_num_frames_;
+};
+
+
+/**
+   This is the online (streaming) counterpart of DecodableAmNnetBatch.  It is
+   intended for servers that decode many audio streams at once: each stream
+   has its own decodable object, and all of them share one NnetBatchComputer,
+   so that chunks from different streams are evaluated together in a single
+   minibatch.
+
+   As in DecodableNnetLoopedOnline, the chunks of a stream are computed with
+   looped computation, so the recurrent state is carried over from one chunk
+   to the next and each chunk needs just --frames-per-chunk new frames; the
+   state is kept in the tasks while they are queued (see
+   NnetInferenceTask::looped_state).  Since a chunk needs the state after the
+   previous one, a stream has at most one chunk in the NnetBatchComputer at a
+   time.  As features arrive, AdvanceChunks() gives the next chunk to the
+   NnetBatchComputer once its input is available and the previous chunk has
+   been computed; it never blocks, and NumFramesReady() reflects only the
+   output that has actually been computed.  The latency is controlled by
+   --frames-per-chunk and by the NnetBatchComputer's --minibatch-size and
+   --max-wait-ms options.
+
+   Frames must be accessed (via LogLikelihood()) in non-decreasing order; we
+   discard the output of chunks that have been passed.
+ */
+class DecodableAmNnetBatchOnline: public DecodableInterface {
+ public:
+  /**
+     Constructor.
+       @param [in] computer  The object that does the neural net computation;
+                         may be shared with other threads.
+       @param [in] trans_model  The transition model, used to map
+                         transition-ids to pdf-ids.
+       @param [in] input_features  The input features; must have the dimension
+                         the neural net expects for its "input".
+       @param [in] ivector_features  If non-NULL, the online iVectors.  As in
+                         DecodableNnetLoopedOnline, each chunk uses the
+                         most recent iVector that is available when we create
+                         the chunk.
+  */
+  DecodableAmNnetBatchOnline(NnetBatchComputer *computer,
+                             const TransitionModel &trans_model,
+                             OnlineFeatureInterface *input_features,
+                             OnlineFeatureInterface *ivector_features);
+
+  /// Collects the output of the chunk that is being computed, if it is done,
+  /// and submits the next chunk if its input features have arrived.  Does
+  /// not block.
+  void AdvanceChunks();
+
+  /// Returns true if AdvanceChunks() has seen the last frame of the input
+  /// features.
+  bool InputFinished() const { return num_subsampled_frames_ >= 0; }
+
+  /// Calls AdvanceChunks(), and if the input is finished, waits for the
+  /// output of all remaining chunks so that NumFramesReady() covers the whole
+  /// utterance.
+  void WaitForAllOutput();
+
+  virtual BaseFloat LogLikelihood(int32 subsampled_frame, int32 transition_id);
+
+  virtual int32 NumFramesReady() const {
+    // The last chunk may extend past the end of the utterance.
+    return (num_subsampled_frames_ >= 0 ?
+            std::min(num_frames_ready_, num_subsampled_frames_) :
+            num_frames_ready_);
+  }
+
+  virtual int32 NumIndices() const { return trans_model_.NumTransitionIds(); }
+
+  virtual bool IsLastFrame(int32 subsampled_frame) const {
+    KALDI_ASSERT(subsampled_frame < NumFramesReady());
+    return subsampled_frame == num_subsampled_frames_ - 1;
+  }
+
+  int32 FrameSubsamplingFactor() const {
+    return computer_->GetOptions().frame_subsampling_factor;
+  }
+
+  // Waits for any chunks that have not been waited for yet, then deletes them.
+  ~DecodableAmNnetBatchOnline();
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(DecodableAmNnetBatchOnline);
+
+  // If the input for the next chunk is available (or the input is finished,
+  // in which case we pad with the last frame) and the utterance is not done,
+  // creates the chunk, gives it to the computer and returns true; else
+  // returns false.  Must not be called while a chunk is being computed.
+  bool SubmitChunk();
+
+  // Called after the last task in tasks_ has been waited for; sets
+  // num_frames_ready_.
+  void TaskDone();
+
+  NnetBatchComputer *computer_;
+  const TransitionModel &trans_model_;
+  OnlineFeatureInterface *input_features_;
+  OnlineFeatureInterface *ivector_features_;
+  // The chunks that have been submitted and not yet discarded, in order.
+  std::deque<NnetInferenceTask*> tasks_;
+  // True if the last chunk in tasks_ has not been waited for yet.
+  bool task_pending_;
+  // The number of chunks submitted so far.
+  int32 num_chunks_submitted_;
+  // The number of subsampled frames covered by the chunks computed so far.
+  int32 num_frames_ready_;
+  // The number of subsampled frames in the utterance, or -1 if we have not
+  // seen the end of the input yet.
+  int32 num_subsampled_frames_;
+};
+
+
+} // namespace nnet3
+} // namespace kaldi
+
+#endif // KALDI_NNET3_NNET_BATCH_COMPUTE_H_
@@ -100,11 +100,13 @@ void TestNnetDecodable(Nnet *nnet) {
   Matrix<BaseFloat> output1(num_frames, output_dim),
       output2(num_frames, output_dim);
 
+  NnetSimpleComputationOptions simple_opts;
+  simple_opts.frames_per_chunk = RandInt(5, 25);
+  simple_opts.extra_left_context_initial = RandInt(-1, 2);
+  simple_opts.extra_right_context_final = RandInt(-1, 2);
   {
-    NnetSimpleComputationOptions opts;
-    opts.frames_per_chunk = RandInt(5, 25);
     CachingOptimizingCompiler compiler(*nnet);
-    DecodableNnetSimple decodable(opts, *nnet, priors, input, &compiler,
+    DecodableNnetSimple decodable(simple_opts, *nnet, priors, input, &compiler,
                                   (ivector_dim != 0 ? &ivector : NULL));
     for (int32 t = 0; t < num_frames; t++) {
       SubVector<BaseFloat> row(output1, t);
@@ -112,6 +114,66 @@ void TestNnetDecodable(Nnet *nnet) {
     }
   }
 
+  {
+    // Check that CompileDecodableNnetSimpleComputations() compiles all the
+    // computations that DecodableNnetSimple needs, by checking that the
+    // cache is unchanged after decoding with it; and that the cache can be
+    // written and read.
+    std::ostringstream os1;
+    {
+      CachingOptimizingCompiler compiler(*nnet, simple_opts.optimize_config);
+      CompileDecodableNnetSimpleComputations(simple_opts, *nnet, &compiler);
+      compiler.WriteCache(os1, true);
+    }
+    CachingOptimizingCompiler compiler(*nnet, simple_opts.optimize_config);
+    std::istringstream is(os1.str());
+    compiler.ReadCache(is, true);
+    std::ostringstream os2, os3;
+    compiler.WriteCache(os2, true);
+    Matrix<BaseFloat> output(num_frames, output_dim);
+    DecodableNnetSimple decodable(simple_opts, *nnet, priors, input, &compiler,
+                                  (ivector_dim != 0 ? &ivector : NULL));
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+    compiler.WriteCache(os3, true);
+    KALDI_ASSERT(os2.str() == os3.str());
+    KALDI_ASSERT(output.ApproxEqual(output1));
+  }
+
+  {
+    // Check that a computation cache on disk is only used with the nnet it
+    // was written for.
+    ComputationCacheOptions cache_opts;
+    cache_opts.computation_cache = "tmp.computation-cache";
+    cache_opts.update_computation_cache = true;
+    std::ostringstream os1, os2, os3, os4;
+    {
+      CachingOptimizingCompiler compiler(*nnet, simple_opts.optimize_config);
+      CompileDecodableNnetSimpleComputations(simple_opts, *nnet, &compiler);
+      compiler.WriteCache(os1, true);
+      WriteComputationCache(cache_opts, &compiler);
+    }
+    CachingOptimizingCompiler compiler(*nnet, simple_opts.optimize_config);
+    ReadComputationCache(cache_opts, &compiler);
+    compiler.WriteCache(os2, true);
+    // (the order of the computations may differ.)
+    KALDI_ASSERT(os1.str().size() == os2.str().size());
+
+    Nnet nnet2(*nnet);
+    PerturbParams(0.1, &nnet2);
+    if (nnet2.Info() != nnet->Info()) {
+      CachingOptimizingCompiler compiler2(nnet2, simple_opts.optimize_config),
+          empty_compiler(nnet2, simple_opts.optimize_config);
+      ReadComputationCache(cache_opts, &compiler2);
+      compiler2.WriteCache(os3, true);
+      empty_compiler.WriteCache(os4, true);
+      KALDI_ASSERT(os3.str() == os4.str());
+    }
+    unlink("tmp.computation-cache");
+  }
+
   {
     NnetSimpleLoopedComputationOptions opts;
     // caution: this may modify nnet, by changing how it consumes iVectors.
@@ -124,6 +186,33 @@ void TestNnetDecodable(Nnet *nnet) {
     }
   }
 
+  {
+    // Check that the looped computation can be obtained from a
+    // CachingOptimizingCompiler whose cache was read from disk.
+    NnetSimpleLoopedComputationOptions opts;
+    std::ostringstream os;
+    {
+      CachingOptimizingCompiler compiler(*nnet, opts.optimize_config);
+      DecodableNnetSimpleLoopedInfo info(opts, priors, nnet, &compiler);
+      compiler.WriteCache(os, true);
+    }
+    CachingOptimizingCompiler compiler(*nnet, opts.optimize_config);
+    std::istringstream is(os.str());
+    compiler.ReadCache(is, true);
+    DecodableNnetSimpleLoopedInfo info(opts, priors, nnet, &compiler);
+    Matrix<BaseFloat> output(num_frames, output_dim);
+    DecodableNnetSimpleLooped decodable(info, input,
+                                        (ivector_dim != 0 ? &ivector : NULL));
+    for (int32 t = 0; t < num_frames; t++) {
+      SubVector<BaseFloat> row(output, t);
+      decodable.GetOutputForFrame(t, &row);
+    }
+    std::ostringstream os2;
+    compiler.WriteCache(os2, true);
+    KALDI_ASSERT(os.str().size() == os2.str().size());
+    KALDI_ASSERT(output.ApproxEqual(output2));
+  }
+
 
   // the components that we exclude from this test, are excluded because they
   // all take "optional" right context, and this destroys the equivalence that
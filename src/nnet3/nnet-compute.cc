@@ -655,6 +655,50 @@ int32 NnetComputer::GetIoMatrixIndex(const std::string &node_name, bool is_outpu
 }
 
 
+int32 NnetComputer::SequenceStateDim(int32 num_sequences) const {
+  KALDI_ASSERT(num_sequences > 0);
+  for (size_t m = 0; m < compressed_matrices_.size(); m++)
+    KALDI_ASSERT(compressed_matrices_[m] == NULL);
+  int32 ans = 0;
+  for (size_t m = 0; m < matrices_.size(); m++) {
+    int32 num_rows = matrices_[m].NumRows();
+    if (num_rows % num_sequences != 0)
+      KALDI_ERR << "Matrix " << m << " has " << num_rows << " rows, which "
+                << "is not a multiple of the number of sequences "
+                << num_sequences;
+    ans += (num_rows / num_sequences) * matrices_[m].NumCols();
+  }
+  return ans;
+}
+
+void NnetComputer::GetSequenceStates(CuMatrixBase<BaseFloat> *states) const {
+  int32 num_sequences = states->NumRows();
+  KALDI_ASSERT(states->NumCols() == SequenceStateDim(num_sequences));
+  int32 offset = 0;
+  for (size_t m = 0; m < matrices_.size(); m++) {
+    int32 num_cols = matrices_[m].NumCols(),
+        num_blocks = matrices_[m].NumRows() / num_sequences;
+    // The rows b * num_sequences ... (b + 1) * num_sequences - 1 of the matrix
+    // have the same 't' and 'x' values.
+    for (int32 b = 0; b < num_blocks; b++, offset += num_cols)
+      states->ColRange(offset, num_cols).CopyFromMat(
+          matrices_[m].RowRange(b * num_sequences, num_sequences));
+  }
+}
+
+void NnetComputer::SetSequenceStates(const CuMatrixBase<BaseFloat> &states) {
+  int32 num_sequences = states.NumRows();
+  KALDI_ASSERT(states.NumCols() == SequenceStateDim(num_sequences));
+  int32 offset = 0;
+  for (size_t m = 0; m < matrices_.size(); m++) {
+    int32 num_cols = matrices_[m].NumCols(),
+        num_blocks = matrices_[m].NumRows() / num_sequences;
+    for (int32 b = 0; b < num_blocks; b++, offset += num_cols)
+      matrices_[m].RowRange(b * num_sequences, num_sequences).CopyFromMat(
+          states.ColRange(offset, num_cols));
+  }
+}
+
 void NnetComputer::AcceptInputs(const Nnet &nnet,
                                 const std::vector<NnetIo> &io_vec) {
   for (size_t i = 0; i < io_vec.size(); i++) {
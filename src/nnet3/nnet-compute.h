@@ -124,6 +124,33 @@ class NnetComputer {
   void GetOutputDestructive(const std::string &output_name,
                             CuMatrix<BaseFloat> *output);
 
+  /// The following functions are for looped computations (see
+  /// nnet-compile-looped.h) that process 'num_sequences' sequences (i.e. 'n'
+  /// values) at a time, all with the same indexes.  They may be called between
+  /// calls to Run(), and give access to the state of the computation (i.e. the
+  /// contents of the matrices that are currently allocated) one sequence at a
+  /// time.  This makes it possible to rearrange the sequences between chunks,
+  /// e.g. so that chunks of different streams of online decoding can share a
+  /// minibatch (see nnet-batch-compute.h).  They assume that the rows of each
+  /// matrix are ordered with 'n' varying fastest, as the compiler does it.
+
+  /// Returns the dimension of the state of one sequence.
+  int32 SequenceStateDim(int32 num_sequences) const;
+
+  /// Copies the state of each sequence n to row n of "states", which must have
+  /// num_sequences rows and SequenceStateDim(num_sequences) columns.
+  void GetSequenceStates(CuMatrixBase<BaseFloat> *states) const;
+
+  /// The reverse of GetSequenceStates().  The layout of the state depends on
+  /// where we are in the computation (the first few chunks of a looped
+  /// computation are not part of the loop), so "states" must have been
+  /// obtained from a computer for the same computation, with the same
+  /// ProgramCounter().
+  void SetSequenceStates(const CuMatrixBase<BaseFloat> &states);
+
+  /// Returns the index of the next command to be executed.
+  int32 ProgramCounter() const { return program_counter_; }
+
 
   ~NnetComputer();
  private:
@@ -5021,8 +5021,12 @@ void ComputationCache::Read(std::istream &is, bool binary) {
   ExpectToken(is, binary, "<ComputationCacheSize>");
   ReadBasicType(is, binary, &computation_cache_size);
   KALDI_ASSERT(computation_cache_size >= 0);
-  computation_cache_.clear();
-  access_queue_.clear();
+  Clear();
+  // Don't let any of the computations we are reading be purged because of the
+  // capacity (e.g. a cache from nnet3-compile-computation-cache may hold more
+  // computations than the decoder would normally keep).
+  if (computation_cache_size > cache_capacity_)
+    cache_capacity_ = computation_cache_size;
   ExpectToken(is, binary, "<ComputationCache>");
   for (size_t c = 0; c < computation_cache_size; c++) {
     ComputationRequest request;
@@ -5033,6 +5037,16 @@ void ComputationCache::Read(std::istream &is, bool binary) {
   }
 }
 
+void ComputationCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CacheType::const_iterator iter = computation_cache_.begin(),
+      end = computation_cache_.end();
+  for (; iter != end; ++iter)
+    delete iter->first;
+  computation_cache_.clear();
+  access_queue_.clear();
+}
+
 void ComputationCache::Check(const Nnet &nnet) const {
   CacheType::const_iterator iter = computation_cache_.begin(),
       end = computation_cache_.end();
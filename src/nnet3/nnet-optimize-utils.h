@@ -627,7 +627,8 @@ class ComputationCache {
   ComputationCache(int32 cache_capacity);
 
   // Note: if something fails in Read(), or the written cache was from an older
-  // format, it will just leave the cache empty.
+  // format, it will just leave the cache empty.  If the cache being read holds
+  // more computations than the capacity, the capacity is increased.
   void Read(std::istream &is, bool binary);
 
   void Write(std::ostream &os, bool binary) const;
@@ -653,6 +654,9 @@ class ComputationCache {
 
   // Checks the stored computation for correctness.
   void Check(const Nnet &nnet) const;
+
+  // Removes all the computations from the cache.
+  void Clear();
  private:
 
   std::mutex mutex_;  // Read/write mutex.
@@ -18,9 +18,14 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <iomanip>
+#include <unistd.h>
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-optimize-utils.h"
+#include "nnet3/nnet-compile-looped.h"
 #include "base/timer.h"
 
 namespace kaldi {
@@ -657,9 +662,18 @@ void CachingOptimizingCompiler::ReadCache(std::istream &is, bool binary) {
     NnetOptimizeOptions opt_config_cached;
     opt_config_cached.Read(is, binary);
     // we won't read cached computations if any optimize option has been changed.
-    if (!(opt_config_ == opt_config_cached))
+    if (!(opt_config_ == opt_config_cached)) {
+      KALDI_WARN << "Not using the cached computations, because they were "
+                 << "compiled with different optimization options.";
       return;
-    cache_.Read(is, binary);
+    }
+    try {
+      cache_.Read(is, binary);
+    } catch (...) {
+      // Don't keep the computations we read before the error.
+      cache_.Clear();
+      throw;
+    }
     seconds_taken_io_ += timer.Elapsed();
   }
   if (GetVerboseLevel() >= 2) {
@@ -680,6 +694,31 @@ void CachingOptimizingCompiler::WriteCache(std::ostream &os, bool binary) {
   seconds_taken_io_ += timer.Elapsed();
 }
 
+bool CachingOptimizingCompiler::CheckCache() {
+  Timer timer;
+  bool ans = true;
+  try {
+    cache_.Check(nnet_);
+  } catch (const std::exception &e) {
+    KALDI_WARN << "A cached computation failed the check, so the cache will "
+               << "not be used.";
+    cache_.Clear();
+    ans = false;
+  }
+  seconds_taken_check_ += timer.Elapsed();
+  seconds_taken_total_ += timer.Elapsed();
+  return ans;
+}
+
+const std::string &CachingOptimizingCompiler::NnetFingerprint() {
+  if (nnet_fingerprint_.empty()) {
+    std::ostringstream os;
+    os << std::hex << StringHasher()(nnet_.Info());
+    nnet_fingerprint_ = os.str();
+  }
+  return nnet_fingerprint_;
+}
+
 CachingOptimizingCompiler::~CachingOptimizingCompiler() {
   if (seconds_taken_total_ > 0.0 || seconds_taken_io_ > 0.0) {
     std::ostringstream os;
@@ -709,6 +748,42 @@ std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::Compile(
   return ans;
 }
 
+std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileLooped(
+    const ComputationRequest &request1,
+    const ComputationRequest &request2,
+    const ComputationRequest &request3) {
+  Timer timer;
+  // The key is request1 with the inputs and outputs of request2 and request3
+  // appended.  Since its input and output names are repeated, it cannot be
+  // the same as any request given to Compile().
+  ComputationRequest key(request1);
+  const ComputationRequest *others[2] = { &request2, &request3 };
+  for (int32 i = 0; i < 2; i++) {
+    key.inputs.insert(key.inputs.end(), others[i]->inputs.begin(),
+                      others[i]->inputs.end());
+    key.outputs.insert(key.outputs.end(), others[i]->outputs.begin(),
+                       others[i]->outputs.end());
+  }
+  std::shared_ptr<const NnetComputation> ans = cache_.Find(key);
+  if (ans == NULL) {
+    NnetComputation *computation = new NnetComputation();
+    {
+      Timer timer;
+      nnet3::CompileLooped(nnet_, opt_config_, request1, request2, request3,
+                           computation);
+      seconds_taken_compile_ += timer.Elapsed();
+    }
+    {
+      Timer timer;
+      computation->ComputeCudaIndexes();
+      seconds_taken_indexes_ += timer.Elapsed();
+    }
+    ans = cache_.Insert(key, computation);
+  }
+  seconds_taken_total_ += timer.Elapsed();
+  return ans;
+}
+
 std::shared_ptr<const NnetComputation> CachingOptimizingCompiler::CompileInternal(
     const ComputationRequest  &request) {
   std::shared_ptr<const NnetComputation> ans = cache_.Find(request);
@@ -907,6 +982,65 @@ void ConsolidateIoOperations(const Nnet &nnet,
 }
 
 
+void ReadComputationCache(const ComputationCacheOptions &opts,
+                          CachingOptimizingCompiler *compiler) {
+  if (opts.computation_cache.empty())
+    return;
+  // Compute the fingerprint now, in case the nnet is modified later.
+  const std::string &fingerprint = compiler->NnetFingerprint();
+  bool binary;
+  Input ki;
+  if (!ki.Open(opts.computation_cache, &binary)) {
+    KALDI_WARN << "Could not read computation cache from "
+               << opts.computation_cache << ", starting with an empty cache.";
+    return;
+  }
+  std::string cache_fingerprint;
+  try {
+    ExpectToken(ki.Stream(), binary, "<NnetFingerprint>");
+    ReadToken(ki.Stream(), binary, &cache_fingerprint);
+    if (cache_fingerprint != fingerprint) {
+      KALDI_WARN << "Not using the computation cache "
+                 << opts.computation_cache << " because it was created for "
+                 << "a different model.";
+      return;
+    }
+    compiler->ReadCache(ki.Stream(), binary);
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error reading computation cache from "
+               << opts.computation_cache << ", starting with an empty cache.";
+    return;
+  }
+  if (compiler->CheckCache())
+    KALDI_LOG << "Read computation cache from " << opts.computation_cache;
+}
+
+void WriteComputationCache(const ComputationCacheOptions &opts,
+                           CachingOptimizingCompiler *compiler) {
+  if (opts.computation_cache.empty() || !opts.update_computation_cache)
+    return;
+  const std::string &filename = opts.computation_cache;
+  bool binary = true;
+  if (ClassifyWxfilename(filename) != kFileOutput) {
+    Output ko(filename, binary);
+    WriteToken(ko.Stream(), binary, "<NnetFingerprint>");
+    WriteToken(ko.Stream(), binary, compiler->NnetFingerprint());
+    compiler->WriteCache(ko.Stream(), binary);
+    return;
+  }
+  std::ostringstream tmp_filename;
+  tmp_filename << filename << ".tmp." << getpid();
+  {
+    Output ko(tmp_filename.str(), binary);
+    WriteToken(ko.Stream(), binary, "<NnetFingerprint>");
+    WriteToken(ko.Stream(), binary, compiler->NnetFingerprint());
+    compiler->WriteCache(ko.Stream(), binary);
+  }
+  if (std::rename(tmp_filename.str().c_str(), filename.c_str()) != 0)
+    KALDI_ERR << "Could not rename " << tmp_filename.str() << " to "
+              << filename << ": " << strerror(errno);
+  KALDI_LOG << "Wrote computation cache to " << filename;
+}
 
 
 } // namespace nnet3
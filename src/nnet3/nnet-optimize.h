@@ -239,9 +239,35 @@ class CachingOptimizingCompiler {
   /// 'std::shared_ptr<const NnetComputation>' in the calling code.
   std::shared_ptr<const NnetComputation> Compile(
       const ComputationRequest &request);
+
+  /// This is a caching version of the function CompileLooped() declared in
+  /// nnet-compile-looped.h, which compiles a looped computation from three
+  /// requests (see CreateLoopedComputationRequest()).  The computation is
+  /// stored in the same cache as those from Compile(), but under a key formed
+  /// from all three requests, which can never be equal to an ordinary request.
+  /// Like Compile(), it calls ComputeCudaIndexes() for you.
+  std::shared_ptr<const NnetComputation> CompileLooped(
+      const ComputationRequest &request1,
+      const ComputationRequest &request2,
+      const ComputationRequest &request3);
+
   void ReadCache(std::istream &is, bool binary);
   void WriteCache(std::ostream &os, bool binary);
 
+  /// Checks all the computations in the cache against the nnet (see
+  /// ComputationChecker).  If any of them fails the check, it prints a
+  /// warning, empties the cache and returns false.
+  bool CheckCache();
+
+  /// Returns a string that identifies the nnet (a hash of Nnet::Info(), which
+  /// covers its structure and parameters), so that computation caches on disk
+  /// are only used with the nnet they were compiled for (see
+  /// ReadComputationCache()).  It is computed the first time this is called;
+  /// call it before anything modifies the nnet (as
+  /// DecodableNnetSimpleLoopedInfo does if it takes iVectors), so that it is
+  /// the same for the reader and the writer of the cache.
+  const std::string &NnetFingerprint();
+
  private:
 
   // This function just implements the work of Compile(); it's made a separate
@@ -290,9 +316,53 @@ class CachingOptimizingCompiler {
   double seconds_taken_io_;
 
   ComputationCache cache_;
+
+  // Empty until NnetFingerprint() is called.
+  std::string nnet_fingerprint_;
 };
 
 
+/// Options for programs that use a computation cache on disk, as created by
+/// nnet3-compile-computation-cache, to avoid compiling the same computations
+/// every time they are run (e.g. in each job of a parallel decode).
+struct ComputationCacheOptions {
+  std::string computation_cache;
+  bool update_computation_cache;
+
+  ComputationCacheOptions(): update_computation_cache(false) { }
+
+  void Register(OptionsItf *opts) {
+    opts->Register("computation-cache", &computation_cache,
+                   "If set, the name of a file of compiled computations (e.g. "
+                   "from nnet3-compile-computation-cache), which is read at "
+                   "startup if it exists.  It is ignored (with a warning) if "
+                   "it was created for a different model or with different "
+                   "optimization options.  Computations for other decoding "
+                   "options (e.g. --frames-per-chunk) are valid but are "
+                   "simply not used.");
+    opts->Register("update-computation-cache", &update_computation_cache,
+                   "If true, write any newly compiled computations back to "
+                   "the file given by --computation-cache at exit.");
+  }
+};
+
+/// Reads the computation cache given by opts.computation_cache (if set) into
+/// 'compiler'.  The cache starts with the fingerprint of the nnet it was
+/// written for (see CachingOptimizingCompiler::NnetFingerprint()); if that
+/// does not match the compiler's nnet, or the file cannot be read, or any
+/// computation fails CachingOptimizingCompiler::CheckCache(), it prints a
+/// warning and the compiler starts with an empty cache.
+void ReadComputationCache(const ComputationCacheOptions &opts,
+                          CachingOptimizingCompiler *compiler);
+
+/// Writes the cache of 'compiler' to opts.computation_cache, if that is set
+/// and opts.update_computation_cache is true.  If it is a regular file, it is
+/// written under a temporary name and then renamed, so that other processes
+/// reading it at the same time see either the old or the new version.
+void WriteComputationCache(const ComputationCacheOptions &opts,
+                           CachingOptimizingCompiler *compiler);
+
+
 /// This optimization, which has no effect unless you set --min-deriv-time or
 /// --max-deriv-time, modifies the backprop operations for efficiency based on
 /// the assumption that derivatives for any Cindex with t < min_deriv_time or t
@@ -0,0 +1,157 @@
+// nnet3bin/nnet3-compile-computation-cache.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <limits>
+#include "base/kaldi-common.h"
+#include "util/common-utils.h"
+#include "hmm/transition-model.h"
+#include "nnet3/nnet-am-decodable-simple.h"
+#include "nnet3/decodable-simple-looped.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+namespace nnet3 {
+
+// The looped and non-looped decoders register options with the same names but
+// different defaults (e.g. --frames-per-chunk is 20 for the looped decoders
+// and 50 otherwise), so we need to know the value of --looped before we
+// register the rest of the options.  This looks for it on the command line;
+// ParseOptions checks it properly later on.
+static bool LoopedOptionGiven(int argc, const char *const *argv) {
+  bool looped = false;
+  for (int32 i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--")
+      break;
+    if (arg == "--looped")
+      looped = true;
+    else if (arg.compare(0, 9, "--looped=") == 0)
+      looped = (arg == "--looped=true" || arg == "--looped=t" ||
+                arg == "--looped=1");
+  }
+  return looped;
+}
+
+}  // namespace nnet3
+}  // namespace kaldi
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace kaldi::nnet3;
+    typedef kaldi::int32 int32;
+
+    const char *usage =
+        "Compile ahead of time the computations that nnet3 decoding\n"
+        "programs need for a model and set of decoding options, and write\n"
+        "them to a computation cache which those programs can read with the\n"
+        "--computation-cache option, to save the compilation time at\n"
+        "startup.  The decoding options (e.g. --frames-per-chunk,\n"
+        "--extra-left-context, --frame-subsampling-factor and the\n"
+        "--optimization.* options) must be the same as those given to the\n"
+        "decoder.  By default the cache is for nnet3-latgen-faster; with\n"
+        "--looped=true it is for nnet3-latgen-faster-looped and\n"
+        "online2-wav-nnet3-latgen-faster, and the options and their defaults\n"
+        "are those of the looped decoders (e.g. --frames-per-chunk defaults\n"
+        "to 20 instead of 50).\n"
+        "\n"
+        "Usage:  nnet3-compile-computation-cache [options] <model-in> "
+        "<cache-out>\n"
+        "e.g.:\n"
+        " nnet3-compile-computation-cache --frames-per-chunk=150 \\\n"
+        "   --extra-left-context=40 final.mdl computation.cache\n"
+        " nnet3-latgen-faster --frames-per-chunk=150 \\\n"
+        "   --extra-left-context=40 --computation-cache=computation.cache \\\n"
+        "   final.mdl HCLG.fst ...\n";
+
+    ParseOptions po(usage);
+    bool looped = LoopedOptionGiven(argc, argv);
+    NnetSimpleComputationOptions decodable_opts;
+    NnetSimpleLoopedComputationOptions looped_opts;
+
+    po.Register("looped", &looped, "If true, compile the computation for the "
+                "'looped' decoders (nnet3-latgen-faster-looped and "
+                "online2-wav-nnet3-latgen-faster).");
+    if (looped)
+      looped_opts.Register(&po);
+    else
+      decodable_opts.Register(&po);
+
+    po.Read(argc, argv);
+    if (looped != LoopedOptionGiven(argc, argv))
+      KALDI_ERR << "The --looped option must be given on the command line "
+                << "as --looped, --looped=true or --looped=false.";
+
+    if (po.NumArgs() != 2) {
+      po.PrintUsage();
+      exit(1);
+    }
+
+    std::string model_in_filename = po.GetArg(1),
+        cache_wxfilename = po.GetArg(2);
+
+    // Prepare the model the same way as the decoding programs do, so that
+    // the computations are the same.
+    TransitionModel trans_model;
+    AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(model_in_filename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      CollapseModel(CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    // Reading the cache increases the decoder's cache capacity if needed,
+    // so we don't limit the capacity here.
+    CachingOptimizingCompilerOptions compiler_config(
+        decodable_opts.compiler_config);
+    compiler_config.cache_capacity = std::numeric_limits<int32>::max();
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       (looped ? looped_opts.optimize_config :
+                                        decodable_opts.optimize_config),
+                                       compiler_config);
+    // The fingerprint of the model has to be computed before
+    // DecodableNnetSimpleLoopedInfo modifies it, as the decoders do.
+    compiler.NnetFingerprint();
+
+    if (looped) {
+      looped_opts.Check();
+      // this compiles the looped computation (and may modify the nnet to
+      // accept iVectors at intervals, exactly as the decoders do).
+      DecodableNnetSimpleLoopedInfo decodable_info(looped_opts, &am_nnet,
+                                                   &compiler);
+      KALDI_LOG << "Compiled the looped computation for frames-per-chunk="
+                << decodable_info.frames_per_chunk;
+    } else {
+      int32 num_requests = CompileDecodableNnetSimpleComputations(
+          decodable_opts, am_nnet.GetNnet(), &compiler);
+      KALDI_LOG << "Compiled " << num_requests << " computation requests.";
+    }
+
+    ComputationCacheOptions cache_opts;
+    cache_opts.computation_cache = cache_wxfilename;
+    cache_opts.update_computation_cache = true;
+    WriteComputationCache(cache_opts, &compiler);
+    return 0;
+  } catch(const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+}
@@ -54,6 +54,7 @@ int main(int argc, char *argv[]) {
     bool allow_partial = false;
     LatticeFasterDecoderConfig config;
     NnetSimpleLoopedComputationOptions decodable_opts;
+    ComputationCacheOptions cache_opts;
 
     std::string word_syms_filename;
     std::string ivector_rspecifier,
@@ -62,6 +63,7 @@ int main(int argc, char *argv[]) {
     int32 online_ivector_period = 0;
     config.Register(&po);
     decodable_opts.Register(&po);
+    cache_opts.Register(&po);
     po.Register("word-symbol-table", &word_syms_filename,
                 "Symbol table for words [for debug output]");
     po.Register("allow-partial", &allow_partial,
@@ -128,11 +130,18 @@ int main(int argc, char *argv[]) {
     kaldi::int64 frame_count = 0;
     int num_success = 0, num_fail = 0;
 
+    // the looped computation is obtained via this compiler, so that it can
+    // be read from (and written to) the --computation-cache.
+    CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                       decodable_opts.optimize_config);
+    ReadComputationCache(cache_opts, &compiler);
+
     // this object contains precomputed stuff that is used by all decodable
     // objects.  It takes a pointer to am_nnet because if it has iVectors it has
     // to modify the nnet to accept iVectors at intervals.
     DecodableNnetSimpleLoopedInfo decodable_info(decodable_opts,
-                                                 &am_nnet);
+                                                 &am_nnet, &compiler);
+    WriteComputationCache(cache_opts, &compiler);
 
 
     if (ClassifyRspecifier(fst_in_str, NULL, NULL) == kNoRspecifier) {
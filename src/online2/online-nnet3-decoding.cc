@@ -81,4 +81,64 @@ bool SingleUtteranceNnet3Decoder::EndpointDetected(
 }
 
 
+SingleUtteranceNnet3BatchDecoder::SingleUtteranceNnet3BatchDecoder(
+    const LatticeFasterDecoderConfig &decoder_opts,
+    const TransitionModel &trans_model,
+    nnet3::NnetBatchComputer *computer,
+    const fst::Fst<fst::StdArc> &fst,
+    OnlineNnet2FeaturePipeline *features):
+    decoder_opts_(decoder_opts),
+    input_feature_frame_shift_in_seconds_(features->FrameShiftInSeconds()),
+    trans_model_(trans_model),
+    decodable_(computer, trans_model_,
+               features->InputFeature(), features->IvectorFeature()),
+    decoder_(fst, decoder_opts_) {
+  decoder_.InitDecoding();
+}
+
+void SingleUtteranceNnet3BatchDecoder::AdvanceDecoding() {
+  decodable_.AdvanceChunks();
+  if (decodable_.InputFinished())
+    decodable_.WaitForAllOutput();
+  decoder_.AdvanceDecoding(&decodable_);
+}
+
+void SingleUtteranceNnet3BatchDecoder::FinalizeDecoding() {
+  decoder_.FinalizeDecoding();
+}
+
+int32 SingleUtteranceNnet3BatchDecoder::NumFramesDecoded() const {
+  return decoder_.NumFramesDecoded();
+}
+
+void SingleUtteranceNnet3BatchDecoder::GetLattice(bool end_of_utterance,
+                                                  CompactLattice *clat) const {
+  if (NumFramesDecoded() == 0)
+    KALDI_ERR << "You cannot get a lattice if you decoded no frames.";
+  Lattice raw_lat;
+  decoder_.GetRawLattice(&raw_lat, end_of_utterance);
+
+  if (!decoder_opts_.determinize_lattice)
+    KALDI_ERR << "--determinize-lattice=false option is not supported at the moment";
+
+  BaseFloat lat_beam = decoder_opts_.lattice_beam;
+  DeterminizeLatticePhonePrunedWrapper(
+      trans_model_, &raw_lat, lat_beam, clat, decoder_opts_.det_opts);
+}
+
+void SingleUtteranceNnet3BatchDecoder::GetBestPath(bool end_of_utterance,
+                                                   Lattice *best_path) const {
+  decoder_.GetBestPath(best_path, end_of_utterance);
+}
+
+bool SingleUtteranceNnet3BatchDecoder::EndpointDetected(
+    const OnlineEndpointConfig &config) {
+  BaseFloat output_frame_shift =
+      input_feature_frame_shift_in_seconds_ *
+      decodable_.FrameSubsamplingFactor();
+  return kaldi::EndpointDetected(config, trans_model_,
+                                 output_frame_shift, decoder_);
+}
+
+
 }  // namespace kaldi
@@ -27,6 +27,7 @@
 #include <deque>
 
 #include "nnet3/decodable-online-looped.h"
+#include "nnet3/nnet-batch-compute.h"
 #include "matrix/matrix-lib.h"
 #include "util/common-utils.h"
 #include "base/kaldi-error.h"
@@ -109,6 +110,70 @@ class SingleUtteranceNnet3Decoder {
 };
 
 
+/**
+   This is like SingleUtteranceNnet3Decoder, but the neural net computation is
+   done by an nnet3::NnetBatchComputer that may be shared between many
+   decoders (typically, one per audio stream, each in its own thread), so
+   that chunks from different streams are computed together in minibatches.
+   See class nnet3::DecodableAmNnetBatchOnline for more information.
+
+   The --frames-per-chunk, --minibatch-size and --max-wait-ms options of the
+   NnetBatchComputer control the trade-off between latency and throughput.
+*/
+class SingleUtteranceNnet3BatchDecoder {
+ public:
+  // Constructor.  The pointers 'computer' and 'features' are not owned by this
+  // class.
+  SingleUtteranceNnet3BatchDecoder(
+      const LatticeFasterDecoderConfig &decoder_opts,
+      const TransitionModel &trans_model,
+      nnet3::NnetBatchComputer *computer,
+      const fst::Fst<fst::StdArc> &fst,
+      OnlineNnet2FeaturePipeline *features);
+
+  /// Advance the decoding as far as we can without blocking on the neural net
+  /// computation; but once the input is finished (InputFinished() has been
+  /// called on the feature pipeline), this waits for the neural net output
+  /// for the rest of the utterance and decodes it.
+  void AdvanceDecoding();
+
+  /// Finalizes the decoding. Cleans up and prunes remaining tokens, so the
+  /// GetLattice() call will return faster.
+  void FinalizeDecoding();
+
+  int32 NumFramesDecoded() const;
+
+  /// Gets the lattice; see SingleUtteranceNnet3Decoder::GetLattice().
+  void GetLattice(bool end_of_utterance,
+                  CompactLattice *clat) const;
+
+  /// Outputs an FST corresponding to the single best path through the current
+  /// lattice; see SingleUtteranceNnet3Decoder::GetBestPath().
+  void GetBestPath(bool end_of_utterance,
+                   Lattice *best_path) const;
+
+  /// This function calls EndpointDetected from online-endpoint.h,
+  /// with the required arguments.
+  bool EndpointDetected(const OnlineEndpointConfig &config);
+
+  const LatticeFasterOnlineDecoder &Decoder() const { return decoder_; }
+
+  ~SingleUtteranceNnet3BatchDecoder() { }
+ private:
+
+  const LatticeFasterDecoderConfig &decoder_opts_;
+
+  BaseFloat input_feature_frame_shift_in_seconds_;
+
+  const TransitionModel &trans_model_;
+
+  nnet3::DecodableAmNnetBatchOnline decodable_;
+
+  LatticeFasterOnlineDecoder decoder_;
+
+};
+
+
 /// @} End of "addtogroup onlinedecoding"
 
 }  // namespace kaldi
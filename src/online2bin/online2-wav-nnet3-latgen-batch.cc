@@ -0,0 +1,362 @@
+// online2bin/online2-wav-nnet3-latgen-batch.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/timer.h"
+#include "feat/wave-reader.h"
+#include "online2/online-nnet3-decoding.h"
+#include "online2/online-nnet2-feature-pipeline.h"
+#include "online2/onlinebin-util.h"
+#include "online2/online-endpoint.h"
+#include "fstext/fstext-lib.h"
+#include "lat/lattice-functions.h"
+#include "util/kaldi-thread.h"
+#include "nnet3/nnet-utils.h"
+
+namespace kaldi {
+
+/*
+   This class decodes one utterance, simulating an audio stream; operator ()
+   is called in its own thread by class TaskSequencer, and the destructor
+   (which writes the output) is called in order of the utterances.
+ */
+class OnlineNnet3BatchDecodeTask {
+ public:
+  OnlineNnet3BatchDecodeTask(
+      const std::string &utt,
+      const WaveData &wave_data,
+      const OnlineNnet2FeaturePipelineInfo &feature_info,
+      const LatticeFasterDecoderConfig &decoder_opts,
+      const OnlineEndpointConfig &endpoint_opts,
+      const TransitionModel &trans_model,
+      nnet3::NnetBatchComputer *computer,
+      const fst::Fst<fst::StdArc> &decode_fst,
+      const fst::SymbolTable *word_syms,
+      BaseFloat chunk_length_secs,
+      bool do_endpointing,
+      CompactLatticeWriter *clat_writer,
+      int32 *num_done, int64 *tot_num_frames, double *tot_like):
+      utt_(utt), wave_data_(wave_data), feature_info_(feature_info),
+      decoder_opts_(decoder_opts), endpoint_opts_(endpoint_opts),
+      trans_model_(trans_model), computer_(computer),
+      decode_fst_(decode_fst), word_syms_(word_syms),
+      chunk_length_secs_(chunk_length_secs),
+      do_endpointing_(do_endpointing), clat_writer_(clat_writer),
+      num_done_(num_done), tot_num_frames_(tot_num_frames),
+      tot_like_(tot_like) { }
+
+  void operator () () {
+    // get the data for channel zero (if the signal is not mono, we only
+    // take the first channel).
+    SubVector<BaseFloat> data(wave_data_.Data(), 0);
+
+    OnlineNnet2FeaturePipeline feature_pipeline(feature_info_);
+
+    OnlineSilenceWeighting silence_weighting(
+        trans_model_,
+        feature_info_.silence_weighting_config,
+        computer_->GetOptions().frame_subsampling_factor);
+
+    SingleUtteranceNnet3BatchDecoder decoder(decoder_opts_, trans_model_,
+                                             computer_, decode_fst_,
+                                             &feature_pipeline);
+
+    BaseFloat samp_freq = wave_data_.SampFreq();
+    int32 chunk_length;
+    if (chunk_length_secs_ > 0) {
+      chunk_length = int32(samp_freq * chunk_length_secs_);
+      if (chunk_length == 0) chunk_length = 1;
+    } else {
+      chunk_length = std::numeric_limits<int32>::max();
+    }
+
+    int32 samp_offset = 0;
+    std::vector<std::pair<int32, BaseFloat> > delta_weights;
+
+    while (samp_offset < data.Dim()) {
+      int32 samp_remaining = data.Dim() - samp_offset;
+      int32 num_samp = chunk_length < samp_remaining ? chunk_length
+                                                     : samp_remaining;
+
+      SubVector<BaseFloat> wave_part(data, samp_offset, num_samp);
+      feature_pipeline.AcceptWaveform(samp_freq, wave_part);
+
+      samp_offset += num_samp;
+      if (samp_offset == data.Dim()) {
+        // no more input. flush out last frames
+        feature_pipeline.InputFinished();
+      }
+
+      if (silence_weighting.Active() &&
+          feature_pipeline.IvectorFeature() != NULL) {
+        silence_weighting.ComputeCurrentTraceback(decoder.Decoder());
+        silence_weighting.GetDeltaWeights(feature_pipeline.NumFramesReady(),
+                                          &delta_weights);
+        feature_pipeline.IvectorFeature()->UpdateFrameWeights(delta_weights);
+      }
+
+      decoder.AdvanceDecoding();
+
+      if (do_endpointing_ && decoder.EndpointDetected(endpoint_opts_))
+        break;
+    }
+    decoder.FinalizeDecoding();
+    if (decoder.NumFramesDecoded() == 0) {
+      KALDI_WARN << "No frames decoded for utterance " << utt_;
+      return;
+    }
+    bool end_of_utterance = true;
+    decoder.GetLattice(end_of_utterance, &clat_);
+    // we want to output the lattice with un-scaled acoustics.
+    BaseFloat inv_acoustic_scale =
+        1.0 / computer_->GetOptions().acoustic_scale;
+    ScaleLattice(AcousticLatticeScale(inv_acoustic_scale), &clat_);
+  }
+
+  ~OnlineNnet3BatchDecodeTask() {
+    if (clat_.NumStates() == 0) {
+      KALDI_WARN << "Empty lattice for utterance " << utt_;
+      return;
+    }
+    CompactLattice best_path_clat;
+    CompactLatticeShortestPath(clat_, &best_path_clat);
+    Lattice best_path_lat;
+    ConvertLattice(best_path_clat, &best_path_lat);
+    LatticeWeight weight;
+    std::vector<int32> alignment;
+    std::vector<int32> words;
+    GetLinearSymbolSequence(best_path_lat, &alignment, &words, &weight);
+    int32 num_frames = alignment.size();
+    // the lattice has un-scaled acoustics, so rescale for the likelihood.
+    double likelihood = -(computer_->GetOptions().acoustic_scale *
+                          weight.Value2() + weight.Value1());
+    *tot_num_frames_ += num_frames;
+    *tot_like_ += likelihood;
+    KALDI_VLOG(2) << "Likelihood per frame for utterance " << utt_ << " is "
+                  << (likelihood / num_frames) << " over " << num_frames
+                  << " frames.";
+    if (word_syms_ != NULL) {
+      std::cerr << utt_ << ' ';
+      for (size_t i = 0; i < words.size(); i++) {
+        std::string s = word_syms_->Find(words[i]);
+        if (s == "")
+          KALDI_ERR << "Word-id " << words[i] << " not in symbol table.";
+        std::cerr << s << ' ';
+      }
+      std::cerr << std::endl;
+    }
+    clat_writer_->Write(utt_, clat_);
+    KALDI_LOG << "Decoded utterance " << utt_;
+    (*num_done_)++;
+  }
+
+ private:
+  std::string utt_;
+  WaveData wave_data_;
+  const OnlineNnet2FeaturePipelineInfo &feature_info_;
+  const LatticeFasterDecoderConfig &decoder_opts_;
+  const OnlineEndpointConfig &endpoint_opts_;
+  const TransitionModel &trans_model_;
+  nnet3::NnetBatchComputer *computer_;
+  const fst::Fst<fst::StdArc> &decode_fst_;
+  const fst::SymbolTable *word_syms_;
+  BaseFloat chunk_length_secs_;
+  bool do_endpointing_;
+  CompactLatticeWriter *clat_writer_;
+  int32 *num_done_;
+  int64 *tot_num_frames_;
+  double *tot_like_;
+  CompactLattice clat_;  // the output.
+};
+
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace kaldi;
+    using namespace fst;
+
+    typedef kaldi::int32 int32;
+    typedef kaldi::int64 int64;
+
+    const char *usage =
+        "Reads in wav file(s) and simulates online decoding of many audio\n"
+        "streams at once with neural nets (nnet3 setup), with optional\n"
+        "iVector-based speaker adaptation and optional endpointing.  Each\n"
+        "stream is decoded in its own thread, and the neural net computation\n"
+        "for all streams is done in a single background thread (or on a GPU),\n"
+        "in minibatches that contain chunks from different streams.  The\n"
+        "latency/throughput trade-off is controlled by --frames-per-chunk,\n"
+        "--minibatch-size and --max-wait-ms; the chunks of each stream are\n"
+        "computed with looped computation as in\n"
+        "online2-wav-nnet3-latgen-faster, in minibatches of exactly\n"
+        "--minibatch-size streams, so set it to about --num-threads.  Each\n"
+        "utterance starts with the default iVector adaptation state, as if\n"
+        "it were a separate stream.\n"
+        "\n"
+        "Usage: online2-wav-nnet3-latgen-batch [options] <nnet3-in> <fst-in> "
+        "<spk2utt-rspecifier> <wav-rspecifier> <lattice-wspecifier>\n"
+        "The spk2utt-rspecifier can just be <utterance-id> <utterance-id> if\n"
+        "you want to decode utterance by utterance.\n";
+
+    ParseOptions po(usage);
+
+    std::string word_syms_rxfilename;
+
+    // feature_opts includes configuration for the iVector adaptation,
+    // as well as the basic features.
+    OnlineNnet2FeaturePipelineConfig feature_opts;
+    nnet3::NnetBatchComputerOptions decodable_opts;
+    LatticeFasterDecoderConfig decoder_opts;
+    OnlineEndpointConfig endpoint_opts;
+    TaskSequencerConfig sequencer_config;  // has --num-threads option
+
+    BaseFloat chunk_length_secs = 0.18;
+    bool do_endpointing = false;
+    bool online = true;
+    std::string use_gpu = "no";
+
+    sequencer_config.num_threads = 16;
+    decodable_opts.minibatch_size = 16;
+
+    po.Register("chunk-length", &chunk_length_secs,
+                "Length of chunk size in seconds, that we process.  Set to <= 0 "
+                "to use all input in one chunk.");
+    po.Register("word-symbol-table", &word_syms_rxfilename,
+                "Symbol table for words [for debug output]");
+    po.Register("do-endpointing", &do_endpointing,
+                "If true, apply endpoint detection");
+    po.Register("online", &online,
+                "You can set this to false to disable online iVector estimation "
+                "and have all the data for each utterance used, even at "
+                "utterance start.  Setting this to false has the same effect "
+                "as setting --use-most-recent-ivector=true and "
+                "--greedy-ivector-extractor=true in the file given to "
+                "--ivector-extraction-config, and --chunk-length=-1.");
+    po.Register("num-threads-startup", &g_num_threads,
+                "Number of threads used when initializing iVector extractor.");
+    po.Register("use-gpu", &use_gpu,
+                "yes|no|optional|wait, only has effect if compiled with CUDA");
+
+    feature_opts.Register(&po);
+    decodable_opts.Register(&po);
+    decoder_opts.Register(&po);
+    endpoint_opts.Register(&po);
+    sequencer_config.Register(&po);
+
+    po.Read(argc, argv);
+
+    if (po.NumArgs() != 5) {
+      po.PrintUsage();
+      return 1;
+    }
+
+    std::string nnet3_rxfilename = po.GetArg(1),
+        fst_rxfilename = po.GetArg(2),
+        spk2utt_rspecifier = po.GetArg(3),
+        wav_rspecifier = po.GetArg(4),
+        clat_wspecifier = po.GetArg(5);
+
+#if HAVE_CUDA==1
+    CuDevice::Instantiate().AllowMultithreading();
+    CuDevice::Instantiate().SelectGpuId(use_gpu);
+#endif
+
+    OnlineNnet2FeaturePipelineInfo feature_info(feature_opts);
+
+    if (!online) {
+      feature_info.ivector_extractor_info.use_most_recent_ivector = true;
+      feature_info.ivector_extractor_info.greedy_ivector_extractor = true;
+      chunk_length_secs = -1.0;
+    }
+
+    TransitionModel trans_model;
+    nnet3::AmNnetSimple am_nnet;
+    {
+      bool binary;
+      Input ki(nnet3_rxfilename, &binary);
+      trans_model.Read(ki.Stream(), binary);
+      am_nnet.Read(ki.Stream(), binary);
+      SetBatchnormTestMode(true, &(am_nnet.GetNnet()));
+      SetDropoutTestMode(true, &(am_nnet.GetNnet()));
+      nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
+    }
+
+    fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
+
+    fst::SymbolTable *word_syms = NULL;
+    if (word_syms_rxfilename != "")
+      if (!(word_syms = fst::SymbolTable::ReadText(word_syms_rxfilename)))
+        KALDI_ERR << "Could not read symbol table from file "
+                  << word_syms_rxfilename;
+
+    int32 num_done = 0, num_err = 0;
+    double tot_like = 0.0;
+    int64 num_frames = 0;
+    Timer timer;
+    double tot_audio_seconds = 0.0;
+
+    SequentialTokenVectorReader spk2utt_reader(spk2utt_rspecifier);
+    RandomAccessTableReader<WaveHolder> wav_reader(wav_rspecifier);
+    CompactLatticeWriter clat_writer(clat_wspecifier);
+
+    {
+      // The computer must be declared before the sequencer, so that it is
+      // destroyed after all the decoding tasks have finished.
+      nnet3::NnetBatchComputer computer(decodable_opts, am_nnet.GetNnet(),
+                                        am_nnet.Priors());
+      TaskSequencer<OnlineNnet3BatchDecodeTask> sequencer(sequencer_config);
+
+      for (; !spk2utt_reader.Done(); spk2utt_reader.Next()) {
+        const std::vector<std::string> &uttlist = spk2utt_reader.Value();
+        for (size_t i = 0; i < uttlist.size(); i++) {
+          std::string utt = uttlist[i];
+          if (!wav_reader.HasKey(utt)) {
+            KALDI_WARN << "Did not find audio for utterance " << utt;
+            num_err++;
+            continue;
+          }
+          const WaveData &wave_data = wav_reader.Value(utt);
+          tot_audio_seconds += wave_data.Duration();
+          sequencer.Run(new OnlineNnet3BatchDecodeTask(
+              utt, wave_data, feature_info, decoder_opts, endpoint_opts,
+              trans_model, &computer, *decode_fst, word_syms,
+              chunk_length_secs, do_endpointing, &clat_writer,
+              &num_done, &num_frames, &tot_like));
+        }
+      }
+      sequencer.Wait();
+    }
+
+    double elapsed = timer.Elapsed();
+    KALDI_LOG << "Time taken " << elapsed
+              << "s: real-time factor is "
+              << (elapsed / std::max(tot_audio_seconds, 1.0e-10))
+              << " (over " << tot_audio_seconds << " seconds of audio, "
+              << "with up to " << sequencer_config.num_threads
+              << " streams at once)";
+    KALDI_LOG << "Decoded " << num_done << " utterances, "
+              << num_err << " with errors.";
+    KALDI_LOG << "Overall likelihood per frame was " << (tot_like / num_frames)
+              << " per frame over " << num_frames << " frames.";
+    delete decode_fst;
+    delete word_syms; // will delete if non-NULL.
+    return (num_done != 0 ? 0 : 1);
+  } catch(const std::exception& e) {
+    std::cerr << e.what();
+    return -1;
+  }
+} // main()
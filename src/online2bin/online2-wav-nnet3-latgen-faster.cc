@@ -101,6 +101,7 @@ int main(int argc, char *argv[]) {
     // as well as the basic features.
     OnlineNnet2FeaturePipelineConfig feature_opts;
     nnet3::NnetSimpleLoopedComputationOptions decodable_opts;
+    nnet3::ComputationCacheOptions cache_opts;
     LatticeFasterDecoderConfig decoder_opts;
     OnlineEndpointConfig endpoint_opts;
 
@@ -129,6 +130,7 @@ int main(int argc, char *argv[]) {
 
     feature_opts.Register(&po);
     decodable_opts.Register(&po);
+    cache_opts.Register(&po);
     decoder_opts.Register(&po);
     endpoint_opts.Register(&po);
 
@@ -166,11 +168,18 @@ int main(int argc, char *argv[]) {
       nnet3::CollapseModel(nnet3::CollapseModelConfig(), &(am_nnet.GetNnet()));
     }
 
+    // the looped computation is obtained via this compiler, so that it can
+    // be read from (and written to) the --computation-cache.
+    nnet3::CachingOptimizingCompiler compiler(am_nnet.GetNnet(),
+                                              decodable_opts.optimize_config);
+    nnet3::ReadComputationCache(cache_opts, &compiler);
+
     // this object contains precomputed stuff that is used by all decodable
     // objects.  It takes a pointer to am_nnet because if it has iVectors it has
     // to modify the nnet to accept iVectors at intervals.
     nnet3::DecodableNnetSimpleLoopedInfo decodable_info(decodable_opts,
-                                                        &am_nnet);
+                                                        &am_nnet, &compiler);
+    nnet3::WriteComputationCache(cache_opts, &compiler);
 
 
     fst::Fst<fst::StdArc> *decode_fst = ReadFstKaldiGeneric(fst_rxfilename);
@@ -0,0 +1,173 @@
+// rnnlm/rnnlm-compute-state-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sstream>
+
+#include "rnnlm/rnnlm-compute-state.h"
+
+namespace kaldi {
+namespace rnnlm {
+
+// Creates a small recurrent RNNLM whose state spans several frames.
+void CreateTestRnnlm(int32 embedding_dim, nnet3::Nnet *rnnlm) {
+  int32 hidden_dim = 10;
+  std::ostringstream config;
+  config << "input-node name=input dim=" << embedding_dim << "\n"
+         << "component name=affine1 type=AffineComponent input-dim="
+         << (embedding_dim + hidden_dim) << " output-dim=" << hidden_dim
+         << " param-stddev=0.3 bias-stddev=0.1\n"
+         << "component name=relu1 type=RectifiedLinearComponent dim="
+         << hidden_dim << "\n"
+         << "component name=affine2 type=AffineComponent input-dim="
+         << (2 * hidden_dim) << " output-dim=" << embedding_dim
+         << " param-stddev=0.3 bias-stddev=0.1\n"
+         << "component-node name=affine1 component=affine1 "
+         << "input=Append(input, IfDefined(Offset(relu1, -1)))\n"
+         << "component-node name=relu1 component=relu1 input=affine1\n"
+         << "component-node name=affine2 component=affine2 "
+         << "input=Append(relu1, IfDefined(Offset(relu1, -2)))\n"
+         << "output-node name=output input=affine2\n";
+  std::istringstream is(config.str());
+  rnnlm->ReadConfig(is);
+}
+
+void UnitTestRnnlmComputeStatePool() {
+  int32 embedding_dim = 6, num_words = 20;
+  nnet3::Nnet rnnlm;
+  CreateTestRnnlm(embedding_dim, &rnnlm);
+  CuMatrix<BaseFloat> word_embedding_mat(num_words, embedding_dim);
+  word_embedding_mat.SetRandn();
+
+  RnnlmComputeStateComputationOptions opts;
+  opts.bos_index = 1;
+  opts.eos_index = 2;
+  opts.normalize_probs = (RandInt(0, 1) == 0);
+  opts.batch_size = RandInt(2, 5);
+  // The pool and the states share the cache, so they should agree if they
+  // look up the same histories.
+  opts.normalizer_cache_order = RandInt(0, 2);
+  RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+  RnnlmComputeStatePool pool(info);
+
+  for (int32 n = 0; n < 2; n++) {
+    // A tree of histories, computed both with RnnlmComputeState and with the
+    // pool.
+    std::vector<RnnlmComputeState*> states;
+    states.push_back(new RnnlmComputeState(info, opts.bos_index));
+    int32 num_states = RandInt(1, 40);
+    for (int32 s = 1; s < num_states; s++) {
+      int32 parent = RandInt(0, s - 1), word = RandInt(3, num_words - 1);
+      // With the pool, the parent's computation may not have been done yet.
+      if (RandInt(0, 1) == 0)
+        pool.LogProbOfWord(parent, word);
+      KALDI_ASSERT(pool.AddSuccessorState(parent, word) == s);
+      states.push_back(states[parent]->GetSuccessorState(word));
+    }
+    KALDI_ASSERT(pool.NumStates() == num_states);
+    for (int32 i = 0; i < 3 * num_states; i++) {
+      int32 s = RandInt(0, num_states - 1), word = RandInt(1, num_words - 1);
+      AssertEqual(pool.LogProbOfWord(s, word),
+                  states[s]->LogProbOfWord(word), 1.0e-04);
+    }
+    for (int32 s = 0; s < num_states; s++)
+      delete states[s];
+    pool.Clear();
+    KALDI_ASSERT(pool.NumStates() == 1);
+  }
+}
+
+void UnitTestRnnlmNormalizer() {
+  int32 embedding_dim = 8, num_words = 200;
+  CuMatrix<BaseFloat> word_embedding_mat(num_words, embedding_dim);
+  word_embedding_mat.SetRandn();
+  std::vector<BaseFloat> unigram_probs(num_words);
+  for (int32 i = 1; i < num_words; i++)
+    unigram_probs[i] = RandUniform() + 0.1;
+  double sum = 0.0;
+  for (int32 i = 0; i < num_words; i++)
+    sum += unigram_probs[i];
+  for (int32 i = 0; i < num_words; i++)
+    unigram_probs[i] /= sum;
+
+  // The normalizers keep a reference to the options.
+  RnnlmComputeStateComputationOptions exact_opts;
+  exact_opts.normalize_probs = true;
+  RnnlmNormalizer exact_normalizer(exact_opts, word_embedding_mat, NULL);
+  KALDI_ASSERT(exact_normalizer.IsExact());
+
+  RnnlmComputeStateComputationOptions cached_opts(exact_opts);
+  cached_opts.normalizer_cache_order = 2;
+  cached_opts.normalizer_check_period = 3;
+  RnnlmNormalizer cached_normalizer(cached_opts, word_embedding_mat, NULL);
+
+  RnnlmComputeStateComputationOptions sampled_opts(exact_opts);
+  sampled_opts.normalization_method = "sampled";
+  sampled_opts.num_normalizer_samples = 100;
+  RnnlmNormalizer sampled_normalizer(sampled_opts, word_embedding_mat,
+                                     &unigram_probs);
+
+  for (int32 n = 0; n < 5; n++) {
+    CuVector<BaseFloat> embedding(embedding_dim);
+    embedding.SetRandn();
+    embedding.Scale(0.5);
+    Vector<BaseFloat> scores(num_words);
+    scores.AddMatVec(1.0, Matrix<BaseFloat>(word_embedding_mat), kNoTrans,
+                     Vector<BaseFloat>(embedding), 0.0);
+    double z = 0.0;
+    for (int32 i = 1; i < num_words; i++)
+      z += Exp(scores(i));
+    std::vector<int32> history;
+    history.push_back(1);
+    history.push_back(n + 3);
+    AssertEqual(exact_normalizer.Compute(history, embedding), Log(z),
+                1.0e-04);
+
+    // The first lookup of a history computes the exact normalizer, later
+    // ones return it even for a different embedding.
+    BaseFloat cached = cached_normalizer.Compute(history, embedding);
+    AssertEqual(cached, Log(z), 1.0e-04);
+    CuVector<BaseFloat> other_embedding(embedding_dim);
+    other_embedding.SetRandn();
+    history.insert(history.begin(), 5);
+    KALDI_ASSERT(cached_normalizer.Compute(history, other_embedding) ==
+                 cached);
+
+    // The sampled estimate is unbiased.
+    int32 num_trials = 200;
+    double z_estimate = 0.0;
+    for (int32 i = 0; i < num_trials; i++)
+      z_estimate += Exp(sampled_normalizer.Compute(history, embedding)) /
+          num_trials;
+    KALDI_LOG << "Normalizer is " << z << ", estimate is " << z_estimate;
+    KALDI_ASSERT(std::abs(z_estimate - z) < 0.05 * z);
+  }
+  cached_normalizer.PrintStats();
+}
+
+}  // namespace rnnlm
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  using namespace kaldi::rnnlm;
+  SetVerboseLevel(0);
+  for (int32 i = 0; i < 10; i++)
+    UnitTestRnnlmComputeStatePool();
+  UnitTestRnnlmNormalizer();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -26,11 +26,144 @@
 namespace kaldi {
 namespace rnnlm {
 
+RnnlmNormalizer::RnnlmNormalizer(
+    const RnnlmComputeStateComputationOptions &opts,
+    const CuMatrix<BaseFloat> &word_embedding_mat,
+    const std::vector<BaseFloat> *unigram_probs):
+    opts_(opts), word_embedding_mat_(word_embedding_mat), sampler_(NULL),
+    num_computed_(0), num_cached_(0), num_checked_(0), tot_error_(0.0),
+    tot_abs_error_(0.0) {
+  KALDI_ASSERT(opts_.normalizer_cache_order >= 0 &&
+               opts_.normalizer_check_period >= 0);
+  if (opts_.normalization_method == "sampled") {
+    if (unigram_probs == NULL)
+      KALDI_ERR << "--normalization-method=sampled requires unigram "
+                << "probabilities.";
+    if (static_cast<int32>(unigram_probs->size()) !=
+        word_embedding_mat_.NumRows())
+      KALDI_ERR << "Number of unigram probabilities " << unigram_probs->size()
+                << " does not match the vocabulary size "
+                << word_embedding_mat_.NumRows();
+    int32 num_nonzero = 0;
+    for (size_t i = 0; i < unigram_probs->size(); i++)
+      if ((*unigram_probs)[i] > 0.0)
+        num_nonzero++;
+    if (opts_.num_normalizer_samples <= 0 ||
+        opts_.num_normalizer_samples >= num_nonzero)
+      KALDI_ERR << "--num-normalizer-samples=" << opts_.num_normalizer_samples
+                << " must be >0 and less than the number of words with "
+                << "nonzero unigram probability, " << num_nonzero;
+    sampler_ = new Sampler(*unigram_probs);
+  } else if (opts_.normalization_method != "exact") {
+    KALDI_ERR << "Invalid --normalization-method: "
+              << opts_.normalization_method;
+  }
+}
+
+RnnlmNormalizer::~RnnlmNormalizer() {
+  delete sampler_;
+}
+
+BaseFloat RnnlmNormalizer::ComputeExact(
+    const CuVectorBase<BaseFloat> &embedding) const {
+  CuVector<BaseFloat> log_probs(word_embedding_mat_.NumRows(), kUndefined);
+  log_probs.AddMatVec(1.0, word_embedding_mat_, kNoTrans, embedding, 0.0);
+  log_probs.ApplyExp();
+  // We exclude the <eps> symbol which is always 0.
+  return log(log_probs.Range(1, log_probs.Dim() - 1).Sum());
+}
+
+BaseFloat RnnlmNormalizer::ComputeSampled(
+    const CuVectorBase<BaseFloat> &embedding) const {
+  std::vector<std::pair<int32, BaseFloat> > higher_order_probs, sample;
+  sampler_->SampleWords(opts_.num_normalizer_samples, 1.0,
+                        higher_order_probs, &sample);
+  int32 num_samples = sample.size();
+  std::vector<int32> words(num_samples);
+  for (int32 i = 0; i < num_samples; i++)
+    words[i] = sample[i].first;
+  CuMatrix<BaseFloat> sampled_embeddings(num_samples,
+                                         word_embedding_mat_.NumCols(),
+                                         kUndefined);
+  sampled_embeddings.CopyRows(word_embedding_mat_, CuArray<int32>(words));
+  CuVector<BaseFloat> log_probs(num_samples, kUndefined);
+  log_probs.AddMatVec(1.0, sampled_embeddings, kNoTrans, embedding, 0.0);
+  Vector<BaseFloat> log_probs_cpu(log_probs);
+  // Each word is weighted by the inverse of the probability with which it was
+  // included in the sample.
+  double sum = 0.0;
+  for (int32 i = 0; i < num_samples; i++)
+    sum += Exp(log_probs_cpu(i)) / sample[i].second;
+  return log(sum);
+}
+
+BaseFloat RnnlmNormalizer::Compute(const std::vector<int32> &history,
+                                   const CuVectorBase<BaseFloat> &embedding) {
+  if (IsExact())
+    return ComputeExact(embedding);
+  std::vector<int32> key;
+  if (opts_.normalizer_cache_order > 0) {
+    int32 order = std::min<int32>(opts_.normalizer_cache_order,
+                                  history.size());
+    key.assign(history.end() - order, history.end());
+  }
+  bool check = false, found = false;
+  BaseFloat ans = 0.0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_computed_++;
+    check = (opts_.normalizer_check_period > 0 &&
+             num_computed_ % opts_.normalizer_check_period == 0);
+    if (opts_.normalizer_cache_order > 0) {
+      CacheType::const_iterator iter = cache_.find(key);
+      if (iter != cache_.end()) {
+        found = true;
+        ans = iter->second;
+        num_cached_++;
+      }
+    }
+  }
+  if (!found)
+    ans = (sampler_ != NULL ? ComputeSampled(embedding) :
+           ComputeExact(embedding));
+  bool store = (!found && opts_.normalizer_cache_order > 0);
+  if (check || store) {
+    BaseFloat exact = 0.0;
+    if (check)
+      exact = (!found && sampler_ == NULL ? ans : ComputeExact(embedding));
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (store)
+      cache_[key] = ans;
+    if (check) {
+      num_checked_++;
+      tot_error_ += ans - exact;
+      tot_abs_error_ += std::abs(ans - exact);
+    }
+  }
+  return ans;
+}
+
+void RnnlmNormalizer::PrintStats() const {
+  if (IsExact())
+    return;
+  if (opts_.normalizer_cache_order > 0)
+    KALDI_LOG << "Took " << num_cached_ << " of " << num_computed_
+              << " normalizers from the cache (" << cache_.size()
+              << " histories of order " << opts_.normalizer_cache_order << ").";
+  if (num_checked_ > 0)
+    KALDI_LOG << "Over " << num_checked_ << " checks, the approximate "
+              << "log-normalizers differ from the exact ones by "
+              << (tot_error_ / num_checked_) << " on average (mean absolute "
+              << "difference " << (tot_abs_error_ / num_checked_) << ").";
+}
+
 RnnlmComputeStateInfo::RnnlmComputeStateInfo(
     const RnnlmComputeStateComputationOptions &opts,
     const kaldi::nnet3::Nnet &rnnlm,
-    const CuMatrix<BaseFloat> &word_embedding_mat):
-    opts(opts), rnnlm(rnnlm), word_embedding_mat(word_embedding_mat) {
+    const CuMatrix<BaseFloat> &word_embedding_mat,
+    const std::vector<BaseFloat> *unigram_probs):
+    opts(opts), rnnlm(rnnlm), word_embedding_mat(word_embedding_mat),
+    normalizer(NULL) {
   KALDI_ASSERT(IsSimpleNnet(rnnlm));
   int32 left_context, right_context;
   ComputeSimpleNnetContext(rnnlm, &left_context, &right_context);
@@ -68,6 +201,27 @@ RnnlmComputeStateInfo::RnnlmComputeStateInfo(
     KALDI_VLOG(3) << "Computation is:";
     computation.Print(std::cerr, rnnlm);
   }
+
+  if (opts.batch_size > 1) {
+    CreateLoopedComputationRequestSimple(rnnlm,
+                                         1, // num_frames
+                                         frame_subsampling_factor,
+                                         1, // ivector_period = 1
+                                         0, // extra_left_context_initial == 0
+                                         0, // extra_right_context == 0
+                                         opts.batch_size, // num_sequences
+                                         &request1, &request2, &request3);
+    CompileLooped(rnnlm, opts.optimize_config, request1, request2,
+                  request3, &batch_computation);
+    batch_computation.ComputeCudaIndexes();
+  }
+
+  if (opts.normalize_probs)
+    normalizer = new RnnlmNormalizer(opts, word_embedding_mat, unigram_probs);
+}
+
+RnnlmComputeStateInfo::~RnnlmComputeStateInfo() {
+  delete normalizer;
 }
 
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
@@ -83,6 +237,7 @@ RnnlmComputeState::RnnlmComputeState(const RnnlmComputeStateInfo &info,
 RnnlmComputeState::RnnlmComputeState(const RnnlmComputeState &other):
   info_(other.info_), computer_(other.computer_),
   previous_word_(other.previous_word_),
+  history_(other.history_),
   normalization_factor_(other.normalization_factor_)
 {}
 
@@ -97,16 +252,15 @@ void RnnlmComputeState::AddWord(int32 word_index) {
   previous_word_ = word_index;
   AdvanceChunk();
 
-  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
   if (info_.opts.normalize_probs) {
-    CuVector<BaseFloat> log_probs(info_.word_embedding_mat.NumRows());
-
-    log_probs.AddMatVec(1.0, word_embedding_mat, kNoTrans,
-                        predicted_word_embedding_->Row(0), 0.0);
-    log_probs.ApplyExp();
-
-    // We excluding the <eps> symbol which is always 0.
-    normalization_factor_ = log(log_probs.Range(1, log_probs.Dim() - 1).Sum());
+    int32 cache_order = info_.opts.normalizer_cache_order;
+    if (cache_order > 0) {
+      if (static_cast<int32>(history_.size()) == cache_order)
+        history_.erase(history_.begin());
+      history_.push_back(word_index);
+    }
+    normalization_factor_ = info_.normalizer->Compute(
+        history_, predicted_word_embedding_->Row(0));
   }
 }
 
@@ -157,5 +311,201 @@ void RnnlmComputeState::AdvanceChunk() {
   }
 }
 
+RnnlmComputeStatePool::RnnlmComputeStatePool(
+    const RnnlmComputeStateInfo &info):
+    info_(info),
+    batch_size_(info.opts.batch_size),
+    num_blocks_used_(1) {
+  KALDI_ASSERT(batch_size_ > 1);
+  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
+  // All the sequences start with the BOS history; the first one is the BOS
+  // state.
+  nnet3::NnetComputer *computer = new nnet3::NnetComputer(
+      info_.opts.compute_config, info_.batch_computation,
+      info_.rnnlm, NULL);  // NULL is 'nnet_to_update'
+  CuMatrix<BaseFloat> input_embeddings(batch_size_,
+                                       word_embedding_mat.NumCols(),
+                                       kUndefined);
+  input_embeddings.CopyRowsFromVec(
+      word_embedding_mat.Row(info_.opts.bos_index));
+  computer->AcceptInput("input", &input_embeddings);
+  computer->Run();
+  const CuMatrixBase<BaseFloat> &output(computer->GetOutput("output"));
+  int32 program_counter = computer->ProgramCounter();
+  computers_[program_counter] = computer;
+  state_blocks_.push_back(new CuMatrix<BaseFloat>(
+      batch_size_, computer->SequenceStateDim(batch_size_), kUndefined));
+  computer->GetSequenceStates(state_blocks_[0]);
+  embedding_blocks_.push_back(new CuMatrix<BaseFloat>(output));
+  block_program_counter_.push_back(program_counter);
+
+  parent_.push_back(-1);
+  word_.push_back(info_.opts.bos_index);
+  row_.push_back(0);
+  if (info_.opts.normalize_probs) {
+    normalization_factor_.push_back(0.0);
+    std::vector<int32> states(1, 0);
+    ComputeNormalizationFactors(states, *(embedding_blocks_[0]));
+  }
+}
+
+RnnlmComputeStatePool::~RnnlmComputeStatePool() {
+  for (size_t i = 0; i < state_blocks_.size(); i++) {
+    delete state_blocks_[i];
+    delete embedding_blocks_[i];
+  }
+  std::map<int32, nnet3::NnetComputer*>::iterator iter = computers_.begin();
+  for (; iter != computers_.end(); ++iter)
+    delete iter->second;
+}
+
+int32 RnnlmComputeStatePool::AddSuccessorState(int32 state, int32 next_word) {
+  KALDI_ASSERT(state >= 0 && state < NumStates() && next_word > 0 &&
+               next_word < info_.word_embedding_mat.NumRows());
+  // We need the parent's state to know the layout of the new state.
+  if (row_[state] == -1)
+    ComputeStates(state);
+  parent_.push_back(state);
+  word_.push_back(next_word);
+  row_.push_back(-1);
+  if (info_.opts.normalize_probs)
+    normalization_factor_.push_back(0.0);
+  int32 ans = NumStates() - 1;
+  pending_[block_program_counter_[Block(state)]].push_back(ans);
+  return ans;
+}
+
+BaseFloat RnnlmComputeStatePool::LogProbOfWord(int32 state,
+                                               int32 word_index) {
+  KALDI_ASSERT(state >= 0 && state < NumStates());
+  if (row_[state] == -1)
+    ComputeStates(state);
+  BaseFloat log_prob = VecVec(
+      embedding_blocks_[Block(state)]->Row(Row(state)),
+      info_.word_embedding_mat.Row(word_index));
+  if (info_.opts.normalize_probs)
+    log_prob -= normalization_factor_[state];
+  return log_prob;
+}
+
+void RnnlmComputeStatePool::Clear() {
+  parent_.resize(1);
+  word_.resize(1);
+  row_.resize(1);
+  if (info_.opts.normalize_probs)
+    normalization_factor_.resize(1);
+  pending_.clear();
+  num_blocks_used_ = 1;
+  block_program_counter_.resize(1);
+}
+
+void RnnlmComputeStatePool::ComputeStates(int32 state) {
+  int32 program_counter = block_program_counter_[Block(parent_[state])];
+  std::deque<int32> &pending = pending_[program_counter];
+  std::vector<int32> states(1, state);
+  while (static_cast<int32>(states.size()) < batch_size_ &&
+         !pending.empty()) {
+    int32 s = pending.front();
+    pending.pop_front();
+    if (row_[s] == -1 && s != state)
+      states.push_back(s);
+  }
+
+  // The sequences we don't need are given the parent state and word of
+  // "state".
+  int32 num_states = states.size();
+  std::vector<const BaseFloat*> parent_states(batch_size_);
+  std::vector<int32> words(batch_size_, word_[state]);
+  for (int32 i = 0; i < batch_size_; i++) {
+    int32 parent = parent_[states[i < num_states ? i : 0]];
+    KALDI_ASSERT(row_[parent] != -1);
+    parent_states[i] = state_blocks_[Block(parent)]->RowData(Row(parent));
+    if (i < num_states)
+      words[i] = word_[states[i]];
+  }
+
+  KALDI_ASSERT(computers_.count(program_counter) != 0);
+  nnet3::NnetComputer *computer = computers_[program_counter];
+  bool in_place = (steady_.count(program_counter) != 0);
+  if (!in_place)
+    computer = new nnet3::NnetComputer(*computer);
+  CuMatrix<BaseFloat> sequence_states(
+      batch_size_, computer->SequenceStateDim(batch_size_), kUndefined);
+  sequence_states.CopyRows(CuArray<const BaseFloat*>(parent_states));
+  computer->SetSequenceStates(sequence_states);
+
+  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
+  CuMatrix<BaseFloat> input_embeddings(batch_size_,
+                                       word_embedding_mat.NumCols(),
+                                       kUndefined);
+  input_embeddings.CopyRows(word_embedding_mat, CuArray<int32>(words));
+  computer->AcceptInput("input", &input_embeddings);
+  computer->Run();
+  const CuMatrixBase<BaseFloat> &output(computer->GetOutput("output"));
+  int32 next_program_counter = computer->ProgramCounter();
+
+  if (num_blocks_used_ == static_cast<int32>(state_blocks_.size())) {
+    state_blocks_.push_back(new CuMatrix<BaseFloat>());
+    embedding_blocks_.push_back(new CuMatrix<BaseFloat>());
+  }
+  int32 block = num_blocks_used_++;
+  state_blocks_[block]->Resize(batch_size_,
+                               computer->SequenceStateDim(batch_size_),
+                               kUndefined);
+  computer->GetSequenceStates(state_blocks_[block]);
+  embedding_blocks_[block]->Resize(output.NumRows(), output.NumCols(),
+                                   kUndefined);
+  embedding_blocks_[block]->CopyFromMat(output);
+  block_program_counter_.push_back(next_program_counter);
+  for (int32 i = 0; i < num_states; i++)
+    row_[states[i]] = block * batch_size_ + i;
+
+  if (!in_place) {
+    // Once we reach the loop of the computation, the computer returns to the
+    // same program counter and from then on we can run it in place.
+    if (next_program_counter == program_counter)
+      steady_.insert(program_counter);
+    if (computers_.count(next_program_counter) == 0)
+      computers_[next_program_counter] = computer;
+    else
+      delete computer;
+  }
+  if (info_.opts.normalize_probs)
+    ComputeNormalizationFactors(states, *(embedding_blocks_[block]));
+}
+
+void RnnlmComputeStatePool::ComputeNormalizationFactors(
+    const std::vector<int32> &states,
+    const CuMatrixBase<BaseFloat> &embeddings) {
+  const CuMatrix<BaseFloat> &word_embedding_mat = info_.word_embedding_mat;
+  int32 num_states = states.size(), num_words = word_embedding_mat.NumRows();
+  if (!info_.normalizer->IsExact()) {
+    int32 cache_order = info_.opts.normalizer_cache_order;
+    std::vector<int32> history;
+    for (int32 i = 0; i < num_states; i++) {
+      history.clear();
+      for (int32 s = states[i];
+           s != -1 && static_cast<int32>(history.size()) < cache_order;
+           s = parent_[s])
+        history.push_back(word_[s]);
+      std::reverse(history.begin(), history.end());
+      normalization_factor_[states[i]] = info_.normalizer->Compute(
+          history, embeddings.Row(i));
+    }
+    return;
+  }
+  CuMatrix<BaseFloat> probs(num_states, num_words, kUndefined);
+  probs.AddMatMat(1.0, embeddings.RowRange(0, num_states), kNoTrans,
+                  word_embedding_mat, kTrans, 0.0);
+  probs.ApplyExp();
+  CuVector<BaseFloat> log_sums(num_states);
+  // We exclude the <eps> symbol, as RnnlmComputeState::AddWord() does.
+  log_sums.AddColSumMat(1.0, probs.ColRange(1, num_words - 1), 0.0);
+  log_sums.ApplyLog();
+  Vector<BaseFloat> log_sums_cpu(log_sums);
+  for (int32 i = 0; i < num_states; i++)
+    normalization_factor_[states[i]] = log_sums_cpu(i);
+}
+
 } // namespace rnnlm
 } // namespace kaldi
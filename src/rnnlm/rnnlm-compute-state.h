@@ -22,12 +22,18 @@
 #ifndef KALDI_RNNLM_COMPUTE_STATE_H_
 #define KALDI_RNNLM_COMPUTE_STATE_H_
 
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
 #include <vector>
 #include "base/kaldi-common.h"
 #include "nnet3/nnet-optimize.h"
 #include "nnet3/nnet-compute.h"
 #include "nnet3/am-nnet-simple.h"
 #include "rnnlm/rnnlm-core-compute.h"
+#include "rnnlm/sampler.h"
+#include "util/stl-utils.h"
 
 namespace kaldi {
 namespace rnnlm {
@@ -41,6 +47,17 @@ struct RnnlmComputeStateComputationOptions {
   int32 eos_index;
   // This is not needed for computation; included only for ease of scripting.
   int32 brk_index;
+  // If >1, RnnlmComputeStatePool is used in lattice rescoring.
+  int32 batch_size;
+  // If >0, the number of states KaldiRnnlmDeterministicFst keeps in memory.
+  // Not supported if batch_size > 1.
+  int32 max_cached_states;
+  // The following are only relevant if normalize_probs is true; see class
+  // RnnlmNormalizer.
+  std::string normalization_method;
+  int32 normalizer_cache_order;
+  int32 num_normalizer_samples;
+  int32 normalizer_check_period;
   nnet3::NnetOptimizeOptions optimize_config;
   nnet3::NnetComputeOptions compute_config;
   RnnlmComputeStateComputationOptions():
@@ -48,7 +65,13 @@ struct RnnlmComputeStateComputationOptions {
       normalize_probs(false),
       bos_index(-1),
       eos_index(-1),
-      brk_index(-1)
+      brk_index(-1),
+      batch_size(1),
+      max_cached_states(0),
+      normalization_method("exact"),
+      normalizer_cache_order(0),
+      num_normalizer_samples(1000),
+      normalizer_check_period(0)
       { }
 
   void Register(OptionsItf *opts) {
@@ -64,6 +87,32 @@ struct RnnlmComputeStateComputationOptions {
     opts->Register("brk-symbol", &brk_index, "Index in wordlist representing "
                    "the break symbol. It is not needed in the computation "
                    "and we are including it for ease of scripting");
+    opts->Register("batch-size", &batch_size, "If >1, in lattice rescoring, "
+                   "compute the RNNLM states of up to this many word histories "
+                   "at a time, in one computation (faster, especially on GPU)");
+    opts->Register("max-cached-states", &max_cached_states, "If >0, in "
+                   "lattice rescoring, keep at most this many RNNLM states "
+                   "(and histories) in memory, evicting the least recently "
+                   "used ones and recomputing them when needed.  Bounds the "
+                   "memory used on long lattices.  Cannot be used with "
+                   "--batch-size > 1.");
+    opts->Register("normalization-method", &normalization_method, "Only "
+                   "relevant if --normalize-probs=true.  If 'exact', compute "
+                   "the normalizer of each history over the whole vocabulary; "
+                   "if 'sampled', estimate it from --num-normalizer-samples "
+                   "words sampled according to the unigram probabilities "
+                   "(requires unigram probabilities, e.g. --unigram-probs).");
+    opts->Register("normalizer-cache-order", &normalizer_cache_order, "If >0 "
+                   "(and --normalize-probs=true), histories that share their "
+                   "last this-many words (including <s>) share their "
+                   "normalizer, which is computed only once.");
+    opts->Register("num-normalizer-samples", &num_normalizer_samples,
+                   "Number of words sampled to estimate the normalizer, with "
+                   "--normalization-method=sampled.");
+    opts->Register("normalizer-check-period", &normalizer_check_period, "If "
+                   ">0, every this-many normalizers that are cached or "
+                   "estimated are also computed exactly, and the average "
+                   "difference is printed at the end (for diagnostics).");
 
     // Register the optimization options with the prefix "optimization".
     ParseOptions optimization_opts("optimization", opts);
@@ -75,6 +124,78 @@ struct RnnlmComputeStateComputationOptions {
   }
 };
 
+/*
+  RnnlmNormalizer computes the log of the normalizer sum_{w > 0} exp(e . w) of
+  the word distribution predicted by the RNNLM, where e is the predicted
+  embedding and w ranges over the rows of the word-embedding matrix (excluding
+  <eps>).  Computed exactly, this costs a matrix-vector product with the whole
+  word-embedding matrix per history, which dominates when the vocabulary is
+  large.  There are two cheaper alternatives, which may be combined:
+
+   - With opts.normalizer_cache_order = n > 0, the normalizer is cached and
+     reused for all histories that end in the same n words (an approximation,
+     since the RNNLM state depends on the whole history).
+
+   - With opts.normalization_method == "sampled", we sample
+     opts.num_normalizer_samples words with class Sampler, using the unigram
+     probabilities, and estimate the normalizer as sum_i exp(e . w_i) / q_i
+     where q_i is the probability with which word w_i was included in the
+     sample (an unbiased estimate of the normalizer).
+
+  With opts.normalizer_check_period > 0, we periodically compare with the exact
+  normalizer, and PrintStats() reports the difference.  This class is
+  thread-safe.
+*/
+class RnnlmNormalizer {
+ public:
+  /// "unigram_probs" is only needed if opts.normalization_method is "sampled"
+  /// (else it may be NULL).  Does not retain a reference to it.
+  RnnlmNormalizer(const RnnlmComputeStateComputationOptions &opts,
+                  const CuMatrix<BaseFloat> &word_embedding_mat,
+                  const std::vector<BaseFloat> *unigram_probs);
+
+  ~RnnlmNormalizer();
+
+  /// True if Compute() always returns the exact normalizer.
+  bool IsExact() const {
+    return sampler_ == NULL && opts_.normalizer_cache_order == 0;
+  }
+
+  /// Returns the (exact or approximate) log-normalizer for the predicted
+  /// embedding "embedding".  "history" is the sequence of words of the
+  /// history (at least the last opts.normalizer_cache_order words of it),
+  /// and is only used by the cache.
+  BaseFloat Compute(const std::vector<int32> &history,
+                    const CuVectorBase<BaseFloat> &embedding);
+
+  /// Returns the exact log-normalizer.
+  BaseFloat ComputeExact(const CuVectorBase<BaseFloat> &embedding) const;
+
+  /// Prints how often the cache was used and, if opts.normalizer_check_period
+  /// > 0, the difference from the exact normalizers.
+  void PrintStats() const;
+
+ private:
+  BaseFloat ComputeSampled(const CuVectorBase<BaseFloat> &embedding) const;
+
+  typedef unordered_map<std::vector<int32>, BaseFloat,
+                        VectorHasher<int32> > CacheType;
+
+  const RnnlmComputeStateComputationOptions &opts_;
+  const CuMatrix<BaseFloat> &word_embedding_mat_;
+  Sampler *sampler_;  // NULL unless opts_.normalization_method == "sampled".
+
+  std::mutex mutex_;  // Guards the members below.
+  CacheType cache_;
+  int64 num_computed_;
+  int64 num_cached_;
+  int64 num_checked_;
+  double tot_error_;
+  double tot_abs_error_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmNormalizer);
+};
+
 /*
   This class const references to the word-embedding, nnet3 part of rnnlm and
 the RnnlmComputeStateComputationOptions. It handles the computation of the nnet3
@@ -85,7 +206,10 @@ class RnnlmComputeStateInfo  {
   RnnlmComputeStateInfo(
       const RnnlmComputeStateComputationOptions &opts,
       const kaldi::nnet3::Nnet &rnnlm,
-      const CuMatrix<BaseFloat> &word_embedding_mat);
+      const CuMatrix<BaseFloat> &word_embedding_mat,
+      const std::vector<BaseFloat> *unigram_probs = NULL);
+
+  ~RnnlmComputeStateInfo();
 
   const RnnlmComputeStateComputationOptions &opts;
   const kaldi::nnet3::Nnet &rnnlm;
@@ -93,6 +217,18 @@ class RnnlmComputeStateInfo  {
 
   // The compiled, 'looped' computation.
   nnet3::NnetComputation computation;
+
+  // The same computation for opts.batch_size sequences (only compiled if
+  // opts.batch_size > 1); used by RnnlmComputeStatePool.
+  nnet3::NnetComputation batch_computation;
+
+  // Computes the normalizers of the word distributions; NULL unless
+  // opts.normalize_probs is true.  "unigram_probs", given to the constructor,
+  // is only needed with opts.normalization_method == "sampled".
+  RnnlmNormalizer *normalizer;
+
+ private:
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmComputeStateInfo);
 };
 
 /*
@@ -133,6 +269,10 @@ class RnnlmComputeState {
   nnet3::NnetComputer computer_;
   int32 previous_word_;
 
+  // The last opts.normalizer_cache_order words of the history (only if that
+  // is > 0), for RnnlmNormalizer.
+  std::vector<int32> history_;
+
   // This is the log of the sum of the exp'ed values in the output.
   // Only used if config_.normalize_probs is set to be true.
   BaseFloat normalization_factor_;
@@ -143,6 +283,98 @@ class RnnlmComputeState {
 };
 
 
+/*
+  RnnlmComputeStatePool does the same computation as RnnlmComputeState, but
+  for many word histories at once, as needed in lattice rescoring.  The states
+  are numbered: state 0 is the BOS history, and AddSuccessorState() creates a
+  new state.  The computation for a new state is deferred until it is needed
+  (i.e. until LogProbOfWord() is called for it), and is then done together
+  with that of up to opts.batch_size - 1 other pending states, as one
+  multi-row nnet computation, plus, if opts.normalize_probs is true, one
+  matrix multiplication by the word-embedding matrix.  States that are never
+  needed (e.g. because of pruning) are never computed.
+
+  The RNNLM state of each history (see NnetComputer::GetSequenceStates()) and
+  its predicted word embedding are stored in blocks of opts.batch_size rows,
+  which are reused after Clear(), rather than in an object per history.
+*/
+class RnnlmComputeStatePool {
+ public:
+  /// Requires info.opts.batch_size > 1.
+  RnnlmComputeStatePool(const RnnlmComputeStateInfo &info);
+
+  ~RnnlmComputeStatePool();
+
+  /// Returns the number of states, including the BOS state.
+  int32 NumStates() const { return parent_.size(); }
+
+  /// Creates a new state for the history of "state" followed by "next_word",
+  /// and returns its index, which is NumStates() - 1.
+  int32 AddSuccessorState(int32 state, int32 next_word);
+
+  /// Return the log-prob that the model predicts for the provided word-index,
+  /// given the history of "state".
+  BaseFloat LogProbOfWord(int32 state, int32 word_index);
+
+  /// Removes all states except the BOS state.
+  void Clear();
+
+ private:
+  /// Computes state "state" and up to opts.batch_size - 1 other pending
+  /// states whose parents' states have the same layout.
+  void ComputeStates(int32 state);
+
+  /// Sets normalization_factor_[states[i]] from row i of "embeddings".  If
+  /// the normalizer is exact we do this with a single matrix multiplication,
+  /// else we use info_.normalizer for each state.
+  void ComputeNormalizationFactors(const std::vector<int32> &states,
+                                   const CuMatrixBase<BaseFloat> &embeddings);
+
+  /// Return the block and the row in it of a computed state, in state_blocks_
+  /// and embedding_blocks_.
+  int32 Block(int32 state) const { return row_[state] / batch_size_; }
+  int32 Row(int32 state) const { return row_[state] % batch_size_; }
+
+  const RnnlmComputeStateInfo &info_;
+  int32 batch_size_;
+
+  // Computers for info_.batch_computation that are between calls to Run(),
+  // indexed by their program counter, which determines the layout of the
+  // states.  The first few chunks of a looped computation are not part of the
+  // loop, so the states of short histories have different layouts.  We run a
+  // copy of the computer, except for program counters in steady_, for which
+  // the computer returns to the same program counter.
+  std::map<int32, nnet3::NnetComputer*> computers_;
+  std::set<int32> steady_;
+
+  // The history of state s is that of state parent_[s] followed by word
+  // word_[s] (for s > 0).
+  std::vector<int32> parent_;
+  std::vector<int32> word_;
+  // row_[s] is -1 if state s has not been computed yet, else it is
+  // b * batch_size_ + r if it is in row r of block b.
+  std::vector<int32> row_;
+  // The log of the sum of the exp'ed values in the output, for each state
+  // (only if opts.normalize_probs is true).
+  std::vector<BaseFloat> normalization_factor_;
+
+  // The states that have not been computed, in the order in which they were
+  // created (some of them may have been computed since), indexed by the
+  // program counter for the states of their parents.
+  std::map<int32, std::deque<int32> > pending_;
+
+  // Each block has batch_size_ rows; block 0 is for the BOS state.
+  // block_program_counter_[b] is the program counter of the computer the
+  // states in block b were obtained from.
+  std::vector<CuMatrix<BaseFloat>*> state_blocks_;
+  std::vector<CuMatrix<BaseFloat>*> embedding_blocks_;
+  std::vector<int32> block_program_counter_;
+  int32 num_blocks_used_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(RnnlmComputeStatePool);
+};
+
+
 } // namespace rnnlm
 } // namespace kaldi
 
@@ -19,6 +19,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <utility>
 
 #include "rnnlm/rnnlm-lattice-rescoring.h"
@@ -29,62 +30,130 @@ namespace kaldi {
 namespace rnnlm {
 
 KaldiRnnlmDeterministicFst::~KaldiRnnlmDeterministicFst() {
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 0; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
-  state_to_rnnlm_state_.resize(0);
-  state_to_wseq_.resize(0);
-  wseq_to_state_.clear();
+  std::vector<std::pair<StateId, RnnlmComputeState*> > rnnlm_states;
+  rnnlm_states_.Clear(&rnnlm_states);
+  for (size_t i = 0; i < rnnlm_states.size(); i++)
+    delete rnnlm_states[i].second;
+  delete bos_rnnlm_state_;
+  delete state_pool_;
 }
 
 void KaldiRnnlmDeterministicFst::Clear() {
   // This function is similar to the destructor but we retain the 0-th entries
   // in each map which corresponds to the <bos> state.
-  int32 size = state_to_rnnlm_state_.size();
-  for (int32 i = 1; i < size; i++)
-    delete state_to_rnnlm_state_[i];
-  
-  state_to_rnnlm_state_.resize(1);
-  state_to_wseq_.resize(1);
-  wseq_to_state_.clear();
-  wseq_to_state_[state_to_wseq_[0]] = 0;
+  std::vector<std::pair<StateId, RnnlmComputeState*> > rnnlm_states;
+  rnnlm_states_.Clear(&rnnlm_states);
+  for (size_t i = 0; i < rnnlm_states.size(); i++)
+    delete rnnlm_states[i].second;
+  if (state_pool_ != NULL)
+    state_pool_->Clear();
+
+  states_.erase(states_.begin() + 1, states_.end());
+  computed_.resize(1);
+  wseq_to_state_.Clear();
+  wseq_to_state_.Insert(std::vector<Label>(1, bos_index_), 0);
 }
 
 KaldiRnnlmDeterministicFst::KaldiRnnlmDeterministicFst(int32 max_ngram_order,
-    const RnnlmComputeStateInfo &info) {
+    const RnnlmComputeStateInfo &info):
+    wseq_to_state_(info.opts.max_cached_states),
+    bos_rnnlm_state_(NULL),
+    rnnlm_states_(info.opts.max_cached_states),
+    state_pool_(NULL),
+    num_states_(1), max_num_states_(1), num_arcs_(0),
+    num_arcs_to_existing_states_(0), num_rnnlm_states_computed_(0),
+    num_rnnlm_states_recomputed_(0) {
+  KALDI_ASSERT(info.opts.max_cached_states >= 0);
+  if (info.opts.batch_size > 1 && info.opts.max_cached_states > 0)
+    KALDI_ERR << "--max-cached-states cannot be used with --batch-size > 1: "
+              << "RnnlmComputeStatePool keeps the RNNLM states of all the "
+              << "histories.";
   max_ngram_order_ = max_ngram_order;
   bos_index_ = info.opts.bos_index;
   eos_index_ = info.opts.eos_index;
 
-  std::vector<Label> bos_seq;
-  bos_seq.push_back(bos_index_);
-  state_to_wseq_.push_back(bos_seq);
-  RnnlmComputeState *decodable_rnnlm = new RnnlmComputeState(info, bos_index_);
-  wseq_to_state_[bos_seq] = 0;
+  states_.push_back(StateInfo(fst::kNoStateId, bos_index_, 1));
+  computed_.push_back(true);
+  wseq_to_state_.Insert(std::vector<Label>(1, bos_index_), 0);
   start_state_ = 0;
 
-  state_to_rnnlm_state_.push_back(decodable_rnnlm);
+  if (info.opts.batch_size > 1)
+    state_pool_ = new RnnlmComputeStatePool(info);
+  else
+    bos_rnnlm_state_ = new RnnlmComputeState(info, bos_index_);
+}
+
+void KaldiRnnlmDeterministicFst::GetWordSequence(
+    StateId s, std::vector<Label> *wseq) const {
+  int32 length = states_[s].length;
+  wseq->resize(length);
+  for (int32 i = length - 1; i >= 0; i--) {
+    KALDI_ASSERT(s != fst::kNoStateId);
+    (*wseq)[i] = states_[s].word;
+    s = states_[s].parent;
+  }
+}
+
+const RnnlmComputeState *KaldiRnnlmDeterministicFst::GetRnnlmState(
+    StateId s) {
+  if (s == start_state_)
+    return bos_rnnlm_state_;
+  RnnlmComputeState **cached = rnnlm_states_.Find(s);
+  if (cached != NULL)
+    return *cached;
+  // Find the nearest ancestor whose RNNLM state we have, and advance it with
+  // the words on the way to s.
+  std::vector<StateId> path;
+  const RnnlmComputeState *ancestor = NULL;
+  for (StateId t = s; ancestor == NULL; t = states_[t].parent) {
+    path.push_back(t);
+    StateId parent = states_[t].parent;
+    if (parent == start_state_) {
+      ancestor = bos_rnnlm_state_;
+    } else {
+      RnnlmComputeState **parent_cached = rnnlm_states_.Find(parent);
+      if (parent_cached != NULL)
+        ancestor = *parent_cached;
+    }
+  }
+  RnnlmComputeState *ans = NULL;
+  for (int32 i = path.size() - 1; i >= 0; i--) {
+    StateId t = path[i];
+    ans = ancestor->GetSuccessorState(states_[t].word);
+    num_rnnlm_states_computed_++;
+    if (computed_[t])
+      num_rnnlm_states_recomputed_++;
+    computed_[t] = true;
+    // The least recently used state may be evicted; this is never "ans", and
+    // we no longer need "ancestor".
+    std::pair<StateId, RnnlmComputeState*> evicted;
+    if (rnnlm_states_.Insert(t, ans, &evicted))
+      delete evicted.second;
+    ancestor = ans;
+  }
+  return ans;
 }
 
 fst::StdArc::Weight KaldiRnnlmDeterministicFst::Final(StateId s) {
   /// At this point, we have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
 
-  RnnlmComputeState* rnn = state_to_rnnlm_state_[s];
-  return Weight(-rnn->LogProbOfWord(eos_index_));
+  if (state_pool_ != NULL)
+    return Weight(-state_pool_->LogProbOfWord(s, eos_index_));
+  return Weight(-GetRnnlmState(s)->LogProbOfWord(eos_index_));
 }
 
 bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
                                         fst::StdArc *oarc) {
   /// At this point, we have created the state.
-  KALDI_ASSERT(static_cast<size_t>(s) < state_to_wseq_.size());
-
-  std::vector<Label> word_seq = state_to_wseq_[s];
-  const RnnlmComputeState* rnnlm = state_to_rnnlm_state_[s];
+  KALDI_ASSERT(static_cast<size_t>(s) < states_.size());
 
-  BaseFloat logprob = rnnlm->LogProbOfWord(ilabel);
+  BaseFloat logprob = (state_pool_ != NULL ?
+                       state_pool_->LogProbOfWord(s, ilabel) :
+                       GetRnnlmState(s)->LogProbOfWord(ilabel));
 
+  std::vector<Label> word_seq;
+  GetWordSequence(s, &word_seq);
   word_seq.push_back(ilabel);
   if (max_ngram_order_ > 0) {
     while (word_seq.size() >= max_ngram_order_) {
@@ -93,28 +162,46 @@ bool KaldiRnnlmDeterministicFst::GetArc(StateId s, Label ilabel,
     }
   }
 
-  std::pair<const std::vector<Label>, StateId> wseq_state_pair(
-      word_seq, static_cast<Label>(state_to_wseq_.size()));
-
-  // Attemps to insert the current <wseq_state_pair>. If the pair already exists
-  // then it returns false.
-  typedef MapType::iterator IterType;
-  std::pair<IterType, bool> result = wseq_to_state_.insert(wseq_state_pair);
-
-  // If the pair was just inserted, then also add it to state_to_* structures.
-  if (result.second == true) {
-    RnnlmComputeState *rnnlm2 = rnnlm->GetSuccessorState(ilabel);
-    state_to_wseq_.push_back(word_seq);
-    state_to_rnnlm_state_.push_back(rnnlm2);
+  num_arcs_++;
+  StateId nextstate;
+  const StateId *existing_state = wseq_to_state_.Find(word_seq);
+  if (existing_state != NULL) {
+    nextstate = *existing_state;
+    num_arcs_to_existing_states_++;
+  } else {
+    nextstate = states_.size();
+    states_.push_back(StateInfo(s, ilabel, word_seq.size()));
+    computed_.push_back(false);
+    wseq_to_state_.Insert(word_seq, nextstate);
+    if (state_pool_ != NULL) {
+      // The computation for the new state happens when it is first needed.
+      int32 new_state = state_pool_->AddSuccessorState(s, ilabel);
+      KALDI_ASSERT(new_state == nextstate);
+    }
+    num_states_++;
+    max_num_states_ = std::max<int32>(max_num_states_, states_.size());
   }
 
   // Creates the arc.
   oarc->ilabel = ilabel;
   oarc->olabel = ilabel;
-  oarc->nextstate = result.first->second;
+  oarc->nextstate = nextstate;
   oarc->weight = Weight(-logprob);
   return true;
 }
 
+void KaldiRnnlmDeterministicFst::PrintStats() const {
+  KALDI_LOG << "KaldiRnnlmDeterministicFst created " << num_states_
+            << " states (at most " << max_num_states_ << " at a time, "
+            << sizeof(StateInfo) << " bytes each, plus the cached histories "
+            << "and RNNLM states); " << num_arcs_to_existing_states_ << " of "
+            << num_arcs_ << " arcs led to existing states.";
+  if (state_pool_ == NULL)
+    KALDI_LOG << "Computed " << num_rnnlm_states_computed_ << " RNNLM states, "
+              << "of which " << num_rnnlm_states_recomputed_ << " had been "
+              << "evicted from the cache (size limit "
+              << rnnlm_states_.Capacity() << ", 0 for none).";
+}
+
 }  // namespace rnnlm
 }  // namespace kaldi
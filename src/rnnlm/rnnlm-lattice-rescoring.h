@@ -29,10 +29,29 @@
 #include "fstext/deterministic-fst.h"
 #include "rnnlm/rnnlm-compute-state.h"
 #include "util/common-utils.h"
+#include "util/lru-cache.h"
 
 namespace kaldi {
 namespace rnnlm {
 
+/*
+  KaldiRnnlmDeterministicFst wraps an RNNLM as a DeterministicOnDemandFst for
+  lattice rescoring.  Each state is a word history (truncated to
+  max_ngram_order - 1 words, if max_ngram_order > 0, so that histories that
+  share those words are merged).
+
+  To bound the memory used on long lattices, the histories are not stored per
+  state: state s was created by GetArc() from state "parent" with label "word",
+  and its history is the last "length" words of that of the parent followed by
+  "word".  If info.opts.max_cached_states > 0, the map from histories to states
+  and the RNNLM states (RnnlmComputeState objects, which are large) are LRU
+  caches of that size.  An RNNLM state that is needed after it was evicted is
+  recomputed from the nearest ancestor whose RNNLM state is cached, and a
+  history that is seen again after it was evicted gets a new state.  The RNNLM
+  state of a new state is only computed when it is needed.  This is not
+  supported if info.opts.batch_size > 1, as the RnnlmComputeStatePool used then
+  keeps the RNNLM states of all the histories.
+*/
 class KaldiRnnlmDeterministicFst
     : public fst::DeterministicOnDemandFst<fst::StdArc> {
  public:
@@ -57,9 +76,29 @@ class KaldiRnnlmDeterministicFst
 
   virtual bool GetArc(StateId s, Label ilabel, fst::StdArc* oarc);
 
+  /// Prints statistics about the states, accumulated over calls to Clear(),
+  /// and the memory they use.
+  void PrintStats() const;
+
  private:
-  typedef unordered_map
-      <std::vector<Label>, StateId, VectorHasher<Label> > MapType;
+  struct StateInfo {
+    StateId parent;
+    Label word;
+    int32 length;
+    StateInfo(StateId parent, Label word, int32 length):
+        parent(parent), word(word), length(length) { }
+  };
+
+  // Outputs the (possibly truncated) history of state s.
+  void GetWordSequence(StateId s, std::vector<Label> *wseq) const;
+
+  // Returns the RNNLM state for state s, computing it if necessary.  The
+  // pointer is owned by this class and is valid until the next call to this
+  // function or to GetArc().  Not used if state_pool_ != NULL.
+  const RnnlmComputeState *GetRnnlmState(StateId s);
+
+  typedef LruCache<std::vector<Label>, StateId, VectorHasher<Label> > MapType;
+  typedef LruCache<StateId, RnnlmComputeState*> RnnlmStateCacheType;
   StateId start_state_;
   int32 max_ngram_order_;
   int32 bos_index_;
@@ -67,13 +106,26 @@ class KaldiRnnlmDeterministicFst
 
   MapType wseq_to_state_;
 
-  // Mapping from state-id to history sequence>
-  std::vector<std::vector<Label> > state_to_wseq_;
-
-  // Mapping from state-id to RNNLM states.
-  // The pointers are owned in this class
-  std::vector<RnnlmComputeState*> state_to_rnnlm_state_;
-
+  std::vector<StateInfo> states_;
+
+  // The RNNLM state of the start state, and a cache of those of the other
+  // states.  The pointers are owned in this class.
+  RnnlmComputeState *bos_rnnlm_state_;
+  RnnlmStateCacheType rnnlm_states_;
+  // True for the states whose RNNLM state has been computed.
+  std::vector<bool> computed_;
+
+  // If info.opts.batch_size > 1, this is used instead of bos_rnnlm_state_ and
+  // rnnlm_states_; its state-ids are the same as ours.
+  RnnlmComputeStatePool *state_pool_;
+
+  // Statistics, accumulated over calls to Clear().
+  int64 num_states_;
+  int32 max_num_states_;
+  int64 num_arcs_;
+  int64 num_arcs_to_existing_states_;
+  int64 num_rnnlm_states_computed_;
+  int64 num_rnnlm_states_recomputed_;
 };
 
 }  // namespace rnnlm
@@ -64,6 +64,33 @@ void ReadSparseWordFeatures(std::istream &is,
       SparseMatrix<BaseFloat>(feature_dim, sparse_rows));
 }
 
+void ReadUnigramProbs(std::istream &is,
+                      int32 vocab_size,
+                      std::vector<BaseFloat> *unigram_probs) {
+  unigram_probs->clear();
+  std::string line;
+  while (std::getline(is, line)) {
+    std::istringstream line_is(line);
+    int32 word_id;
+    BaseFloat prob;
+    if (!(line_is >> word_id >> prob) || prob < 0.0)
+      KALDI_ERR << "Bad line in unigram-probs file: " << line;
+    if (word_id != static_cast<int32>(unigram_probs->size()))
+      KALDI_ERR << "The word-indexes are expected to be in order 0, 1, 2, ...";
+    unigram_probs->push_back(prob);
+  }
+  if (static_cast<int32>(unigram_probs->size()) != vocab_size)
+    KALDI_ERR << "Expected unigram probabilities for " << vocab_size
+              << " words, got " << unigram_probs->size();
+  (*unigram_probs)[0] = 0.0;
+  double sum = std::accumulate(unigram_probs->begin(), unigram_probs->end(),
+                               0.0);
+  if (sum <= 0.0)
+    KALDI_ERR << "Unigram probabilities sum to zero.";
+  for (int32 i = 0; i < vocab_size; i++)
+    (*unigram_probs)[i] /= sum;
+}
+
 
 }  // namespace rnnlm
 }  // namespace kaldi
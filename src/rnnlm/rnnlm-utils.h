@@ -54,6 +54,22 @@ void ReadSparseWordFeatures(std::istream &is,
                             int32 feature_dim,
                             SparseMatrix<BaseFloat> *word_feature_matrix);
 
+/**
+   Reads a text file (e.g. exp/rnnlm/config/unigram_probs.txt) containing the
+   unigram probability of each word, with lines of the format:
+     <word-index> <probability>
+   with the word-indexes in order 0, 1, 2, ... .  The probability of word 0
+   (<eps>) is set to zero and the probabilities are renormalized to sum to one.
+
+     @param [in] is   The stream we are reading.
+     @param [in] vocab_size  The number of words; the file is expected to have
+                             this many lines.
+     @param [out] unigram_probs   The probabilities, indexed by word-index.
+ */
+void ReadUnigramProbs(std::istream &is,
+                      int32 vocab_size,
+                      std::vector<BaseFloat> *unigram_probs);
+
 
 
 } // namespace rnnlm
@@ -24,6 +24,7 @@
 #include "rnnlm/rnnlm-example-utils.h"
 #include "rnnlm/rnnlm-core-compute.h"
 #include "rnnlm/rnnlm-compute-state.h"
+#include "rnnlm/rnnlm-utils.h"
 #include "nnet3/nnet-utils.h"
 #include <fstream>
 #include <sstream>
@@ -55,6 +56,7 @@ int main(int argc, char *argv[]) {
 
     ParseOptions po(usage);
     rnnlm::RnnlmComputeStateComputationOptions opts;
+    std::string unigram_probs_rxfilename;
     po.Register("use-gpu", &use_gpu,
                 "yes|no|optional|wait, only has effect if compiled with CUDA");
     po.Register("batchnorm-test-mode", &batchnorm_test_mode,
@@ -62,6 +64,10 @@ int main(int argc, char *argv[]) {
     po.Register("dropout-test-mode", &dropout_test_mode,
                 "If true, set test-mode to true on any DropoutComponents and "
                 "DropoutMaskComponents.");
+    po.Register("unigram-probs", &unigram_probs_rxfilename, "File with the "
+                "unigram probability of each word, with lines '<word-id> "
+                "<prob>' (e.g. exp/rnnlm/config/unigram_probs.txt); needed "
+                "with --normalization-method=sampled.");
     opts.Register(&po);
 
     po.Read(argc, argv);
@@ -96,7 +102,15 @@ int main(int argc, char *argv[]) {
     CuMatrix<BaseFloat> word_embedding_mat;
     ReadKaldiObject(word_embedding_rxfilename, &word_embedding_mat);
 
-    const rnnlm::RnnlmComputeStateInfo info(opts, rnnlm, word_embedding_mat);
+    std::vector<BaseFloat> unigram_probs;
+    if (!unigram_probs_rxfilename.empty()) {
+      Input ki(unigram_probs_rxfilename);
+      rnnlm::ReadUnigramProbs(ki.Stream(), word_embedding_mat.NumRows(),
+                              &unigram_probs);
+    }
+    const rnnlm::RnnlmComputeStateInfo info(
+        opts, rnnlm, word_embedding_mat,
+        unigram_probs_rxfilename.empty() ? NULL : &unigram_probs);
 
     std::ifstream ifile(text_filename.c_str());
 
@@ -121,6 +135,9 @@ int main(int argc, char *argv[]) {
       std::cout << rnnlm_compute_state.LogProbOfWord(word_id) << std::endl;
     }
 
+    if (info.normalizer != NULL)
+      info.normalizer->PrintStats();
+
 #if HAVE_CUDA==1
     CuDevice::Instantiate().PrintProfile();
 #endif
@@ -0,0 +1,139 @@
+// util/flat-hash-list-inl.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef KALDI_UTIL_FLAT_HASH_LIST_INL_H_
+#define KALDI_UTIL_FLAT_HASH_LIST_INL_H_
+
+// Do not include this file directly.  It is included by flat-hash-list.h
+
+#include <algorithm>
+
+namespace kaldi {
+
+template<class I, class T> FlatHashList<I, T>::FlatHashList():
+    stamp_(1), shift_(64), list_head_(NULL), list_tail_(NULL), num_elems_(0),
+    cur_store_(0), num_undeleted_(0) {
+  Rehash(16);
+}
+
+template<class I, class T> void FlatHashList<I, T>::SetSize(size_t size) {
+  if (size <= keys_.size())
+    return;
+  size_t new_size = keys_.size();
+  while (new_size < size)
+    new_size *= 2;
+  Rehash(new_size);
+}
+
+template<class I, class T> void FlatHashList<I, T>::Rehash(size_t size) {
+  KALDI_ASSERT((size & (size - 1)) == 0 && size > 2 * num_elems_);
+  std::vector<I>(size).swap(keys_);
+  std::vector<Elem*>(size, static_cast<Elem*>(NULL)).swap(elems_);
+  std::vector<uint32>(size, 0).swap(stamps_);
+  stamp_ = 1;
+  shift_ = 64;
+  for (size_t s = size; s > 1; s /= 2)
+    shift_--;
+  size_t mask = size - 1;
+  for (Elem *e = list_head_; e != NULL; e = e->tail) {
+    size_t s = Slot(e->key);
+    while (stamps_[s] == stamp_)
+      s = (s + 1) & mask;
+    keys_[s] = e->key;
+    elems_[s] = e;
+    stamps_[s] = stamp_;
+  }
+}
+
+template<class I, class T>
+typename FlatHashList<I, T>::Elem* FlatHashList<I, T>::Clear() {
+  // The list returned by the previous call must have been deleted, as we are
+  // about to reuse its memory.
+  KALDI_ASSERT(num_undeleted_ == 0);
+  Elem *ans = list_head_;
+  num_undeleted_ = num_elems_;
+  list_head_ = list_tail_ = NULL;
+  num_elems_ = 0;
+  cur_store_ = 1 - cur_store_;
+  stores_[cur_store_].num_used = 0;
+  if (++stamp_ == 0) {  // the stamp wrapped around.
+    std::fill(stamps_.begin(), stamps_.end(), 0);
+    stamp_ = 1;
+  }
+  return ans;
+}
+
+template<class I, class T>
+inline void FlatHashList<I, T>::Delete(Elem *e) {
+  KALDI_ASSERT(num_undeleted_ > 0);
+  num_undeleted_--;
+}
+
+template<class I, class T>
+inline typename FlatHashList<I, T>::Elem* FlatHashList<I, T>::New() {
+  ElemStore &store = stores_[cur_store_];
+  size_t block = store.num_used / allocate_block_size_,
+      offset = store.num_used % allocate_block_size_;
+  if (block == store.blocks.size())
+    store.blocks.push_back(new Elem[allocate_block_size_]);
+  store.num_used++;
+  return store.blocks[block] + offset;
+}
+
+template<class I, class T>
+inline typename FlatHashList<I, T>::Elem* FlatHashList<I, T>::Find(I key) {
+  size_t mask = keys_.size() - 1;
+  for (size_t s = Slot(key); stamps_[s] == stamp_; s = (s + 1) & mask)
+    if (keys_[s] == key)
+      return elems_[s];
+  return NULL;
+}
+
+template<class I, class T>
+inline void FlatHashList<I, T>::Insert(I key, T val) {
+  if (2 * (num_elems_ + 1) > keys_.size())
+    Rehash(2 * keys_.size());
+  Elem *e = New();
+  e->key = key;
+  e->val = val;
+  e->tail = NULL;
+  if (list_tail_ != NULL)
+    list_tail_->tail = e;
+  else
+    list_head_ = e;
+  list_tail_ = e;
+  num_elems_++;
+
+  size_t mask = keys_.size() - 1, s = Slot(key);
+  while (stamps_[s] == stamp_)
+    s = (s + 1) & mask;
+  keys_[s] = key;
+  elems_[s] = e;
+  stamps_[s] = stamp_;
+}
+
+template<class I, class T> FlatHashList<I, T>::~FlatHashList() {
+  for (int32 i = 0; i < 2; i++)
+    for (size_t j = 0; j < stores_[i].blocks.size(); j++)
+      delete [] stores_[i].blocks[j];
+}
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_FLAT_HASH_LIST_INL_H_
@@ -0,0 +1,165 @@
+// util/flat-hash-list-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/flat-hash-list.h"
+#include "util/hash-list.h"
+#include "base/timer.h"
+#include <map>  // for baseline.
+#include <cstdlib>
+#include <iostream>
+
+namespace kaldi {
+
+// As TestHashList() in hash-list-test.cc.
+template<class Int, class T> void TestFlatHashList() {
+  typedef typename FlatHashList<Int, T>::Elem Elem;
+
+  FlatHashList<Int, T> hash;
+  hash.SetSize(Rand() % 2 == 0 ? 200 : 2);  // it grows if needed.
+  std::map<Int, T> m1;
+  for (size_t j = 0; j < 50; j++) {
+    Int key = Rand() % 200;
+    T val = Rand() % 50;
+    m1[key] = val;
+    Elem *e = hash.Find(key);
+    if (e) e->val = val;
+    else  hash.Insert(key, val);
+  }
+
+  std::map<Int, T> m2;
+
+  for (int i = 0; i < 100; i++) {
+    m2.clear();
+    for (typename std::map<Int, T>::const_iterator iter = m1.begin();
+        iter != m1.end();
+        iter++) {
+      m2[iter->first + 1] = iter->second;
+    }
+    std::swap(m1, m2);
+
+    Elem *h = hash.Clear(), *tmp;
+
+    hash.SetSize(100 + Rand() % 100);
+
+    for (; h != NULL; h = tmp) {
+      hash.Insert(h->key + 1, h->val);
+      tmp = h->tail;
+      hash.Delete(h);
+    }
+
+    // Now make sure h and m2 are the same.  The list is in the order of
+    // insertion.
+    const Elem *list = hash.GetList();
+    size_t count = 0;
+    for (; list != NULL; list = list->tail, count++) {
+      KALDI_ASSERT(m1[list->key] == list->val);
+      if (list->tail != NULL)
+        KALDI_ASSERT(list->tail == list + 1 || count % 1024 == 1023);
+    }
+
+    for (size_t j = 0; j < 10; j++) {
+      Int key = Rand() % 200;
+      bool found_m1 = (m1.find(key) != m1.end());
+      Elem *e = hash.Find(key);
+      KALDI_ASSERT((e != NULL) == found_m1);
+      if (found_m1)
+        KALDI_ASSERT(m1[key] == e->val);
+    }
+
+    KALDI_ASSERT(m1.size() == count);
+  }
+}
+
+// Propagates "tokens" from frame to frame the way the decoders do, keeping the
+// best score for each state, and returns the sum of the final scores.
+template<class H> double DecoderSimulation(int32 num_states,
+                                           int32 num_frames,
+                                           const std::vector<int32> &arcs,
+                                           H *hash) {
+  typedef typename H::Elem Elem;
+  int32 arcs_per_state = arcs.size() / num_states;
+  hash->SetSize(1000);
+  hash->Insert(0, 0);
+  for (int32 t = 0; t < num_frames; t++) {
+    Elem *list = hash->Clear(), *tail;
+    // As PossiblyResizeHash() in the decoders.
+    size_t num_toks = 0;
+    for (const Elem *e = list; e != NULL; e = e->tail)
+      num_toks++;
+    if (num_toks * 2 > hash->Size())
+      hash->SetSize(num_toks * 2);
+    for (Elem *e = list; e != NULL; e = tail) {
+      for (int32 a = 0; a < arcs_per_state; a++) {
+        int32 next_state = arcs[e->key * arcs_per_state + a],
+            cost = e->val + (e->key + a) % 7;
+        Elem *e_found = hash->Find(next_state);
+        if (e_found == NULL)
+          hash->Insert(next_state, cost);
+        else if (cost < e_found->val)
+          e_found->val = cost;
+      }
+      tail = e->tail;
+      hash->Delete(e);
+    }
+  }
+  double ans = 0.0;
+  for (const Elem *e = hash->GetList(); e != NULL; e = e->tail)
+    ans += e->val;
+  for (Elem *e = hash->Clear(), *tail; e != NULL; e = tail) {
+    tail = e->tail;
+    hash->Delete(e);
+  }
+  return ans;
+}
+
+void TestFlatHashListSpeed() {
+  int32 num_states = 100000, arcs_per_state = 3, num_frames = 30;
+  std::vector<int32> arcs(num_states * arcs_per_state);
+  for (size_t i = 0; i < arcs.size(); i++)
+    arcs[i] = Rand() % num_states;
+
+  HashList<int32, int32> hash_list;
+  FlatHashList<int32, int32> flat_hash_list;
+  Timer timer;
+  double sum1 = DecoderSimulation(num_states, num_frames, arcs, &hash_list);
+  double time1 = timer.Elapsed();
+  timer.Reset();
+  double sum2 = DecoderSimulation(num_states, num_frames, arcs,
+                                  &flat_hash_list);
+  double time2 = timer.Elapsed();
+  KALDI_ASSERT(sum1 == sum2);
+  KALDI_LOG << "Time taken by HashList was " << time1 << "s, by FlatHashList "
+            << time2 << "s.";
+}
+
+}  // end namespace kaldi
+
+
+
+int main() {
+  using namespace kaldi;
+  for (size_t i = 0;i < 3;i++) {
+    TestFlatHashList<int, unsigned int>();
+    TestFlatHashList<unsigned int, int>();
+    TestFlatHashList<int16, int32>();
+    TestFlatHashList<char, unsigned char>();
+    TestFlatHashList<unsigned char, int>();
+  }
+  TestFlatHashListSpeed();
+  std::cout << "Test OK.\n";
+}
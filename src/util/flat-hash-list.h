@@ -0,0 +1,148 @@
+// util/flat-hash-list.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_FLAT_HASH_LIST_H_
+#define KALDI_UTIL_FLAT_HASH_LIST_H_
+#include <vector>
+#include "base/kaldi-common.h"
+
+
+/* FlatHashList is a replacement for HashList (see hash-list.h) with the same
+   interface (except InsertMore()), for use in the decoders.  The differences
+   are in how it is implemented:
+
+    - The hash is open-addressing (linear probing, in a power-of-two sized
+      table) rather than chained, and is stored as separate arrays of keys,
+      element pointers and "stamps", so a lookup mostly touches the keys_ and
+      stamps_ arrays.
+    - A slot of the table is in use only if its stamp equals the current
+      stamp, so Clear() just increments the stamp instead of visiting the
+      buckets.
+    - The table grows automatically if it gets more than half full, so
+      SetSize() is just a hint.
+    - The Elems are allocated contiguously, in the order in which they are
+      inserted, which is also the order of the list; so walking the list is a
+      sequential pass over memory.  There are two stores of Elems, one for the
+      list currently in the hash and one for the list most recently returned by
+      Clear(), and Clear() swaps them.
+
+   The last point means that it is more restrictive than HashList about
+   memory: all the Elems of the list returned by Clear() must be Delete()'d
+   before the next call to Clear() (which is how the decoders use it), because
+   that call reuses their memory.  Elems are never moved while they are in use,
+   though, so pointers to them stay valid across Insert().
+
+   The key type I must be an integer type.
+*/
+
+
+namespace kaldi {
+
+template<class I, class T> class FlatHashList {
+ public:
+  struct Elem {
+    I key;
+    T val;
+    Elem *tail;
+  };
+
+  /// Constructor takes no arguments.
+  /// Call SetSize to inform it of the likely size.
+  FlatHashList();
+
+  /// Clears the hash and gives the head of the current list to the user;
+  /// the user must call Delete() for each element in the list before the
+  /// next call to Clear().
+  Elem *Clear();
+
+  /// Gives the head of the current list to the user.  Ownership retained in
+  /// the class.
+  const Elem *GetList() const { return list_head_; }
+
+  /// To be called for each Elem of the list returned by Clear().
+  inline void Delete(Elem *e);
+
+  /// Allocates a new Elem; used by Insert().
+  inline Elem *New();
+
+  /// Find tries to find this element in the current list using the hashtable.
+  /// It returns NULL if not present.  The Elem it returns is not owned by the
+  /// user, but the user is free to modify the "val" element.
+  inline Elem *Find(I key);
+
+  /// Insert inserts a new element into the hashtable/stored list.  By calling
+  /// this, the user asserts that it is not already present (e.g. Find was
+  /// called and returned NULL).
+  inline void Insert(I key, T val);
+
+  /// SetSize makes sure that there are at least "sz" slots in the hash table
+  /// (it rounds up to a power of two).  For fastest performance this should be
+  /// at least twice the number of objects we expect to go in the structure,
+  /// but unlike for HashList it is not necessary, and it may be called at any
+  /// time.
+  void SetSize(size_t sz);
+
+  /// Returns current number of slots in the hash table.
+  inline size_t Size() { return keys_.size(); }
+
+  ~FlatHashList();
+ private:
+  // Returns the slot where we start looking for "key".
+  inline size_t Slot(I key) const {
+    return static_cast<size_t>(
+        (static_cast<uint64>(key) * 11400714819323198485ULL) >> shift_);
+  }
+
+  // Changes the size of the table to "size" (a power of two), re-inserting
+  // the elements of the current list.
+  void Rehash(size_t size);
+
+  // A store of Elems, allocated in blocks so that they never move.
+  struct ElemStore {
+    std::vector<Elem*> blocks;
+    size_t num_used;  // the number of Elems handed out.
+    ElemStore(): num_used(0) { }
+  };
+
+  std::vector<I> keys_;
+  std::vector<Elem*> elems_;
+  std::vector<uint32> stamps_;  // slot s is in use iff stamps_[s] == stamp_.
+  uint32 stamp_;
+  int32 shift_;  // 64 - log2(Size()).
+
+  Elem *list_head_;  // head of currently stored list.
+  Elem *list_tail_;  // tail of currently stored list.
+  size_t num_elems_;  // number of Elems in the current list.
+
+  ElemStore stores_[2];
+  int32 cur_store_;  // the index of the store used for the current list.
+  size_t num_undeleted_;  // number of Elems of the list returned by the last
+                          // call to Clear() that have not been Delete()'d.
+
+  static const size_t allocate_block_size_ = 1024;  // Number of Elements to
+  // allocate in one block.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(FlatHashList);
+};
+
+
+}  // end namespace kaldi
+
+#include "util/flat-hash-list-inl.h"
+
+#endif  // KALDI_UTIL_FLAT_HASH_LIST_H_
@@ -23,12 +23,15 @@
 #define KALDI_UTIL_KALDI_HOLDER_INL_H_
 
 #include <algorithm>
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <utility>
 #include <string>
 
 #include "base/kaldi-utils.h"
 #include "util/kaldi-io.h"
+#include "util/kaldi-mapped-file.h"
 #include "util/text-utils.h"
 #include "matrix/kaldi-matrix.h"
 
@@ -119,6 +122,245 @@ template<class KaldiType> class KaldiObjectHolder {
 };
 
 
+template<class Real> class SubMatrixHolder {
+ public:
+  // T is const because the data may be in a read-only mapping of a file; it
+  // is a MatrixBase rather than a SubMatrix so that it can't be copied into a
+  // (non-const) SubMatrix pointing to the same memory.
+  typedef const MatrixBase<Real> T;
+
+  SubMatrixHolder(): t_(NULL) { }
+
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    InitKaldiOutputStream(os, binary);  // Puts binary header if binary mode.
+    try {
+      t.Write(os, binary);
+      return os.good();
+    } catch(const std::exception &e) {
+      KALDI_WARN << "Exception caught writing Table object. " << e.what();
+      return false;  // Write failure.
+    }
+  }
+
+  void Clear() {
+    delete t_;
+    t_ = NULL;
+    file_.reset();
+    owned_.reset();
+  }
+
+  bool Read(std::istream &is) {
+    Clear();
+    bool is_binary;
+    if (!InitKaldiInputStream(is, &is_binary)) {
+      KALDI_WARN << "Reading Table object, failed reading binary header\n";
+      return false;
+    }
+    if (is_binary && ReadMapped(is))
+      return true;
+    try {
+      owned_.reset(new Matrix<Real>());
+      owned_->Read(is, is_binary);
+      t_ = new SubMatrix<Real>(owned_->Data(), owned_->NumRows(),
+                               owned_->NumCols(), owned_->Stride());
+      return true;
+    } catch(const std::exception &e) {
+      KALDI_WARN << "Exception caught reading Table object. " << e.what();
+      Clear();
+      return false;
+    }
+  }
+
+  static bool IsReadInBinary() { return true; }
+
+  T &Value() {
+    if (!t_) KALDI_ERR << "SubMatrixHolder::Value() called wrongly.";
+    return *t_;
+  }
+
+  void Swap(SubMatrixHolder<Real> *other) {
+    std::swap(t_, other->t_);
+    file_.swap(other->file_);
+    owned_.swap(other->owned_);
+  }
+
+  // The range is a view into the same memory as 'other', so nothing is copied
+  // here either.
+  bool ExtractRange(const SubMatrixHolder<Real> &other,
+                    const std::string &range) {
+    KALDI_ASSERT(other.t_ != NULL);
+    Clear();
+    const SubMatrix<Real> &input = *(other.t_);
+    std::vector<int32> row_range, col_range;
+    if (!ParseMatrixRangeSpecifier(range, input.NumRows(), input.NumCols(),
+                                   &row_range, &col_range))
+      return false;
+    int32 row_size = std::min(row_range[1], input.NumRows() - 1)
+                     - row_range[0] + 1,
+          col_size = col_range[1] - col_range[0] + 1;
+    t_ = new SubMatrix<Real>(input, row_range[0], row_size, col_range[0],
+                             col_size);
+    file_ = other.file_;
+    owned_ = other.owned_;
+    return true;
+  }
+
+  ~SubMatrixHolder() { delete t_; }
+ private:
+  // If 'is' reads from a memory-mapped file and the next thing in it is a
+  // binary matrix of our type whose data is suitably aligned, sets t_ to
+  // point to it, skips over it and returns true; otherwise returns false
+  // without consuming any input.  (The binary format is the token "FM " or
+  // "DM ", then the number of rows and columns, each as a length byte
+  // followed by an int32, then the data).
+  bool ReadMapped(std::istream &is) {
+    MappedStreambuf *buf = dynamic_cast<MappedStreambuf*>(is.rdbuf());
+    if (buf == NULL)
+      return false;
+    const size_t header_size = 3 + 5 + 5;
+    if (buf->Remaining() < header_size)
+      return false;
+    const char *header = buf->Current(),
+        *my_token = (sizeof(Real) == 4 ? "FM " : "DM ");
+    if (std::memcmp(header, my_token, 3) != 0 || header[3] != 4 ||
+        header[8] != 4)
+      return false;
+    int32 rows, cols;
+    std::memcpy(&rows, header + 4, sizeof(rows));
+    std::memcpy(&cols, header + 9, sizeof(cols));
+    if (rows < 0 || cols < 0)
+      return false;
+    size_t data_size = sizeof(Real) * static_cast<size_t>(rows) *
+        static_cast<size_t>(cols);
+    const char *data = header + header_size;
+    if (buf->Remaining() - header_size < data_size ||
+        reinterpret_cast<uintptr_t>(data) % sizeof(Real) != 0)
+      return false;
+    buf->Advance(header_size + data_size);
+    if (rows == 0 || cols == 0)
+      t_ = new SubMatrix<Real>(NULL, 0, 0, 0);
+    else
+      t_ = new SubMatrix<Real>(reinterpret_cast<Real*>(const_cast<char*>(data)),
+                               rows, cols, cols);
+    file_ = buf->File();
+    return true;
+  }
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SubMatrixHolder);
+  const SubMatrix<Real> *t_;
+  // At most one of these is set; it owns the memory that t_ points to.
+  std::shared_ptr<const MappedFile> file_;
+  std::shared_ptr<Matrix<Real> > owned_;
+};
+
+
+template<class Real> class SubVectorHolder {
+ public:
+  // T is const because the data may be in a read-only mapping of a file; it
+  // is a VectorBase for the same reason as in SubMatrixHolder.
+  typedef const VectorBase<Real> T;
+
+  SubVectorHolder(): t_(NULL) { }
+
+  static bool Write(std::ostream &os, bool binary, const T &t) {
+    InitKaldiOutputStream(os, binary);  // Puts binary header if binary mode.
+    try {
+      t.Write(os, binary);
+      return os.good();
+    } catch(const std::exception &e) {
+      KALDI_WARN << "Exception caught writing Table object. " << e.what();
+      return false;  // Write failure.
+    }
+  }
+
+  void Clear() {
+    delete t_;
+    t_ = NULL;
+    file_.reset();
+    owned_.reset();
+  }
+
+  bool Read(std::istream &is) {
+    Clear();
+    bool is_binary;
+    if (!InitKaldiInputStream(is, &is_binary)) {
+      KALDI_WARN << "Reading Table object, failed reading binary header\n";
+      return false;
+    }
+    if (is_binary && ReadMapped(is))
+      return true;
+    try {
+      owned_.reset(new Vector<Real>());
+      owned_->Read(is, is_binary);
+      t_ = new SubVector<Real>(owned_->Data(), owned_->Dim());
+      return true;
+    } catch(const std::exception &e) {
+      KALDI_WARN << "Exception caught reading Table object. " << e.what();
+      Clear();
+      return false;
+    }
+  }
+
+  static bool IsReadInBinary() { return true; }
+
+  T &Value() {
+    if (!t_) KALDI_ERR << "SubVectorHolder::Value() called wrongly.";
+    return *t_;
+  }
+
+  void Swap(SubVectorHolder<Real> *other) {
+    std::swap(t_, other->t_);
+    file_.swap(other->file_);
+    owned_.swap(other->owned_);
+  }
+
+  bool ExtractRange(const SubVectorHolder<Real> &other,
+                    const std::string &range) {
+    KALDI_ERR << "ExtractRange is not defined for this type of holder.";
+    return false;
+  }
+
+  ~SubVectorHolder() { delete t_; }
+ private:
+  // See SubMatrixHolder::ReadMapped(); the binary format is the token "FV "
+  // or "DV ", then the dimension as a length byte followed by an int32, then
+  // the data.
+  bool ReadMapped(std::istream &is) {
+    MappedStreambuf *buf = dynamic_cast<MappedStreambuf*>(is.rdbuf());
+    if (buf == NULL)
+      return false;
+    const size_t header_size = 3 + 5;
+    if (buf->Remaining() < header_size)
+      return false;
+    const char *header = buf->Current(),
+        *my_token = (sizeof(Real) == 4 ? "FV " : "DV ");
+    if (std::memcmp(header, my_token, 3) != 0 || header[3] != 4)
+      return false;
+    int32 dim;
+    std::memcpy(&dim, header + 4, sizeof(dim));
+    if (dim < 0)
+      return false;
+    size_t data_size = sizeof(Real) * static_cast<size_t>(dim);
+    const char *data = header + header_size;
+    if (buf->Remaining() - header_size < data_size ||
+        reinterpret_cast<uintptr_t>(data) % sizeof(Real) != 0)
+      return false;
+    buf->Advance(header_size + data_size);
+    Real *real_data = (dim == 0 ? NULL :
+                       reinterpret_cast<Real*>(const_cast<char*>(data)));
+    t_ = new SubVector<Real>(real_data, dim);
+    file_ = buf->File();
+    return true;
+  }
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(SubVectorHolder);
+  const SubVector<Real> *t_;
+  // At most one of these is set; it owns the memory that t_ points to.
+  std::shared_ptr<const MappedFile> file_;
+  std::shared_ptr<Vector<Real> > owned_;
+};
+
+
 // BasicHolder is valid for float, double, bool, and integer
 // types.  There will be a compile time error otherwise, because
 // we make sure that the {Write, Read}BasicType functions do not
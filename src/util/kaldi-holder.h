@@ -178,6 +178,21 @@ template<class KaldiType> class KaldiObjectHolder;
 /// get instantiated for other types.
 template<class BasicType> class BasicHolder;
 
+/// SubMatrixHolder reads and writes matrices in the same format as
+/// KaldiObjectHolder<Matrix<Real> >, but its type T is const MatrixBase<Real>.
+/// When it reads a binary, uncompressed matrix of the right type from a
+/// memory-mapped file (see the "mmap" rspecifier option), the object points
+/// directly into the mapped memory, so nothing is copied; otherwise (or if the
+/// data is not suitably aligned in the file) it reads into a Matrix it owns.
+/// T is const because the mapping is read-only, and it is not a SubMatrix so
+/// that it can't be copied into a non-const view of the same memory; copy it
+/// into a Matrix if you need to modify it.
+template<class Real> class SubMatrixHolder;
+
+/// SubVectorHolder is as SubMatrixHolder but for vectors; T is
+/// const VectorBase<Real>.
+template<class Real> class SubVectorHolder;
+
 
 // A Holder for a vector of basic types, e.g.
 // std::vector<int32>, std::vector<float>, and so on.
@@ -259,6 +274,15 @@ template <class Real>
 bool ExtractObjectRange(const CompressedMatrix &input, const std::string &range,
                         Matrix<Real> *output);
 
+/// Parses a matrix range specifier of the form r1:r2,c1:c2 (any of the four
+/// numbers may be missing, meaning 0 for r1 or c1 and the last row or column
+/// for r2 or c2) for a matrix with 'rows' rows and 'cols' columns, and outputs
+/// the first and last row and column.  Returns true on success.
+bool ParseMatrixRangeSpecifier(const std::string &range,
+                               const int rows, const int cols,
+                               std::vector<int32> *row_range,
+                               std::vector<int32> *col_range);
+
 // In SequentialTableReaderScriptImpl and RandomAccessTableReaderScriptImpl, for
 // cases where the scp contained 'range specifiers' (things in square brackets
 // identifying parts of objects like matrices), use this function to separate
@@ -25,6 +25,7 @@
 #include "util/parse-options.h"
 #include "util/kaldi-holder.h"
 #include "util/kaldi-pipebuf.h"
+#include "util/kaldi-mapped-file.h"
 #include "util/kaldi-table.h"  // for Classify{W,R}specifier
 #include <stdio.h>
 #include <stdlib.h>
@@ -375,6 +376,9 @@ class InputImplBase {
                                    // call Open twice
   // (has efficiency benefits).
 
+  // Returns true if this reads from a memory-mapped file (MappedFileInputImpl).
+  virtual bool IsMapped() const { return false; }
+
   virtual ~InputImplBase() { }
 };
 
@@ -662,6 +666,72 @@ class OffsetFileInputImpl: public InputImplBase {
 };
 
 
+// MappedFileInputImpl reads normal files and offsets into files (e.g.
+// /my/file:123) from a memory mapping; see Input::OpenMapped().  Like
+// OffsetFileInputImpl, its Open() may be called again to seek within the same
+// file.  The binary/text distinction is irrelevant here as we never translate
+// newlines.
+class MappedFileInputImpl: public InputImplBase {
+ public:
+  explicit MappedFileInputImpl(InputType type): type_(type) { }
+
+  virtual bool Open(const std::string &rxfilename, bool binary) {
+    std::string filename;
+    size_t offset = 0;
+    if (type_ == kOffsetFileInput)
+      OffsetFileInputImpl::SplitFilename(rxfilename, &filename, &offset);
+    else
+      filename = rxfilename;
+    filename = MapOsPath(filename);
+    if (file_ == NULL || file_->Filename() != filename) {
+      is_.reset();
+      buf_.reset();
+      file_ = MappedFile::Open(filename);
+      if (file_ == NULL)
+        return false;
+    }
+    if (offset > file_->Size()) {
+      KALDI_WARN << "Offset " << offset << " is past the end of file "
+                 << filename;
+      return false;
+    }
+    if (buf_ == NULL) {
+      buf_.reset(new MappedStreambuf(file_, offset));
+      is_.reset(new std::istream(buf_.get()));
+    } else {
+      is_->clear();
+      is_->seekg(offset, std::ios_base::beg);
+    }
+    return is_->good();
+  }
+
+  virtual std::istream &Stream() {
+    if (is_ == NULL)
+      KALDI_ERR << "MappedFileInputImpl::Stream(), file is not open.";
+    return *is_;
+  }
+
+  virtual int32 Close() {
+    if (is_ == NULL)
+      KALDI_ERR << "MappedFileInputImpl::Close(), file is not open.";
+    is_.reset();
+    buf_.reset();
+    file_.reset();
+    return 0;
+  }
+
+  virtual InputType MyType() { return type_; }
+
+  virtual bool IsMapped() const { return true; }
+
+ private:
+  InputType type_;
+  std::shared_ptr<const MappedFile> file_;
+  std::unique_ptr<MappedStreambuf> buf_;
+  std::unique_ptr<std::istream> is_;
+};
+
+
 Output::Output(const std::string &wxfilename, bool binary,
                bool write_header):impl_(NULL) {
   if (!Open(wxfilename, binary, write_header)) {
@@ -771,11 +841,14 @@ int32 Input::Close() {
 
 bool Input::OpenInternal(const std::string &rxfilename,
                          bool file_binary,
+                         bool mapped,
                          bool *contents_binary) {
   InputType type = ClassifyRxfilename(rxfilename);
+  mapped = mapped && (type == kFileInput || type == kOffsetFileInput);
   if (IsOpen()) {
     // May have to close the stream first.
-    if (type == kOffsetFileInput && impl_->MyType() == kOffsetFileInput) {
+    if (type == kOffsetFileInput && impl_->MyType() == kOffsetFileInput &&
+        mapped == impl_->IsMapped()) {
       // We want to use the same object to Open... this is in case
       // the files are the same, so we can just seek.
       if (!impl_->Open(rxfilename, file_binary)) {  // true is binary mode--
@@ -794,7 +867,9 @@ bool Input::OpenInternal(const std::string &rxfilename,
       // and fall through to code below which actually opens the file.
     }
   }
-  if (type ==  kFileInput) {
+  if (mapped) {
+    impl_ = new MappedFileInputImpl(type);
+  } else if (type ==  kFileInput) {
     impl_ = new FileInputImpl();
   } else if (type == kStandardInput) {
     impl_ = new StandardInputImpl();
@@ -213,6 +213,14 @@ class Input {
   // binary mode (and ignore the \r).
   inline bool OpenTextMode(const std::string &rxfilename);
 
+  // As Open, but for normal filenames and offsets into files (kFileInput and
+  // kOffsetFileInput), the file is memory-mapped (see class MappedFile in
+  // kaldi-mapped-file.h) and the stream reads directly from the mapped memory;
+  // holders such as SubMatrixHolder can then avoid copying the data.  For
+  // other types of input this is the same as Open.
+  inline bool OpenMapped(const std::string &rxfilename,
+                         bool *contents_binary = NULL);
+
   // Return true if currently open for reading and Stream() will
   // succeed.  Does not guarantee that the stream is good.
   inline bool IsOpen();
@@ -231,7 +239,7 @@ class Input {
   ~Input();
  private:
   bool OpenInternal(const std::string &rxfilename, bool file_binary,
-                    bool *contents_binary);
+                    bool mapped, bool *contents_binary);
   InputImplBase *impl_;
   KALDI_DISALLOW_COPY_AND_ASSIGN(Input);
 };
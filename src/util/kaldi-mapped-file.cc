@@ -0,0 +1,178 @@
+// util/kaldi-mapped-file.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/kaldi-mapped-file.h"
+#include <errno.h>
+#include <cstring>
+#include <map>
+#include <mutex>
+#ifdef _MSC_VER
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace kaldi {
+
+#ifndef _MSC_VER
+// The mappings that are currently in use in this process, indexed by the
+// identity of the file (see MappedFile::FileId); guarded by
+// mapped_files_mutex.
+static std::map<MappedFile::FileId, std::weak_ptr<const MappedFile> >
+    mapped_files;
+static std::mutex mapped_files_mutex;
+#endif
+
+
+bool MappedFile::FileId::operator < (const FileId &other) const {
+  if (device != other.device) return device < other.device;
+  if (inode != other.inode) return inode < other.inode;
+  if (mtime != other.mtime) return mtime < other.mtime;
+  return size < other.size;
+}
+
+
+std::shared_ptr<const MappedFile> MappedFile::Open(
+    const std::string &filename) {
+  char *data = NULL;
+  size_t size = 0;
+  FileId id;
+#ifdef _MSC_VER
+  // We just read the file, so there is nothing to share.
+  std::ifstream is(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!is.is_open()) {
+    KALDI_WARN << "Could not open file " << filename;
+    return std::shared_ptr<const MappedFile>();
+  }
+  is.seekg(0, std::ios_base::end);
+  size = is.tellg();
+  is.seekg(0, std::ios_base::beg);
+  if (size > 0) {
+    data = new char[size];
+    if (!is.read(data, size)) {
+      delete [] data;
+      KALDI_WARN << "Error reading file " << filename;
+      return std::shared_ptr<const MappedFile>();
+    }
+  }
+  return std::shared_ptr<const MappedFile>(new MappedFile(filename, id,
+                                                          data, size));
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    KALDI_WARN << "Could not open file " << filename << ": "
+               << strerror(errno);
+    return std::shared_ptr<const MappedFile>();
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    KALDI_WARN << "Cannot memory-map " << filename
+               << " (it is not a regular file)";
+    close(fd);
+    return std::shared_ptr<const MappedFile>();
+  }
+  // A file that has been rewritten since we mapped it (or a different file
+  // with the same name) has a different identity, so it gets a new mapping.
+  id.device = st.st_dev;
+  id.inode = st.st_ino;
+  id.mtime = st.st_mtime;
+  id.size = st.st_size;
+  std::lock_guard<std::mutex> lock(mapped_files_mutex);
+  std::map<FileId, std::weak_ptr<const MappedFile> >::iterator iter =
+      mapped_files.find(id);
+  if (iter != mapped_files.end()) {
+    std::shared_ptr<const MappedFile> ans = iter->second.lock();
+    if (ans != NULL) {
+      close(fd);
+      return ans;
+    }
+  }
+  size = st.st_size;
+  if (size > 0) {
+    void *addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      KALDI_WARN << "Failed to memory-map file " << filename << ": "
+                 << strerror(errno);
+      close(fd);
+      return std::shared_ptr<const MappedFile>();
+    }
+    data = static_cast<char*>(addr);
+  }
+  // The mapping stays valid after the file descriptor is closed.
+  close(fd);
+  std::shared_ptr<const MappedFile> ans(new MappedFile(filename, id,
+                                                       data, size));
+  mapped_files[id] = ans;
+  return ans;
+#endif
+}
+
+
+MappedFile::~MappedFile() {
+#ifdef _MSC_VER
+  delete [] data_;
+#else
+  if (data_ != NULL)
+    munmap(data_, size_);
+  std::lock_guard<std::mutex> lock(mapped_files_mutex);
+  std::map<FileId, std::weak_ptr<const MappedFile> >::iterator iter =
+      mapped_files.find(id_);
+  // Don't erase the entry if it has been replaced by a newer mapping.
+  if (iter != mapped_files.end() && iter->second.expired())
+    mapped_files.erase(iter);
+#endif
+}
+
+
+MappedStreambuf::MappedStreambuf(const std::shared_ptr<const MappedFile> &file,
+                                 size_t offset): file_(file) {
+  KALDI_ASSERT(file != NULL && offset <= file->Size());
+  // std::streambuf wants non-const pointers, but we never write through them.
+  char *begin = const_cast<char*>(file->Data());
+  setg(begin, begin + offset, begin + file->Size());
+}
+
+
+MappedStreambuf::pos_type MappedStreambuf::seekoff(
+    off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+  off_type base;
+  if (dir == std::ios_base::beg)
+    base = 0;
+  else if (dir == std::ios_base::cur)
+    base = gptr() - eback();
+  else
+    base = egptr() - eback();
+  off_type pos = base + off;
+  if (pos < 0 || pos > egptr() - eback())
+    return pos_type(off_type(-1));
+  setg(eback(), eback() + pos, egptr());
+  return pos_type(pos);
+}
+
+
+MappedStreambuf::pos_type MappedStreambuf::seekpos(
+    pos_type pos, std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+
+}  // end namespace kaldi
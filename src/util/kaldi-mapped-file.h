@@ -0,0 +1,133 @@
+// util/kaldi-mapped-file.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_KALDI_MAPPED_FILE_H_
+#define KALDI_UTIL_KALDI_MAPPED_FILE_H_
+
+#include <memory>
+#include <streambuf>
+#include <string>
+#include "base/kaldi-common.h"
+
+namespace kaldi {
+
+/// \addtogroup io_group
+/// @{
+
+/**
+   MappedFile is a read-only memory mapping of a whole file.  It is what we use
+   to read archives when the "mmap" option is given in an rspecifier (e.g.
+   "ark,mmap:feats.ark").  Because the mapping is shared and read-only, the
+   pages come straight from the operating system's page cache and are shared
+   between all processes that read the same file; and within a process, all
+   readers of the same file share a single mapping (see Open()).  The contents
+   must not be modified while they are mapped; this is why the holders that
+   use it give const views of the data.
+
+   On platforms without mmap() (i.e. Windows), the file is simply read into
+   memory, and nothing is shared.
+ */
+class MappedFile {
+ public:
+  /// Returns a mapping of the file 'filename' (which must be an actual
+  /// filename, not an rxfilename such as a pipe), or NULL on failure (after
+  /// printing a warning).  If the same file is already mapped by this
+  /// process, the existing mapping is returned; a file counts as the same if
+  /// its device, inode, modification time and size are all unchanged, so a
+  /// file that has been replaced or rewritten is mapped again.  The file is
+  /// unmapped when the last pointer to it goes out of scope.
+  static std::shared_ptr<const MappedFile> Open(const std::string &filename);
+
+  /// Returns the start of the file's contents (NULL if the file is empty).
+  const char *Data() const { return data_; }
+
+  /// Returns the size of the file in bytes.
+  size_t Size() const { return size_; }
+
+  const std::string &Filename() const { return filename_; }
+
+  ~MappedFile();
+
+  // Identifies a version of a file, as returned by stat(); used to share
+  // mappings.
+  struct FileId {
+    uint64 device;
+    uint64 inode;
+    int64 mtime;
+    uint64 size;
+    FileId(): device(0), inode(0), mtime(0), size(0) { }
+    bool operator < (const FileId &other) const;
+  };
+ private:
+  MappedFile(const std::string &filename, const FileId &id, char *data,
+             size_t size):
+      filename_(filename), id_(id), data_(data), size_(size) { }
+
+  std::string filename_;
+  FileId id_;
+  char *data_;
+  size_t size_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+};
+
+
+/**
+   MappedStreambuf is a std::streambuf that reads directly from a MappedFile,
+   so reading from an istream that uses it involves no system calls.  It
+   supports seeking.  Holders that can make use of the mapped memory directly
+   (such as SubMatrixHolder) check, via dynamic_cast, whether the stream they
+   are reading from has a MappedStreambuf; if so, they can construct their
+   object in place without copying it, keeping a pointer to File() so the
+   memory stays mapped for as long as they need it.
+ */
+class MappedStreambuf: public std::streambuf {
+ public:
+  /// Starts reading at byte 'offset' of the file (which must be <=
+  /// file->Size()).
+  MappedStreambuf(const std::shared_ptr<const MappedFile> &file,
+                  size_t offset);
+
+  const std::shared_ptr<const MappedFile> &File() const { return file_; }
+
+  /// Returns a pointer to the next byte that would be read.
+  const char *Current() const { return gptr(); }
+
+  /// Returns the number of bytes between Current() and the end of the file.
+  size_t Remaining() const { return egptr() - gptr(); }
+
+  /// Skips over the next n bytes; requires n <= Remaining().
+  void Advance(size_t n) {
+    KALDI_ASSERT(n <= Remaining());
+    setg(eback(), gptr() + n, egptr());
+  }
+
+ protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+ private:
+  std::shared_ptr<const MappedFile> file_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MappedStreambuf);
+};
+
+/// @}
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_MAPPED_FILE_H_
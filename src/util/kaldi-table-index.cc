@@ -0,0 +1,234 @@
+// util/kaldi-table-index.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/kaldi-table-index.h"
+#include <sys/stat.h>
+#include <cstring>
+#include <unordered_set>
+#include "util/kaldi-io.h"
+#include "util/stl-utils.h"
+
+namespace kaldi {
+
+static const char kTableIndexMagic[4] = { 'K', 'I', 'D', 'X' };
+static const int32 kTableIndexVersion = 2;
+// magic, version, archive size, archive mtime, num-entries, num-buckets.
+static const int64 kTableIndexHeaderSize = 4 + 4 + 8 + 8 + 8 + 8;
+
+// The hash function has to be the same in every process that reads the index,
+// so we can't use std::hash; this is 64-bit FNV-1a.
+static inline uint64 TableIndexHash(const char *key, size_t len) {
+  uint64 ans = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    ans ^= static_cast<unsigned char>(key[i]);
+    ans *= 1099511628211ULL;
+  }
+  return ans;
+}
+
+template<class I>
+static inline void WriteRaw(std::ostream &os, I i) {
+  os.write(reinterpret_cast<const char*>(&i), sizeof(i));
+}
+
+template<class I>
+static inline I ReadRaw(const char *data) {
+  I ans;
+  std::memcpy(&ans, data, sizeof(ans));
+  return ans;
+}
+
+
+std::string TableIndexFilename(const std::string &archive_filename) {
+  return archive_filename + ".idx";
+}
+
+// Outputs the size in bytes and the modification time (in seconds since the
+// epoch) of the file 'filename'; returns false if it can't be stat'ed.
+static bool GetArchiveSizeAndMtime(const std::string &filename, int64 *size,
+                                   int64 *mtime) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return false;
+  *size = static_cast<int64>(st.st_size);
+  *mtime = static_cast<int64>(st.st_mtime);
+  return true;
+}
+
+
+void TableIndexWriter::Add(const std::string &key, int64 offset,
+                           int64 length) {
+  KALDI_ASSERT(offset >= 0 && length >= 0);
+  Entry e;
+  e.key = key;
+  e.offset = offset;
+  e.length = length;
+  entries_.push_back(e);
+}
+
+
+bool TableIndexWriter::Write(const std::string &archive_filename) const {
+  std::string filename = TableIndexFilename(archive_filename);
+  int64 archive_size, archive_mtime;
+  if (!GetArchiveSizeAndMtime(archive_filename, &archive_size,
+                              &archive_mtime)) {
+    KALDI_WARN << "Could not stat archive " << archive_filename
+               << ", not writing table index " << filename;
+    return false;
+  }
+  // Remove duplicate keys, keeping the first occurrence.
+  std::vector<const Entry*> entries;
+  entries.reserve(entries_.size());
+  {
+    std::unordered_set<std::string, StringHasher> seen;
+    for (size_t i = 0; i < entries_.size(); i++)
+      if (seen.insert(entries_[i].key).second)
+        entries.push_back(&(entries_[i]));
+  }
+  int64 num_entries = entries.size(),
+      num_buckets = 2 * num_entries + 1;  // load factor at most 0.5.
+
+  // Work out where each record goes, and which bucket points to it.
+  std::vector<uint64> buckets(num_buckets, 0);
+  int64 pos = kTableIndexHeaderSize + 8 * num_buckets;
+  for (int64 i = 0; i < num_entries; i++) {
+    const std::string &key = entries[i]->key;
+    int64 b = TableIndexHash(key.data(), key.size()) % num_buckets;
+    while (buckets[b] != 0)
+      b = (b + 1) % num_buckets;
+    buckets[b] = pos + 1;
+    pos += 4 + key.size() + 8 + 8;
+  }
+
+  try {
+    Output ko(filename, true, false);
+    std::ostream &os = ko.Stream();
+    os.write(kTableIndexMagic, 4);
+    WriteRaw<int32>(os, kTableIndexVersion);
+    WriteRaw<int64>(os, archive_size);
+    WriteRaw<int64>(os, archive_mtime);
+    WriteRaw<int64>(os, num_entries);
+    WriteRaw<int64>(os, num_buckets);
+    os.write(reinterpret_cast<const char*>(&(buckets[0])),
+             sizeof(uint64) * num_buckets);
+    for (int64 i = 0; i < num_entries; i++) {
+      const Entry &e = *(entries[i]);
+      WriteRaw<int32>(os, static_cast<int32>(e.key.size()));
+      os.write(e.key.data(), e.key.size());
+      WriteRaw<int64>(os, e.offset);
+      WriteRaw<int64>(os, e.length);
+    }
+    if (!ko.Close()) {
+      KALDI_WARN << "Error writing table index " << filename;
+      return false;
+    }
+    return true;
+  } catch (const std::exception &e) {
+    KALDI_WARN << "Error writing table index " << filename << ": "
+               << e.what();
+    return false;
+  }
+}
+
+
+bool TableIndex::Open(const std::string &archive_filename) {
+  file_.reset();
+  std::string filename = TableIndexFilename(archive_filename);
+  std::shared_ptr<const MappedFile> file = MappedFile::Open(filename);
+  if (file == NULL)
+    return false;  // MappedFile::Open() will have printed a warning.
+  const char *data = file->Data();
+  int64 size = file->Size();
+  if (size < kTableIndexHeaderSize ||
+      std::memcmp(data, kTableIndexMagic, 4) != 0) {
+    KALDI_WARN << "File " << filename << " is not a table index.";
+    return false;
+  }
+  int32 version = ReadRaw<int32>(data + 4);
+  if (version != kTableIndexVersion) {
+    KALDI_WARN << "Table index " << filename << " has unsupported version "
+               << version;
+    return false;
+  }
+  int64 archive_size = ReadRaw<int64>(data + 8),
+      archive_mtime = ReadRaw<int64>(data + 16),
+      num_entries = ReadRaw<int64>(data + 24),
+      num_buckets = ReadRaw<int64>(data + 32);
+  if (num_entries < 0 || num_buckets <= num_entries ||
+      kTableIndexHeaderSize + 8 * num_buckets > size) {
+    KALDI_WARN << "Table index " << filename << " is corrupted.";
+    return false;
+  }
+  int64 actual_archive_size, actual_archive_mtime;
+  if (!GetArchiveSizeAndMtime(archive_filename, &actual_archive_size,
+                              &actual_archive_mtime)) {
+    KALDI_WARN << "Could not stat archive " << archive_filename;
+    return false;
+  }
+  if (actual_archive_size != archive_size) {
+    KALDI_WARN << "Table index " << filename << " is out of date: it was "
+               << "written for an archive of " << archive_size << " bytes, but "
+               << archive_filename << " has " << actual_archive_size
+               << " bytes.";
+    return false;
+  }
+  // The size alone does not catch an archive that was rewritten with objects
+  // of the same sizes (e.g. the same keys and dimensions).
+  if (actual_archive_mtime != archive_mtime) {
+    KALDI_WARN << "Table index " << filename << " is out of date: "
+               << archive_filename << " was modified after the index was "
+               << "written.";
+    return false;
+  }
+  file_ = file;
+  archive_size_ = archive_size;
+  num_entries_ = num_entries;
+  num_buckets_ = num_buckets;
+  return true;
+}
+
+
+bool TableIndex::Lookup(const std::string &key, int64 *offset,
+                        int64 *length) const {
+  KALDI_ASSERT(IsOpen());
+  const char *data = file_->Data();
+  int64 size = file_->Size();
+  const char *buckets = data + kTableIndexHeaderSize;
+  int64 b = TableIndexHash(key.data(), key.size()) % num_buckets_;
+  // Since the table is never more than half full, this terminates.
+  while (true) {
+    uint64 pos = ReadRaw<uint64>(buckets + 8 * b);
+    if (pos == 0)
+      return false;
+    pos--;
+    if (pos + 4 > static_cast<uint64>(size))
+      KALDI_ERR << "Table index " << file_->Filename() << " is corrupted.";
+    int32 key_len = ReadRaw<int32>(data + pos);
+    if (key_len < 0 || pos + 4 + key_len + 16 > static_cast<uint64>(size))
+      KALDI_ERR << "Table index " << file_->Filename() << " is corrupted.";
+    const char *record_key = data + pos + 4;
+    if (static_cast<size_t>(key_len) == key.size() &&
+        std::memcmp(record_key, key.data(), key_len) == 0) {
+      *offset = ReadRaw<int64>(record_key + key_len);
+      *length = ReadRaw<int64>(record_key + key_len + 8);
+      return true;
+    }
+    b = (b + 1) % num_buckets_;
+  }
+}
+
+}  // end namespace kaldi
@@ -0,0 +1,139 @@
+// util/kaldi-table-index.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_KALDI_TABLE_INDEX_H_
+#define KALDI_UTIL_KALDI_TABLE_INDEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "base/kaldi-common.h"
+#include "util/kaldi-mapped-file.h"
+
+namespace kaldi {
+
+/// \addtogroup table_group
+/// @{
+
+/**
+   A table index is a "sidecar" file that is written next to an archive (its
+   name is the archive's filename with ".idx" appended; see
+   TableIndexFilename()), and which maps each key in the archive to the byte
+   offset and length of its object.  It is written when the "idx" option is
+   given in a wspecifier, e.g. "ark,idx:feats.ark", and used when the "idx"
+   option is given in an rspecifier for random access, e.g.
+   RandomAccessBaseFloatMatrixReader reader("ark,idx:feats.ark").  This gives
+   constant-time lookup of keys without having to scan the archive or keep any
+   of it in memory.  The archive's filename is implicit, and the type of the
+   objects is given by the Holder, as for any archive.
+
+   The on-disk format is a hash table that is designed to be memory-mapped
+   and searched in place, so opening an index costs nothing in proportion to
+   its size.  It is (all integers little-endian on little-endian machines, as
+   for Kaldi's other binary formats):
+
+     "KIDX" <int32 version> <int64 archive-size> <int64 archive-mtime>
+            <int64 num-entries> <int64 num-buckets>
+     <uint64 bucket> * num-buckets
+     <record> * num-entries
+
+   where each record is
+     <int32 key-length> <key> <int64 offset> <int64 length>
+   and each bucket is zero if it is empty, or one plus the position in the
+   index file of the record that hashes to it (with linear probing).  The
+   archive's size and modification time (in seconds since the epoch) are used
+   to detect an index that is out of date; so copying an archive and its index
+   elsewhere requires preserving the modification times (e.g. cp -p).
+ */
+
+/// Returns the filename of the index that goes with the archive
+/// 'archive_filename', i.e. archive_filename + ".idx".
+std::string TableIndexFilename(const std::string &archive_filename);
+
+
+/// Accumulates the (key, offset, length) entries of an archive as it is
+/// written, and writes them out as an index.
+class TableIndexWriter {
+ public:
+  TableIndexWriter() { }
+
+  /// Adds the object with key 'key' that starts at byte 'offset' of the
+  /// archive and has 'length' bytes.  If a key is added more than once, the
+  /// first occurrence is the one that will be found by lookups (which is
+  /// consistent with what the other random-access readers do, in the cases
+  /// where they accept duplicates at all).
+  void Add(const std::string &key, int64 offset, int64 length);
+
+  /// Writes the index of the archive 'archive_filename', which must have been
+  /// closed, to TableIndexFilename(archive_filename), recording the archive's
+  /// current size and modification time.  Returns false (after printing a
+  /// warning) on error.
+  bool Write(const std::string &archive_filename) const;
+
+  void Clear() { entries_.clear(); }
+
+  size_t NumEntries() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    std::string key;
+    int64 offset;
+    int64 length;
+  };
+  std::vector<Entry> entries_;
+};
+
+
+/// TableIndex provides lookup of keys in an index written by
+/// TableIndexWriter.  It is memory-mapped (see class MappedFile), so it takes
+/// no memory of its own and is shared between all readers of the same index.
+/// It is safe to call Lookup() from multiple threads.
+class TableIndex {
+ public:
+  TableIndex(): archive_size_(0), num_entries_(0), num_buckets_(0) { }
+
+  /// Opens the index of the archive 'archive_filename' (i.e. the file
+  /// TableIndexFilename(archive_filename)) and checks that it is consistent
+  /// with the archive.  Returns false, after printing a warning, if the index
+  /// does not exist, is corrupted, or was written for a different version of
+  /// the archive.
+  bool Open(const std::string &archive_filename);
+
+  bool IsOpen() const { return file_ != NULL; }
+
+  void Close() { file_.reset(); }
+
+  /// If the key 'key' is in the index, outputs the byte offset and length of
+  /// its object within the archive and returns true; otherwise returns false.
+  bool Lookup(const std::string &key, int64 *offset, int64 *length) const;
+
+  int64 NumEntries() const { return num_entries_; }
+
+  int64 ArchiveSize() const { return archive_size_; }
+
+ private:
+  std::shared_ptr<const MappedFile> file_;
+  int64 archive_size_;
+  int64 num_entries_;
+  int64 num_buckets_;
+};
+
+/// @} end "addtogroup table_group"
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_KALDI_TABLE_INDEX_H_
@@ -24,6 +24,10 @@
 #define KALDI_UTIL_KALDI_TABLE_INL_H_
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <utility>
@@ -34,6 +38,7 @@
 #include "util/text-utils.h"
 #include "util/stl-utils.h"  // for StringHasher.
 #include "util/kaldi-semaphore.h"
+#include "util/kaldi-table-index.h"
 
 
 namespace kaldi {
@@ -75,6 +80,15 @@ template<class Holder> class SequentialTableReaderImplBase {
   // this->holder_ with those of 'other_holder'.  It's needed as part of how
   // we implement SequentialTableReaderBackgroundImpl.
   virtual void SwapHolder(Holder *other_holder) = 0;
+  // GetDataRxfilename() is also not part of the public interface.  It may be
+  // called when it would be valid to call Value().  If the object for the
+  // current key can be read on its own, from an rxfilename (possibly with a
+  // range specifier) without going through this reader, it outputs them and
+  // returns true; otherwise it returns false.  It lets
+  // SequentialTableReaderBackgroundImpl read objects from scp files in
+  // parallel.
+  virtual bool GetDataRxfilename(std::string *data_rxfilename,
+                                 std::string *range) { return false; }
   SequentialTableReaderImplBase() { }
   virtual ~SequentialTableReaderImplBase() { }  // throws.
  private:
@@ -210,6 +224,18 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
     // function needs to be lightweight for the 'bg' feature to work well.
   }
 
+  virtual bool GetDataRxfilename(std::string *data_rxfilename,
+                                 std::string *range) {
+    // In permissive mode, Next() has already loaded the object (to check that
+    // it could), so there would be no point reading it again elsewhere.
+    if (opts_.permissive || !(state_ == kHaveScpLine ||
+                              state_ == kHaveObject || state_ == kHaveRange))
+      return false;
+    *data_rxfilename = data_rxfilename_;
+    *range = range_;
+    return true;
+  }
+
   // Next goes to the next object.
   // It can leave the object in most of the statuses, but
   // the only circumstances under which it will return are:
@@ -302,7 +328,10 @@ template<class Holder>  class SequentialTableReaderScriptImpl:
       bool ans;
       // note, NULL means it doesn't read the binary-mode header
       if (Holder::IsReadInBinary()) {
-        ans = data_input_.Open(data_rxfilename_, NULL);
+        if (opts_.mmap)
+          ans = data_input_.OpenMapped(data_rxfilename_, NULL);
+        else
+          ans = data_input_.Open(data_rxfilename_, NULL);
       } else {
         ans = data_input_.OpenTextMode(data_rxfilename_);
       }
@@ -505,7 +534,9 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
 
     bool ans;
     // NULL means don't expect binary-mode header
-    if (Holder::IsReadInBinary())
+    if (Holder::IsReadInBinary() && opts_.mmap)
+      ans = input_.OpenMapped(archive_rxfilename_, NULL);
+    else if (Holder::IsReadInBinary())
       ans = input_.Open(archive_rxfilename_, NULL);
     else
       ans = input_.OpenTextMode(archive_rxfilename_);
@@ -696,8 +727,15 @@ template<class Holder>  class SequentialTableReaderArchiveImpl:
   } state_;
 };
 
-// this is for when someone adds the 'th' modifier; it wraps around the basic
-// implementation and allows it to do the reading in a background thread.
+// This is for when someone adds the 'bg' modifier (or 'bg=N' or 'bgw=M'); it
+// wraps around the basic implementation and allows it to do the reading in the
+// background.  A background thread (the "scanner") steps through the base
+// reader and fills a ring of read_ahead slots with the objects, in order.  If
+// num_workers > 1 and the base reader can tell us where each object lives
+// (i.e. it is an scp file; see GetDataRxfilename()), the scanner only records
+// the rxfilename and the objects are read and parsed by num_workers worker
+// threads in parallel.  The main thread takes the objects from the slots in
+// order, waiting if the next one is not ready yet.
 template<class Holder>
 class SequentialTableReaderBackgroundImpl:
       public SequentialTableReaderImplBase<Holder> {
@@ -705,8 +743,14 @@ class SequentialTableReaderBackgroundImpl:
   typedef typename Holder::T T;
 
   SequentialTableReaderBackgroundImpl(
-      SequentialTableReaderImplBase<Holder> *base_reader):
-      base_reader_(base_reader) {}
+      SequentialTableReaderImplBase<Holder> *base_reader,
+      const RspecifierOptions &opts):
+      base_reader_(base_reader), opts_(opts),
+      slots_(std::max(opts.read_ahead, opts.num_workers)),
+      head_(0), tail_(0), scanner_done_(false), scanner_error_(false),
+      stop_(false), current_failed_(false) {
+    KALDI_ASSERT(opts.read_ahead > 0 && opts.num_workers > 0);
+  }
 
   // This function ignores the rxfilename argument.
   // We use the same function signature as the regular Open(),
@@ -714,13 +758,14 @@ class SequentialTableReaderBackgroundImpl:
   virtual bool Open(const std::string &rxfilename) {
     KALDI_ASSERT(base_reader_ != NULL &&
                  base_reader_->IsOpen());  // or code error.
-    {
-      thread_ = std::thread(SequentialTableReaderBackgroundImpl<Holder>::run,
-                            this);
+    scanner_ = std::thread(SequentialTableReaderBackgroundImpl<Holder>::
+                           RunScanner, this);
+    if (opts_.num_workers > 1) {
+      for (int32 i = 0; i < opts_.num_workers; i++)
+        workers_.push_back(std::thread(
+            SequentialTableReaderBackgroundImpl<Holder>::RunWorker, this));
     }
-
-    if (!base_reader_->Done())
-      Next();
+    Next();
     return true;
   }
 
@@ -730,44 +775,6 @@ class SequentialTableReaderBackgroundImpl:
     return base_reader_ != NULL;
   }
 
-  void RunInBackground() {
-    try {
-      // This function is called in the background thread.  The whole point of
-      // the background thread is that we don't want to do the actual reading
-      // (inside Next()) in the foreground.
-      while (base_reader_ != NULL && !base_reader_->Done()) {
-        consumer_sem_.Signal();
-        // Here is where the consumer process (parent thread) gets to do its
-        // stuff.  Principally it calls SwapHolder()-- a shallow swap that is
-        // cheap.
-        producer_sem_.Wait();
-        // we check that base_reader_ is not NULL in case Close() was
-        // called in the main thread.
-        if (base_reader_ != NULL)
-          base_reader_->Next();   //  here is where the work happens.
-      }
-      // this signal will be waited on in the Next() function of the foreground
-      // thread if it is still running, or Close() otherwise.
-      consumer_sem_.Signal();
-      // this signal may be waited on in Close().
-      consumer_sem_.Signal();
-    } catch (...) {
-      // There is nothing we called above that could potentially throw due to
-      // user data.  So we treat reaching this point as a code-error condition.
-      // Closing base_reader_ will trigger an exception in Next() in the main
-      // thread when it checks that base_reader_->IsOpen().
-      if (base_reader_->IsOpen()) {
-        base_reader_->Close();
-        delete base_reader_;
-        base_reader_ = NULL;
-      }
-      consumer_sem_.Signal();
-      return;
-    }
-  }
-  static void run(SequentialTableReaderBackgroundImpl<Holder> *object) {
-    object->RunInBackground();
-  }
   virtual bool Done() const {
     return key_.empty();
   }
@@ -779,6 +786,12 @@ class SequentialTableReaderBackgroundImpl:
   virtual T &Value() {
     if (key_.empty())
       KALDI_ERR << "Calling Value() at the wrong time.";
+    if (current_failed_)
+      KALDI_ERR << "Failed to load object from "
+                << PrintableRxfilename(current_rxfilename_)
+                << (current_range_.empty() ? "" : "[" + current_range_ + "]")
+                << " (to suppress this error, add the permissive "
+                << "(p, ) option to the rspecifier.";
     return holder_.Value();
   }
   void SwapHolder(Holder *other_holder) {
@@ -795,41 +808,57 @@ class SequentialTableReaderBackgroundImpl:
     holder_.Clear();
   }
   virtual void Next() {
-    consumer_sem_.Wait();
-    if (base_reader_ == NULL || !base_reader_->IsOpen())
-      KALDI_ERR << "Error detected (likely code error) in background "
-                << "reader (',bg' option)";
-    if (base_reader_->Done()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Slot &slot = slots_[head_];
+    while (!(slot.state == kReady || slot.state == kFailed ||
+             (slot.state == kEmpty && scanner_done_)))
+      consumer_cond_.wait(lock);
+    if (slot.state == kEmpty) {
+      if (scanner_error_)
+        KALDI_ERR << "Error detected in background reader (',bg' option)";
       // there is nothing else to read.
       key_ = "";
-    } else {
-      key_ = base_reader_->Key();
-      base_reader_->SwapHolder(&holder_);
+      return;
     }
-    // this Signal() tells the producer thread, in the background,
-    // that it's now safe to read the next value.
-    producer_sem_.Signal();
+    key_ = slot.key;
+    current_failed_ = (slot.state == kFailed);
+    current_rxfilename_ = slot.data_rxfilename;
+    current_range_ = slot.range;
+    // This is a shallow swap, which is cheap.  After this, slot.holder
+    // contains our previous object, which will be overwritten when the slot
+    // is reused.
+    holder_.Swap(&slot.holder);
+    slot.state = kEmpty;
+    head_ = (head_ + 1) % slots_.size();
+    // tell the scanner that there is a free slot.
+    scanner_cond_.notify_one();
   }
 
   // note: we can be sure that Close() won't be called twice, as the TableReader
   // object will delete this object after calling Close.
   virtual bool Close() {
-    KALDI_ASSERT(base_reader_ != NULL && thread_.joinable());
-    // wait until the producer thread is idle.
-    consumer_sem_.Wait();
-    bool ans = true;
+    KALDI_ASSERT(base_reader_ != NULL && scanner_.joinable());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    scanner_cond_.notify_all();
+    worker_cond_.notify_all();
+    // The scanner may be in the middle of reading an object; we have to wait
+    // for that.
+    scanner_.join();
+    for (size_t i = 0; i < workers_.size(); i++)
+      workers_[i].join();
+    workers_.clear();
+    bool ans = !scanner_error_;
     try {
-      ans = base_reader_->Close();
+      if (!base_reader_->Close())
+        ans = false;
     } catch (...) {
       ans = false;
     }
     delete base_reader_;
-    // setting base_reader_ to NULL will cause the loop in the producer thread
-    // to exit.
     base_reader_ = NULL;
-    producer_sem_.Signal();
-
-    thread_.join();
     return ans;
   }
   ~SequentialTableReaderBackgroundImpl() {
@@ -841,16 +870,176 @@ class SequentialTableReaderBackgroundImpl:
     }
   }
  private:
-  std::string key_;
-  Holder holder_;
-  // I couldn't figure out what to call these semaphores.  consumer_sem_ is the
-  // one that the consumer (main thread) waits on; producer_sem_ is the one
-  // that the producer (background thread) waits on.
-  Semaphore consumer_sem_;
-  Semaphore producer_sem_;
-  std::thread thread_;
+  static void RunScanner(SequentialTableReaderBackgroundImpl<Holder> *object) {
+    object->Scan();
+  }
+  static void RunWorker(SequentialTableReaderBackgroundImpl<Holder> *object) {
+    object->Work();
+  }
+
+  // This is called in the scanner thread.  The whole point of the background
+  // thread is that we don't want to do the actual reading (inside the base
+  // reader's Next()) in the foreground.
+  void Scan() {
+    try {
+      // base_reader_ is already positioned at the first object when we start.
+      for (bool first = true; ; first = false) {
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          while (slots_[tail_].state != kEmpty && !stop_)
+            scanner_cond_.wait(lock);
+          if (stop_)
+            return;
+        }
+        // From here until we change its state, the slot at tail_ belongs to
+        // this thread.
+        if (!first)
+          base_reader_->Next();   //  here is where the work happens.
+        if (base_reader_->Done())
+          break;
+        Slot &slot = slots_[tail_];
+        slot.key = base_reader_->Key();
+        bool use_workers = opts_.num_workers > 1 &&
+            base_reader_->GetDataRxfilename(&slot.data_rxfilename, &slot.range);
+        if (!use_workers)
+          base_reader_->SwapHolder(&slot.holder);  // reads the object.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (use_workers) {
+          slot.state = kPending;
+          pending_.push_back(tail_);
+          worker_cond_.notify_one();
+        } else {
+          slot.state = kReady;
+          consumer_cond_.notify_one();
+        }
+        tail_ = (tail_ + 1) % slots_.size();
+      }
+    } catch (...) {
+      // The base reader should only throw on code error, or if the user is
+      // not using the permissive option and an scp entry cannot be read;
+      // the main thread will report the error in Next().
+      std::lock_guard<std::mutex> lock(mutex_);
+      scanner_error_ = true;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    scanner_done_ = true;
+    consumer_cond_.notify_one();
+  }
+
+  // This is called in each worker thread; it reads the objects for the slots
+  // that the scanner gives it.
+  void Work() {
+    Input input;  // kept between objects, so we can just seek if consecutive
+                  // objects are in the same archive.
+    Holder range_source;
+    while (true) {
+      size_t s;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (pending_.empty() && !stop_)
+          worker_cond_.wait(lock);
+        if (stop_)
+          return;
+        s = pending_.front();
+        pending_.pop_front();
+      }
+      Slot &slot = slots_[s];
+      bool ans;
+      try {
+        ans = ReadObject(slot.data_rxfilename, slot.range, &input,
+                         &range_source, &(slot.holder));
+      } catch (...) {
+        ans = false;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.state = (ans ? kReady : kFailed);
+      if (s == head_)
+        consumer_cond_.notify_one();
+    }
+  }
+
+  // Reads into 'holder' the object in 'data_rxfilename', or if 'range' is
+  // nonempty, that range of it, in the same way as
+  // SequentialTableReaderScriptImpl does.
+  bool ReadObject(const std::string &data_rxfilename, const std::string &range,
+                  Input *input, Holder *range_source, Holder *holder) {
+    bool ans;
+    // note, NULL means it doesn't read the binary-mode header
+    if (Holder::IsReadInBinary()) {
+      if (opts_.mmap)
+        ans = input->OpenMapped(data_rxfilename, NULL);
+      else
+        ans = input->Open(data_rxfilename, NULL);
+    } else {
+      ans = input->OpenTextMode(data_rxfilename);
+    }
+    if (!ans) {
+      KALDI_WARN << "Failed to open file "
+                 << PrintableRxfilename(data_rxfilename);
+      return false;
+    }
+    Holder *read_holder = (range.empty() ? holder : range_source);
+    if (!read_holder->Read(input->Stream())) {
+      KALDI_WARN << "Failed to load object from "
+                 << PrintableRxfilename(data_rxfilename);
+      return false;
+    }
+    if (range.empty())
+      return true;
+    ans = holder->ExtractRange(*range_source, range);
+    range_source->Clear();
+    if (!ans)
+      KALDI_WARN  << "Failed to load object from "
+                  << PrintableRxfilename(data_rxfilename)
+                  << "[" << range << "]";
+    return ans;
+  }
+
+  enum SlotState {
+    kEmpty,    // Free for the scanner to use.
+    kPending,  // Waiting for (or being read by) a worker.
+    kReady,    // holder contains the object.
+    kFailed    // A worker could not read the object.
+  };
+  struct Slot {
+    std::string key;
+    std::string data_rxfilename;  // Only set if the object is read by a worker.
+    std::string range;  // Only set if the object is read by a worker.
+    Holder holder;
+    SlotState state;
+    Slot(): state(kEmpty) { }
+  };
+
   SequentialTableReaderImplBase<Holder> *base_reader_;
+  RspecifierOptions opts_;
 
+  // mutex_ guards the slot states and the variables below it, but not the
+  // contents of the slots: a slot in state kEmpty belongs to the scanner, a
+  // slot in state kPending to a worker, and slots in state kReady or kFailed
+  // to the main thread.
+  std::mutex mutex_;
+  std::vector<Slot> slots_;  // A ring buffer of objects read ahead.
+  size_t head_;  // The next slot that the main thread will take.
+  size_t tail_;  // The next slot that the scanner will fill.
+  std::deque<size_t> pending_;  // Slots waiting for a worker, in order.
+  bool scanner_done_;  // True if the scanner has reached the end of the input
+                       // (or had an error).
+  bool scanner_error_;
+  bool stop_;  // Set in Close(), to tell the background threads to finish.
+  std::condition_variable consumer_cond_;  // The main thread waits on this.
+  std::condition_variable scanner_cond_;  // The scanner waits on this.
+  std::condition_variable worker_cond_;  // The workers wait on this.
+
+  std::thread scanner_;
+  std::vector<std::thread> workers_;
+
+  // The current object, and information about it; only accessed from the main
+  // thread.
+  std::string key_;
+  Holder holder_;
+  bool current_failed_;
+  std::string current_rxfilename_;
+  std::string current_range_;
 };
 
 template<class Holder>
@@ -887,7 +1076,7 @@ bool SequentialTableReader<Holder>::Open(const std::string &rspecifier) {
   }
   if (opts.background) {
     impl_ = new SequentialTableReaderBackgroundImpl<Holder>(
-        impl_);
+        impl_, opts);
     if (!impl_->Open("")) {
       // the rxfilename is ignored in that Open() call.
       // It should only return false on code error.
@@ -1014,6 +1203,13 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
                                            NULL,
                                            &opts_);
     KALDI_ASSERT(ws == kArchiveWspecifier);  // or wrongly called.
+    if (opts_.index && ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "Not writing an index for archive "
+                 << PrintableWxfilename(archive_wxfilename_)
+                 << " as it is not an actual file.";
+      opts_.index = false;
+    }
+    index_writer_.Clear();
 
     if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false
                                                       // means no binary header.
@@ -1053,12 +1249,17 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDI_ERR << "Using invalid key " << key;
     output_.Stream() << key << ' ';
+    int64 offset = (opts_.index ? static_cast<int64>(output_.Stream().tellp())
+                    : 0);
     if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
       KALDI_WARN << "Write failure to "
                  << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
       return false;
     }
+    if (opts_.index)
+      index_writer_.Add(key, offset,
+                        static_cast<int64>(output_.Stream().tellp()) - offset);
     if (state_ == kWriteError) return false;  // Even if this Write seems to
     // have succeeded, we fail because a previous Write failed and the archive
     // may be corrupted and unreadable.
@@ -1097,6 +1298,11 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
       return false;
     }
     state_ = kUninitialized;
+    if (opts_.index) {
+      bool ans = index_writer_.Write(archive_wxfilename_);
+      index_writer_.Clear();
+      return ans;
+    }
     return true;
   }
 
@@ -1115,6 +1321,7 @@ class TableWriterArchiveImpl: public TableWriterImplBase<Holder> {
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
+  TableIndexWriter index_writer_;  // Only used if opts_.index.
   enum {               // is stream open?
     kUninitialized,    // no
     kOpen,             // yes
@@ -1311,6 +1518,13 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       KALDI_WARN << "When writing to both archive and script, the script file "
           "will generally not be interpreted correctly unless the archive is "
           "an actual file: wspecifier = " << wspecifier;
+    if (opts_.index && ClassifyWxfilename(archive_wxfilename_) != kFileOutput) {
+      KALDI_WARN << "Not writing an index for archive "
+                 << PrintableWxfilename(archive_wxfilename_)
+                 << " as it is not an actual file.";
+      opts_.index = false;
+    }
+    index_writer_.Clear();
 
     if (!archive_output_.Open(archive_wxfilename_, opts_.binary, false)) {
       // false means no binary header.
@@ -1401,6 +1615,11 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       state_ = kWriteError;
       return false;
     }
+    if (opts_.index) {
+      int64 offset = static_cast<int64>(archive_os_pos);
+      index_writer_.Add(key, offset,
+                        static_cast<int64>(archive_os.tellp()) - offset);
+    }
 
     if (state_ == kWriteError) return false;  // Even if this Write seems to
     // have succeeded, we fail because a previous Write failed and the archive
@@ -1434,6 +1653,9 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
       if (!script_output_.Close()) close_success = false;
     bool ans = close_success && (state_ != kWriteError);
     state_ = kUninitialized;
+    if (ans && opts_.index)
+      ans = index_writer_.Write(archive_wxfilename_);
+    index_writer_.Clear();
     return ans;
   }
 
@@ -1453,6 +1675,7 @@ class TableWriterBothImpl: public TableWriterImplBase<Holder> {
   Output script_output_;
   WspecifierOptions opts_;
   std::string archive_wxfilename_;
+  TableIndexWriter index_writer_;  // Only used if opts_.index.
   std::string script_wxfilename_;
   std::string wspecifier_;
   enum {               // is stream open?
@@ -1661,6 +1884,7 @@ class RandomAccessTableReaderScriptImpl:
     key_ = "";
     range_ = "";
     data_rxfilename_ = "";
+    ClearArchiveInputs();
     // This cannot fail because any errors of a "global" nature would have been
     // detected when we did Open().  With archives it's different.
     return true;
@@ -1690,7 +1914,7 @@ class RandomAccessTableReaderScriptImpl:
     }
   }
 
-  virtual ~RandomAccessTableReaderScriptImpl() { }
+  virtual ~RandomAccessTableReaderScriptImpl() { ClearArchiveInputs(); }
 
  private:
 
@@ -1765,12 +1989,15 @@ class RandomAccessTableReaderScriptImpl:
         range_ = range;
         if (state_ == kNotHaveObject) {
           // we need to read the object.
-          if (!input_.Open(data_rxfilename)) {
+          Input *input = GetInput(data_rxfilename);
+          bool ans = (opts_.mmap ? input->OpenMapped(data_rxfilename) :
+                      input->Open(data_rxfilename));
+          if (!ans) {
             KALDI_WARN << "Error opening stream "
                        << PrintableRxfilename(data_rxfilename);
             return false;
           } else {
-            if (holder_.Read(input_.Stream())) {
+            if (holder_.Read(input->Stream())) {
               state_ = kHaveObject;
             } else {
               KALDI_WARN << "Error reading object from "
@@ -1796,6 +2023,47 @@ class RandomAccessTableReaderScriptImpl:
     }
   }
 
+  // Returns the Input object that we should use to read 'data_rxfilename'.
+  // When the scp file points into archives (e.g. "1.ark:100"), we keep one
+  // Input open for each of the most recently used archives, because the
+  // entries for different archives are often interleaved (e.g. after sorting
+  // an scp made from several archives), and re-opening an Input on the file
+  // it already has open is just a seek.  Open files use file descriptors, so
+  // we keep at most kMaxOpenArchives of them and an archive that was dropped
+  // is reopened when it is needed again; with the "mmap" option an open
+  // archive is just a mapping (see class MappedFile), so we keep them all.
+  // (The scp file already gives the offset of each object, so the "idx"
+  // index would not help here.)
+  Input *GetInput(const std::string &data_rxfilename) {
+    if (ClassifyRxfilename(data_rxfilename) != kOffsetFileInput)
+      return &input_;
+    std::string filename = data_rxfilename.substr(
+        0, data_rxfilename.find_last_of(':'));
+    typedef std::list<std::pair<std::string, Input*> >::iterator IterType;
+    for (IterType iter = archive_inputs_.begin();
+         iter != archive_inputs_.end(); ++iter) {
+      if (iter->first == filename) {
+        // move it to the front.
+        archive_inputs_.splice(archive_inputs_.begin(), archive_inputs_, iter);
+        return iter->second;
+      }
+    }
+    if (!opts_.mmap && archive_inputs_.size() >= kMaxOpenArchives) {
+      delete archive_inputs_.back().second;
+      archive_inputs_.pop_back();
+    }
+    archive_inputs_.push_front(std::make_pair(filename, new Input()));
+    return archive_inputs_.front().second;
+  }
+
+  void ClearArchiveInputs() {
+    typedef std::list<std::pair<std::string, Input*> >::iterator IterType;
+    for (IterType iter = archive_inputs_.begin();
+         iter != archive_inputs_.end(); ++iter)
+      delete iter->second;
+    archive_inputs_.clear();
+  }
+
   // This function attempts to look up the key "key" in the sorted array
   // script_.  If it was found it returns true and puts the array offset into
   // 'script_offset'; otherwise it returns false.
@@ -1828,9 +2096,12 @@ class RandomAccessTableReaderScriptImpl:
   }
 
 
-  Input input_;  // Use the same input_ object for reading each file, in case
-                 // the scp specifies offsets in an archive so we can keep the
-                 // same file open.
+  Input input_;  // Used for reading files that are not archive offsets (e.g.
+                 // "foo.mat"); see GetInput().
+  static const size_t kMaxOpenArchives = 16;  // unless opts_.mmap.
+  // The Inputs for the most recently used archives that the scp file points
+  // into, most recent first, as (archive filename, Input) pairs.
+  std::list<std::pair<std::string, Input*> > archive_inputs_;
   RspecifierOptions opts_;
   std::string rspecifier_;  // rspecifier used to open this object; used in
                             // debug messages
@@ -1912,7 +2183,9 @@ class RandomAccessTableReaderArchiveImplBase:
 
     // NULL means don't expect binary-mode header
     bool ans;
-    if (Holder::IsReadInBinary())
+    if (Holder::IsReadInBinary() && opts_.mmap)
+      ans = input_.OpenMapped(archive_rxfilename_, NULL);
+    else if (Holder::IsReadInBinary())
       ans = input_.Open(archive_rxfilename_, NULL);
     else
       ans = input_.OpenTextMode(archive_rxfilename_);
@@ -2501,6 +2774,118 @@ class RandomAccessTableReaderUnsortedArchiveImpl:
 };
 
 
+// RandomAccessTableReaderIndexedArchiveImpl is used for archives when the user
+// specifies the "idx" option, e.g. "ark,idx:foo.ark".  Keys are looked up in
+// the index that was written with the archive (see class TableIndex), and the
+// object is read by seeking straight to it, so the time taken per key does
+// not depend on the size of the archive, and nothing is kept in memory apart
+// from the most recently read object.  The sorting options (s, cs) make no
+// difference, and neither does "once".
+template<class Holder>
+class RandomAccessTableReaderIndexedArchiveImpl:
+      public RandomAccessTableReaderImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessTableReaderIndexedArchiveImpl(): have_object_(false) { }
+
+  virtual bool Open(const std::string &rspecifier) {
+    if (index_.IsOpen())
+      KALDI_ERR << "Opening already open RandomAccessTableReader:"
+                   " call Close first.";
+    rspecifier_ = rspecifier;
+    RspecifierType rs = ClassifyRspecifier(rspecifier, &archive_rxfilename_,
+                                           &opts_);
+    KALDI_ASSERT(rs == kArchiveRspecifier && opts_.index);  // or wrongly
+                                                             // called.
+    if (ClassifyRxfilename(archive_rxfilename_) != kFileInput) {
+      KALDI_WARN << "The idx option requires the archive to be an actual "
+                 << "file: rspecifier is " << rspecifier;
+      return false;
+    }
+    if (!index_.Open(archive_rxfilename_)) {
+      KALDI_WARN << "Could not use the index of the archive: rspecifier is "
+                 << rspecifier;
+      return false;
+    }
+    return true;
+  }
+
+  virtual bool HasKey(const std::string &key) {
+    if (opts_.permissive) {
+      // In permissive mode, we have to check that we can read the object
+      // before we assert that the key is there.
+      return ReadObject(key);
+    }
+    int64 offset, length;
+    return index_.Lookup(key, &offset, &length);
+  }
+
+  virtual const T &Value(const std::string &key) {
+    if (!ReadObject(key))
+      KALDI_ERR << "Could not get item for key " << key
+                << ", rspecifier is " << rspecifier_;
+    return holder_.Value();
+  }
+
+  virtual bool Close() {
+    if (!index_.IsOpen())
+      KALDI_ERR << "Close() called on RandomAccessTableReader that was not"
+                   " open.";
+    index_.Close();
+    if (input_.IsOpen())
+      input_.Close();
+    holder_.Clear();
+    have_object_ = false;
+    key_ = "";
+    // Errors reading objects have already been reported.
+    return true;
+  }
+
+  virtual ~RandomAccessTableReaderIndexedArchiveImpl() { }
+
+ private:
+  // Makes sure holder_ contains the object for 'key'; returns false if the key
+  // is not in the index or the object could not be read.
+  bool ReadObject(const std::string &key) {
+    if (have_object_ && key == key_)
+      return true;
+    int64 offset, length;
+    if (!index_.Lookup(key, &offset, &length))
+      return false;
+    holder_.Clear();
+    have_object_ = false;
+    std::ostringstream data_rxfilename;
+    data_rxfilename << archive_rxfilename_ << ':' << offset;
+    // Since input_ is always reopened on the same file, this is just a seek.
+    bool ans = (opts_.mmap ? input_.OpenMapped(data_rxfilename.str()) :
+                input_.Open(data_rxfilename.str()));
+    if (!ans) {
+      KALDI_WARN << "Error opening stream "
+                 << PrintableRxfilename(data_rxfilename.str());
+      return false;
+    }
+    if (!holder_.Read(input_.Stream())) {
+      KALDI_WARN << "Error reading object for key " << key << " from "
+                 << PrintableRxfilename(data_rxfilename.str());
+      return false;
+    }
+    key_ = key;
+    have_object_ = true;
+    return true;
+  }
+
+  Input input_;
+  RspecifierOptions opts_;
+  std::string rspecifier_;
+  std::string archive_rxfilename_;
+  TableIndex index_;
+  Holder holder_;
+  bool have_object_;  // true if holder_ contains the object for key_.
+  std::string key_;
+};
+
+
 
 
 
@@ -2524,7 +2909,9 @@ bool RandomAccessTableReader<Holder>::Open(const std::string &rspecifier) {
       impl_ = new RandomAccessTableReaderScriptImpl<Holder>();
       break;
     case kArchiveRspecifier:
-      if (opts.sorted) {
+      if (opts.index) {
+        impl_ = new RandomAccessTableReaderIndexedArchiveImpl<Holder>();
+      } else if (opts.sorted) {
         if (opts.called_sorted)  // "doubly" sorted case.
           impl_ = new RandomAccessTableReaderDSortedArchiveImpl<Holder>();
         else
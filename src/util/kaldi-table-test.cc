@@ -22,6 +22,11 @@
 #include "util/kaldi-table.h"
 #include "util/kaldi-holder.h"
 #include "util/table-types.h"
+#include <type_traits>
+#ifndef _MSC_VER
+#include <sys/stat.h>
+#include <utime.h>
+#endif
 
 namespace kaldi {
 
@@ -125,6 +130,15 @@ void UnitTestClassifyWspecifier() {
                  opts.binary == false);
   }
 
+  {
+    std::string a = "ark,idx:foo.ark";
+    std::string ark = "x", scp = "y";
+    WspecifierOptions opts;
+    WspecifierType ans = ClassifyWspecifier(a, &ark, &scp, &opts);
+    KALDI_ASSERT(ans == kArchiveWspecifier && ark == "foo.ark" && scp == "" &&
+                 opts.index);
+  }
+
   {
     std::string a = "";
     std::string ark = "x", scp = "y";
@@ -190,6 +204,35 @@ void UnitTestClassifyRspecifier() {
   }
 
 
+  {
+    std::string a = "ark,mmap:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo" && opts.mmap);
+  }
+
+  {
+    std::string a = "scp,bg=8,bgw=3:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kScriptRspecifier && fname == "foo" &&
+                 opts.background && opts.read_ahead == 8 &&
+                 opts.num_workers == 3);
+    ans = ClassifyRspecifier("ark,bg=0:foo", NULL, NULL);
+    KALDI_ASSERT(ans == kNoRspecifier);
+  }
+
+  {
+    std::string a = "ark,idx:foo";
+    std::string fname = "x";
+    RspecifierOptions opts;
+    RspecifierType ans = ClassifyRspecifier(a, &fname, &opts);
+    KALDI_ASSERT(ans == kArchiveRspecifier && fname == "foo" && opts.index &&
+                 !opts.mmap);
+  }
+
   {
     std::string a = "b,ark:foo|";  // b, is ignored.
     std::string fname = "x";
@@ -757,6 +800,276 @@ void UnitTestTableSequentialBaseFloatVectorBoth(bool binary, bool read_scp) {
   }
 }
 
+// Writing as both, and reading memory-mapped with the SubMatrix and SubVector
+// readers.
+void UnitTestTableSubMatrixMmap(bool binary, bool read_scp) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<BaseFloat>*> v;
+
+  for (int32 i = 0; i < sz; i++) {
+    // Keys of various lengths, so that some of the matrices will be aligned
+    // in the file and some not.
+    k.push_back(CharToString('a' + static_cast<char>(i)));
+    for (int32 j = 0; j < i % 4; j++)
+      k.back() += CharToString('a' + j);
+    int32 rows = Rand() % 4, cols = (rows == 0 ? 0 : 1 + Rand() % 4);
+    v.push_back(new Matrix<BaseFloat>(rows, cols));
+    v.back()->SetRandn();
+  }
+
+  bool ans;
+  BaseFloatMatrixWriter bw(binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                           "t,ark,scp:tmpf,tmpf.scp");
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[i], *(v[i]));
+  ans = bw.Close();
+  KALDI_ASSERT(ans);
+
+  // The values may be in read-only memory, so it must not be possible to make
+  // non-const views of them.
+  KALDI_COMPILE_TIME_ASSERT((!std::is_constructible<SubMatrix<BaseFloat>,
+                             SubMatrixHolder<BaseFloat>::T&>::value));
+  KALDI_COMPILE_TIME_ASSERT((!std::is_constructible<SubVector<BaseFloat>,
+                             SubVectorHolder<BaseFloat>::T&>::value));
+  {
+    SequentialBaseFloatSubMatrixReader sbr(read_scp ? "scp,mmap:tmpf.scp" :
+                                           "ark,mmap:tmpf");
+    std::vector<std::string> k2;
+    for (; !sbr.Done(); sbr.Next()) {
+      int32 i = k2.size();
+      k2.push_back(sbr.Key());
+      KALDI_ASSERT(i < sz && sbr.Value().ApproxEqual(*(v[i]), 1.0e-05));
+    }
+    KALDI_ASSERT(sbr.Close());
+    KALDI_ASSERT(k2 == k);
+  }
+  {
+    RandomAccessBaseFloatSubMatrixReader rbr(read_scp ? "scp,mmap:tmpf.scp" :
+                                             "ark,mmap:tmpf");
+    for (int32 n = 0; n < sz; n++) {
+      int32 i = Rand() % sz;
+      KALDI_ASSERT(rbr.HasKey(k[i]) &&
+                   rbr.Value(k[i]).ApproxEqual(*(v[i]), 1.0e-05));
+    }
+    KALDI_ASSERT(!rbr.HasKey("xyz"));
+  }
+
+  // The vectors are the first rows of the matrices (or empty).
+  std::vector<Vector<BaseFloat> > vecs(sz);
+  BaseFloatVectorWriter vw(binary ? "b,ark:tmpf" : "t,ark:tmpf");
+  for (int32 i = 0; i < sz; i++) {
+    if (v[i]->NumRows() > 0)
+      vecs[i] = v[i]->Row(0);
+    vw.Write(k[i], vecs[i]);
+  }
+  ans = vw.Close();
+  KALDI_ASSERT(ans);
+  SequentialBaseFloatSubVectorReader svr("ark,mmap:tmpf");
+  for (int32 i = 0; i < sz; i++, svr.Next()) {
+    KALDI_ASSERT(!svr.Done() && svr.Key() == k[i]);
+    KALDI_ASSERT(svr.Value().ApproxEqual(vecs[i], 1.0e-05));
+  }
+  KALDI_ASSERT(svr.Done() && svr.Close());
+
+  for (int32 i = 0; i < sz; i++)
+    delete v[i];
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
+// A file that is replaced while a mapping of the old version is still in use
+// must be mapped again, not read through the old mapping.
+void UnitTestTableMmapReplacedFile() {
+  Matrix<BaseFloat> m1(2, 3), m2(4, 3);
+  m1.SetRandn();
+  m2.SetRandn();
+  {
+    BaseFloatMatrixWriter bw("ark:tmpf");
+    bw.Write("a", m1);
+  }
+  SequentialBaseFloatSubMatrixReader reader1("ark,mmap:tmpf");
+  KALDI_ASSERT(!reader1.Done() && reader1.Value().ApproxEqual(m1));
+  {
+    BaseFloatMatrixWriter bw("ark:tmpf.new");
+    bw.Write("a", m2);
+  }
+  KALDI_ASSERT(rename("tmpf.new", "tmpf") == 0);
+  SequentialBaseFloatSubMatrixReader reader2("ark,mmap:tmpf");
+  KALDI_ASSERT(!reader2.Done() && reader2.Value().ApproxEqual(m2));
+  // The first reader still sees the old file.
+  KALDI_ASSERT(reader1.Value().ApproxEqual(m1));
+  reader1.Close();
+  reader2.Close();
+  unlink("tmpf");
+}
+
+void UnitTestTableSequentialReadAhead(bool binary, bool read_scp) {
+  int32 sz = Rand() % 40;
+  std::vector<std::string> k;
+  std::vector<Matrix<BaseFloat> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    k.push_back(os.str());
+    v[i].Resize(1 + Rand() % 10, 1 + Rand() % 10);
+    v[i].SetRandn();
+  }
+  BaseFloatMatrixWriter bw(binary ? "b,ark,scp:tmpf,tmpf.scp" :
+                           "t,ark,scp:tmpf,tmpf.scp");
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[i], v[i]);
+  KALDI_ASSERT(bw.Close());
+  if (read_scp) {
+    // Add some entries with ranges to the scp file.
+    Input ki("tmpf.scp");
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(ki.Stream(), line))
+      lines.push_back(line);
+    Output ko("tmpf.scp", false);
+    for (int32 i = 0; i < sz; i++) {
+      if (i % 3 == 1) {
+        lines[i] += "[0:0]";
+        v[i].Resize(1, v[i].NumCols(), kCopyData);
+      }
+      ko.Stream() << lines[i] << '\n';
+    }
+  }
+
+  std::ostringstream rspecifier;
+  rspecifier << (read_scp ? "scp" : "ark") << ",bg=" << RandInt(1, 8)
+             << ",bgw=" << RandInt(1, 4) << (read_scp ? ":tmpf.scp" : ":tmpf");
+  for (int32 j = 0; j < 2; j++) {
+    // On the second pass we close the reader before the end.
+    int32 num_to_read = (j == 0 ? sz : sz / 2);
+    SequentialBaseFloatMatrixReader sbr(rspecifier.str());
+    for (int32 i = 0; i < num_to_read; i++, sbr.Next()) {
+      KALDI_ASSERT(!sbr.Done() && sbr.Key() == k[i]);
+      KALDI_ASSERT(sbr.Value().ApproxEqual(v[i], 1.0e-05));
+    }
+    KALDI_ASSERT((j == 1 || sbr.Done()) && sbr.Close());
+  }
+  unlink("tmpf");
+  unlink("tmpf.scp");
+}
+
+void UnitTestTableIndex(bool binary, bool write_scp) {
+  int32 sz = Rand() % 10;
+  std::vector<std::string> k;
+  std::vector<Matrix<BaseFloat> > v(sz);
+  for (int32 i = 0; i < sz; i++) {
+    k.push_back(CharToString('a' + static_cast<char>(i)));
+    int32 rows = Rand() % 4, cols = (rows == 0 ? 0 : 1 + Rand() % 4);
+    v[i].Resize(rows, cols);
+    v[i].SetRandn();
+  }
+  std::vector<int32> order(sz);  // the order in which we write the keys.
+  for (int32 i = 0; i < sz; i++)
+    order[i] = i;
+  std::random_shuffle(order.begin(), order.end());
+
+  std::string wspecifier = std::string(binary ? "b," : "t,") +
+      (write_scp ? "ark,scp,idx:tmpf,tmpf.scp" : "ark,idx:tmpf");
+  BaseFloatMatrixWriter bw(wspecifier);
+  for (int32 i = 0; i < sz; i++)
+    bw.Write(k[order[i]], v[order[i]]);
+  KALDI_ASSERT(bw.Close());
+
+  for (int32 j = 0; j < 2; j++) {
+    RandomAccessBaseFloatMatrixReader rbr(j == 0 ? "ark,idx:tmpf" :
+                                          "ark,idx,mmap,p:tmpf");
+    for (int32 n = 0; n < 2 * sz; n++) {
+      int32 i = Rand() % sz;
+      KALDI_ASSERT(rbr.HasKey(k[i]) &&
+                   rbr.Value(k[i]).ApproxEqual(v[i], 1.0e-05));
+    }
+    KALDI_ASSERT(!rbr.HasKey("xyz"));
+    KALDI_ASSERT(rbr.Close());
+  }
+
+#ifndef _MSC_VER
+  {
+    // Check that an index is rejected if the archive has been modified since,
+    // even if its size is the same.
+    struct stat st;
+    KALDI_ASSERT(stat("tmpf", &st) == 0);
+    struct utimbuf times;
+    times.actime = st.st_atime;
+    times.modtime = st.st_mtime - 10;
+    KALDI_ASSERT(utime("tmpf", &times) == 0);
+    RandomAccessBaseFloatMatrixReader rbr;
+    KALDI_ASSERT(!rbr.Open("ark,idx:tmpf"));
+  }
+#endif
+  {
+    // Check that an index that does not match the archive is rejected.
+    Output ko("tmpf", false, false);
+    ko.Stream() << "zz ";
+    KALDI_ASSERT(ko.Close());
+    RandomAccessBaseFloatMatrixReader rbr;
+    KALDI_ASSERT(!rbr.Open("ark,idx:tmpf"));
+  }
+  unlink("tmpf");
+  unlink("tmpf.idx");
+  if (write_scp)
+    unlink("tmpf.scp");
+}
+
+// Tests reading an scp file whose entries alternate between archives, which
+// exercises the pool of open archives in RandomAccessTableReaderScriptImpl.
+void UnitTestTableRandomScriptManyArchives(bool binary) {
+  int32 num_archives = 1 + Rand() % 20, sz = Rand() % 40;
+  std::vector<Vector<BaseFloat> > v(sz);
+  std::vector<std::string> k(sz);
+  std::vector<BaseFloatVectorWriter*> writers(num_archives);
+  for (int32 a = 0; a < num_archives; a++) {
+    std::ostringstream os;
+    os << (binary ? "b" : "t") << ",ark,scp:tmpf" << a << ",tmpf" << a
+       << ".scp";
+    writers[a] = new BaseFloatVectorWriter(os.str());
+  }
+  for (int32 i = 0; i < sz; i++) {
+    std::ostringstream os;
+    os << "key" << i;
+    k[i] = os.str();
+    v[i].Resize(Rand() % 5);
+    v[i].SetRandn();
+    writers[i % num_archives]->Write(k[i], v[i]);
+  }
+  Output ko("tmpf.scp", false, false);
+  for (int32 a = 0; a < num_archives; a++) {
+    KALDI_ASSERT(writers[a]->Close());
+    delete writers[a];
+    std::ostringstream os;
+    os << "tmpf" << a << ".scp";
+    Input ki(os.str());
+    std::string line;
+    while (std::getline(ki.Stream(), line))
+      ko.Stream() << line << '\n';
+  }
+  KALDI_ASSERT(ko.Close());
+
+  for (int32 j = 0; j < 2; j++) {
+    // with mmap, all the archives are kept open.
+    RandomAccessBaseFloatVectorReader rbr(j == 0 ? "scp:tmpf.scp" :
+                                          "scp,mmap:tmpf.scp");
+    for (int32 n = 0; n < 2 * sz; n++) {
+      int32 i = Rand() % sz;
+      KALDI_ASSERT(rbr.HasKey(k[i]) &&
+                   rbr.Value(k[i]).ApproxEqual(v[i], 1.0e-05));
+    }
+    KALDI_ASSERT(rbr.Close());
+  }
+  for (int32 a = 0; a < num_archives; a++) {
+    std::ostringstream os;
+    os << "tmpf" << a;
+    unlink(os.str().c_str());
+    unlink((os.str() + ".scp").c_str());
+  }
+  unlink("tmpf.scp");
+}
+
 template<class T> void RandomizeVector(std::vector<T> *v) {
   if (v->size() > 1) {
     for (size_t i = 0; i < 10; i++) {
@@ -1064,6 +1377,8 @@ int main() {
     UnitTestTableSequentialInt32Script(b);
     UnitTestTableSequentialDouble(b);
     UnitTestRangesMatrix(b);
+    UnitTestTableRandomScriptManyArchives(b);
+    UnitTestTableMmapReplacedFile();
     for (int j = 0; j < 2; j++) {
       bool c = (j == 0);
       UnitTestTableSequentialDoubleBoth(b, c);
@@ -1072,6 +1387,9 @@ int main() {
       UnitTestTableSequentialInt32PairVectorBoth(b, c);
       UnitTestTableSequentialInt32VectorVectorBoth(b, c);
       UnitTestTableSequentialBaseFloatVectorBoth(b, c);
+      UnitTestTableSubMatrixMmap(b, c);
+      UnitTestTableIndex(b, c);
+      UnitTestTableSequentialReadAhead(b, c);
       for (int k = 0; k < 2; k++) {
         bool d = (k == 0);
         for (int l = 0; l < 2; l++) {
@@ -183,6 +183,8 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->index = true;
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier) ws = kArchiveWspecifier;
       else
@@ -293,6 +295,24 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
       if (opts) opts->called_sorted = false;
     } else if (!strcmp(c, "bg")) {
       if (opts) opts->background = true;
+    } else if (!strncmp(c, "bg=", 3) || !strncmp(c, "bgw=", 4)) {
+      bool workers = (c[2] == 'w');
+      int32 n;
+      if (!ConvertStringToInteger(str.substr(workers ? 4 : 3), &n) || n <= 0)
+        return kNoRspecifier;
+      if (opts) {
+        opts->background = true;
+        if (workers) opts->num_workers = n;
+        else opts->read_ahead = n;
+      }
+    } else if (!strcmp(c, "mmap")) {
+      if (opts) opts->mmap = true;
+    } else if (!strcmp(c, "nmmap")) {
+      if (opts) opts->mmap = false;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->index = true;
+    } else if (!strcmp(c, "nidx")) {
+      if (opts) opts->index = false;
     } else if (!strcmp(c, "ark")) {
       if (rs == kNoRspecifier) rs = kArchiveRspecifier;
       else
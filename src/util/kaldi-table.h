@@ -71,12 +71,18 @@ typedef std::vector<std::string> KeyList;
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  idx means write an index of the archive, next to it, with ".idx" appended
+//     to the archive's filename (see class TableIndex).  It requires the
+//     archive to be an actual file, not a pipe or stdout.  The index allows
+//     constant-time random access to the archive via the "idx" rspecifier
+//     option.
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
+//  ark,idx:foo.ark
 //
 //  The meanings of rxfilename and wxfilename are as described in
 //  kaldi-stream.h (they are filenames but include pipes, stdin/stdout
@@ -114,7 +120,9 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive;  // will ignore absent scp entries.
-  WspecifierOptions(): binary(true), flush(false), permissive(false) { }
+  bool index;  // write an index of the archive; see the "idx" option above.
+  WspecifierOptions(): binary(true), flush(false), permissive(false),
+                       index(false) { }
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
@@ -189,6 +197,37 @@ bool WriteScriptFile(std::ostream &os,
 //       value, in a background thread.  Recommended when reading larger objects
 //       such as neural-net training examples, especially when you want to
 //       maximize GPU usage.
+//   bg=N  is like bg but reads up to N values ahead (the default is 1).  This
+//       smooths over variations in read speed, e.g. when reading from a
+//       network file system.
+//   bgw=M means "background workers": it implies bg, and for scp files, the
+//       objects are read and parsed (including, e.g., uncompressing
+//       compressed matrices) by M background threads in parallel.  Values are
+//       still returned in the order of the scp file, and at least M values
+//       are read ahead.  For archives the objects have to be read in order,
+//       by a single thread, so this is the same as bg=M; and it has no effect
+//       in permissive (p) mode, where the scp reader has to read each object
+//       before it knows whether to skip it.  E.g. "scp,bg=16,bgw=4:egs.scp".
+//   mmap means "memory-mapped".  Archives, and files referred to in scp files,
+//       that are actual files (not pipes or stdin) are mapped into memory and
+//       read from there, which avoids read system calls and lets processes
+//       reading the same files share the operating system's page cache.  With
+//       SubMatrixHolder and SubVectorHolder (e.g.
+//       SequentialBaseFloatSubMatrixReader), binary uncompressed matrices and
+//       vectors are not copied at all: the objects are views into the mapped
+//       memory.  For random access to an scp file that points into archives
+//       (e.g. "foo.ark:1234"), it also lets the reader keep all the archives
+//       open; without it, at most 16 archives are kept open at a time, and
+//       an scp file that interleaves entries from more archives than that
+//       has to reopen them.
+//   idx means "indexed".  For random-access readers of archives that are
+//       actual files, it causes keys to be looked up in the index that was
+//       written alongside the archive with the "idx" wspecifier option (see
+//       class TableIndex), so each lookup is a single seek and nothing is
+//       held in memory except the object most recently read.  The index
+//       must exist and be up to date (the archive's size and modification
+//       time are checked).  It has no effect for sequential readers or for
+//       scp files, which already give the offset of each object.
 //
 //   b   is ignored [for scripting convenience]
 //   t   is ignored [for scripting convenience]
@@ -211,9 +250,17 @@ struct  RspecifierOptions {
   bool background;  // For sequential readers, if the background option ("bg")
                     // is provided, it will read ahead to the next object in a
                     // background thread.
+  int32 read_ahead;  // The number of objects to read ahead if background is
+                     // true; set by the "bg=N" option.
+  int32 num_workers;  // The number of threads that read objects from scp files
+                      // in the background; set by the "bgw=M" option.
+  bool mmap;  // If the "mmap" option is provided, files are memory-mapped.
+  bool index;  // If the "idx" option is provided, random-access readers of
+               // archives use the archive's index.
   RspecifierOptions(): once(false), sorted(false),
                        called_sorted(false), permissive(false),
-                       background(false) { }
+                       background(false), read_ahead(1), num_workers(1),
+                       mmap(false), index(false) { }
 };
 
 enum RspecifierType  {
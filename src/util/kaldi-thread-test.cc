@@ -123,6 +123,26 @@ void TestTaskSequencer() {
 }
 
 
+void TestThreadTeam() {
+  ThreadTeam team(RandInt(0, 8));
+  int32 n = RandInt(0, 1000), granularity = RandInt(1, 10);
+  std::vector<int32> count(n, 0);
+  for (int32 iter = 0; iter < 100; iter++) {
+    // Each thread adds one to its own part of 'count'; the parts must cover
+    // [0, n) without overlapping.
+    team.Run([&](int32 thread_id) {
+        int32 begin, end;
+        team.GetRange(thread_id, n, granularity, &begin, &end);
+        KALDI_ASSERT(begin == n || begin % granularity == 0);
+        for (int32 i = begin; i < end; i++)
+          count[i]++;
+      });
+    for (int32 i = 0; i < n; i++)
+      KALDI_ASSERT(count[i] == iter + 1);
+  }
+}
+
+
 }  // end namespace kaldi.
 
 int main() {
@@ -130,4 +150,6 @@ int main() {
   TestThreads();
   for (int32 i = 0; i < 1000; i++)
     TestTaskSequencer();
+  for (int32 i = 0; i < 20; i++)
+    TestThreadTeam();
 }
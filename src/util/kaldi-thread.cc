@@ -18,6 +18,7 @@
 // See the Apache 2 License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include "base/kaldi-common.h"
 #include "util/kaldi-thread.h"
 
@@ -28,6 +29,77 @@ MultiThreadable::~MultiThreadable() {
   // default implementation does nothing
 }
 
+ThreadTeam::ThreadTeam(int32 num_threads):
+    num_threads_(std::max<int32>(1, num_threads)), func_(NULL),
+    generation_(0), num_running_(0), exiting_(false) {
+  for (int32 i = 1; i < num_threads_; i++)
+    threads_.push_back(std::thread(&ThreadTeam::ThreadLoop, this, i));
+}
+
+void ThreadTeam::Run(const std::function<void(int32)> &func) {
+  if (num_threads_ == 1) {
+    func(0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    func_ = &func;
+    num_running_ = num_threads_ - 1;
+    generation_++;
+  }
+  work_available_.notify_all();
+  func(0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_running_ != 0)
+    work_done_.wait(lock);
+  func_ = NULL;
+}
+
+void ThreadTeam::GetRange(int32 thread_id, int32 n, int32 granularity,
+                          int32 *begin, int32 *end) const {
+  KALDI_ASSERT(thread_id >= 0 && thread_id < num_threads_ && granularity > 0);
+  int32 num_blocks = (n + granularity - 1) / granularity;
+  int64 block_begin = static_cast<int64>(num_blocks) * thread_id / num_threads_,
+      block_end = static_cast<int64>(num_blocks) * (thread_id + 1) /
+      num_threads_;
+  *begin = std::min<int64>(n, block_begin * granularity);
+  *end = std::min<int64>(n, block_end * granularity);
+}
+
+void ThreadTeam::ThreadLoop(int32 thread_id) {
+  int64 generation_done = 0;
+  while (true) {
+    const std::function<void(int32)> *func;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!exiting_ && generation_ == generation_done)
+        work_available_.wait(lock);
+      if (exiting_)
+        return;
+      generation_done = generation_;
+      func = func_;
+    }
+    (*func)(thread_id);
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      last = (--num_running_ == 0);
+    }
+    if (last)
+      work_done_.notify_one();
+  }
+}
+
+ThreadTeam::~ThreadTeam() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+  }
+  work_available_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+}
+
 
 
 }  // end namespace kaldi
@@ -22,6 +22,9 @@
 #ifndef KALDI_THREAD_KALDI_THREAD_H_
 #define KALDI_THREAD_KALDI_THREAD_H_ 1
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include "itf/options-itf.h"
 #include "util/kaldi-semaphore.h"
@@ -52,6 +55,12 @@
 // destructor to have side effects such as outputting data.
 // Note: the destructor of TaskSequencer will wait for any remaining jobs that
 // are still running and will call the destructors.
+//
+// The class ThreadTeam is for computations that have many small parallel
+// sections one after the other (e.g. one per frame), where creating new threads
+// for each section as MultiThreader does would cost too much.  It keeps a fixed
+// set of threads alive, and its function Run() runs a function on all of them
+// and waits for them to finish.
 
 
 namespace kaldi {
@@ -152,6 +161,54 @@ template<class C> void RunMultiThreaded(const C &c_in) {
 }
 
 
+/// ThreadTeam keeps num_threads - 1 threads waiting for work; Run(func) calls
+/// func(i) for 0 <= i < NumThreads(), in parallel (func(0) is called in the
+/// calling thread), and returns when all the calls have returned.  Run() may
+/// be called any number of times, but only from one thread at a time.  It is
+/// up to 'func' to divide up the work according to its argument, e.g. with
+/// ThreadTeam::GetRange().  If num_threads <= 1, no threads are created and
+/// Run(func) just calls func(0).
+class ThreadTeam {
+ public:
+  explicit ThreadTeam(int32 num_threads);
+
+  int32 NumThreads() const { return num_threads_; }
+
+  void Run(const std::function<void(int32)> &func);
+
+  /// Divides up the range [0, n) into NumThreads() contiguous pieces of
+  /// roughly equal size and outputs to *begin and *end the piece for thread
+  /// 'thread_id'.  If 'granularity' > 1, the boundaries of the pieces (other
+  /// than n itself) are multiples of 'granularity'.
+  void GetRange(int32 thread_id, int32 n, int32 granularity,
+                int32 *begin, int32 *end) const;
+
+  /// Waits for the threads to exit.
+  ~ThreadTeam();
+
+ private:
+  void ThreadLoop(int32 thread_id);
+
+  int32 num_threads_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  // Signalled when there is new work (or when we are exiting).
+  std::condition_variable work_available_;
+  // Signalled when the last thread finishes its part of the work.
+  std::condition_variable work_done_;
+  // The function that is being run, if any.
+  const std::function<void(int32)> *func_;
+  // Incremented each time Run() is called, so that each thread can tell
+  // whether it has already done its part of the current work.
+  int64 generation_;
+  // The number of threads that have not yet finished the current work.
+  int32 num_running_;
+  bool exiting_;
+  KALDI_DISALLOW_COPY_AND_ASSIGN(ThreadTeam);
+};
+
+
 struct TaskSequencerConfig {
   int32 num_threads;
   int32 num_threads_total;
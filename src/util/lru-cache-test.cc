@@ -0,0 +1,96 @@
+// util/lru-cache-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/lru-cache.h"
+#include "base/kaldi-math.h"
+#include <map>  // for baseline.
+#include <iostream>
+
+namespace kaldi {
+
+// Compares LruCache with a simple implementation that stores the time each
+// key was last used.
+void TestLruCache() {
+  size_t capacity = (Rand() % 2 == 0 ? 0 : 1 + Rand() % 20);
+  LruCache<int32, int32> cache(capacity);
+  std::map<int32, std::pair<int32, int32> > baseline;  // key -> (time, value)
+  for (int32 t = 0; t < 1000; t++) {
+    int32 key = Rand() % 50;
+    bool present = (baseline.count(key) != 0);
+    int32 *value = cache.Find(key);
+    KALDI_ASSERT((value != NULL) == present);
+    if (present) {
+      KALDI_ASSERT(*value == baseline[key].second);
+      baseline[key].first = t;
+      if (Rand() % 2 == 0) {
+        *value = Rand() % 100;
+        baseline[key].second = *value;
+      }
+    } else {
+      int32 new_value = Rand() % 100;
+      std::pair<int32, int32> evicted;
+      bool was_evicted = cache.Insert(key, new_value, &evicted);
+      baseline[key] = std::make_pair(t, new_value);
+      KALDI_ASSERT(was_evicted == (capacity != 0 &&
+                                   baseline.size() > capacity));
+      if (was_evicted) {
+        // The evicted element should be the least recently used one.
+        std::map<int32, std::pair<int32, int32> >::iterator iter =
+            baseline.begin(), oldest = baseline.begin();
+        for (; iter != baseline.end(); ++iter)
+          if (iter->second.first < oldest->second.first)
+            oldest = iter;
+        KALDI_ASSERT(evicted.first == oldest->first &&
+                     evicted.second == oldest->second.second);
+        baseline.erase(oldest);
+      }
+    }
+    KALDI_ASSERT(cache.Size() == baseline.size());
+    if (Rand() % 200 == 0) {
+      std::vector<std::pair<int32, int32> > removed;
+      cache.Clear(&removed);
+      KALDI_ASSERT(removed.size() == baseline.size() && cache.Size() == 0);
+      for (size_t i = 0; i < removed.size(); i++)
+        KALDI_ASSERT(baseline[removed[i].first].second == removed[i].second);
+      baseline.clear();
+    }
+  }
+}
+
+// Tests it with vector keys, as used for word histories.
+void TestLruCacheVector() {
+  LruCache<std::vector<int32>, int32, VectorHasher<int32> > cache(3);
+  for (int32 i = 0; i < 10; i++) {
+    std::vector<int32> key(i % 5, i);
+    if (cache.Find(key) == NULL)
+      cache.Insert(key, i);
+    KALDI_ASSERT(*(cache.Find(key)) == i || *(cache.Find(key)) == i - 5);
+  }
+  KALDI_ASSERT(cache.Size() == 3);
+}
+
+}  // end namespace kaldi
+
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 20; i++)
+    TestLruCache();
+  TestLruCacheVector();
+  std::cout << "Test OK.\n";
+}
@@ -0,0 +1,108 @@
+// util/lru-cache.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_LRU_CACHE_H_
+#define KALDI_UTIL_LRU_CACHE_H_
+#include <list>
+#include <utility>
+#include <vector>
+#include "util/stl-utils.h"
+
+
+/* This header provides class LruCache, a hash map with an optional maximum
+   size: when inserting an element would exceed it, the least recently used
+   element is removed.  It is used for the caches of states in the on-demand
+   language-model FSTs used in lattice rescoring (see ConstArpaLmDeterministicFst
+   and rnnlm::KaldiRnnlmDeterministicFst), which would otherwise grow without
+   bound on long lattices.
+*/
+
+namespace kaldi {
+
+template<class Key, class Value, class Hasher = std::hash<Key> >
+class LruCache {
+ public:
+  /// "capacity" is the maximum number of elements; 0 means no limit.
+  explicit LruCache(size_t capacity = 0): capacity_(capacity) { }
+
+  /// Returns a pointer to the value for "key", or NULL if it is not present.
+  /// Makes it the most recently used element.  The pointer is valid until
+  /// the element is removed.
+  Value *Find(const Key &key) {
+    typename MapType::iterator iter = map_.find(key);
+    if (iter == map_.end())
+      return NULL;
+    // Move the element to the front of the list.
+    list_.splice(list_.begin(), list_, iter->second.second);
+    return &(iter->second.first);
+  }
+
+  /// Inserts "key" with value "value"; "key" must not be present.  If the
+  /// size then exceeds the capacity, removes the least recently used element
+  /// and, if "evicted" is not NULL, outputs it there, and returns true.
+  bool Insert(const Key &key, const Value &value,
+              std::pair<Key, Value> *evicted = NULL) {
+    std::pair<typename MapType::iterator, bool> ans = map_.insert(
+        std::make_pair(key, std::make_pair(value, list_.end())));
+    KALDI_ASSERT(ans.second && "LruCache::Insert(): key already present");
+    list_.push_front(&(ans.first->first));
+    ans.first->second.second = list_.begin();
+    if (capacity_ == 0 || map_.size() <= capacity_)
+      return false;
+    typename MapType::iterator iter = map_.find(*(list_.back()));
+    if (evicted != NULL)
+      *evicted = std::make_pair(iter->first, iter->second.first);
+    list_.pop_back();
+    map_.erase(iter);
+    return true;
+  }
+
+  /// Removes all elements, outputting them to "removed" if it is not NULL.
+  void Clear(std::vector<std::pair<Key, Value> > *removed = NULL) {
+    if (removed != NULL) {
+      typename MapType::const_iterator iter = map_.begin();
+      for (; iter != map_.end(); ++iter)
+        removed->push_back(std::make_pair(iter->first, iter->second.first));
+    }
+    list_.clear();
+    map_.clear();
+  }
+
+  size_t Size() const { return map_.size(); }
+
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  // The list points to the keys in the map (pointers to the elements of an
+  // unordered_map stay valid when it is rehashed), so they are stored once.
+  typedef std::list<const Key*> ListType;
+  typedef unordered_map<Key, std::pair<Value, typename ListType::iterator>,
+                        Hasher> MapType;
+
+  size_t capacity_;
+  // The keys, the most recently used first.
+  ListType list_;
+  // Maps each key to its value and its position in list_.
+  MapType map_;
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(LruCache);
+};
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_LRU_CACHE_H_
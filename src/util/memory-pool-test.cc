@@ -0,0 +1,73 @@
+// util/memory-pool-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "util/memory-pool.h"
+#include <set>
+
+namespace kaldi {
+
+struct TestPoolElem {
+  int32 a;
+  float b;
+  TestPoolElem *next;
+  TestPoolElem(int32 a, float b, TestPoolElem *next): a(a), b(b), next(next) { }
+};
+
+void TestMemoryPool() {
+  size_t block_size = 1 + Rand() % 20;
+  MemoryPool<TestPoolElem> pool(block_size);
+  std::vector<TestPoolElem*> in_use;
+  for (int32 i = 0; i < 1000; i++) {
+    if (in_use.empty() || Rand() % 3 != 0) {
+      int32 a = Rand() % 100;
+      TestPoolElem *e = pool.New(a, a * 0.5, nullptr);
+      KALDI_ASSERT(e->a == a && e->b == a * 0.5 && e->next == NULL);
+      in_use.push_back(e);
+    } else {
+      size_t j = Rand() % in_use.size();
+      pool.Delete(in_use[j]);
+      in_use[j] = in_use.back();
+      in_use.pop_back();
+    }
+    KALDI_ASSERT(pool.NumInUse() == in_use.size());
+    KALDI_ASSERT(pool.NumAllocated() >= in_use.size());
+  }
+  // Make sure no two live objects share memory.
+  std::set<TestPoolElem*> distinct(in_use.begin(), in_use.end());
+  KALDI_ASSERT(distinct.size() == in_use.size());
+
+  size_t num_allocated = pool.NumAllocated();
+  pool.DeleteAll();
+  KALDI_ASSERT(pool.NumInUse() == 0);
+  // After DeleteAll(), we should be able to reuse all of the memory without
+  // allocating any more.
+  for (size_t i = 0; i < num_allocated; i++)
+    pool.New(0, 0.0, nullptr);
+  KALDI_ASSERT(pool.NumAllocated() == num_allocated &&
+               pool.NumInUse() == num_allocated);
+  pool.DeleteAll();
+}
+
+}  // end namespace kaldi.
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 10; i++)
+    TestMemoryPool();
+  std::cout << "Test OK.\n";
+}
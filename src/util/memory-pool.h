@@ -0,0 +1,143 @@
+// util/memory-pool.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef KALDI_UTIL_MEMORY_POOL_H_
+#define KALDI_UTIL_MEMORY_POOL_H_
+#include <vector>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "base/kaldi-common.h"
+
+
+/* This header provides a simple fixed-size object pool ("slab allocator") that
+   is intended for the decoders, which create and destroy very large numbers of
+   small objects (tokens and forward links) on every frame.  Objects are carved
+   out of large blocks, and freed objects go on a free-list for reuse, so after
+   the first few frames of the first utterance there are essentially no calls
+   to the system allocator.  This is the same scheme that HashList (see
+   hash-list.h) uses for its Elems, but generalized to arbitrary types.
+
+   The pool is not thread safe; the intended use is one pool per decoder
+   object, which avoids contention in malloc when many decoders run in
+   parallel threads.
+
+   See memory-pool-test.cc for an example of how to use this object.
+*/
+
+
+namespace kaldi {
+
+template<class T> class MemoryPool {
+ public:
+  /// The block size is the number of objects we allocate from the system at a
+  /// time.  It must be largish so storing the list of blocks doesn't become a
+  /// problem.
+  explicit MemoryPool(size_t block_size = 1024):
+      freed_head_(NULL), block_size_(block_size), num_in_use_(0) {
+    KALDI_ASSERT(block_size > 0);
+  }
+
+  /// Think of this like "new T(args...)".  It constructs the object in memory
+  /// owned by this pool.
+  template<typename... Args>
+  inline T *New(Args&&... args) {
+    if (freed_head_ == NULL)
+      AllocateBlock();
+    Slot *slot = freed_head_;
+    freed_head_ = slot->next;
+    num_in_use_++;
+    return new (static_cast<void*>(slot)) T(std::forward<Args>(args)...);
+  }
+
+  /// Think of this like "delete t".  It calls the destructor and returns the
+  /// memory to the pool for reuse.  "t" must have been obtained from New() on
+  /// this same object.
+  inline void Delete(T *t) {
+    t->~T();
+    Slot *slot = reinterpret_cast<Slot*>(t);
+    slot->next = freed_head_;
+    freed_head_ = slot;
+    num_in_use_--;
+  }
+
+  /// Returns all objects to the pool at once, without the caller having to
+  /// call Delete() on each of them; any pointers previously returned by New()
+  /// become invalid.  Destructors are not called, so this may only be used for
+  /// trivially destructible types.  The memory is retained for reuse.  The
+  /// free-list is rebuilt over every slot, so the cost is linear in
+  /// NumAllocated() (not just in the number of objects in use), but it avoids
+  /// a call to Delete() per object.
+  void DeleteAll() {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "MemoryPool::DeleteAll() requires trivially destructible type.");
+    freed_head_ = NULL;
+    for (size_t i = 0; i < allocated_.size(); i++)
+      LinkBlock(allocated_[i]);
+    num_in_use_ = 0;
+  }
+
+  /// Returns the number of objects currently handed out by New() and not yet
+  /// returned by Delete() or DeleteAll().
+  size_t NumInUse() const { return num_in_use_; }
+
+  /// Returns the number of objects that the currently allocated blocks can
+  /// hold.
+  size_t NumAllocated() const { return allocated_.size() * block_size_; }
+
+  ~MemoryPool() {
+    if (num_in_use_ != 0 && !std::is_trivially_destructible<T>::value) {
+      KALDI_WARN << "Possible memory leak: " << num_in_use_
+                 << " objects still in use when destroying MemoryPool.";
+    }
+    for (size_t i = 0; i < allocated_.size(); i++)
+      delete [] allocated_[i];
+  }
+
+ private:
+  union Slot {
+    Slot *next;  // next in the free-list, when this slot is free.
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void AllocateBlock() {
+    Slot *block = new Slot[block_size_];
+    allocated_.push_back(block);
+    LinkBlock(block);
+  }
+
+  // Puts all elements of this block at the front of the free-list.
+  void LinkBlock(Slot *block) {
+    for (size_t i = 0; i + 1 < block_size_; i++)
+      block[i].next = block + i + 1;
+    block[block_size_ - 1].next = freed_head_;
+    freed_head_ = block;
+  }
+
+  Slot *freed_head_;  // head of list of currently freed elements.
+  size_t block_size_;
+  size_t num_in_use_;
+  std::vector<Slot*> allocated_;  // list of allocated blocks.
+
+  KALDI_DISALLOW_COPY_AND_ASSIGN(MemoryPool);
+};
+
+
+}  // end namespace kaldi
+
+#endif  // KALDI_UTIL_MEMORY_POOL_H_
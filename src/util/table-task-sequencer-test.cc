@@ -0,0 +1,106 @@
+// util/table-task-sequencer-test.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include "base/kaldi-common.h"
+#include "util/table-types.h"
+#include "util/table-task-sequencer.h"
+
+namespace kaldi {
+
+// Computes a matrix from a seed, taking a random amount of time so that the
+// tasks finish out of order; it fails if the seed is a multiple of 7.
+class MyMatrixTask {
+ public:
+  MyMatrixTask(int32 seed, int32 sleep_ms): seed_(seed), sleep_ms_(sleep_ms) { }
+  bool operator () (Matrix<BaseFloat> *output) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms_));
+    if (seed_ % 7 == 0)
+      return false;
+    output->Resize(1 + seed_ % 5, 3);
+    for (int32 i = 0; i < output->NumRows(); i++)
+      for (int32 j = 0; j < output->NumCols(); j++)
+        (*output)(i, j) = seed_ * 0.5 + i - j;
+    return true;
+  }
+ private:
+  int32 seed_;
+  int32 sleep_ms_;
+};
+
+// Writes the same table with various numbers of threads, and checks that the
+// output is the same.
+void UnitTestTableTaskSequencer() {
+  int32 num_items = RandInt(0, 40);
+  std::vector<int32> sleep_ms(num_items);
+  for (int32 i = 0; i < num_items; i++)
+    sleep_ms[i] = RandInt(0, 5);
+  int32 num_threads_list[] = { 1, 2, 8 };
+  std::vector<std::string> outputs;
+  for (int32 n = 0; n < 3; n++) {
+    TaskSequencerConfig config;
+    config.num_threads = num_threads_list[n];
+    std::string filename = "tmpf.table-task-sequencer";
+    BaseFloatMatrixWriter writer("ark:" + filename);
+    int32 num_done, num_fail;
+    {
+      TableTaskSequencer<KaldiObjectHolder<Matrix<BaseFloat> >,
+                         MyMatrixTask> sequencer(config, &writer);
+      for (int32 i = 0; i < num_items; i++)
+        sequencer.Run("key" + std::to_string(i),
+                      new MyMatrixTask(i, sleep_ms[i]));
+      sequencer.Wait();
+      num_done = sequencer.NumDone();
+      num_fail = sequencer.NumFail();
+    }
+    KALDI_ASSERT(num_fail == (num_items + 6) / 7 &&
+                 num_done + num_fail == num_items);
+    writer.Close();
+
+    std::ifstream is(filename.c_str(), std::ios::binary);
+    std::ostringstream os;
+    os << is.rdbuf();
+    outputs.push_back(os.str());
+
+    // Check that the items were written in order, with the right values.
+    SequentialBaseFloatMatrixReader reader("ark:" + filename);
+    int32 i = 0;
+    for (; !reader.Done(); reader.Next(), i++) {
+      if (i % 7 == 0) i++;
+      KALDI_ASSERT(reader.Key() == "key" + std::to_string(i));
+      Matrix<BaseFloat> m;
+      MyMatrixTask(i, 0)(&m);
+      KALDI_ASSERT(m.ApproxEqual(reader.Value()));
+    }
+    KALDI_ASSERT(i >= num_items);
+    reader.Close();
+    unlink(filename.c_str());
+  }
+  KALDI_ASSERT(outputs[0] == outputs[1] && outputs[0] == outputs[2]);
+}
+
+}  // namespace kaldi
+
+int main() {
+  using namespace kaldi;
+  for (int32 i = 0; i < 5; i++)
+    UnitTestTableTaskSequencer();
+  std::cout << "Test OK.\n";
+  return 0;
+}
@@ -0,0 +1,131 @@
+// util/table-task-sequencer.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_UTIL_TABLE_TASK_SEQUENCER_H_
+#define KALDI_UTIL_TABLE_TASK_SEQUENCER_H_
+
+#include <string>
+#include "base/kaldi-common.h"
+#include "util/kaldi-table.h"
+#include "util/kaldi-thread.h"
+
+namespace kaldi {
+
+/**
+   TableTaskSequencer is a wrapper around TaskSequencer (see kaldi-thread.h)
+   for the many programs that read a table, do some computation for each item,
+   and write the result to another table, e.g. the feature-extraction programs.
+   The computations for different items are run in parallel if
+   config.num_threads > 1, and the results are written in the same order as
+   the items were given to Run(), so the output is exactly the same as with a
+   single thread.  If config.num_threads <= 1 (the default), everything is done
+   in the calling thread.
+
+   The template argument C is a class that does the computation for one item.
+   It must have a function
+   \code
+     bool operator () (typename Holder::T *output);
+   \endcode
+   which computes the output, and returns false if it failed (it should print
+   a warning in that case), in which case nothing is written for this item.
+   This may be run in a different thread from the one that called Run(), so it
+   must not use anything that is not thread-safe, such as random-access table
+   readers or the global random number generator; things like that should be
+   looked up in the calling thread and given to the object of type C.
+*/
+template<class Holder, class C>
+class TableTaskSequencer {
+ public:
+  typedef typename Holder::T T;
+
+  /// 'writer' must outlive this object, and must be open before Run() is
+  /// called.
+  TableTaskSequencer(const TaskSequencerConfig &config,
+                     TableWriter<Holder> *writer):
+      writer_(writer),
+      sequencer_(SequencerConfig(config)),
+      num_done_(0), num_fail_(0) { }
+
+  /// Computes the output for 'key' using 'c' (of which this function takes
+  /// ownership), and writes it to the writer.  If the computation is being
+  /// done in other threads, this may return before it is finished, and it
+  /// will block if all the threads are busy.
+  void Run(const std::string &key, C *c) {
+    sequencer_.Run(new Task(this, key, c));
+  }
+
+  /// Waits for all the computations to finish and their outputs to be
+  /// written.  You must call this (or destroy this object) before calling
+  /// NumDone() or NumFail(), or closing the writer.
+  void Wait() { sequencer_.Wait(); }
+
+  /// Returns the number of items that were successfully computed and written.
+  int32 NumDone() const { return num_done_; }
+
+  /// Returns the number of items for which the computation failed.
+  int32 NumFail() const { return num_fail_; }
+
+  ~TableTaskSequencer() { Wait(); }
+
+ private:
+  // The TaskSequencer runs the tasks in the calling thread if num_threads is
+  // zero.
+  static TaskSequencerConfig SequencerConfig(const TaskSequencerConfig &config) {
+    TaskSequencerConfig ans(config);
+    if (ans.num_threads <= 1) {
+      ans.num_threads = 0;
+      ans.num_threads_total = 0;
+    }
+    return ans;
+  }
+
+  // The computation happens in operator (), the output happens in the
+  // destructor, which TaskSequencer calls in the same order as Run() was called.
+  class Task {
+   public:
+    Task(TableTaskSequencer *sequencer, const std::string &key, C *c):
+        sequencer_(sequencer), key_(key), c_(c), success_(false) { }
+    void operator () () {
+      success_ = (*c_)(&output_);
+    }
+    ~Task() {
+      if (success_) {
+        sequencer_->writer_->Write(key_, output_);
+        sequencer_->num_done_++;
+      } else {
+        sequencer_->num_fail_++;
+      }
+      delete c_;
+    }
+   private:
+    TableTaskSequencer *sequencer_;
+    std::string key_;
+    C *c_;
+    T output_;
+    bool success_;
+  };
+
+  TableWriter<Holder> *writer_;
+  TaskSequencer<Task> sequencer_;
+  int32 num_done_;
+  int32 num_fail_;
+};
+
+
+}  // namespace kaldi
+
+#endif  // KALDI_UTIL_TABLE_TASK_SEQUENCER_H_
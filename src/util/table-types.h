@@ -179,6 +179,22 @@ typedef RandomAccessTableReaderMapped<KaldiObjectHolder<GeneralMatrix> >
                                       RandomAccessGeneralMatrixReaderMapped;
 
 
+/// The SubMatrix and SubVector readers give const views directly into
+/// memory-mapped archives when the "mmap" rspecifier option is used (e.g.
+/// "ark,mmap:feats.ark"); see SubMatrixHolder.  Programs have to opt in to
+/// them: the programs that read features (e.g. copy-feats, the nnet3 egs and
+/// decoding programs) use the Matrix readers, which with "mmap" still copy
+/// each object out of the mapping (but avoid the read system calls).
+typedef SequentialTableReader<SubMatrixHolder<BaseFloat> >
+                              SequentialBaseFloatSubMatrixReader;
+typedef RandomAccessTableReader<SubMatrixHolder<BaseFloat> >
+                                RandomAccessBaseFloatSubMatrixReader;
+typedef SequentialTableReader<SubVectorHolder<BaseFloat> >
+                              SequentialBaseFloatSubVectorReader;
+typedef RandomAccessTableReader<SubVectorHolder<BaseFloat> >
+                                RandomAccessBaseFloatSubVectorReader;
+
+
 
 /// @}
 